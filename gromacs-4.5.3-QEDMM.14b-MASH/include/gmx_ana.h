@@ -267,6 +267,9 @@ gmx_membed(int argc,char *argv[]);
 int 
 gmx_pme_error(int argc,char *argv[]);
 
+int 
+gmx_qedtraj(int argc,char *argv[]);
+
 #ifdef __cplusplus
 }
 #endif
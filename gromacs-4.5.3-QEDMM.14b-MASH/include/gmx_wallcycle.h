@@ -43,7 +43,7 @@
 extern "C" {
 #endif
 
-  enum { ewcRUN, ewcSTEP, ewcPPDURINGPME, ewcDOMDEC, ewcDDCOMMLOAD, ewcDDCOMMBOUND, ewcVSITECONSTR, ewcPP_PMESENDX, ewcMOVEX, ewcNS, ewcGB, ewcFORCE, ewcMOVEF, ewcPMEMESH, ewcPME_REDISTXF, ewcPME_SPREADGATHER, ewcPME_FFT, ewcPME_SOLVE, ewcPMEWAITCOMM, ewcPP_PMEWAITRECVF, ewcVSITESPREAD, ewcTRAJ, ewcUPDATE, ewcCONSTR, ewcMoveE, ewcTEST, ewcNR };
+  enum { ewcRUN, ewcSTEP, ewcPPDURINGPME, ewcDOMDEC, ewcDDCOMMLOAD, ewcDDCOMMBOUND, ewcVSITECONSTR, ewcPP_PMESENDX, ewcMOVEX, ewcNS, ewcGB, ewcFORCE, ewcMOVEF, ewcPMEMESH, ewcPME_REDISTXF, ewcPME_SPREADGATHER, ewcPME_FFT, ewcPME_SOLVE, ewcPMEWAITCOMM, ewcPP_PMEWAITRECVF, ewcVSITESPREAD, ewcTRAJ, ewcUPDATE, ewcCONSTR, ewcMoveE, ewcQM_INPUT, ewcQM_RUN, ewcQM_OUTPUT, ewcQED_HAM, ewcQED_DIAG, ewcQED_PROP, ewcQED_NAC, ewcQED_FORCE, ewcQED_COMM, ewcQED_WRITE, ewcQED_WRITER, ewcTEST, ewcNR };
 
 gmx_bool wallcycle_have_counter(void);
 /* Returns if cycle counting is supported */
@@ -59,11 +59,26 @@ void wallcycle_start(gmx_wallcycle_t wc, int ewc);
 double wallcycle_stop(gmx_wallcycle_t wc, int ewc);
 /* Stop the cycle count for ewc, returns the last cycle count */
 
+void wallcycle_suspend(gmx_wallcycle_t wc, int ewc);
+/* Adds the cycles since the last start or resume of ewc, without
+ * counting a call, for a nested count that should not be part of ewc
+ */
+
+void wallcycle_resume(gmx_wallcycle_t wc, int ewc);
+/* Restarts ewc after wallcycle_suspend */
+
+void wallcycle_add(gmx_wallcycle_t wc, int ewc, int n, double cycles);
+/* Add n counts and cycles measured elsewhere, e.g. in another thread,
+ * to ewc
+ */
+
 void wallcycle_reset_all(gmx_wallcycle_t wc);
 /* Resets all cycle counters to zero */
 
 void wallcycle_sum(t_commrec *cr, gmx_wallcycle_t wc,double cycles[]);
-/* Sum the cycles over the nodes in cr->mpi_comm_mysim */
+/* Sum the cycles over the nodes in cr->mpi_comm_mysim, with multiple
+ * simulations the QM and QED counters also over the simulations
+ */
 
 void wallcycle_print(FILE *fplog, int nnodes, int npme, double realtime,
 			    gmx_wallcycle_t wc, double cycles[]);
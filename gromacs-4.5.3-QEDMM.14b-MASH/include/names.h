@@ -84,6 +84,7 @@ extern const char *epull_names[epullNR+1];
 extern const char *epullg_names[epullgNR+1];
 extern const char *eQMmethod_names[eQMmethodNR+1];
 extern const char *eQMbasis_names[eQMbasisNR+1];
+extern const char *eQMprogram_names[eQMprogramNR+1];
 extern const char *eQMMMscheme_names[eQMMMschemeNR+1];
 extern const char *eMultentOpt_names[eMultentOptNR+1];
 extern const char *eSHmethod_names[eSHmethodNR+1];
@@ -124,6 +125,7 @@ extern const char *eQEDrepresentation_names[eQEDrepresentationNR+1];
 #define EPULLGEOM(e)   ENUM_NAME(e,epullgNR,epullg_names)
 #define EQMMETHOD(e)   ENUM_NAME(e,eQMmethodNR,eQMmethod_names)
 #define EQMBASIS(e)    ENUM_NAME(e,eQMbasisNR,eQMbasis_names)
+#define EQMPROGRAM(e)  ENUM_NAME(e,eQMprogramNR,eQMprogram_names)
 #define EQMMMSCHEME(e) ENUM_NAME(e,eQMMMschemeNR,eQMMMscheme_names)
 #define ESHMETHOD(e)   ENUM_NAME(e,eSHmethodNR,eSHmethod_names)
 #define EQEDREPRESENTATION(e)   ENUM_NAME(e,eQEDrepresentationNR,eQEDrepresentation_names)
@@ -104,6 +104,23 @@ void gmx_sumf_sim(int nr,float r[],const gmx_multisim_t *ms);
 void gmx_sumd_sim(int nr,double r[],const gmx_multisim_t *ms);
 /* Calculate the sum over the simulations of an array of doubles */
 
+void gmx_scatter_sim(int nbytes,void *sbuf,void *rbuf,int root,
+                     const gmx_multisim_t *ms);
+/* Send nbytes bytes of sbuf on simulation root to each simulation in
+ * order, received in rbuf. sbuf is only used on root.
+ */
+
+void gmx_send_sim(int nbytes,void *b,int dest,const gmx_multisim_t *ms);
+void gmx_recv_sim(int nbytes,void *b,int src,const gmx_multisim_t *ms);
+/* Send nbytes bytes from the master of this simulation to that of
+ * simulation dest, which receives them with gmx_recv_sim.
+ */
+
+void gmx_bcast_masters(int nbytes,void *b,int root,const gmx_multisim_t *ms);
+/* Broadcast nbytes bytes of b from simulation root to the masters of
+ * all simulations.
+ */
+
 void gmx_abort(int nodeid,int nnodes,int errorno);
 /* Abort the parallel run */
 
@@ -98,6 +98,14 @@ void gmx_pme_calc_energy(gmx_pme_t pme,int n,rvec *x,real *q,real *V);
  * Currently does not work in parallel or with free energy.
  */
 
+void gmx_pme_calc_potential(gmx_pme_t pme,int n,rvec *x,real *V,rvec *E);
+/* Calculate the reciprocal space potential V and field E at n points
+ * from the grid in the pme struct, determined before with a call to
+ * gmx_pme_do with at least GMX_PME_SPREAD_Q, GMX_PME_SOLVE and
+ * GMX_PME_CALC_POT specified.
+ * Currently does not work in parallel or with free energy.
+ */
+
 /* The following three routines are for PME/PP node splitting in pme_pp.c */
 
 /* Abstract type for PME <-> PP communication */
@@ -62,17 +62,34 @@ void init_QMMMrec(t_commrec *cr,
  * and md->cQMMM gives numbers of the MM and QM atoms 
  */
 
+void init_QMMM_MMtables(t_MMrec *mm, const gmx_mtop_t *mtop,
+                        int ntype, real *nbfp, gmx_bool bLJ);
+
+/* init_QMMM_MMtables stores the mass, the scaled charge and, with bLJ,
+ * the c6 and c12 (in au) of every atom of the system in mm. Called once
+ * from init_QMMMrec.
+ */
+
+void gather_QMMM_MMtables(t_MMrec *mm, gmx_bool bLJ);
+
+/* gather_QMMM_MMtables fills ffmass, MMcharges and, with bLJ, c6 and
+ * c12 for the current MM atoms indexMM from these tables.
+ */
+
 void update_QMMMrec(t_commrec *cr,
 			   t_forcerec *fr,
 			   rvec x[], rvec v[],
 			   t_mdatoms *md,
 			   matrix box,
-			   gmx_localtop_t *top,gmx_mtop_t *mtop);
+			   gmx_localtop_t *top,gmx_mtop_t *mtop,
+			   gmx_bool bNS);
 
 /* update_QMMMrec fills the MM stuff in QMMMrec. The MM atoms are
  * taken froom the neighbourlists of the QM atoms. In a QMMM run this
  * routine should be called at every step, since it updates the MM
- * elements of the t_QMMMrec struct.  
+ * elements of the t_QMMMrec struct. The list of MM atoms is only
+ * rebuilt when bNS is set, on the other steps only their coordinates
+ * are updated.
  */
 
 real calculate_QMMM(t_commrec *cr,
@@ -87,6 +104,18 @@ real calculate_QMMM(t_commrec *cr,
  * called by system().
  */
 
+void done_QMMMrec(t_QMMMrec *qr);
+
+/* done_QMMMrec lets the QM program of each QM group clean up at the
+ * end of the run.
+ */
+
+void checkpoint_QMMMrec(t_QMMMrec *qr);
+
+/* checkpoint_QMMMrec lets the QM programs store what they need for a
+ * restart, when mdrun writes a checkpoint.
+ */
+
 #ifdef __cplusplus
 }
 #endif
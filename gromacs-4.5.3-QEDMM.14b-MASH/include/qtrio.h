@@ -0,0 +1,116 @@
+/*
+ *
+ *                This source code is part of
+ *
+ *                 G   R   O   M   A   C   S
+ *
+ *          GROningen MAchine for Chemical Simulations
+ *
+ *                        VERSION 3.2.0
+ * Written by David van der Spoel, Erik Lindahl, Berk Hess, and others.
+ * Copyright (c) 1991-2000, University of Groningen, The Netherlands.
+ * Copyright (c) 2001-2004, The GROMACS development team,
+ * check out http://www.gromacs.org for more information.
+
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * If you want to redistribute modifications, please consider that
+ * scientific software is very special. Version control is crucial -
+ * bugs must be traceable. We will be happy to consider code for
+ * inclusion in the official distribution, but derived work must not
+ * be called official GROMACS. Details are found in the README & COPYING
+ * files - if they are missing, get the official version at www.gromacs.org.
+ *
+ * To help us fund GROMACS development, we humbly ask that you cite
+ * the papers on the package - you can find them in the top README file.
+ *
+ * For more info, check our website at http://www.gromacs.org
+ *
+ * And Hey:
+ * Gallium Rubidium Oxygen Manganese Argon Carbon Silicon
+ */
+
+#ifndef _qtrio_h
+#define _qtrio_h
+
+#include <stdio.h>
+#include "typedefs.h"
+#include "xdrf.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Polariton trajectory (.qtr) of the QED/MM runs: portable xdr frames,
+ * each with a header giving the sizes and the arrays present, so the
+ * file can be read without the run input. The arrays are stored as
+ * doubles, or with prec > 0 compressed as xtc coordinates are, in
+ * groups of three to an accuracy of 1/prec. An array too large for
+ * that precision is stored as doubles.
+ *
+ * The layout says which text file of the run a frame replaces, see
+ * g_qedtraj, which converts back:
+ *   eqtrEIGEN   eigenvectors.dat of the adiabatic runs: gap, c, eigvec
+ *   eqtrHYBRID  as eqtrEIGEN, plus d and energy for coefficients.dat
+ *   eqtrCOEFF   eigenvectors.dat of the diabatic runs: energy, c
+ *   eqtrBRIGHT  eigenvectors.dat with $QED_BRIGHT: gap, pop, photon, ndeg
+ * and with QTR_MOL the energies%d.dat of the molecules.
+ */
+
+enum { eqtrEIGEN, eqtrHYBRID, eqtrCOEFF, eqtrBRIGHT, eqtrNR };
+
+#define QTR_MOL    (1<<0)  /* E0, E1 and tdm of the molecules   */
+#define QTR_GAP    (1<<1)
+#define QTR_POP    (1<<2)
+#define QTR_PHOTON (1<<3)  /* photon and ndeg                    */
+#define QTR_C      (1<<4)
+#define QTR_D      (1<<5)
+#define QTR_EIGVEC (1<<6)
+
+typedef struct {
+  int     step;
+  int     layout;      /* eqtr*                                      */
+  int     flags;       /* QTR_*, the arrays present                  */
+  int     nmol;
+  int     ndim;        /* size of the diabatic basis                 */
+  int     nstate;      /* states in gap, pop, photon and ndeg        */
+  int     npol;        /* eqtrBRIGHT: the first npol are polaritons  */
+  float   prec;        /* of the compressed arrays, 0: lossless      */
+  double  energy;      /* kJ/mol                                     */
+  double  ref;         /* the ground state the gaps are relative to  */
+  double  groundstate; /* its population                             */
+  double *E0,*E1;      /* nmol, hartree                              */
+  double *tdm;         /* 3 nmol, au                                 */
+  double *gap;         /* nstate, hartree                            */
+  double *pop;         /* nstate                                     */
+  double *photon;      /* nstate, photon weight of the state         */
+  int    *ndeg;        /* nstate, states in the (dark) manifold      */
+  double *c;           /* 2 ndim, re,im of the coefficients          */
+  double *d;           /* 2 ndim, eqtrHYBRID: diabatic coefficients  */
+  double *eigvec;      /* 2 nstate ndim, eigenvector i at 2 i ndim   */
+} t_qtrframe;
+
+void qtr_alloc_frame(t_qtrframe *fr);
+/* (Re)allocates the arrays in fr->flags for the sizes in fr */
+
+void done_qtrframe(t_qtrframe *fr);
+/* Frees the arrays, not fr */
+
+gmx_bool qtr_do_frame(XDR *xd, t_qtrframe *fr, gmx_bool bRead);
+/* Writes or reads a frame, allocating its arrays on reading. Returns
+ * FALSE at the end of the file or on an error.
+ */
+
+gmx_bool write_qtr_frame(FILE *fp, t_qtrframe *fr);
+
+gmx_bool read_next_qtr_frame(FILE *fp, t_qtrframe *fr);
+/* Reads the next frame into fr, zero-initialised the first time */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif	/* _qtrio_h */
@@ -242,6 +242,13 @@ enum {
   eQMMMschemenormal,eQMMMschemeoniom,eQMMMschemeNR
 };
 
+/* QM program of a QM group, default is the one mdrun was built for */
+enum {
+  eQMprogramDEFAULT, eQMprogramGAUSSIAN, eQMprogramGAMESS,
+  eQMprogramORCA, eQMprogramMOPAC, eQMprogramMOCK, eQMprogramQEDMODEL,
+  eQMprogramNR
+};
+
 enum {
   eSHmethoddiabatic, eSHmethodTully, eSHmethodGranucci, eSHmethodEhrenfest, eSHmethodNR
 };
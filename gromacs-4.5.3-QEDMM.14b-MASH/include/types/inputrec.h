@@ -82,6 +82,7 @@ typedef struct {
   int     ngQM;         /* nr of QM groups                              */
   int     *QMmethod;    /* Level of theory in the QM calculation        */
   int     *QMbasis;     /* Basisset in the QM calculation               */
+  int     *QMprogram;   /* QM program (backend) of the group            */
   int     *QMcharge;    /* Total charge in the QM region                */
   int     *QMmult;      /* Spin multiplicicty in the QM region          */
   gmx_bool    *bSH;         /* surface hopping (diabatic hop only)          */
@@ -55,7 +55,10 @@ typedef struct {
  int           multiplicity;   /* multipicity (no of unpaired eln)  */
  int           QMmethod;       /* see enums.h for all methods       */
  int           QMbasis;        /* see enums.h for all bases         */
+ int           QMprogram;      /* eQMprogram, never DEFAULT         */
+ const struct gmx_qm_backend *backend; /* functions of QMprogram    */
  int           nelectrons;     /* total number of elecs in QM region*/
+ int           QMstep;         /* nr of QM calls with this record   */
  gmx_bool          bTS;            /* Optimize a TS, only steep, no md  */
  gmx_bool          bOPT;          /* Optimize QM subsys, only steep, no md  */
  gmx_bool          *frontatoms;   /* qm atoms on the QM side of a QM-MM bond */
@@ -123,6 +126,32 @@ double groundstate;
   real *ffmass; /* qm atoms masses */
   int restart;
   gmx_bool bMASH;
+  int QEDdiag; /* eigensolver for the polariton matrix, from $QED_DIAG */
+  int QEDprop; /* propagator of the coefficients, from $QED_PROP */
+  double QEDtrack; /* energy window of the state tracking, from $QED_TRACK */
+  struct gmx_qm_server *qmserver; /* persistent QM driver from $QM_SERVER,
+                                   * NULL: input.com and system() */
+  struct gmx_qm_pool *qmpool; /* QM workers shared by the molecules,
+                               * from $QM_POOL */
+  struct gmx_qed_dist *qeddist; /* other simulations serving the linear
+                                 * algebra of the master, from $QED_DIST */
+  struct gmx_qed_work *qedwork; /* buffers of the local diabatic propagator */
+  struct gmx_qed_writer *qedwriter; /* background writer of the QED output */
+  dplx *cavfac; /* photon weights of the modes in the coupling to */
+  int  cavmol;  /* molecule cavmol of cavnmol, see cavity_factors() */
+  int  cavnmol;
+  struct gmx_qm_mock *qmmock; /* state of the mock QM program */
+  gmx_bool bMTSinner;  /* inner MTS step: propagate with the last QM results */
+  struct gmx_qed_mts *qedmts; /* these results, see call_gaussian_QED */
+  struct gmx_qm_guess *qmguess; /* SCF guess from $QM_GUESS, NULL: default */
+  struct gmx_qm_scratch *qmscratch; /* subdir, possibly on $QM_SCRATCH */
+  struct gmx_qed_cavity *qedcav; /* Hamiltonian without matrix, $QED_FFT */
+  struct gmx_qed_modes *qedmodes; /* adaptive cavity modes, $QED_MODES,
+                                   * NULL: all modes */
+  struct gmx_qed_bright *qedbright; /* bright/dark basis, $QED_BRIGHT */
+  struct gmx_qed_traj *qedtraj; /* binary output, $QED_TRAJ, NULL: text */
+  struct gmx_qed_model *qedmodel; /* model molecules of QMprogram =
+                                   * QEDmodel, NULL: the QM program */
 } t_QMrec;
 
 typedef struct {
@@ -138,6 +167,11 @@ typedef struct {
   /* gaussian specific stuff */
   real          *c6;
   real          *c12;
+  /* per atom of the system, filled once in init_QMMMrec */
+  real          *atom_mass;
+  real          *atom_charge;   /* scaled by scalefactor             */
+  real          *atom_c6;       /* only for TS/OPT, in au            */
+  real          *atom_c12;
 } t_MMrec;
 
 
@@ -149,6 +183,11 @@ typedef struct {
   int           SHmethod;
   int           QEDrepresentation;
   rvec *v;
+  struct gmx_wallcycle *wcycle; /* of do_force, for the QM counters */
+  struct gmx_qmmm_embed *embed; /* MM embedding of the last search step */
+  struct gmx_qmmm_lr *lr;       /* far field through PME, NULL if off */
+  struct gmx_qmmm_oniom *oniom; /* layer jobs of multi-layer ONIOM    */
+  struct gmx_qmmm_mts *mts;     /* QM force every N steps, NULL if off */
 } t_QMMMrec;
 
 #ifdef __cplusplus
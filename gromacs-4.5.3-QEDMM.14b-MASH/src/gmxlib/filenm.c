@@ -197,7 +197,8 @@ static const t_deffile
     { eftASC, ".edo", "sam",    NULL, "ED sampling output"},
     { eftASC, ".hat", "gk", NULL, "Fourier transform of spread function" },
     { eftASC, ".cub", "pot",  NULL, "Gaussian cube file" },
-    { eftASC, ".xpm", "root", NULL, "X PixMap compatible matrix file" } 
+    { eftASC, ".xpm", "root", NULL, "X PixMap compatible matrix file" },
+    { eftXDR, ".qtr", "polariton", "-f", "Polariton trajectory of QED/MM runs" }
 };
 
 static char *default_file_name = NULL;
@@ -397,6 +397,7 @@ static void bc_grpopts(const t_commrec *cr,t_grpopts *g)
     block_bc(cr,g->ngQM);
     snew_bc(cr,g->QMmethod,g->ngQM);
     snew_bc(cr,g->QMbasis,g->ngQM);
+    snew_bc(cr,g->QMprogram,g->ngQM);
     snew_bc(cr,g->QMcharge,g->ngQM);
     snew_bc(cr,g->QMmult,g->ngQM);
     snew_bc(cr,g->bSH,g->ngQM);
@@ -410,6 +411,7 @@ static void bc_grpopts(const t_commrec *cr,t_grpopts *g)
     {
         nblock_bc(cr,g->ngQM,g->QMmethod);
         nblock_bc(cr,g->ngQM,g->QMbasis);
+        nblock_bc(cr,g->ngQM,g->QMprogram);
         nblock_bc(cr,g->ngQM,g->QMcharge);
         nblock_bc(cr,g->ngQM,g->QMmult);
         nblock_bc(cr,g->ngQM,g->bSH);
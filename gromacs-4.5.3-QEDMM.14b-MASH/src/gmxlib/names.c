@@ -205,6 +205,10 @@ const char *eQMMMscheme_names[eQMMMschemeNR+1] = {
   "normal", "ONIOM", NULL
 };
 
+const char *eQMprogram_names[eQMprogramNR+1] = {
+  "default", "Gaussian", "GAMESS", "ORCA", "MOPAC", "mock", "QEDmodel", NULL
+};
+
 const char *eSHmethod_names[eSHmethodNR+1] = {
   "diabatic", "Tully", "Granucci", "Ehrenfest", NULL
 };
@@ -640,6 +640,46 @@ void gmx_sumi_sim(int nr,int r[], const gmx_multisim_t *ms)
 #endif
 }
 
+void gmx_scatter_sim(int nbytes,void *sbuf,void *rbuf,int root,
+                     const gmx_multisim_t *ms)
+{
+#ifndef GMX_MPI
+  gmx_call("gmx_scatter_sim");
+#else
+  MPI_Scatter(sbuf,nbytes,MPI_BYTE,rbuf,nbytes,MPI_BYTE,root,
+              ms->mpi_comm_masters);
+#endif
+}
+
+void gmx_send_sim(int nbytes,void *b,int dest,const gmx_multisim_t *ms)
+{
+#ifndef GMX_MPI
+  gmx_call("gmx_send_sim");
+#else
+  MPI_Send(b,nbytes,MPI_BYTE,dest,0,ms->mpi_comm_masters);
+#endif
+}
+
+void gmx_recv_sim(int nbytes,void *b,int src,const gmx_multisim_t *ms)
+{
+#ifndef GMX_MPI
+  gmx_call("gmx_recv_sim");
+#else
+  MPI_Status stat;
+
+  MPI_Recv(b,nbytes,MPI_BYTE,src,0,ms->mpi_comm_masters,&stat);
+#endif
+}
+
+void gmx_bcast_masters(int nbytes,void *b,int root,const gmx_multisim_t *ms)
+{
+#ifndef GMX_MPI
+  gmx_call("gmx_bcast_masters");
+#else
+  MPI_Bcast(b,nbytes,MPI_BYTE,root,ms->mpi_comm_masters);
+#endif
+}
+
 void gmx_finalize(void)
 {
 #ifndef GMX_MPI
@@ -0,0 +1,215 @@
+/*
+ *
+ *                This source code is part of
+ *
+ *                 G   R   O   M   A   C   S
+ *
+ *          GROningen MAchine for Chemical Simulations
+ *
+ *                        VERSION 3.2.0
+ * Written by David van der Spoel, Erik Lindahl, Berk Hess, and others.
+ * Copyright (c) 1991-2000, University of Groningen, The Netherlands.
+ * Copyright (c) 2001-2004, The GROMACS development team,
+ * check out http://www.gromacs.org for more information.
+
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * If you want to redistribute modifications, please consider that
+ * scientific software is very special. Version control is crucial -
+ * bugs must be traceable. We will be happy to consider code for
+ * inclusion in the official distribution, but derived work must not
+ * be called official GROMACS. Details are found in the README & COPYING
+ * files - if they are missing, get the official version at www.gromacs.org.
+ *
+ * To help us fund GROMACS development, we humbly ask that you cite
+ * the papers on the package - you can find them in the top README file.
+ *
+ * For more info, check our website at http://www.gromacs.org
+ *
+ * And Hey:
+ * GROwing Monsters And Cloning Shrimps
+ */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <math.h>
+#include <string.h>
+#include "typedefs.h"
+#include "xdrf.h"
+#include "smalloc.h"
+#include "gmx_fatal.h"
+#include "qtrio.h"
+
+#define QTR_MAGIC   1962
+#define QTR_VERSION 1
+
+/* larger values times the precision do not fit the integers of
+ * xdr3dfcoord
+ */
+#define QTR_MAXABS  1e9
+
+void qtr_alloc_frame(t_qtrframe *fr)
+{
+  if (fr->flags & QTR_MOL){
+    srenew(fr->E0,fr->nmol);
+    srenew(fr->E1,fr->nmol);
+    srenew(fr->tdm,3*fr->nmol);
+  }
+  if (fr->flags & QTR_GAP)
+    srenew(fr->gap,fr->nstate);
+  if (fr->flags & QTR_POP)
+    srenew(fr->pop,fr->nstate);
+  if (fr->flags & QTR_PHOTON){
+    srenew(fr->photon,fr->nstate);
+    srenew(fr->ndeg,fr->nstate);
+  }
+  if (fr->flags & QTR_C)
+    srenew(fr->c,2*fr->ndim);
+  if (fr->flags & QTR_D)
+    srenew(fr->d,2*fr->ndim);
+  if (fr->flags & QTR_EIGVEC)
+    srenew(fr->eigvec,2*fr->nstate*fr->ndim);
+}
+
+void done_qtrframe(t_qtrframe *fr)
+{
+  sfree(fr->E0);
+  sfree(fr->E1);
+  sfree(fr->tdm);
+  sfree(fr->gap);
+  sfree(fr->pop);
+  sfree(fr->photon);
+  sfree(fr->ndeg);
+  sfree(fr->c);
+  sfree(fr->d);
+  sfree(fr->eigvec);
+}
+
+static gmx_bool qtr_do_doubles(XDR *xd, int n, double *a)
+{
+  int i;
+
+  for (i=0; i<n; i++)
+    if (xdr_double(xd,&a[i]) == 0)
+      return FALSE;
+
+  return TRUE;
+}
+
+/* an array of n doubles, compressed with prec > 0 unless out of range */
+static gmx_bool qtr_do_reals(XDR *xd, int n, double *a, float prec,
+                             gmx_bool bRead)
+{
+  int      i,bComp=0,n3;
+  float    *f,p=prec;
+  gmx_bool bOK;
+
+  if (!bRead && prec > 0){
+    bComp = 1;
+    for (i=0; i<n; i++)
+      if (fabs(a[i])*prec > QTR_MAXABS)
+        bComp = 0;
+  }
+  if (xdr_int(xd,&bComp) == 0)
+    return FALSE;
+  if (!bComp)
+    return qtr_do_doubles(xd,n,a);
+
+  /* xdr3dfcoord packs triplets, pad with zeros */
+  n3 = (n+2)/3;
+  snew(f,3*n3);
+  if (!bRead)
+    for (i=0; i<n; i++)
+      f[i] = a[i];
+  bOK = (xdr3dfcoord(xd,f,&n3,&p) != 0);
+  if (bRead)
+    for (i=0; i<n; i++)
+      a[i] = f[i];
+  sfree(f);
+
+  return bOK;
+}
+
+gmx_bool qtr_do_frame(XDR *xd, t_qtrframe *fr, gmx_bool bRead)
+{
+  int      magic=QTR_MAGIC,version=QTR_VERSION,i;
+  gmx_bool bOK=TRUE;
+
+  if (xdr_int(xd,&magic) == 0)
+    return FALSE;
+  if (magic != QTR_MAGIC)
+    gmx_fatal(FARGS,"Magic number of a polariton trajectory frame is %d, "
+              "should be %d",magic,QTR_MAGIC);
+  bOK = bOK && xdr_int(xd,&version);
+  if (bOK && version > QTR_VERSION)
+    gmx_fatal(FARGS,"Polariton trajectory version %d, this program reads "
+              "up to version %d",version,QTR_VERSION);
+  bOK = bOK && xdr_int(xd,&fr->step);
+  bOK = bOK && xdr_int(xd,&fr->layout);
+  bOK = bOK && xdr_int(xd,&fr->flags);
+  bOK = bOK && xdr_int(xd,&fr->nmol);
+  bOK = bOK && xdr_int(xd,&fr->ndim);
+  bOK = bOK && xdr_int(xd,&fr->nstate);
+  bOK = bOK && xdr_int(xd,&fr->npol);
+  bOK = bOK && xdr_float(xd,&fr->prec);
+  bOK = bOK && xdr_double(xd,&fr->energy);
+  bOK = bOK && xdr_double(xd,&fr->ref);
+  bOK = bOK && xdr_double(xd,&fr->groundstate);
+  if (!bOK)
+    return FALSE;
+  if (bRead)
+    qtr_alloc_frame(fr);
+
+  /* the absolute energies only lossless */
+  if (fr->flags & QTR_MOL){
+    bOK = bOK && qtr_do_doubles(xd,fr->nmol,fr->E0);
+    bOK = bOK && qtr_do_doubles(xd,fr->nmol,fr->E1);
+    bOK = bOK && qtr_do_reals(xd,3*fr->nmol,fr->tdm,fr->prec,bRead);
+  }
+  if (fr->flags & QTR_GAP)
+    bOK = bOK && qtr_do_reals(xd,fr->nstate,fr->gap,fr->prec,bRead);
+  if (fr->flags & QTR_POP)
+    bOK = bOK && qtr_do_reals(xd,fr->nstate,fr->pop,fr->prec,bRead);
+  if (fr->flags & QTR_PHOTON){
+    bOK = bOK && qtr_do_reals(xd,fr->nstate,fr->photon,fr->prec,bRead);
+    for (i=0; i<fr->nstate && bOK; i++)
+      bOK = xdr_int(xd,&fr->ndeg[i]);
+  }
+  if (fr->flags & QTR_C)
+    bOK = bOK && qtr_do_reals(xd,2*fr->ndim,fr->c,fr->prec,bRead);
+  if (fr->flags & QTR_D)
+    bOK = bOK && qtr_do_reals(xd,2*fr->ndim,fr->d,fr->prec,bRead);
+  if (fr->flags & QTR_EIGVEC)
+    bOK = bOK && qtr_do_reals(xd,2*fr->nstate*fr->ndim,fr->eigvec,fr->prec,
+                              bRead);
+
+  return bOK;
+}
+
+gmx_bool write_qtr_frame(FILE *fp, t_qtrframe *fr)
+{
+  XDR      xd;
+  gmx_bool bOK;
+
+  xdrstdio_create(&xd,fp,XDR_ENCODE);
+  bOK = qtr_do_frame(&xd,fr,FALSE);
+  xdr_destroy(&xd);
+
+  return bOK;
+}
+
+gmx_bool read_next_qtr_frame(FILE *fp, t_qtrframe *fr)
+{
+  XDR      xd;
+  gmx_bool bOK;
+
+  xdrstdio_create(&xd,fp,XDR_DECODE);
+  bOK = qtr_do_frame(&xd,fr,TRUE);
+  xdr_destroy(&xd);
+
+  return bOK;
+}
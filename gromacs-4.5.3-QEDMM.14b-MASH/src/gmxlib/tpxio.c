@@ -64,7 +64,7 @@
 #include "mtop_util.h"
 
 /* This number should be increased whenever the file format changes! */
-static const int tpx_version = 73;
+static const int tpx_version = 74;
 
 /* This number should only be increased when you edit the TOPOLOGY section
  * of the tpx format. This way we can maintain forward compatibility too
@@ -902,6 +902,7 @@ static void do_inputrec(t_fileio *fio, t_inputrec *ir,gmx_bool bRead,
       if (bRead) {
         snew(ir->opts.QMmethod,    ir->opts.ngQM);
         snew(ir->opts.QMbasis,     ir->opts.ngQM);
+        snew(ir->opts.QMprogram,   ir->opts.ngQM);
         snew(ir->opts.QMcharge,    ir->opts.ngQM);
         snew(ir->opts.QMmult,      ir->opts.ngQM);
         snew(ir->opts.bSH,         ir->opts.ngQM);
@@ -933,6 +934,9 @@ snew(ir->opts.bMASH,        ir->opts.ngQM);
         bDum=gmx_fio_ndo_int(fio,ir->opts.SAsteps,ir->opts.ngQM);
         bDum=gmx_fio_ndo_gmx_bool(fio,ir->opts.bOPT,ir->opts.ngQM);
         bDum=gmx_fio_ndo_gmx_bool(fio,ir->opts.bTS,ir->opts.ngQM);
+        if (file_version >= 74) {
+          bDum=gmx_fio_ndo_int(fio,ir->opts.QMprogram,ir->opts.ngQM);
+        }
       }
       /* end of QMMM stuff */
     }    
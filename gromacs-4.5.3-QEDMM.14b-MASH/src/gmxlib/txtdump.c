@@ -345,6 +345,7 @@ void pr_qm_opts(FILE *fp,int indent,const char *title,t_grpopts *opts)
   if (opts->ngQM > 0) {
     pr_ivec(fp,indent,"QMmethod",opts->QMmethod,opts->ngQM,FALSE);
     pr_ivec(fp,indent,"QMbasis",opts->QMbasis,opts->ngQM,FALSE);
+    pr_ivec(fp,indent,"QMprogram",opts->QMprogram,opts->ngQM,FALSE);
     pr_ivec(fp,indent,"QMcharge",opts->QMcharge,opts->ngQM,FALSE);
     pr_ivec(fp,indent,"QMmult",opts->QMmult,opts->ngQM,FALSE);
     pr_bvec(fp,indent,"bSH",opts->bSH,opts->ngQM,FALSE);
@@ -404,6 +404,7 @@ void done_inputrec(t_inputrec *ir)
   sfree(ir->opts.nFreeze);
   sfree(ir->opts.QMmethod);
   sfree(ir->opts.QMbasis);
+  sfree(ir->opts.QMprogram);
   sfree(ir->opts.QMcharge);
   sfree(ir->opts.QMmult);
   sfree(ir->opts.bSH);
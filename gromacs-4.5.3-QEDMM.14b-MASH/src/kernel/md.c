@@ -2186,6 +2186,10 @@ double do_md(FILE *fplog,t_commrec *cr,int nfile,const t_filenm fnm[],
                        step,t,state,state_global,f,f_global,&n_xtc,&x_xtc);
             if (bCPT)
             {
+                if (fr->bQMMM)
+                {
+                    checkpoint_QMMMrec(fr->qr);
+                }
                 nchkpt++;
                 bCPT = FALSE;
             }
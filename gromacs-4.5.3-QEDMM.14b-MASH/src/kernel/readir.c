@@ -81,7 +81,8 @@ static char foreign_lambda[STRLEN];
 static char **pull_grp;
 static char anneal[STRLEN],anneal_npoints[STRLEN],
   anneal_time[STRLEN],anneal_temp[STRLEN];
-static char QMmethod[STRLEN],QMbasis[STRLEN],QMcharge[STRLEN],QMmult[STRLEN],
+static char QMmethod[STRLEN],QMbasis[STRLEN],QMprogram[STRLEN],
+    QMcharge[STRLEN],QMmult[STRLEN],
     bSH[STRLEN],bQED[STRLEN],bMASH[STRLEN],
     CASorbitals[STRLEN], CASelectrons[STRLEN],SAon[STRLEN],
   SAoff[STRLEN],SAsteps[STRLEN],bTS[STRLEN],bOPT[STRLEN]; 
@@ -1001,6 +1002,8 @@ void get_ir(const char *mdparin,const char *mdparout,
   EETYPE("QMMMscheme",  ir->QMMMscheme,    eQMMMscheme_names);
   CTYPE ("QM basisset");
   STYPE("QMbasis",      QMbasis, NULL);
+  CTYPE ("QM program per group, empty: the one mdrun was built for");
+  STYPE("QMprogram",    QMprogram, NULL);
   CTYPE ("QM charge");
   STYPE ("QMcharge",    QMcharge,NULL);
   CTYPE ("QM multiplicity");
@@ -1318,7 +1321,7 @@ static int search_QMstring(char *s,int ng,const char *gn[])
     if (gmx_strcasecmp(s,gn[i]) == 0)
       return i;
 
-  gmx_fatal(FARGS,"this QM method or basisset (%s) is not implemented\n!",s);
+  gmx_fatal(FARGS,"this QM method, basisset or program (%s) is not implemented\n!",s);
 
   return -1;
 
@@ -1797,7 +1800,7 @@ void do_index(const char* mdparin, const char *ndx,
   int     i,j,k,restnm;
   real    SAtime;
   gmx_bool    bExcl,bTable,bSetTCpar,bAnneal,bRest;
-  int     nQMmethod,nQMbasis,nQMcharge,nQMmult,nbSH,nbQED,nbMASH,nCASorb,nCASelec,
+  int     nQMmethod,nQMbasis,nQMprogram,nQMcharge,nQMmult,nbSH,nbQED,nbMASH,nCASorb,nCASelec,
     nSAon,nSAoff,nSAsteps,nQMg,nbOPT,nbTS;
   char    warn_buf[STRLEN];
 
@@ -2131,6 +2134,16 @@ void do_index(const char* mdparin, const char *ndx,
                                            eQMbasis_names);
 
   }
+  nQMprogram = str_nelem(QMprogram,MAXPTR,ptr2);
+  if(nQMprogram != 0 && nQMprogram != nQMg){
+    gmx_fatal(FARGS,"Invalid QMMM input: %d groups and %d QM programs\n",
+              nQMg,nQMprogram);
+  }
+  snew(ir->opts.QMprogram,nr);
+  for(i=0;i<nQMprogram;i++){
+    ir->opts.QMprogram[i] = search_QMstring(ptr2[i],eQMprogramNR,
+                                            eQMprogram_names);
+  }
   nQMmult   = str_nelem(QMmult,MAXPTR,ptr1);
   nQMcharge = str_nelem(QMcharge,MAXPTR,ptr2);
   nbSH      = str_nelem(bSH,MAXPTR,ptr3);
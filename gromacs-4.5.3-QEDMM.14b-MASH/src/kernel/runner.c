@@ -852,6 +852,11 @@ int mdrunner(int nthreads_requested, FILE *fplog,t_commrec *cr,int nfile,
         }
     }
 
+    if (fr && fr->bQMMM)
+    {
+        done_QMMMrec(fr->qr);
+    }
+
     wallcycle_stop(wcycle,ewcRUN);
 
     /* Finish up, write some stuff
@@ -171,6 +171,7 @@ void do_force_lowlevel(FILE       *fplog,   gmx_large_int_t step,
     /* do QMMM first if requested */
     if(fr->bQMMM)
     {
+        fr->qr->wcycle = wcycle;
         enerd->term[F_EQM] = calculate_QMMM(cr,x,f,fr,md);
     }
     
@@ -72,11 +72,14 @@ typedef struct gmx_wallcycle
 #ifdef GMX_MPI
     MPI_Comm     mpi_comm_mygroup;
 #endif
+    int          nsim;              /* >1: the QM and QED counters below  */
+    double       sim_sum[ewcNR];    /* are summed and maxed over the      */
+    double       sim_max[ewcNR];    /* simulations by wallcycle_sum       */
 } gmx_wallcycle_t_t;
 
 /* Each name should not exceed 19 characters */
 static const char *wcn[ewcNR] =
-{ "Run", "Step", "PP during PME", "Domain decomp.", "DD comm. load", "DD comm. bounds", "Vsite constr.", "Send X to PME", "Comm. coord.", "Neighbor search", "Born radii", "Force", "Wait + Comm. F", "PME mesh", "PME redist. X/F", "PME spread/gather", "PME 3D-FFT", "PME solve", "Wait + Comm. X/F", "Wait + Recv. PME F", "Vsite spread", "Write traj.", "Update", "Constraints", "Comm. energies", "Test" };
+{ "Run", "Step", "PP during PME", "Domain decomp.", "DD comm. load", "DD comm. bounds", "Vsite constr.", "Send X to PME", "Comm. coord.", "Neighbor search", "Born radii", "Force", "Wait + Comm. F", "PME mesh", "PME redist. X/F", "PME spread/gather", "PME 3D-FFT", "PME solve", "Wait + Comm. X/F", "Wait + Recv. PME F", "Vsite spread", "Write traj.", "Update", "Constraints", "Comm. energies", "QM input", "QM program", "QM output parsing", "QED Hamiltonian", "QED diagonalization", "QED propagation", "QED NAC/hop/vel.", "QED forces", "QED replica comm.", "QED output", "QED writer thread", "Test" };
 
 gmx_bool wallcycle_have_counter(void)
 {
@@ -228,6 +231,37 @@ double wallcycle_stop(gmx_wallcycle_t wc, int ewc)
     return last;
 }
 
+void wallcycle_suspend(gmx_wallcycle_t wc, int ewc)
+{
+    if (wc == NULL)
+    {
+        return;
+    }
+
+    wc->wcc[ewc].c += gmx_cycles_read() - wc->wcc[ewc].start;
+}
+
+void wallcycle_resume(gmx_wallcycle_t wc, int ewc)
+{
+    if (wc == NULL)
+    {
+        return;
+    }
+
+    wc->wcc[ewc].start = gmx_cycles_read();
+}
+
+void wallcycle_add(gmx_wallcycle_t wc, int ewc, int n, double cycles)
+{
+    if (wc == NULL)
+    {
+        return;
+    }
+
+    wc->wcc[ewc].n += n;
+    wc->wcc[ewc].c += (gmx_cycles_t)cycles;
+}
+
 void wallcycle_reset_all(gmx_wallcycle_t wc)
 {
     int i;
@@ -326,6 +360,17 @@ void wallcycle_sum(t_commrec *cr, gmx_wallcycle_t wc,double cycles[])
             sfree(cyc_all);
         }
     }
+    /* the QM and QED counters of all simulations, for the load balance
+     * of the QM calls; the masters hold the sums over their simulation
+     */
+    if (MULTISIM(cr) && MASTER(cr))
+    {
+        wc->nsim = cr->ms->nsim;
+        MPI_Allreduce(cycles,wc->sim_sum,ewcNR,MPI_DOUBLE,MPI_SUM,
+                      cr->ms->mpi_comm_masters);
+        MPI_Allreduce(cycles,wc->sim_max,ewcNR,MPI_DOUBLE,MPI_MAX,
+                      cr->ms->mpi_comm_masters);
+    }
 #endif
 }
 
@@ -349,16 +394,30 @@ static void print_cycles(FILE *fplog, double c2t, const char *name, int nnodes,
     }
 }
 
-static gmx_bool subdivision(int ewc)
+static gmx_bool pme_subdivision(int ewc)
 {
     return (ewc >= ewcPME_REDISTXF && ewc <= ewcPME_SOLVE);
 }
 
+/* the QM and QED counters run inside Force and do not overlap, the
+ * writer thread runs outside the step
+ */
+static gmx_bool qed_subdivision(int ewc)
+{
+    return (ewc >= ewcQM_INPUT && ewc <= ewcQED_WRITER);
+}
+
+static gmx_bool subdivision(int ewc)
+{
+    return (pme_subdivision(ewc) || qed_subdivision(ewc));
+}
+
 void wallcycle_print(FILE *fplog, int nnodes, int npme, double realtime,
                      gmx_wallcycle_t wc, double cycles[])
 {
     double c2t,tot,sum;
     int    i,j,npp;
+    gmx_bool bQED;
     char   buf[STRLEN];
     const char *myline = "-----------------------------------------------------------------------";
     
@@ -430,7 +489,7 @@ void wallcycle_print(FILE *fplog, int nnodes, int npme, double realtime,
         fprintf(fplog,"%s\n",myline);
         for(i=ewcPPDURINGPME+1; i<ewcNR; i++)
         {
-            if (subdivision(i))
+            if (pme_subdivision(i))
             {
                 print_cycles(fplog,c2t,wcn[i],
                              (i>=ewcPMEMESH || i<=ewcPME_SOLVE) ? npme : npp,
@@ -440,6 +499,45 @@ void wallcycle_print(FILE *fplog, int nnodes, int npme, double realtime,
         fprintf(fplog,"%s\n",myline);
     }
 
+    bQED = FALSE;
+    for(i=ewcPPDURINGPME+1; i<ewcNR; i++)
+    {
+        bQED = bQED || (qed_subdivision(i) && wc->wcc[i].n > 0);
+    }
+    if (bQED)
+    {
+        fprintf(fplog,"%s\n",myline);
+        for(i=ewcPPDURINGPME+1; i<ewcNR; i++)
+        {
+            if (qed_subdivision(i))
+            {
+                print_cycles(fplog,c2t,wcn[i],npp,
+                             wc->wcc[i].n,cycles[i],tot);
+            }
+        }
+        fprintf(fplog,"%s\n",myline);
+    }
+
+    if (bQED && wc->nsim > 1)
+    {
+        /* in the cycles of this simulation, the same clock everywhere */
+        sprintf(buf,"%d simulations",wc->nsim);
+        fprintf(fplog,"\n %-19s %10s %10s %9s   %5s\n",
+                buf,"Average","Maximum","Max/Avg","%");
+        fprintf(fplog,"%s\n",myline);
+        for(i=ewcPPDURINGPME+1; i<ewcNR; i++)
+        {
+            if (qed_subdivision(i) && wc->sim_max[i] > 0)
+            {
+                fprintf(fplog," %-19s %10.1f %10.1f %9.2f   %5.1f\n",wcn[i],
+                        wc->sim_sum[i]*c2t/wc->nsim,wc->sim_max[i]*c2t,
+                        wc->sim_max[i]*wc->nsim/wc->sim_sum[i],
+                        100*wc->sim_sum[i]/wc->sim_sum[ewcRUN]);
+            }
+        }
+        fprintf(fplog,"%s\n",myline);
+    }
+
     if (cycles[ewcMoveE] > tot*0.05)
     {
         sprintf(buf,
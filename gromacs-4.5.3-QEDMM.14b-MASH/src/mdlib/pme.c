@@ -1594,6 +1594,88 @@ static real gather_energy_bsplines(gmx_pme_t pme,real *grid,
     return energy;
 }
 
+static void gather_potential_bsplines(gmx_pme_t pme,real *grid,
+                                      pme_atomcomm_t *atc,
+                                      real *V,rvec *E)
+{
+    int     n,ithx,ithy,ithz,i0,j0,k0;
+    int     index_x,index_xy;
+    int     nx,ny,nz,pny,pnz;
+    int *   idxptr;
+    real    pot,tx,ty,dx,dy,gval;
+    real    fx,fy,fz,fxy1,fz1;
+    real    *thx,*thy,*thz,*dthx,*dthy,*dthz;
+    int     norder;
+    real    rxx,ryx,ryy,rzx,rzy,rzz;
+    int     order;
+    
+    order = pme->pme_order;
+    nx    = pme->nkx;
+    ny    = pme->nky;
+    nz    = pme->nkz;
+    pny   = pme->pmegrid_ny;
+    pnz   = pme->pmegrid_nz;
+    
+    rxx   = pme->recipbox[XX][XX];
+    ryx   = pme->recipbox[YY][XX];
+    ryy   = pme->recipbox[YY][YY];
+    rzx   = pme->recipbox[ZZ][XX];
+    rzy   = pme->recipbox[ZZ][YY];
+    rzz   = pme->recipbox[ZZ][ZZ];
+
+    for(n=0; (n<atc->n); n++) {
+        idxptr = atc->idx[n];
+        norder = n*order;
+        
+        i0   = idxptr[XX]; 
+        j0   = idxptr[YY];
+        k0   = idxptr[ZZ];
+        
+        /* Pointer arithmetic alert, next six statements */
+        thx  = atc->theta[XX] + norder;
+        thy  = atc->theta[YY] + norder;
+        thz  = atc->theta[ZZ] + norder;
+        dthx = atc->dtheta[XX] + norder;
+        dthy = atc->dtheta[YY] + norder;
+        dthz = atc->dtheta[ZZ] + norder;
+
+        pot = 0;
+        fx  = 0;
+        fy  = 0;
+        fz  = 0;
+        for(ithx=0; (ithx<order); ithx++)
+        {
+            index_x = (i0+ithx)*pny*pnz;
+            tx      = thx[ithx];
+            dx      = dthx[ithx];
+
+            for(ithy=0; (ithy<order); ithy++)
+            {
+                index_xy = index_x+(j0+ithy)*pnz;
+                ty       = thy[ithy];
+                dy       = dthy[ithy];
+                fxy1     = fz1 = 0;
+
+                for(ithz=0; (ithz<order); ithz++)
+                {
+                    gval  = grid[index_xy+(k0+ithz)];
+                    fxy1 += thz[ithz]*gval;
+                    fz1  += dthz[ithz]*gval;
+                }
+                pot += tx*ty*fxy1;
+                fx  += dx*ty*fxy1;
+                fy  += tx*dy*fxy1;
+                fz  += tx*ty*fz1;
+            }
+        }
+
+        V[n]     = pot;
+        E[n][XX] = -( fx*nx*rxx );
+        E[n][YY] = -( fx*nx*ryx + fy*ny*ryy );
+        E[n][ZZ] = -( fx*nx*rzx + fy*ny*rzy + fz*nz*rzz );
+    }
+}
+
 void make_bsplines(splinevec theta,splinevec dtheta,int order,
                    rvec fractx[],int nr,real charge[],
                    gmx_bool bFreeEnergy)
@@ -2355,6 +2437,46 @@ void gmx_pme_calc_energy(gmx_pme_t pme,int n,rvec *x,real *q,real *V)
 }
 
 
+void gmx_pme_calc_potential(gmx_pme_t pme,int n,rvec *x,real *V,rvec *E)
+{
+    pme_atomcomm_t *atc;
+    real *q;
+    int  i;
+
+    if (pme->nnodes > 1)
+    {
+        gmx_incons("gmx_pme_calc_potential called in parallel");
+    }
+    if (pme->bFEP > 1)
+    {
+        gmx_incons("gmx_pme_calc_potential with free energy");
+    }
+
+    /* unit charges, the splines are only computed for charged points */
+    snew(q,n);
+    for(i=0; i<n; i++)
+    {
+        q[i] = 1;
+    }
+
+    atc = &pme->atc_energy;
+    atc->nslab     = 1;
+    atc->bSpread   = TRUE;
+    atc->pme_order = pme->pme_order;
+    atc->n         = n;
+    pme_realloc_atomcomm_things(atc);
+    atc->x         = x;
+    atc->q         = q;
+    
+    /* We only use the A-charges grid */
+    spread_on_grid(pme,atc,NULL,TRUE,FALSE);
+
+    gather_potential_bsplines(pme,pme->pmegridA,atc,V,E);
+
+    sfree(q);
+}
+
+
 static void reset_pmeonly_counters(t_commrec *cr,gmx_wallcycle_t wcycle,
         t_nrnb *nrnb,t_inputrec *ir, gmx_large_int_t step_rel)
 {
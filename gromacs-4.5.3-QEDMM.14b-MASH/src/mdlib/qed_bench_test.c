@@ -0,0 +1,493 @@
+/* -*- mode: c; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; c-file-style: "stroustrup"; -*-
+ * $Id: gmx_matrix.c,v 1.4 2008/12/02 18:27:57 spoel Exp $
+ * 
+ *                This source code is part of
+ * 
+ *                 G   R   O   M   A   C   S
+ * 
+ *          GROningen MAchine for Chemical Simulations
+ * 
+ *                        VERSION 4.5
+ * Written by David van der Spoel, Erik Lindahl, Berk Hess, and others.
+ * Copyright (c) 1991-2000, University of Groningen, The Netherlands.
+ * Copyright (c) 2001-2008, The GROMACS development team,
+ * check out http://www.gromacs.org for more information.
+ 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * If you want to redistribute modifications, please consider that
+ * scientific software is very special. Version control is crucial -
+ * bugs must be traceable. We will be happy to consider code for
+ * inclusion in the official distribution, but derived work must not
+ * be called official GROMACS. Details are found in the README & COPYING
+ * files - if they are missing, get the official version at www.gromacs.org.
+ * 
+ * To help us fund GROMACS development, we humbly ask that you cite
+ * the papers on the package - you can find them in the top README file.
+ * 
+ * For more info, check our website at http://www.gromacs.org
+ * 
+ * And Hey:
+ * Groningen Machine for Chemical Simulation
+ */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include "typedefs.h"
+#include "smalloc.h"
+#include "macros.h"
+#include "vec.h"
+#include "physics.h"
+#include "qed_linalg.h"
+#include "qed_diag.h"
+#include "qed_cavity.h"
+#include "qed_bright.h"
+#include "qed_model.h"
+
+#include <complex.h>
+#ifdef I
+#undef I
+#endif
+#define IMAG _Complex_I
+
+/* Scaling benchmark of the cavity QED engine on the model molecules of
+ * qed_model.c, so without a QM program or multiple simulations. For
+ * every number of molecules (-nmol, default 10 100 500 1000 2000) and
+ * of cavity modes (-modes, default 1 11 101) it runs -steps (default 3)
+ * steps of stand-ins for the kernels each representation of
+ * call_gaussian_QED() spends its time in. These call the same library
+ * routines, but the driver itself is not run: the forces
+ * (polariton_forces), the non-adiabatic couplings (get_NAC), the
+ * output and the communication between the simulations are not
+ * timed, so the totals are lower bounds. The phases are:
+ *
+ *   model      the QM stand-in for all molecules
+ *   build      the dense polariton Hamiltonian
+ *   adiabatic  diag (arrowhead, else zheev), track, propagate (local
+ *              diabatization)
+ *   diabatic   propagate (Krylov on H_old + H)
+ *   diab_nh    the same with cavity losses
+ *   hybrid     diag, propagate and the rotations between the bases
+ *   hybrid_nh  the same with cavity losses
+ *   fft        propagate with the FFT Hamiltonian ($QED_FFT)
+ *   bright     states (decomposition and populations) and propagate in
+ *              the bright/dark basis ($QED_BRIGHT, -width, default 0.01)
+ *
+ * -rep selects the representations (default all). The table has the
+ * time per step of each phase and, in est(MB), an estimate of the
+ * memory the representation needs: it is not measured, but counted
+ * from the n x n arrays qm_gaussian.c allocates for it (rep_nsq), or
+ * the nmol x modes and nr x nr arrays of qed_bright.c. The measured
+ * peak of the whole run is printed at the end. The dense
+ * representations are skipped above -max <ndim> (default 3000).
+ */
+
+enum { erepADIA, erepDIA, erepDIANH, erepHYB, erepHYBNH, erepFFT, erepBRIGHT,
+       erepNR };
+static const char *rep_names[erepNR] = {
+  "adiabatic", "diabatic", "diab_nh", "hybrid", "hybrid_nh", "fft", "bright"
+};
+/* n x n complex arrays for the estimate: matrix, qm->matrix and
+ * qm->eigvec, plus those of do_adiabatic (eigvec, U and f of QEDFSSHop
+ * and the six of gmx_qed_work), do_diabatic* (expH, ham) and
+ * do_hybrid* (ten)
+ */
+static const int rep_nsq[erepNR] = { 3+9, 3+2, 3+2, 3+10, 3+10, 0, 0 };
+
+#define NQMATOMS 3
+#define KAPPA    1e-4   /* cavity loss rate (au) of the _nh variants */
+
+static double wallclock(void)
+{
+  struct timeval tv;
+
+  gettimeofday(&tv,NULL);
+  return tv.tv_sec+1e-6*tv.tv_usec;
+}
+
+static double peak_mb(void)
+{
+  struct rusage ru;
+
+  getrusage(RUSAGE_SELF,&ru);
+  return ru.ru_maxrss/1024.0;
+}
+
+static int parse_list(int argc, char *argv[], int *i, int *list)
+{
+  int n=0;
+
+  while (*i+1 < argc && argv[*i+1][0] != '-'){
+    list[n++] = atoi(argv[++(*i)]);
+  }
+  return n;
+}
+
+typedef struct {
+  int             nmol,nmodes,ndim;
+  t_QMrec         qm;
+  t_MMrec         mm;
+  rvec            *x0;         /* geometry of every molecule */
+  gmx_qed_model_t *model;
+  double          *E0,*E1,*g;  /* per molecule                */
+  double          *s,*diag;
+  dplx            *H,*Hold,*ham;
+} t_bench;
+
+/* moves every molecule a bit and evaluates the model, as the QM calls
+ * of the simulations do
+ */
+static void bench_model(t_bench *b, int step)
+{
+  rvec   grad[5*NQMATOMS],tdm,*gm=NULL;
+  double Eg;
+  int    m,i,d;
+
+  for (m=0; m<b->nmol; m++){
+    for (i=0; i<NQMATOMS; i++){
+      for (d=0; d<DIM; d++){
+        b->qm.xQM[i][d] = b->x0[m*NQMATOMS+i][d]
+          + 1e-3*sin(0.3*step+m+i+d);
+      }
+    }
+    b->E1[m] = qed_model_compute(b->model[m],&b->qm,&b->mm,
+                                 grad,gm,grad+NQMATOMS,gm,&tdm,
+                                 grad+2*NQMATOMS,grad+3*NQMATOMS,
+                                 grad+4*NQMATOMS,gm,gm,gm,&Eg);
+    b->E0[m] = Eg;
+    b->g[m]  = -(tdm[XX]*b->qm.E[XX]+tdm[YY]*b->qm.E[YY]+
+                 tdm[ZZ]*b->qm.E[ZZ])/norm(b->qm.E);
+  }
+}
+
+/* the diagonal and, for dense, the Hamiltonian as call_gaussian_QED */
+static void bench_build(t_bench *b, gmx_bool bDense)
+{
+  double sum=0;
+  int    m,j,n=b->ndim;
+  long   r;
+  dplx   c;
+
+  for (m=0; m<b->nmol; m++){
+    sum += b->E0[m];
+  }
+  for (m=0; m<b->nmol; m++){
+    b->diag[m] = sum+b->E1[m]-b->E0[m];
+  }
+  for (j=0; j<b->nmodes; j++){
+    b->diag[b->nmol+j] = sum+0.15+0.001*abs(j-b->nmodes/2);
+  }
+  if (!bDense){
+    return;
+  }
+  memcpy(b->Hold,b->H,n*n*sizeof(dplx));
+  memset(b->H,0,n*n*sizeof(dplx));
+  for (m=0; m<n; m++){
+    b->H[m*n+m] = b->diag[m];
+  }
+  for (m=0; m<b->nmol; m++){
+    for (j=0; j<b->nmodes; j++){
+      r = ((long)(j-b->nmodes/2)*m)%b->nmol;
+      if (r < 0){
+        r += b->nmol;
+      }
+      c = b->g[m]*b->s[j]*cexp(IMAG*2*M_PI*r/((double) b->nmol));
+      b->H[m*n+b->nmol+j]   = c;
+      b->H[(b->nmol+j)*n+m] = conj(c);
+    }
+  }
+}
+
+/* H_old + H, with the cavity losses on the photon states if bLoss */
+static void bench_ham(t_bench *b, gmx_bool bLoss)
+{
+  int i,n=b->ndim;
+
+  for (i=0; i<n*n; i++){
+    b->ham[i] = b->H[i]+b->Hold[i];
+  }
+  if (bLoss){
+    for (i=b->nmol; i<n; i++){
+      b->ham[i*n+i] -= IMAG*KAPPA;
+    }
+  }
+}
+
+int main(int argc,char *argv[])
+{
+  int              defmol[] = { 10, 100, 500, 1000, 2000 };
+  int              defmod[] = { 1, 11, 101 };
+  int              *nmols,*nmods,nnmol=0,nnmod=0,nsteps=3,maxdense=3000;
+  gmx_bool         bRep[erepNR];
+  int              i,j,im,ik,r,step,m,n,npol=0,*ndeg;
+  double           t0,tmodel,tbuild,t[3],mb,*w,*wold,width=0.01;
+  double           *photon,*pop;
+  dplx             *c,*V,*Vold,*U,*tmp;
+  gmx_qed_work_t   work;
+  gmx_qed_cavity_t cav;
+  gmx_qed_bright_t br;
+  t_bench          b;
+
+  snew(nmols,argc+asize(defmol));
+  snew(nmods,argc+asize(defmod));
+  for (r=0; r<erepNR; r++){
+    bRep[r] = TRUE;
+  }
+  for (i=1; i<argc; i++){
+    if (strcmp(argv[i],"-nmol") == 0){
+      nnmol = parse_list(argc,argv,&i,nmols);
+    }
+    else if (strcmp(argv[i],"-modes") == 0){
+      nnmod = parse_list(argc,argv,&i,nmods);
+    }
+    else if (strcmp(argv[i],"-steps") == 0 && i+1 < argc){
+      nsteps = atoi(argv[++i]);
+    }
+    else if (strcmp(argv[i],"-max") == 0 && i+1 < argc){
+      maxdense = atoi(argv[++i]);
+    }
+    else if (strcmp(argv[i],"-width") == 0 && i+1 < argc){
+      width = atof(argv[++i]);
+    }
+    else if (strcmp(argv[i],"-rep") == 0){
+      for (r=0; r<erepNR; r++){
+        bRep[r] = FALSE;
+      }
+      while (i+1 < argc && argv[i+1][0] != '-'){
+        i++;
+        for (r=0; r<erepNR && strcmp(argv[i],rep_names[r]); r++);
+        if (r == erepNR){
+          fprintf(stderr,"unknown representation %s\n",argv[i]);
+          return 1;
+        }
+        bRep[r] = TRUE;
+      }
+    }
+    else{
+      fprintf(stderr,"usage: %s [-nmol n ...] [-modes n ...] [-rep name ...] "
+              "[-steps n] [-max ndim] [-width au]\n",argv[0]);
+      return 1;
+    }
+  }
+  if (nnmol == 0){
+    for (i=0; i<asize(defmol); i++){
+      nmols[nnmol++] = defmol[i];
+    }
+  }
+  if (nnmod == 0){
+    for (i=0; i<asize(defmod); i++){
+      nmods[nnmod++] = defmod[i];
+    }
+  }
+
+  work = qed_work_init();
+  printf("%6s %6s %6s %-10s %10s %10s %10s %10s %10s %10s %9s\n",
+         "nmol","modes","ndim","rep","model(s)","build(s)","diag(s)",
+         "track(s)","prop(s)","rot(s)","est(MB)");
+  for (im=0; im<nnmol; im++){
+    for (ik=0; ik<nnmod; ik++){
+      memset(&b,0,sizeof(b));
+      b.nmol   = nmols[im];
+      b.nmodes = nmods[ik];
+      n = b.ndim = b.nmol+b.nmodes;
+      b.qm.nrQMatoms = NQMATOMS;
+      b.qm.E[ZZ]     = 1;
+      snew(b.qm.xQM,NQMATOMS);
+      snew(b.x0,b.nmol*NQMATOMS);
+      snew(b.model,b.nmol);
+      for (m=0; m<b.nmol; m++){
+        /* a bent triatomic, 0.1 nm bonds */
+        b.x0[m*NQMATOMS+1][XX] = 0.1;
+        b.x0[m*NQMATOMS+2][YY] = 0.1;
+        for (i=0; i<NQMATOMS; i++){
+          copy_rvec(b.x0[m*NQMATOMS+i],b.qm.xQM[i]);
+        }
+        b.model[m] = qed_model_init("sigma=0.005",m,&b.qm);
+      }
+      snew(b.E0,b.nmol);
+      snew(b.E1,b.nmol);
+      snew(b.g,b.nmol);
+      snew(b.s,b.nmodes);
+      for (j=0; j<b.nmodes; j++){
+        b.s[j] = 1e-3*sqrt(1+0.01*abs(j-b.nmodes/2));
+      }
+      snew(b.diag,n);
+      snew(c,n);
+      snew(w,n);
+      snew(wold,n);
+      snew(photon,n);
+      snew(pop,n);
+      snew(ndeg,n);
+      tmodel = tbuild = 0;
+      if (n <= maxdense){
+        snew(b.H,n*n);
+        snew(b.Hold,n*n);
+        snew(b.ham,n*n);
+      }
+
+      for (r=0; r<erepNR; r++){
+        if (!bRep[r] || (r != erepFFT && r != erepBRIGHT && n > maxdense)){
+          continue;
+        }
+        t[0] = t[1] = t[2] = 0;
+        V = Vold = U = tmp = NULL;
+        cav = NULL;
+        br  = NULL;
+        if (r == erepFFT){
+          cav = qed_cavity_init(b.nmol,-(b.nmodes/2),b.nmodes,b.s);
+        }
+        else if (r == erepBRIGHT){
+          br = qed_bright_init(b.nmol,-(b.nmodes/2),b.nmodes,b.s,width,work);
+        }
+        else if (r == erepADIA || r == erepHYB || r == erepHYBNH){
+          snew(V,n*n);
+          snew(Vold,n*n);
+          snew(U,n*n);
+          snew(tmp,n);
+        }
+        for (i=0; i<n; i++){
+          c[i] = (i == 0);
+        }
+        for (step=0; step<=nsteps; step++){
+          t0 = wallclock();
+          bench_model(&b,step);
+          if (step > 0){
+            tmodel += wallclock()-t0;
+          }
+          t0 = wallclock();
+          bench_build(&b,r != erepFFT && r != erepBRIGHT);
+          if (step > 0){
+            tbuild += wallclock()-t0;
+          }
+          if (cav){
+            qed_cavity_step(cav,b.diag,b.g);
+          }
+          if (br){
+            qed_bright_step(br,b.diag,b.g);
+          }
+          if (step == 0){
+            /* the first step only sets up the previous Hamiltonian */
+            if (V){
+              if (!qed_diag_arrowhead(n,b.nmol,wold,Vold,b.H)){
+                qed_zheev(work,n,wold,Vold,b.H);
+              }
+            }
+            continue;
+          }
+          t0 = wallclock();
+          if (V){
+            if (!qed_diag_arrowhead(n,b.nmol,w,V,b.H)){
+              qed_zheev(work,n,w,V,b.H);
+            }
+          }
+          if (br){
+            qed_bright_states(br,c,w,photon,pop,ndeg,&npol);
+          }
+          t[0] += wallclock()-t0;
+          t0 = wallclock();
+          switch (r){
+          case erepADIA:
+            qed_track_states(work,NULL,n,Vold,V,wold,w,0,TRUE);
+            t[1] += wallclock()-t0;
+            t0 = wallclock();
+            qed_propagate_local_dia(work,NULL,n,0.02,c,V,Vold,w,wold,U);
+            break;
+          case erepDIA:
+          case erepDIANH:
+            bench_ham(&b,r == erepDIANH);
+            qed_expv(work,n,b.ham,0.01,c);
+            break;
+          case erepHYB:
+          case erepHYBNH:
+            bench_ham(&b,r == erepHYBNH);
+            qed_expv(work,n,b.ham,0.01,c);
+            break;
+          case erepFFT:
+            qed_expv_op(work,n,qed_cavity_matvec_sum,cav,
+                        qed_cavity_shift(cav),0.01,c);
+            break;
+          case erepBRIGHT:
+            qed_bright_propagate(br,0.02,c);
+            break;
+          }
+          t[2] += wallclock()-t0;
+          if (r == erepHYB || r == erepHYBNH){
+            /* to the adiabatic basis and back, and the old rotation */
+            t0 = wallclock();
+            qed_zgemm('N','N',n,1,n,1,V,n,c,1,0,tmp,1);
+            qed_zgemm('C','N',n,1,n,1,V,n,tmp,1,0,c,1);
+            qed_zgemm('N','N',n,1,n,1,Vold,n,c,1,0,tmp,1);
+            t[1] += wallclock()-t0;
+          }
+          if (V){
+            memcpy(Vold,V,n*n*sizeof(dplx));
+            memcpy(wold,w,n*sizeof(double));
+          }
+        }
+        if (r == erepBRIGHT){
+          /* Q of both decompositions, the QR scratch, and V of both and
+           * the polariton matrix at the size of the last
+           */
+          mb = (4*(double)b.nmol*b.nmodes+3*(double)npol*npol)*sizeof(dplx)
+            /(1024*1024);
+        }
+        else{
+          mb = (rep_nsq[r]*(double)n*n*sizeof(dplx)
+                + (QED_EXPV_MMAX+8)*(double)n*sizeof(dplx))/(1024*1024);
+        }
+        printf("%6d %6d %6d %-10s %10.3e %10.3e %10.3e %10.3e %10.3e %10.3e %9.1f\n",
+               b.nmol,b.nmodes,n,rep_names[r],
+               tmodel/nsteps,(r == erepFFT || r == erepBRIGHT) ? 0 : tbuild/nsteps,
+               t[0]/nsteps,r == erepADIA ? t[1]/nsteps : 0,
+               t[2]/nsteps,
+               (r == erepHYB || r == erepHYBNH) ? t[1]/nsteps : 0,mb);
+        tmodel = tbuild = 0;
+        if (cav){
+          qed_cavity_done(cav);
+        }
+        if (br){
+          qed_bright_done(br);
+        }
+        sfree(V);
+        sfree(Vold);
+        sfree(U);
+        sfree(tmp);
+      }
+      for (m=0; m<b.nmol; m++){
+        qed_model_done(b.model[m]);
+      }
+      sfree(b.model);
+      sfree(b.x0);
+      sfree(b.qm.xQM);
+      sfree(b.E0);
+      sfree(b.E1);
+      sfree(b.g);
+      sfree(b.s);
+      sfree(b.diag);
+      sfree(b.H);
+      sfree(b.Hold);
+      sfree(b.ham);
+      sfree(c);
+      sfree(w);
+      sfree(wold);
+      sfree(photon);
+      sfree(pop);
+      sfree(ndeg);
+    }
+  }
+  printf("peak resident memory %.1f MB\n",peak_mb());
+  sfree(nmols);
+  sfree(nmods);
+
+  return 0;
+}
@@ -0,0 +1,484 @@
+/*
+ *
+ *                This source code is part of
+ *
+ *                 G   R   O   M   A   C   S
+ *
+ *          GROningen MAchine for Chemical Simulations
+ *
+ *                        VERSION 3.2.0
+ * Written by David van der Spoel, Erik Lindahl, Berk Hess, and others.
+ * Copyright (c) 1991-2000, University of Groningen, The Netherlands.
+ * Copyright (c) 2001-2004, The GROMACS development team,
+ * check out http://www.gromacs.org for more information.
+
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * If you want to redistribute modifications, please consider that
+ * scientific software is very special. Version control is crucial -
+ * bugs must be traceable. We will be happy to consider code for
+ * inclusion in the official distribution, but derived work must not
+ * be called official GROMACS. Details are found in the README & COPYING
+ * files - if they are missing, get the official version at www.gromacs.org.
+ *
+ * To help us fund GROMACS development, we humbly ask that you cite
+ * the papers on the package - you can find them in the top README file.
+ *
+ * For more info, check our website at http://www.gromacs.org
+ *
+ * And Hey:
+ * GROwing Monsters And Cloning Shrimps
+ */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#ifdef GMX_QMMM_GAUSSIAN
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "typedefs.h"
+#include "smalloc.h"
+#include "macros.h"
+#include "gmx_fatal.h"
+#include "qed_diag.h"
+#include "qed_bright.h"
+
+#include <complex.h>
+#ifdef I
+#undef I
+#endif
+#define IMAG _Complex_I
+
+/* The decomposition of one Hamiltonian. The reduced states are the
+ * bright combinations of all manifolds, followed by the modes.
+ */
+typedef struct {
+  gmx_bool bSet;
+  int      nclust;
+  int      *mol;    /* the molecules, ordered by manifold           */
+  int      *cstart; /* manifold c: mol[cstart[c]..cstart[c+1]-1]     */
+  double   *ec;     /* its energy, the mean of its molecules        */
+  int      *rstart; /* its reduced states rstart[c]..rstart[c+1]-1, */
+  int      *qoff;   /* the bright combinations, s x kr column major */
+  dplx     *Q;      /* at Q+qoff[c]                                 */
+  int      nr;      /* number of reduced states                     */
+  double   *w;      /* polariton energies, ascending                */
+  dplx     *V;      /* polariton p: V[p*nr+k] on the reduced states */
+} t_bright_dec;
+
+typedef struct {
+  double e;
+  int    i;
+} t_bright_sort;
+
+struct gmx_qed_bright {
+  int            nmol,nmodes,ndim;
+  double         width;
+  double         *s;          /* photon weights of the modes            */
+  int            *q;          /* (nmin+j) mod nmol                      */
+  double         *d,*g;       /* diagonal and couplings of the last step */
+  double         *dsum,*gsum; /* and summed with those of the step before */
+  gmx_bool       bSet;
+  gmx_bool       bSame;       /* the two steps are the same             */
+  t_bright_dec   dec[2];      /* of the mean of the two steps, the last */
+  gmx_qed_work_t work;
+  t_bright_sort  *order;
+  dplx           *A,*R,*H,*y,*z,*c;
+};
+
+static int bright_comp(const void *a, const void *b)
+{
+  const t_bright_sort
+    *sa=(const t_bright_sort *)a,*sb=(const t_bright_sort *)b;
+
+  if (sa->e < sb->e){
+    return -1;
+  }
+  if (sa->e > sb->e){
+    return 1;
+  }
+  return sa->i-sb->i;
+}
+
+gmx_qed_bright_t qed_bright_init(int nmol, int nmin, int nmodes,
+                                 const double *s, double width,
+                                 gmx_qed_work_t work)
+{
+  gmx_qed_bright_t br;
+  long             r;
+  int              j,k;
+
+  snew(br,1);
+  br->nmol   = nmol;
+  br->nmodes = nmodes;
+  br->ndim   = nmol+nmodes;
+  br->width  = width;
+  br->work   = work;
+  snew(br->s,nmodes);
+  snew(br->q,nmodes);
+  for (j=0; j<nmodes; j++){
+    br->s[j] = s[j];
+    r = (nmin+j)%nmol;
+    br->q[j] = r < 0 ? r+nmol : r;
+  }
+  snew(br->d,br->ndim);
+  snew(br->dsum,br->ndim);
+  snew(br->g,nmol);
+  snew(br->gsum,nmol);
+  for (k=0; k<2; k++){
+    snew(br->dec[k].mol,nmol);
+    snew(br->dec[k].cstart,nmol+1);
+    snew(br->dec[k].ec,nmol);
+    snew(br->dec[k].rstart,nmol+1);
+    snew(br->dec[k].qoff,nmol);
+    snew(br->dec[k].Q,nmol*nmodes);
+  }
+  snew(br->order,nmol);
+  snew(br->A,nmol*nmodes);
+  snew(br->R,nmol*nmodes);
+  snew(br->y,br->ndim);
+  snew(br->z,br->ndim);
+  snew(br->c,br->ndim);
+
+  return br;
+}
+
+void qed_bright_step(gmx_qed_bright_t br, const double *diag,
+                     const double *g)
+{
+  int
+    i;
+
+  br->bSame = (diag == NULL || !br->bSet);
+  if (diag == NULL){
+    /* the same Hamiltonian again */
+    diag = br->d;
+    g    = br->g;
+  }
+  for (i=0; i<br->ndim; i++){
+    br->dsum[i] = (br->bSet ? br->d[i] : diag[i]) + diag[i];
+  }
+  for (i=0; i<br->nmol; i++){
+    br->gsum[i] = (br->bSet ? br->g[i] : g[i]) + g[i];
+  }
+  if (diag != br->d){
+    memcpy(br->d,diag,br->ndim*sizeof(*diag));
+    memcpy(br->g,g,br->nmol*sizeof(*g));
+  }
+  br->bSet = TRUE;
+  br->dec[0].bSet = br->dec[1].bSet = FALSE;
+}
+
+/* Decomposes the Hamiltonian f (d, g): manifolds, their bright
+ * combinations and the polaritons
+ */
+static void bright_decompose(gmx_qed_bright_t br, t_bright_dec *dec,
+                             double f, const double *d, const double *g)
+{
+  int
+    nmol=br->nmol,K=br->nmodes,nb=0,qo=0,c,i0,i1,s,kr,j,k,n,m,nr;
+  long
+    r;
+  double
+    e;
+  dplx
+    *A=br->A,*H;
+
+  for (m=0; m<nmol; m++){
+    br->order[m].e = f*d[m];
+    br->order[m].i = m;
+  }
+  qsort(br->order,nmol,sizeof(br->order[0]),bright_comp);
+  dec->nclust = 0;
+  for (i0=0; i0<nmol; i0=i1){
+    for (i1=i0+1; i1<nmol && br->order[i1].e-br->order[i0].e <= br->width; i1++)
+      ;
+    s  = i1-i0;
+    kr = min(s,K);
+    c  = dec->nclust++;
+    e  = 0;
+    for (j=0; j<s; j++){
+      dec->mol[i0+j] = br->order[i0+j].i;
+      e += br->order[i0+j].e;
+    }
+    dec->cstart[c] = i0;
+    dec->ec[c]     = e/s;
+    dec->rstart[c] = nb;
+    dec->qoff[c]   = qo;
+    /* couplings of the manifold to the modes, the QR leaves those of
+     * its bright combinations in the triangle
+     */
+    for (n=0; n<K; n++){
+      for (j=0; j<s; j++){
+        m = dec->mol[i0+j];
+        r = ((long)br->q[n]*m)%nmol;
+        A[j+n*s] = f*g[m]*br->s[n]*cexp(IMAG*2*M_PI*r/((double) nmol));
+      }
+    }
+    qed_cluster_qr(s,K,kr,A,dec->Q+qo);
+    for (k=0; k<kr; k++){
+      for (n=0; n<K; n++){
+        br->R[(nb+k)*K+n] = (n >= k) ? A[k+n*s] : 0;
+      }
+    }
+    nb += kr;
+    qo += s*kr;
+  }
+  dec->cstart[dec->nclust] = nmol;
+  dec->rstart[dec->nclust] = nb;
+
+  /* the polariton problem, column major for qed_zheev, which then
+   * returns the eigenvectors in the columns of V
+   */
+  nr = dec->nr = nb+K;
+  srenew(br->H,nr*nr);
+  H = br->H;
+  memset(H,0,nr*nr*sizeof(*H));
+  for (c=0; c<dec->nclust; c++){
+    for (k=dec->rstart[c]; k<dec->rstart[c+1]; k++){
+      H[k+k*nr] = dec->ec[c];
+    }
+  }
+  for (n=0; n<K; n++){
+    H[(nb+n)*(nr+1)] = f*d[nmol+n];
+    for (k=0; k<nb; k++){
+      H[k+(nb+n)*nr] = br->R[k*K+n];
+      H[nb+n+k*nr]   = conj(br->R[k*K+n]);
+    }
+  }
+  srenew(dec->w,nr);
+  srenew(dec->V,nr*nr);
+  qed_zheev(br->work,nr,dec->w,dec->V,H);
+  dec->bSet = TRUE;
+}
+
+static t_bright_dec *bright_last(gmx_qed_bright_t br)
+{
+  if (!br->bSet){
+    gmx_incons("bright/dark decomposition before the first Hamiltonian");
+  }
+  if (!br->dec[1].bSet){
+    bright_decompose(br,&br->dec[1],1.0,br->d,br->g);
+  }
+  return &br->dec[1];
+}
+
+static t_bright_dec *bright_mean(gmx_qed_bright_t br)
+{
+  if (br->bSame){
+    return bright_last(br);
+  }
+  if (!br->dec[0].bSet){
+    bright_decompose(br,&br->dec[0],0.5,br->dsum,br->gsum);
+  }
+  return &br->dec[0];
+}
+
+/* y = the bright combinations and modes of c, and c keeps only the
+ * dark part on the molecules
+ */
+static void bright_split(gmx_qed_bright_t br, t_bright_dec *dec,
+                         dplx *c, dplx *y)
+{
+  int
+    cl,s,kr,j,k,n,nb=dec->rstart[dec->nclust],*mol;
+  dplx
+    a,*Q;
+
+  for (cl=0; cl<dec->nclust; cl++){
+    mol = dec->mol+dec->cstart[cl];
+    s   = dec->cstart[cl+1]-dec->cstart[cl];
+    kr  = dec->rstart[cl+1]-dec->rstart[cl];
+    Q   = dec->Q+dec->qoff[cl];
+    for (k=0; k<kr; k++){
+      a = 0;
+      for (j=0; j<s; j++){
+        a += conj(Q[j+k*s])*c[mol[j]];
+      }
+      y[dec->rstart[cl]+k] = a;
+      for (j=0; j<s; j++){
+        c[mol[j]] -= Q[j+k*s]*a;
+      }
+    }
+  }
+  for (n=0; n<br->nmodes; n++){
+    y[nb+n] = c[br->nmol+n];
+  }
+}
+
+/* the reverse of bright_split */
+static void bright_join(gmx_qed_bright_t br, t_bright_dec *dec,
+                        dplx *c, dplx *y)
+{
+  int
+    cl,s,kr,j,k,n,nb=dec->rstart[dec->nclust],*mol;
+  dplx
+    *Q;
+
+  for (cl=0; cl<dec->nclust; cl++){
+    mol = dec->mol+dec->cstart[cl];
+    s   = dec->cstart[cl+1]-dec->cstart[cl];
+    kr  = dec->rstart[cl+1]-dec->rstart[cl];
+    Q   = dec->Q+dec->qoff[cl];
+    for (k=0; k<kr; k++){
+      for (j=0; j<s; j++){
+        c[mol[j]] += Q[j+k*s]*y[dec->rstart[cl]+k];
+      }
+    }
+  }
+  for (n=0; n<br->nmodes; n++){
+    c[br->nmol+n] = y[nb+n];
+  }
+}
+
+/* z = V^H y, the polariton amplitudes */
+static void bright_project(t_bright_dec *dec, dplx *y, dplx *z)
+{
+  int
+    p,k,nr=dec->nr;
+  dplx
+    a,*v;
+
+  for (p=0; p<nr; p++){
+    v = dec->V+p*nr;
+    a = 0;
+    for (k=0; k<nr; k++){
+      a += conj(v[k])*y[k];
+    }
+    z[p] = a;
+  }
+}
+
+void qed_bright_propagate(gmx_qed_bright_t br, double dt, dplx *c)
+{
+  t_bright_dec
+    *dec=bright_mean(br);
+  int
+    cl,j,k,p,nr=dec->nr;
+  dplx
+    ph,*v,*y=br->y,*z=br->z;
+
+  bright_split(br,dec,c,y);
+  /* the dark combinations only change phase */
+  for (cl=0; cl<dec->nclust; cl++){
+    ph = cexp(-IMAG*dt*dec->ec[cl]);
+    for (j=dec->cstart[cl]; j<dec->cstart[cl+1]; j++){
+      c[dec->mol[j]] *= ph;
+    }
+  }
+  bright_project(dec,y,z);
+  for (k=0; k<nr; k++){
+    y[k] = 0;
+  }
+  for (p=0; p<nr; p++){
+    z[p] *= cexp(-IMAG*dt*dec->w[p]);
+    v = dec->V+p*nr;
+    for (k=0; k<nr; k++){
+      y[k] += v[k]*z[p];
+    }
+  }
+  bright_join(br,dec,c,y);
+}
+
+int qed_bright_states(gmx_qed_bright_t br, dplx *c, double *e,
+                      double *photon, double *pop, int *ndeg, int *npol)
+{
+  t_bright_dec
+    *dec=bright_last(br);
+  int
+    cl,j,k,p,n,nr=dec->nr,nb=dec->rstart[dec->nclust];
+  double
+    a;
+
+  memcpy(br->c,c,br->ndim*sizeof(*c));
+  bright_split(br,dec,br->c,br->y);
+  bright_project(dec,br->y,br->z);
+  for (p=0; p<nr; p++){
+    e[p]    = dec->w[p];
+    pop[p]  = creal(conj(br->z[p])*br->z[p]);
+    ndeg[p] = 1;
+    a = 0;
+    for (k=nb; k<nr; k++){
+      a += creal(conj(dec->V[p*nr+k])*dec->V[p*nr+k]);
+    }
+    photon[p] = a;
+  }
+  *npol = n = nr;
+  for (cl=0; cl<dec->nclust; cl++){
+    if (dec->cstart[cl+1]-dec->cstart[cl] == dec->rstart[cl+1]-dec->rstart[cl]){
+      continue;
+    }
+    a = 0;
+    for (j=dec->cstart[cl]; j<dec->cstart[cl+1]; j++){
+      a += creal(conj(br->c[dec->mol[j]])*br->c[dec->mol[j]]);
+    }
+    e[n]      = dec->ec[cl];
+    photon[n] = 0;
+    pop[n]    = a;
+    ndeg[n]   = (dec->cstart[cl+1]-dec->cstart[cl])-(dec->rstart[cl+1]-dec->rstart[cl]);
+    n++;
+  }
+  return n;
+}
+
+void qed_bright_weights(gmx_qed_bright_t br, dplx *c, double *w)
+{
+  t_bright_dec
+    *dec=bright_last(br);
+  int
+    cl,j;
+  double
+    a;
+
+  for (cl=0; cl<dec->nclust; cl++){
+    a = 0;
+    for (j=dec->cstart[cl]; j<dec->cstart[cl+1]; j++){
+      a += creal(conj(c[dec->mol[j]])*c[dec->mol[j]]);
+    }
+    a /= dec->cstart[cl+1]-dec->cstart[cl];
+    for (j=dec->cstart[cl]; j<dec->cstart[cl+1]; j++){
+      w[dec->mol[j]] = a;
+    }
+  }
+}
+
+void qed_bright_done(gmx_qed_bright_t br)
+{
+  int
+    k;
+
+  for (k=0; k<2; k++){
+    sfree(br->dec[k].mol);
+    sfree(br->dec[k].cstart);
+    sfree(br->dec[k].ec);
+    sfree(br->dec[k].rstart);
+    sfree(br->dec[k].qoff);
+    sfree(br->dec[k].Q);
+    sfree(br->dec[k].w);
+    sfree(br->dec[k].V);
+  }
+  sfree(br->s);
+  sfree(br->q);
+  sfree(br->d);
+  sfree(br->dsum);
+  sfree(br->g);
+  sfree(br->gsum);
+  sfree(br->order);
+  sfree(br->A);
+  sfree(br->R);
+  sfree(br->H);
+  sfree(br->y);
+  sfree(br->z);
+  sfree(br->c);
+  sfree(br);
+}
+
+#else
+int
+gmx_qed_bright_empty;
+#endif
@@ -0,0 +1,130 @@
+/*
+ *
+ *                This source code is part of
+ *
+ *                 G   R   O   M   A   C   S
+ *
+ *          GROningen MAchine for Chemical Simulations
+ *
+ *                        VERSION 3.2.0
+ * Written by David van der Spoel, Erik Lindahl, Berk Hess, and others.
+ * Copyright (c) 1991-2000, University of Groningen, The Netherlands.
+ * Copyright (c) 2001-2004, The GROMACS development team,
+ * check out http://www.gromacs.org for more information.
+
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * If you want to redistribute modifications, please consider that
+ * scientific software is very special. Version control is crucial -
+ * bugs must be traceable. We will be happy to consider code for
+ * inclusion in the official distribution, but derived work must not
+ * be called official GROMACS. Details are found in the README & COPYING
+ * files - if they are missing, get the official version at www.gromacs.org.
+ *
+ * To help us fund GROMACS development, we humbly ask that you cite
+ * the papers on the package - you can find them in the top README file.
+ *
+ * For more info, check our website at http://www.gromacs.org
+ *
+ * And Hey:
+ * Gallium Rubidium Oxygen Manganese Argon Carbon Silicon
+ */
+
+#ifndef _qed_bright_h
+#define _qed_bright_h
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "typedefs.h"
+#include "qed_linalg.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Bright/dark basis for the Ehrenfest dynamics in the adiabatic
+ * representation, $QED_BRIGHT. The Hamiltonian is that of qed_cavity.h,
+ * diagonal plus couplings g[m] s[j] exp(2 pi I k m/nmol), and is never
+ * formed. The molecules are grouped in manifolds of excitation energies
+ * within width of the lowest one, that all get the mean energy of the
+ * manifold. Of the s molecules of a manifold only min(s,nmodes)
+ * bright combinations couple to the modes; these and the modes span
+ * the polariton problem, nr = sum_c min(s_c,nmodes) + nmodes states,
+ * that is diagonalized densely. The s-min(s,nmodes) dark states of a
+ * manifold are degenerate and only enter through the part of the
+ * wavefunction in their span, the populated dark combination, which
+ * keeps its shape and only changes phase. Storage is O(ndim nmodes +
+ * nr^2) instead of O(ndim^2); nr is small for ensembles of (near)
+ * identical molecules, with width 0 and static disorder it is ndim.
+ *
+ * The wavefunction c stays in the diabatic basis, as in the diabatic
+ * representation, which is all the Ehrenfest forces need. Between
+ * steps it is propagated exactly in the mean of the Hamiltonians of
+ * the two steps, the populations of the polaritons and dark manifolds
+ * are those of the last step.
+ *
+ * The manifolds are a model, not a numerical approximation that
+ * converges: the dynamics is exact for the Hamiltonian with the
+ * molecular energies replaced by the means of their manifolds, which
+ * differ from the true ones by up to width. The grouping is made from
+ * scratch on every decomposition, greedily upwards from the lowest
+ * energy, so it is not continuous in the geometry: when a molecule
+ * crosses the edge of a window, it and possibly the molecules above
+ * it change manifold, their energies in the Hamiltonian jump by up to
+ * width, and so do the populations qed_bright_weights divides over
+ * the molecules, and with them the forces. The total energy then
+ * jumps as well. A smaller width makes the jumps and the energy error
+ * smaller, but gives more manifolds and a larger nr, up to ndim at
+ * width 0, where the dynamics is that of the full Hamiltonian. width
+ * should thus stay well below the collective coupling and the thermal
+ * fluctuations of the excitation energies, and the energy
+ * conservation of a run shows whether it does.
+ *
+ * $QED_BRIGHT is the width in Hartree.
+ */
+
+typedef struct gmx_qed_bright *gmx_qed_bright_t;
+
+gmx_qed_bright_t qed_bright_init(int nmol, int nmin, int nmodes,
+                                 const double *s, double width,
+                                 gmx_qed_work_t work);
+/* work is used for the diagonalizations, and not freed by
+ * qed_bright_done
+ */
+
+void qed_bright_step(gmx_qed_bright_t br, const double *diag,
+                     const double *g);
+/* Stores the Hamiltonian of a new QM step, as qed_cavity_step. The
+ * decompositions are made on the first call that needs them, so
+ * only where the dynamics is done.
+ */
+
+void qed_bright_propagate(gmx_qed_bright_t br, double dt, dplx *c);
+/* c = exp(-I dt H) c, H the mean of the last two steps, dt in au */
+
+int qed_bright_states(gmx_qed_bright_t br, dplx *c, double *e,
+                      double *photon, double *pop, int *ndeg, int *npol);
+/* Fills the energy, photon fraction and population in c of the npol
+ * polaritons of the last step, ascending, followed by those of the dark
+ * manifolds, with ndeg their number of states (1 for a polariton), and
+ * returns the total number. The arrays need ndim elements.
+ */
+
+void qed_bright_weights(gmx_qed_bright_t br, dplx *c, double *w);
+/* w[m] the excited state population of molecule m in the forces: the
+ * population of its manifold divided over its molecules, as they share
+ * its energy. With single molecule manifolds this is |c[m]|^2.
+ */
+
+void qed_bright_done(gmx_qed_bright_t br);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif	/* _qed_bright_h */
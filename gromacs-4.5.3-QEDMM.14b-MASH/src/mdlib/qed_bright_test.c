@@ -0,0 +1,246 @@
+/* -*- mode: c; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; c-file-style: "stroustrup"; -*-
+ * $Id: gmx_matrix.c,v 1.4 2008/12/02 18:27:57 spoel Exp $
+ * 
+ *                This source code is part of
+ * 
+ *                 G   R   O   M   A   C   S
+ * 
+ *          GROningen MAchine for Chemical Simulations
+ * 
+ *                        VERSION 4.5
+ * Written by David van der Spoel, Erik Lindahl, Berk Hess, and others.
+ * Copyright (c) 1991-2000, University of Groningen, The Netherlands.
+ * Copyright (c) 2001-2008, The GROMACS development team,
+ * check out http://www.gromacs.org for more information.
+ 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * If you want to redistribute modifications, please consider that
+ * scientific software is very special. Version control is crucial -
+ * bugs must be traceable. We will be happy to consider code for
+ * inclusion in the official distribution, but derived work must not
+ * be called official GROMACS. Details are found in the README & COPYING
+ * files - if they are missing, get the official version at www.gromacs.org.
+ * 
+ * To help us fund GROMACS development, we humbly ask that you cite
+ * the papers on the package - you can find them in the top README file.
+ * 
+ * For more info, check our website at http://www.gromacs.org
+ * 
+ * And Hey:
+ * Groningen Machine for Chemical Simulation
+ */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "smalloc.h"
+#include "macros.h"
+#include "qed_linalg.h"
+#include "qed_bright.h"
+
+#include <complex.h>
+#ifdef I
+#undef I
+#endif
+#define IMAG _Complex_I
+
+/* Checks the bright/dark basis of qed_bright.c against the dense
+ * exponential. Molecules in two groups of near identical energies and
+ * some with distinct ones, coupled to a few modes, are propagated over
+ * -steps (default 4) QM steps with qed_bright_propagate and with the
+ * exponential of the mean of the dense Hamiltonians of two steps,
+ * with the molecular energies replaced by the means of the manifolds
+ * as in qed_bright.c. With width 0 every molecule is a manifold of its
+ * own and this is the full Hamiltonian. For every step it reports the
+ * largest deviation of the two wavefunctions, and the deviations of
+ * the total population and the energy of qed_bright_states from the
+ * norm and the dense expectation value. Exits with 1 if any is above
+ * -tol (default 1e-10).
+ */
+
+#define NMOL   40
+#define NMODES 3
+#define NDIM   (NMOL+NMODES)
+
+typedef struct {
+  double e;
+  int    i;
+} t_sort;
+
+static int sort_comp(const void *a, const void *b)
+{
+  const t_sort *sa=a,*sb=b;
+
+  if (sa->e != sb->e){
+    return sa->e < sb->e ? -1 : 1;
+  }
+  return sa->i-sb->i;
+}
+
+/* the dense Hamiltonian (row major) of diagonal d and couplings g, the
+ * molecules grouped in manifolds within width as bright_decompose
+ */
+static void dense_ham(int nmin, const double *s, double width,
+                      const double *d, const double *g, dplx *H)
+{
+  t_sort order[NMOL];
+  int    i0,i1,j,m,n,q;
+  double e;
+  long   r;
+  dplx   b;
+
+  memset(H,0,NDIM*NDIM*sizeof(*H));
+  for (m=0; m<NMOL; m++){
+    order[m].e = d[m];
+    order[m].i = m;
+  }
+  qsort(order,NMOL,sizeof(order[0]),sort_comp);
+  for (i0=0; i0<NMOL; i0=i1){
+    e = 0;
+    for (i1=i0; i1<NMOL && order[i1].e-order[i0].e <= width; i1++){
+      e += order[i1].e;
+    }
+    for (j=i0; j<i1; j++){
+      m = order[j].i;
+      H[m*NDIM+m] = e/(i1-i0);
+    }
+  }
+  for (n=0; n<NMODES; n++){
+    H[(NMOL+n)*NDIM+NMOL+n] = d[NMOL+n];
+    q = ((nmin+n)%NMOL+NMOL)%NMOL;
+    for (m=0; m<NMOL; m++){
+      r = ((long)q*m)%NMOL;
+      b = g[m]*s[n]*cexp(IMAG*2*M_PI*r/((double) NMOL));
+      H[m*NDIM+NMOL+n] = b;
+      H[(NMOL+n)*NDIM+m] = conj(b);
+    }
+  }
+}
+
+/* c = exp(-I dt H) c through the eigenpairs of H */
+static void dense_expv(gmx_qed_work_t work, dplx *H, double dt, dplx *c)
+{
+  double w[NDIM];
+  dplx   V[NDIM*NDIM],z[NDIM];
+  int    i,k;
+
+  qed_zheev(work,NDIM,w,V,H);
+  /* row i of V is the conjugate of eigenvector i */
+  for (i=0; i<NDIM; i++){
+    z[i] = 0;
+    for (k=0; k<NDIM; k++){
+      z[i] += V[i*NDIM+k]*c[k];
+    }
+    z[i] *= cexp(-IMAG*dt*w[i]);
+  }
+  for (k=0; k<NDIM; k++){
+    c[k] = 0;
+    for (i=0; i<NDIM; i++){
+      c[k] += conj(V[i*NDIM+k])*z[i];
+    }
+  }
+}
+
+int main(int argc,char *argv[])
+{
+  static const double widths[] = { 2e-3, 0 };
+  static const double s[NMODES] = { 0.01, 0.012, 0.011 };
+  int            nmin=-1,nsteps=4,w,i,k,m,step,ns,npol,nfail=0;
+  int            ndeg[NDIM];
+  double         tol=1e-10,dt=5,width,base,err,dpop,dener,norm,tp,te;
+  double         d[2][NDIM],g[2][NMOL],dm[NDIM],gm[NMOL];
+  double         e[NDIM],photon[NDIM],pop[NDIM];
+  dplx           c[NDIM],cd[NDIM],*H,y;
+  gmx_qed_work_t work;
+  gmx_qed_bright_t br;
+
+  for (i=1; i<argc; i++){
+    if (strcmp(argv[i],"-tol") == 0 && i+1 < argc){
+      tol = strtod(argv[++i],NULL);
+    }
+    else if (strcmp(argv[i],"-steps") == 0 && i+1 < argc){
+      nsteps = strtol(argv[++i],NULL,10);
+    }
+  }
+  work = qed_work_init();
+  snew(H,NDIM*NDIM);
+
+  printf("%8s %4s %6s %6s %10s %10s %10s\n","width","step","npol",
+         "states","dev c","dev pop","dev E");
+  for (w=0; w<asize(widths); w++){
+    width = widths[w];
+    srand48(1);
+    br = qed_bright_init(NMOL,nmin,NMODES,s,width,work);
+    for (i=0; i<NDIM; i++){
+      c[i]  = (drand48()-0.5)+IMAG*(drand48()-0.5);
+      cd[i] = c[i];
+    }
+    for (step=0; step<=nsteps; step++){
+      /* two groups of near identical molecules, the rest distinct,
+       * with small changes from step to step
+       */
+      for (m=0; m<NMOL; m++){
+        base = (m%3 == 0) ? 0.10 : ((m%3 == 1) ? 0.12 : 0.2+0.01*m);
+        d[step%2][m] = base+1e-4*(drand48()-0.5);
+        g[step%2][m] = 1+0.3*(drand48()-0.5);
+      }
+      for (k=0; k<NMODES; k++){
+        d[step%2][NMOL+k] = 0.11+0.005*k;
+      }
+      qed_bright_step(br,d[step%2],g[step%2]);
+      if (step > 0){
+        for (i=0; i<NDIM; i++){
+          dm[i] = 0.5*(d[0][i]+d[1][i]);
+        }
+        for (m=0; m<NMOL; m++){
+          gm[m] = 0.5*(g[0][m]+g[1][m]);
+        }
+        qed_bright_propagate(br,dt,c);
+        dense_ham(nmin,s,width,dm,gm,H);
+        dense_expv(work,H,dt,cd);
+      }
+      for (i=0,err=0; i<NDIM; i++){
+        err = max(err,cabs(c[i]-cd[i]));
+      }
+      /* the polaritons and dark manifolds of the last step */
+      ns = qed_bright_states(br,c,e,photon,pop,ndeg,&npol);
+      for (i=0,tp=0,te=0; i<ns; i++){
+        tp += pop[i];
+        te += e[i]*pop[i];
+      }
+      dense_ham(nmin,s,width,d[step%2],g[step%2],H);
+      for (i=0,norm=0,dener=0; i<NDIM; i++){
+        norm += creal(conj(c[i])*c[i]);
+        y = 0;
+        for (k=0; k<NDIM; k++){
+          y += H[i*NDIM+k]*c[k];
+        }
+        dener += creal(conj(c[i])*y);
+      }
+      dpop  = fabs(tp-norm);
+      dener = fabs(te-dener);
+      printf("%8.1e %4d %6d %6d %10.2e %10.2e %10.2e\n",width,step,npol,ns,
+             err,dpop,dener);
+      if (err > tol || dpop > tol || dener > tol){
+        nfail++;
+      }
+    }
+    qed_bright_done(br);
+  }
+  sfree(H);
+  if (nfail > 0){
+    printf("FAILED: %d steps\n",nfail);
+    return 1;
+  }
+  printf("passed\n");
+
+  return 0;
+}
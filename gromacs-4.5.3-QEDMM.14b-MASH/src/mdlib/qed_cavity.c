@@ -0,0 +1,332 @@
+/*
+ *
+ *                This source code is part of
+ *
+ *                 G   R   O   M   A   C   S
+ *
+ *          GROningen MAchine for Chemical Simulations
+ *
+ *                        VERSION 3.2.0
+ * Written by David van der Spoel, Erik Lindahl, Berk Hess, and others.
+ * Copyright (c) 1991-2000, University of Groningen, The Netherlands.
+ * Copyright (c) 2001-2004, The GROMACS development team,
+ * check out http://www.gromacs.org for more information.
+
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * If you want to redistribute modifications, please consider that
+ * scientific software is very special. Version control is crucial -
+ * bugs must be traceable. We will be happy to consider code for
+ * inclusion in the official distribution, but derived work must not
+ * be called official GROMACS. Details are found in the README & COPYING
+ * files - if they are missing, get the official version at www.gromacs.org.
+ *
+ * To help us fund GROMACS development, we humbly ask that you cite
+ * the papers on the package - you can find them in the top README file.
+ *
+ * For more info, check our website at http://www.gromacs.org
+ *
+ * And Hey:
+ * GROwing Monsters And Cloning Shrimps
+ */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <math.h>
+#include <string.h>
+#include "typedefs.h"
+#include "smalloc.h"
+#include "gmx_fatal.h"
+#include "qed_cavity.h"
+
+#include <complex.h>
+#ifdef I
+#undef I
+#endif
+#define IMAG _Complex_I
+
+/* Complex FFT of length n in double precision, whatever the precision
+ * of gmx_fft: radix 2 for a power of 2, otherwise through Bluestein's
+ * chirp convolution of length m >= 2n-1, a power of 2.
+ */
+typedef struct {
+  int  n,m;
+  dplx *tw;     /* exp(-2 pi I k/m), k < m/2                         */
+  dplx *chirp;  /* exp(-pi I k^2/n), k < n; NULL when m == n          */
+  dplx *b;      /* forward transform of the conjugate chirp, m        */
+  dplx *a;      /* work, m                                            */
+} t_cavity_fft;
+
+/* in place, unnormalized, exp(sign 2 pi I jk/m) */
+static void fft_radix2(int m, dplx *tw, dplx *a, int sign)
+{
+  int  i,j,k,len,half,step;
+  dplx t,w;
+
+  for (i=1,j=0; i<m; i++){
+    for (k=m>>1; j & k; k>>=1){
+      j ^= k;
+    }
+    j ^= k;
+    if (i < j){
+      t = a[i]; a[i] = a[j]; a[j] = t;
+    }
+  }
+  for (len=2; len<=m; len<<=1){
+    half = len>>1;
+    step = m/len;
+    for (i=0; i<m; i+=len){
+      for (k=0; k<half; k++){
+        w = sign < 0 ? tw[k*step] : conj(tw[k*step]);
+        t = w*a[i+k+half];
+        a[i+k+half] = a[i+k]-t;
+        a[i+k]     += t;
+      }
+    }
+  }
+}
+
+static void fft_init(t_cavity_fft *fft, int n)
+{
+  int  k;
+  long k2;
+
+  fft->n = n;
+  for (fft->m=1; fft->m<n; fft->m<<=1)
+    ;
+  if (fft->m != n){
+    for (fft->m=1; fft->m<2*n-1; fft->m<<=1)
+      ;
+  }
+  snew(fft->tw,fft->m > 1 ? fft->m/2 : 1);
+  for (k=0; k<fft->m/2; k++){
+    fft->tw[k] = cexp(-IMAG*2*M_PI*k/fft->m);
+  }
+  snew(fft->a,fft->m);
+  if (fft->m != n){
+    snew(fft->chirp,n);
+    snew(fft->b,fft->m);
+    for (k=0; k<n; k++){
+      /* k^2 mod 2n keeps the phase exact for large k */
+      k2 = ((long)k*k) % (2L*n);
+      fft->chirp[k] = cexp(-IMAG*M_PI*k2/n);
+      fft->b[k]     = conj(fft->chirp[k]);
+      if (k > 0){
+        fft->b[fft->m-k] = fft->b[k];
+      }
+    }
+    fft_radix2(fft->m,fft->tw,fft->b,-1);
+  }
+}
+
+/* y = sum_j x[j] exp(sign 2 pi I jk/n), sign -1 forward, +1 backward */
+static void fft_do(t_cavity_fft *fft, int sign, dplx *x, dplx *y)
+{
+  int  k,n=fft->n,m=fft->m;
+  dplx *a=fft->a;
+
+  if (m == n){
+    memcpy(a,x,n*sizeof(*a));
+    fft_radix2(m,fft->tw,a,sign);
+    memcpy(y,a,n*sizeof(*a));
+    return;
+  }
+  /* backward is the conjugate of the forward transform of conj(x) */
+  for (k=0; k<n; k++){
+    a[k] = (sign < 0 ? x[k] : conj(x[k]))*fft->chirp[k];
+  }
+  for (k=n; k<m; k++){
+    a[k] = 0;
+  }
+  fft_radix2(m,fft->tw,a,-1);
+  for (k=0; k<m; k++){
+    a[k] *= fft->b[k];
+  }
+  fft_radix2(m,fft->tw,a,1);
+  for (k=0; k<n; k++){
+    y[k] = fft->chirp[k]*a[k]/m;
+    if (sign > 0){
+      y[k] = conj(y[k]);
+    }
+  }
+}
+
+static void fft_done(t_cavity_fft *fft)
+{
+  sfree(fft->tw);
+  sfree(fft->chirp);
+  sfree(fft->b);
+  sfree(fft->a);
+}
+
+struct gmx_qed_cavity {
+  int       nmol,nmodes,ndim;
+  double    *s;         /* photon weights of the modes               */
+  int       *q;         /* (nmin+j) mod nmol, the Fourier index of j,
+                         * exact for large nmin+j
+                         */
+  double    *d,*g;      /* diagonal and couplings of the last step   */
+  double    *dsum,*gsum;/* and summed with those of the step before  */
+  gmx_bool  bSet;
+  t_cavity_fft fft;
+  dplx      *z,*zt;     /* FFT in- and output, nmol                  */
+};
+
+gmx_qed_cavity_t qed_cavity_init(int nmol, int nmin, int nmodes,
+                                 const double *s)
+{
+  gmx_qed_cavity_t cav;
+  long             r;
+  int              j;
+
+  snew(cav,1);
+  cav->nmol   = nmol;
+  cav->nmodes = nmodes;
+  cav->ndim   = nmol+nmodes;
+  snew(cav->s,nmodes);
+  snew(cav->q,nmodes);
+  for (j=0; j<nmodes; j++){
+    cav->s[j] = s[j];
+    r = (nmin+j)%nmol;
+    cav->q[j] = r < 0 ? r+nmol : r;
+  }
+  snew(cav->d,cav->ndim);
+  snew(cav->dsum,cav->ndim);
+  snew(cav->g,nmol);
+  snew(cav->gsum,nmol);
+  snew(cav->z,nmol);
+  snew(cav->zt,nmol);
+  fft_init(&cav->fft,nmol);
+
+  return cav;
+}
+
+void qed_cavity_step(gmx_qed_cavity_t cav, const double *diag,
+                     const double *g)
+{
+  int
+    i;
+
+  if (diag == NULL){
+    /* the same Hamiltonian again */
+    diag = cav->d;
+    g    = cav->g;
+  }
+  for (i=0; i<cav->ndim; i++){
+    cav->dsum[i] = (cav->bSet ? cav->d[i] : diag[i]) + diag[i];
+  }
+  for (i=0; i<cav->nmol; i++){
+    cav->gsum[i] = (cav->bSet ? cav->g[i] : g[i]) + g[i];
+  }
+  if (diag != cav->d){
+    memcpy(cav->d,diag,cav->ndim*sizeof(*diag));
+    memcpy(cav->g,g,cav->nmol*sizeof(*g));
+  }
+  cav->bSet = TRUE;
+}
+
+/* y = H x for the diagonal d and couplings g */
+static void cavity_apply(gmx_qed_cavity_t cav, double *d, double *g,
+                         dplx *x, dplx *y)
+{
+  int
+    j,m,nmol=cav->nmol;
+  dplx
+    *xp=x+nmol,*yp=y+nmol;
+
+  for (j=0; j<cav->ndim; j++){
+    y[j] = d[j]*x[j];
+  }
+  /* molecules: sum_j s[j] xp[j] exp(2 pi I (nmin+j) m/nmol), the
+   * backward transform of the modes folded onto their Fourier index
+   */
+  for (m=0; m<nmol; m++){
+    cav->z[m] = 0;
+  }
+  for (j=0; j<cav->nmodes; j++){
+    cav->z[cav->q[j]] += cav->s[j]*xp[j];
+  }
+  fft_do(&cav->fft,1,cav->z,cav->zt);
+  for (m=0; m<nmol; m++){
+    y[m] += g[m]*cav->zt[m];
+  }
+  /* modes: s[j] sum_m g[m] x[m] exp(-2 pi I (nmin+j) m/nmol), the
+   * forward transform of the molecules at the Fourier index of j
+   */
+  for (m=0; m<nmol; m++){
+    cav->z[m] = g[m]*x[m];
+  }
+  fft_do(&cav->fft,-1,cav->z,cav->zt);
+  for (j=0; j<cav->nmodes; j++){
+    yp[j] += cav->s[j]*cav->zt[cav->q[j]];
+  }
+}
+
+void qed_cavity_matvec(void *op, int n, dplx *x, dplx *y)
+{
+  gmx_qed_cavity_t
+    cav=(gmx_qed_cavity_t)op;
+
+  if (n != cav->ndim){
+    gmx_incons("cavity Hamiltonian applied to a vector of the wrong size");
+  }
+  cavity_apply(cav,cav->d,cav->g,x,y);
+}
+
+void qed_cavity_matvec_sum(void *op, int n, dplx *x, dplx *y)
+{
+  gmx_qed_cavity_t
+    cav=(gmx_qed_cavity_t)op;
+
+  if (n != cav->ndim){
+    gmx_incons("cavity Hamiltonian applied to a vector of the wrong size");
+  }
+  cavity_apply(cav,cav->dsum,cav->gsum,x,y);
+}
+
+double qed_cavity_shift(gmx_qed_cavity_t cav)
+{
+  int
+    i;
+  double
+    shift=0;
+
+  for (i=0; i<cav->ndim; i++){
+    shift += cav->dsum[i];
+  }
+  return shift/cav->ndim;
+}
+
+dplx qed_cavity_expect(gmx_qed_cavity_t cav, dplx *c)
+{
+  int
+    i;
+  dplx
+    e=0,*hc;
+
+  snew(hc,cav->ndim);
+  cavity_apply(cav,cav->d,cav->g,c,hc);
+  for (i=0; i<cav->ndim; i++){
+    e += conj(c[i])*hc[i];
+  }
+  sfree(hc);
+  return e;
+}
+
+void qed_cavity_done(gmx_qed_cavity_t cav)
+{
+  fft_done(&cav->fft);
+  sfree(cav->s);
+  sfree(cav->q);
+  sfree(cav->d);
+  sfree(cav->dsum);
+  sfree(cav->g);
+  sfree(cav->gsum);
+  sfree(cav->z);
+  sfree(cav->zt);
+  sfree(cav);
+}
@@ -0,0 +1,98 @@
+/*
+ *
+ *                This source code is part of
+ *
+ *                 G   R   O   M   A   C   S
+ *
+ *          GROningen MAchine for Chemical Simulations
+ *
+ *                        VERSION 3.2.0
+ * Written by David van der Spoel, Erik Lindahl, Berk Hess, and others.
+ * Copyright (c) 1991-2000, University of Groningen, The Netherlands.
+ * Copyright (c) 2001-2004, The GROMACS development team,
+ * check out http://www.gromacs.org for more information.
+
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * If you want to redistribute modifications, please consider that
+ * scientific software is very special. Version control is crucial -
+ * bugs must be traceable. We will be happy to consider code for
+ * inclusion in the official distribution, but derived work must not
+ * be called official GROMACS. Details are found in the README & COPYING
+ * files - if they are missing, get the official version at www.gromacs.org.
+ *
+ * To help us fund GROMACS development, we humbly ask that you cite
+ * the papers on the package - you can find them in the top README file.
+ *
+ * For more info, check our website at http://www.gromacs.org
+ *
+ * And Hey:
+ * Gallium Rubidium Oxygen Manganese Argon Carbon Silicon
+ */
+
+#ifndef _qed_cavity_h
+#define _qed_cavity_h
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "typedefs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* The diabatic polariton Hamiltonian without forming it. Of the ndim =
+ * nmol+nmodes states, the first nmol (one molecule excited) only couple
+ * to the last nmodes (one photon in mode k = nmin+j), through
+ *
+ *   H[m][nmol+j] = g[m] s[j] exp(2 pi I k m/nmol) = conj(H[nmol+j][m])
+ *
+ * with g[m] = -tdm.u of molecule m and s[j] = sqrt(omega_k/V0_2EP), see
+ * cavity_factors() in qm_gaussian.c. The sums over m and over j in a
+ * product with this block are discrete Fourier transforms of length
+ * nmol, so H x costs O(ndim log nmol) instead of O(ndim^2), and the
+ * storage is O(ndim). The transforms are done in double precision, also
+ * in a mixed precision build, as the dense products.
+ *
+ * The record keeps the Hamiltonian of the last two QM steps, for the
+ * interpolation of the diabatic propagator.
+ */
+
+typedef struct gmx_qed_cavity *gmx_qed_cavity_t;
+
+gmx_qed_cavity_t qed_cavity_init(int nmol, int nmin, int nmodes,
+                                 const double *s);
+
+void qed_cavity_step(gmx_qed_cavity_t cav, const double *diag,
+                     const double *g);
+/* Stores the Hamiltonian of a new QM step, diag (ndim) on the diagonal
+ * and the couplings g (nmol). The first call also sets the previous
+ * step. With diag NULL the last Hamiltonian is kept for another step.
+ */
+
+void qed_cavity_matvec(void *cav, int n, dplx *x, dplx *y);
+/* y = H x, H of the last step. A qed_matvec_t. */
+
+void qed_cavity_matvec_sum(void *cav, int n, dplx *x, dplx *y);
+/* y = (H_old + H) x with the two last steps, the interpolated
+ * Hamiltonian the diabatic propagators use
+ */
+
+double qed_cavity_shift(gmx_qed_cavity_t cav);
+/* The mean of the diagonal of H_old + H, for qed_expv_op */
+
+dplx qed_cavity_expect(gmx_qed_cavity_t cav, dplx *c);
+/* <c|H|c> with H of the last step */
+
+void qed_cavity_done(gmx_qed_cavity_t cav);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif	/* _qed_cavity_h */
@@ -0,0 +1,235 @@
+/* -*- mode: c; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; c-file-style: "stroustrup"; -*-
+ * $Id: gmx_matrix.c,v 1.4 2008/12/02 18:27:57 spoel Exp $
+ * 
+ *                This source code is part of
+ * 
+ *                 G   R   O   M   A   C   S
+ * 
+ *          GROningen MAchine for Chemical Simulations
+ * 
+ *                        VERSION 4.5
+ * Written by David van der Spoel, Erik Lindahl, Berk Hess, and others.
+ * Copyright (c) 1991-2000, University of Groningen, The Netherlands.
+ * Copyright (c) 2001-2008, The GROMACS development team,
+ * check out http://www.gromacs.org for more information.
+ 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * If you want to redistribute modifications, please consider that
+ * scientific software is very special. Version control is crucial -
+ * bugs must be traceable. We will be happy to consider code for
+ * inclusion in the official distribution, but derived work must not
+ * be called official GROMACS. Details are found in the README & COPYING
+ * files - if they are missing, get the official version at www.gromacs.org.
+ * 
+ * To help us fund GROMACS development, we humbly ask that you cite
+ * the papers on the package - you can find them in the top README file.
+ * 
+ * For more info, check our website at http://www.gromacs.org
+ * 
+ * And Hey:
+ * Groningen Machine for Chemical Simulation
+ */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include "smalloc.h"
+#include "macros.h"
+#include "qed_linalg.h"
+#include "qed_cavity.h"
+
+#include <complex.h>
+#ifdef I
+#undef I
+#endif
+#define IMAG _Complex_I
+
+/* Micro-benchmark of the FFT polariton Hamiltonian of qed_cavity.c
+ * against the dense matrix call_gaussian_QED() builds. For each number
+ * of molecules on the command line (default 10 ... 20000) and -modes
+ * <nmodes> cavity modes (default 101, centered on k=0) it sets up a
+ * random diagonal and couplings, and reports the time of a product
+ * with H and of a Krylov step, and the largest deviation of both from
+ * the dense versions. The dense reference is skipped above -ref
+ * <ndim> (default 4000). The FFT is done in double precision also in a
+ * mixed precision build, so the test fails when the product deviates
+ * by more than -tol (default 1e-10) from the dense one.
+ */
+
+static double wallclock(void)
+{
+  struct timeval tv;
+
+  gettimeofday(&tv,NULL);
+  return tv.tv_sec+1e-6*tv.tv_usec;
+}
+
+/* as call_gaussian_QED() and cavity_factors() */
+static void dense_ham(int nmol, int nmin, int nmodes, double *s,
+                      double *d, double *g, dplx *H)
+{
+  int  ndim=nmol+nmodes,k,j;
+  long r;
+  dplx c;
+
+  memset(H,0,ndim*ndim*sizeof(*H));
+  for (k=0; k<ndim; k++){
+    H[k*ndim+k] = d[k];
+  }
+  for (k=0; k<nmol; k++){
+    for (j=0; j<nmodes; j++){
+      r = ((long)(nmin+j)*k)%nmol;
+      if (r < 0){
+        r += nmol;
+      }
+      c = g[k]*s[j]*cexp(IMAG*2*M_PI*r/((double) nmol));
+      H[k*ndim+nmol+j]    = c;
+      H[(nmol+j)*ndim+k]  = conj(c);
+    }
+  }
+}
+
+static double maxdev(int n, dplx *a, dplx *b)
+{
+  double dev=0;
+  int    i;
+
+  for (i=0; i<n; i++){
+    dev = max(dev,cabs(a[i]-b[i]));
+  }
+  return dev;
+}
+
+int main(int argc,char *argv[])
+{
+  int              def[] = { 10, 100, 1000, 2000, 5000, 10000, 20000 };
+  int              i,s,n,ndim,nmodes=101,nmin,refmax=4000,nsize=0,*size;
+  int              nrep;
+  double           *w,*d,*g,*d2,*g2,t0,tf,td,tkf,tkd,devmv,devkv,tau=0.05;
+  double           tol=1e-10,worst=0;
+  dplx             *H,*H2,*x,*yf,*yd,*vf,*vd;
+  gmx_qed_cavity_t cav;
+  gmx_qed_work_t   work;
+
+  snew(size,argc+asize(def));
+  for (i=1; i<argc; i++){
+    if (strcmp(argv[i],"-ref") == 0 && i+1 < argc){
+      refmax = atoi(argv[++i]);
+    }
+    else if (strcmp(argv[i],"-modes") == 0 && i+1 < argc){
+      nmodes = atoi(argv[++i]);
+    }
+    else if (strcmp(argv[i],"-tol") == 0 && i+1 < argc){
+      tol = atof(argv[++i]);
+    }
+    else{
+      size[nsize++] = atoi(argv[i]);
+    }
+  }
+  if (nsize == 0){
+    for (i=0; i<asize(def); i++){
+      size[nsize++] = def[i];
+    }
+  }
+  nmin = -(nmodes/2);
+  work = qed_work_init();
+  snew(w,nmodes);
+  for (i=0; i<nmodes; i++){
+    w[i] = 1+0.1*sqrt(1.0+i);
+  }
+  printf("%8s %8s %12s %12s %12s %12s %10s %10s\n","nmol","ndim",
+         "Hx fft (s)","Hx dense (s)","expv fft(s)","expv dns(s)",
+         "dev Hx","dev expv");
+  for (s=0; s<nsize; s++){
+    n    = size[s];
+    ndim = n+nmodes;
+    snew(d,ndim);
+    snew(d2,ndim);
+    snew(g,n);
+    snew(g2,n);
+    snew(x,ndim);
+    snew(yf,ndim);
+    snew(yd,ndim);
+    snew(vf,ndim);
+    snew(vd,ndim);
+    for (i=0; i<ndim; i++){
+      d[i]  = -100+0.01*rand()/RAND_MAX;
+      d2[i] = d[i]+1e-4*rand()/RAND_MAX;
+      x[i]  = (rand()-0.5*RAND_MAX+IMAG*(rand()-0.5*RAND_MAX))/RAND_MAX;
+    }
+    for (i=0; i<n; i++){
+      g[i]  = 0.01*(rand()-0.5*RAND_MAX)/RAND_MAX;
+      g2[i] = g[i]+1e-4*rand()/RAND_MAX;
+    }
+    cav = qed_cavity_init(n,nmin,nmodes,w);
+    qed_cavity_step(cav,d,g);
+    qed_cavity_step(cav,d2,g2);
+
+    nrep = max(1,100000/ndim);
+    t0 = wallclock();
+    for (i=0; i<nrep; i++){
+      qed_cavity_matvec(cav,ndim,x,yf);
+    }
+    tf = (wallclock()-t0)/nrep;
+    memcpy(vf,x,ndim*sizeof(*x));
+    t0 = wallclock();
+    qed_expv_op(work,ndim,qed_cavity_matvec_sum,cav,qed_cavity_shift(cav),
+                tau,vf);
+    tkf = wallclock()-t0;
+
+    td = tkd = devmv = devkv = -1;
+    if (ndim <= refmax){
+      snew(H,ndim*ndim);
+      snew(H2,ndim*ndim);
+      dense_ham(n,nmin,nmodes,w,d2,g2,H);
+      t0 = wallclock();
+      for (i=0; i<nrep; i++){
+        qed_zgemm('N','N',ndim,1,ndim,1,H,ndim,x,1,0,yd,1);
+      }
+      td = (wallclock()-t0)/nrep;
+      devmv = maxdev(ndim,yf,yd);
+      worst = max(worst,devmv);
+      /* the diabatic propagators use H_old + H */
+      dense_ham(n,nmin,nmodes,w,d,g,H2);
+      for (i=0; i<ndim*ndim; i++){
+        H2[i] += H[i];
+      }
+      memcpy(vd,x,ndim*sizeof(*x));
+      t0 = wallclock();
+      qed_expv(work,ndim,H2,tau,vd);
+      tkd = wallclock()-t0;
+      devkv = maxdev(ndim,vf,vd);
+      sfree(H);
+      sfree(H2);
+    }
+    printf("%8d %8d %12.3e %12.3e %12.3e %12.3e %10.2e %10.2e\n",n,ndim,
+           tf,td,tkf,tkd,devmv,devkv);
+    qed_cavity_done(cav);
+    sfree(d);
+    sfree(d2);
+    sfree(g);
+    sfree(g2);
+    sfree(x);
+    sfree(yf);
+    sfree(yd);
+    sfree(vf);
+    sfree(vd);
+  }
+
+  if (worst > tol){
+    printf("FAILED: H x deviates by %g from the dense product\n",worst);
+    return 1;
+  }
+  printf("passed\n");
+
+  return 0;
+}
@@ -0,0 +1,737 @@
+/*
+ *
+ *                This source code is part of
+ *
+ *                 G   R   O   M   A   C   S
+ *
+ *          GROningen MAchine for Chemical Simulations
+ *
+ *                        VERSION 3.2.0
+ * Written by David van der Spoel, Erik Lindahl, Berk Hess, and others.
+ * Copyright (c) 1991-2000, University of Groningen, The Netherlands.
+ * Copyright (c) 2001-2004, The GROMACS development team,
+ * check out http://www.gromacs.org for more information.
+
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * If you want to redistribute modifications, please consider that
+ * scientific software is very special. Version control is crucial -
+ * bugs must be traceable. We will be happy to consider code for
+ * inclusion in the official distribution, but derived work must not
+ * be called official GROMACS. Details are found in the README & COPYING
+ * files - if they are missing, get the official version at www.gromacs.org.
+ *
+ * To help us fund GROMACS development, we humbly ask that you cite
+ * the papers on the package - you can find them in the top README file.
+ *
+ * For more info, check our website at http://www.gromacs.org
+ *
+ * And Hey:
+ * GROwing Monsters And Cloning Shrimps
+ */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#ifdef GMX_QMMM_GAUSSIAN
+
+#include <math.h>
+#include <float.h>
+#include <stdlib.h>
+#include <string.h>
+#include "typedefs.h"
+#include "smalloc.h"
+#include "macros.h"
+#include "string2.h"
+#include "gmx_fatal.h"
+#include "qed_diag.h"
+
+#ifndef F77_FUNC
+#define F77_FUNC(name,NAME) name ## _
+#endif
+
+#include <complex.h>
+#ifdef I
+#undef I
+#endif
+
+#ifdef MKL
+#include <mkl_types.h>
+#include <mkl_lapack.h>
+typedef MKL_Complex16 t_lapack_cplx;
+#define QED_ZHEEV  zheev
+#define QED_ZGEQRF zgeqrf
+#define QED_ZUNGQR zungqr
+#else
+#include <lapacke.h>
+typedef lapack_complex_double t_lapack_cplx;
+#define QED_ZHEEV  F77_FUNC(zheev,ZHEEV)
+#define QED_ZGEQRF F77_FUNC(zgeqrf,ZGEQRF)
+#define QED_ZUNGQR F77_FUNC(zungqr,ZUNGQR)
+/* lapacke.h only declares the LAPACKE_ wrappers */
+extern void QED_ZHEEV(char *jobz, char *uplo, int *n,
+                      t_lapack_cplx *a, int *lda, double *w,
+                      t_lapack_cplx *work, int *lwork, double *rwork,
+                      int *info);
+extern void QED_ZGEQRF(int *m, int *n, t_lapack_cplx *a, int *lda,
+                       t_lapack_cplx *tau, t_lapack_cplx *work, int *lwork,
+                       int *info);
+extern void QED_ZUNGQR(int *m, int *n, int *k, t_lapack_cplx *a, int *lda,
+                       t_lapack_cplx *tau, t_lapack_cplx *work, int *lwork,
+                       int *info);
+#endif
+
+/* The polariton Hamiltonian is an arrowhead matrix with a K-wide
+ * border:
+ *
+ *        | D   B |      D = diag(e_m), nmol molecular states
+ *    H = |       |      W = diag(w_n), K cavity modes
+ *        | B^H W |      B = nmol x K couplings
+ *
+ * so there is no need to hand the full ndim x ndim matrix to zheev.
+ * We first deflate all molecular states that do not couple, then
+ * rotate every cluster of degenerate molecular energies such that at
+ * most K bright combinations couple to the modes; the remaining dark
+ * combinations are eigenvectors as they are. The eigenvalues of the
+ * reduced problem follow from bisection on the inertia of H - lambda,
+ * which by Haynsworth is the inertia of D - lambda plus that of the
+ * K x K Schur complement
+ *
+ *    S(lambda) = W - lambda - B^H (D - lambda)^-1 B.
+ *
+ * The photonic part b of an eigenvector spans the null space of
+ * S(lambda), the molecular part then is a = -(D - lambda)^-1 B b.
+ * Close to a pole e_j the eigenvalue is resolved relative to e_j to
+ * keep d_j = e_j - lambda accurate.
+ */
+
+typedef struct {
+  int     K;       /* number of cavity modes                           */
+  int     nred;    /* number of coupled molecular states               */
+  double *e;       /* their energies, ascending                        */
+  double *wc;      /* energies of the cavity modes                     */
+  dplx   *B;       /* couplings of the reduced states, nred x K        */
+  dplx   *BB;      /* conj(B_jn)B_jp for n<=p, nred x K(K+1)/2          */
+  double *B2;      /* |B_j|^2, used for a single mode                  */
+  int    *cstart;  /* reduced state j is sum_c coef[c]|idx[c]>, with   */
+  int    *cidx;    /* c = cstart[j]..cstart[j+1]-1                      */
+  dplx   *coef;
+  double  scale;
+  dplx   *S;       /* K x K Schur complement, column major             */
+  double *sev;
+  int     lwork;
+  t_lapack_cplx *work;
+  double *rwork;
+} t_arrow;
+
+typedef struct {
+  double e;
+  int    i;
+} t_qed_sort;
+
+static int qed_sort_comp(const void *a, const void *b)
+{
+  double
+    ea = ((t_qed_sort *)a)->e, eb = ((t_qed_sort *)b)->e;
+
+  if (ea < eb)
+    return -1;
+  else if (ea > eb)
+    return 1;
+  else
+    return ((t_qed_sort *)a)->i - ((t_qed_sort *)b)->i;
+}
+
+int qed_diag_type(const char *name)
+{
+  if (gmx_strcasecmp(name,"arrowhead") == 0)
+    return eqeddiagARROW;
+  if (gmx_strcasecmp(name,"dense") == 0)
+    return eqeddiagDENSE;
+  if (gmx_strcasecmp(name,"check") == 0)
+    return eqeddiagCHECK;
+  return -1;
+}
+
+/* eigenpairs of the K x K matrix in a->S, overwritten by the eigenvectors */
+static void arrow_heev(t_arrow *a)
+{
+  char
+    jobz='V',uplo='U';
+  int
+    info;
+
+  QED_ZHEEV(&jobz, &uplo, &a->K, (t_lapack_cplx *)a->S, &a->K, a->sev,
+            a->work, &a->lwork, a->rwork, &info);
+  if (info != 0){
+    gmx_fatal(FARGS, "Lapack returned error code: %d in zheev", info);
+  }
+}
+
+static double arrow_denom(t_arrow *a, int j, double origin, double mu)
+{
+  double
+    d = (a->e[j]-origin)-mu;
+
+  /* lambda exactly on a pole, only happens by accident in the bisection */
+  if (d == 0){
+    d = DBL_EPSILON*DBL_EPSILON*a->scale;
+  }
+  return d;
+}
+
+/* S(origin+mu), with the shifted differences computed as (x-origin)-mu;
+ * only the upper triangle is set
+ */
+static void arrow_schur(t_arrow *a, double origin, double mu)
+{
+  int
+    j,n,p,np,K=a->K,nK=K*(K+1)/2;
+  double
+    dinv;
+  dplx
+    *BBj;
+
+  for (n=0; n<K*K; n++){
+    a->S[n] = 0;
+  }
+  for (n=0; n<K; n++){
+    a->S[n+n*K] = (a->wc[n]-origin)-mu;
+  }
+  for (j=0; j<a->nred; j++){
+    dinv = 1.0/arrow_denom(a,j,origin,mu);
+    BBj  = &a->BB[j*nK];
+    np   = 0;
+    for (p=0; p<K; p++){
+      for (n=0; n<=p; n++){
+        a->S[n+p*K] -= BBj[np++]*dinv;
+      }
+    }
+  }
+}
+
+/* number of negative eigenvalues of the hermitian K x K matrix in a->S
+ * (upper triangle) from the signs of the pivots of S = L D L^H. An
+ * exactly vanishing pivot is replaced by a tiny positive one, as in the
+ * tridiagonal Sturm count.
+ */
+static int arrow_inertia(t_arrow *a)
+{
+  int
+    i,j,k,K=a->K,nneg=0;
+  double
+    piv,pmin=DBL_EPSILON*DBL_EPSILON*a->scale;
+  dplx
+    *S=a->S,l;
+
+  for (k=0; k<K; k++){
+    piv = creal(S[k+k*K]);
+    if (piv == 0){
+      piv = pmin;
+    }
+    if (piv < 0){
+      nneg++;
+    }
+    for (i=k+1; i<K; i++){
+      l = S[k+i*K]/piv;
+      for (j=i; j<K; j++){
+        S[i+j*K] -= conj(l)*S[k+j*K];
+      }
+    }
+  }
+  return nneg;
+}
+
+/* number of eigenvalues of the reduced problem below origin+mu */
+static int arrow_count(t_arrow *a, double origin, double mu)
+{
+  int
+    j,count=0;
+  double
+    s;
+
+  for (j=0; j<a->nred; j++){
+    if ((a->e[j]-origin)-mu < 0){
+      count++;
+    }
+  }
+  if (a->K == 1){
+    s = (a->wc[0]-origin)-mu;
+    for (j=0; j<a->nred; j++){
+      s -= a->B2[j]/arrow_denom(a,j,origin,mu);
+    }
+    count += (s < 0);
+  }
+  else if (a->K > 1){
+    arrow_schur(a,origin,mu);
+    count += arrow_inertia(a);
+  }
+  return count;
+}
+
+/* index of the reduced molecular energy closest to x */
+static int arrow_nearest_pole(t_arrow *a, double x)
+{
+  int
+    lo=0,hi=a->nred-1,mid;
+
+  while (hi-lo > 1){
+    mid = (lo+hi)/2;
+    if (a->e[mid] < x)
+      lo = mid;
+    else
+      hi = mid;
+  }
+  return (fabs(a->e[lo]-x) <= fabs(a->e[hi]-x)) ? lo : hi;
+}
+
+/* k-th eigenvalue (from 0) of the reduced problem as origin+mu */
+static void arrow_bisect(t_arrow *a, int k, double glo, double ghi,
+                         double tol, double *origin, double *mu)
+{
+  int
+    iter;
+  double
+    lo=glo,hi=ghi,mid;
+
+  for (iter=0; iter<256 && hi-lo > tol; iter++){
+    mid = 0.5*(lo+hi);
+    if (arrow_count(a,0,mid) <= k)
+      lo = mid;
+    else
+      hi = mid;
+  }
+  *origin = 0;
+  if (a->nred > 0){
+    /* continue relative to the nearest pole, where lambda can be
+     * resolved to full relative precision
+     */
+    *origin = a->e[arrow_nearest_pole(a,0.5*(lo+hi))];
+    lo -= *origin;
+    hi -= *origin;
+    for (iter=0; iter<256; iter++){
+      if (hi-lo <= 2*DBL_EPSILON*max(fabs(lo),fabs(hi)) || hi-lo <= DBL_MIN){
+        break;
+      }
+      mid = 0.5*(lo+hi);
+      if (mid <= lo || mid >= hi){
+        break;
+      }
+      if (arrow_count(a,*origin,mid) <= k)
+        lo = mid;
+      else
+        hi = mid;
+    }
+  }
+  *mu = 0.5*(lo+hi);
+}
+
+static double row_norm(int n, dplx *x)
+{
+  int
+    i;
+  double
+    nrm=0;
+
+  for (i=0; i<n; i++){
+    nrm += creal(x[i])*creal(x[i])+cimag(x[i])*cimag(x[i]);
+  }
+  return sqrt(nrm);
+}
+
+/* x -= (y^H x) y for the normalized row y */
+static void row_project_out(int n, dplx *x, dplx *y)
+{
+  int
+    i;
+  dplx
+    ov=0;
+
+  for (i=0; i<n; i++){
+    ov += conj(y[i])*x[i];
+  }
+  for (i=0; i<n; i++){
+    x[i] -= ov*y[i];
+  }
+}
+
+static void row_normalize(int n, dplx *x)
+{
+  int
+    i;
+  double
+    nrm=row_norm(n,x);
+
+  if (nrm > 0){
+    for (i=0; i<n; i++){
+      x[i] /= nrm;
+    }
+  }
+}
+
+void qed_cluster_qr(int s, int K, int nq, dplx *A, dplx *Q)
+{
+  int
+    i,kr=min(s,K),lwork,info;
+  t_lapack_cplx
+    *tau,*work;
+
+  lwork = 64*(s+K);
+  snew(tau,max(kr,1));
+  snew(work,lwork);
+  QED_ZGEQRF(&s, &K, (t_lapack_cplx *)A, &s, tau, work, &lwork, &info);
+  if (info != 0){
+    gmx_fatal(FARGS, "Lapack returned error code: %d in zgeqrf", info);
+  }
+  for (i=0; i<s*kr; i++){
+    Q[i] = A[i];
+  }
+  QED_ZUNGQR(&s, &nq, &kr, (t_lapack_cplx *)Q, &s, tau, work, &lwork, &info);
+  if (info != 0){
+    gmx_fatal(FARGS, "Lapack returned error code: %d in zungqr", info);
+  }
+  sfree(work);
+  sfree(tau);
+}
+
+gmx_bool qed_diag_arrowhead(int ndim, int nmol, double *w, dplx *V, dplx *M)
+{
+  int
+    K=ndim-nmol,i,j,n,c,g,m,i0,i1,s,kr,row,nfix,nr,k,*perm,*sel;
+  double
+    shift=0,tol,tol_b,tol_mult,tol_orth,glo,ghi,rad,nrm,*wrow,*origin,*mu,
+    mu_g,d,*sabs,tmp;
+  dplx
+    *A,*Q,*x,*Bj,aj,*rowtmp;
+  t_qed_sort
+    *order;
+  t_arrow
+    a;
+  gmx_bool
+    bOK=TRUE,*done;
+
+  if (K < 0 || nmol < 0){
+    gmx_fatal(FARGS,"qed_diag_arrowhead: %d molecules in a %d x %d matrix",
+              nmol,ndim,ndim);
+  }
+
+  /* work with diagonal energies relative to their mean, such that
+   * the tolerances scale with the spread and not with the absolute
+   * (total) QM energies
+   */
+  for (i=0; i<ndim; i++){
+    shift += creal(M[i*ndim+i]);
+  }
+  shift /= max(ndim,1);
+
+  memset(&a,0,sizeof(a));
+  a.K = K;
+  snew(a.e,max(nmol,1));
+  snew(a.wc,max(K,1));
+  snew(a.B,max(nmol*K,1));
+  snew(a.B2,max(nmol,1));
+  snew(a.cstart,nmol+1);
+  snew(a.cidx,max(nmol*max(K,1),1));
+  snew(a.coef,max(nmol*max(K,1),1));
+  snew(order,max(nmol,1));
+  snew(wrow,ndim);
+
+  a.scale = 0;
+  for (n=0; n<K; n++){
+    a.wc[n] = creal(M[(nmol+n)*ndim+nmol+n])-shift;
+    a.scale = max(a.scale,fabs(a.wc[n]));
+  }
+  nrm = 0;
+  for (m=0; m<nmol; m++){
+    order[m].e = creal(M[m*ndim+m])-shift;
+    order[m].i = m;
+    a.scale = max(a.scale,fabs(order[m].e));
+    for (n=0; n<K; n++){
+      nrm += creal(M[m*ndim+nmol+n])*creal(M[m*ndim+nmol+n])
+        +cimag(M[m*ndim+nmol+n])*cimag(M[m*ndim+nmol+n]);
+    }
+  }
+  a.scale = max(a.scale,sqrt(nrm));
+  if (a.scale == 0){
+    a.scale = 1;
+  }
+  tol      = 8*DBL_EPSILON*a.scale;
+  tol_b    = 4*DBL_EPSILON*a.scale;
+  tol_mult = 64*tol;
+  tol_orth = 1e-7*a.scale;
+  qsort(order,nmol,sizeof(order[0]),qed_sort_comp);
+
+  for (i=0; i<ndim*ndim; i++){
+    V[i] = 0;
+  }
+
+  /* deflation: uncoupled states and the dark combinations of
+   * degenerate clusters go straight into V, the bright ones into
+   * the reduced problem
+   */
+  nfix = 0;
+  a.nred = 0;
+  c = 0;
+  a.cstart[0] = 0;
+  for (i0=0; i0<nmol; i0=i1){
+    for (i1=i0+1; i1<nmol && order[i1].e-order[i0].e <= tol; i1++)
+      ;
+    s = i1-i0;
+    if (s == 1){
+      m = order[i0].i;
+      nrm = 0;
+      for (n=0; n<K; n++){
+        a.B[a.nred*K+n] = M[m*ndim+nmol+n];
+        nrm += creal(a.B[a.nred*K+n])*creal(a.B[a.nred*K+n])
+          +cimag(a.B[a.nred*K+n])*cimag(a.B[a.nred*K+n]);
+      }
+      if (sqrt(nrm) <= tol){
+        wrow[nfix] = order[i0].e;
+        V[nfix*ndim+m] = 1;
+        nfix++;
+      }
+      else {
+        a.e[a.nred] = order[i0].e;
+        a.B2[a.nred] = nrm;
+        a.cidx[c] = m;
+        a.coef[c] = 1;
+        c++;
+        a.nred++;
+        a.cstart[a.nred] = c;
+      }
+      continue;
+    }
+    /* s degenerate molecules */
+    tmp = 0;
+    for (j=i0; j<i1; j++){
+      tmp += order[j].e;
+    }
+    tmp /= s;
+    kr = min(s,K);
+    snew(A,max(s*K,1));
+    snew(Q,s*s);
+    for (n=0; n<K; n++){
+      for (j=0; j<s; j++){
+        A[j+n*s] = M[order[i0+j].i*ndim+nmol+n];
+      }
+    }
+    if (K > 0){
+      qed_cluster_qr(s,K,s,A,Q);
+    }
+    else {
+      for (j=0; j<s; j++){
+        Q[j+j*s] = 1;
+      }
+    }
+    for (k=0; k<s; k++){
+      nrm = 0;
+      if (k < kr){
+        for (n=0; n<K; n++){
+          a.B[a.nred*K+n] = (n >= k) ? A[k+n*s] : 0;
+          nrm += creal(a.B[a.nred*K+n])*creal(a.B[a.nred*K+n])
+            +cimag(a.B[a.nred*K+n])*cimag(a.B[a.nred*K+n]);
+        }
+      }
+      if (sqrt(nrm) <= tol){
+        /* dark combination */
+        wrow[nfix] = tmp;
+        for (j=0; j<s; j++){
+          V[nfix*ndim+order[i0+j].i] = Q[j+k*s];
+        }
+        nfix++;
+      }
+      else {
+        a.e[a.nred] = tmp;
+        a.B2[a.nred] = nrm;
+        for (j=0; j<s; j++){
+          a.cidx[c] = order[i0+j].i;
+          a.coef[c] = Q[j+k*s];
+          c++;
+        }
+        a.nred++;
+        a.cstart[a.nred] = c;
+      }
+    }
+    sfree(Q);
+    sfree(A);
+  }
+
+  /* the reduced problem: nred coupled states plus K modes */
+  nr = a.nred+K;
+  snew(a.BB,max(a.nred*K*(K+1)/2,1));
+  for (j=0; j<a.nred; j++){
+    Bj = &a.B[j*K];
+    i  = j*K*(K+1)/2;
+    for (k=0; k<K; k++){
+      for (n=0; n<=k; n++){
+        a.BB[i++] = conj(Bj[n])*Bj[k];
+      }
+    }
+  }
+  if (K > 0){
+    snew(a.S,K*K);
+    snew(a.sev,K);
+    a.lwork = max(2*K,64*K);
+    snew(a.work,a.lwork);
+    snew(a.rwork,3*K);
+  }
+  snew(origin,max(nr,1));
+  snew(mu,max(nr,1));
+  glo = 0;
+  ghi = 0;
+  for (j=0; j<a.nred; j++){
+    rad = 0;
+    for (n=0; n<K; n++){
+      rad += cabs(a.B[j*K+n]);
+    }
+    glo = min(glo,a.e[j]-rad);
+    ghi = max(ghi,a.e[j]+rad);
+  }
+  for (n=0; n<K; n++){
+    rad = 0;
+    for (j=0; j<a.nred; j++){
+      rad += cabs(a.B[j*K+n]);
+    }
+    glo = min(glo,a.wc[n]-rad);
+    ghi = max(ghi,a.wc[n]+rad);
+  }
+  glo -= tol;
+  ghi += tol;
+  for (k=0; k<nr; k++){
+    arrow_bisect(&a,k,glo,ghi,tol_b,&origin[k],&mu[k]);
+  }
+
+  /* eigenvectors, per group of (numerically) degenerate eigenvalues */
+  snew(sel,max(K,1));
+  snew(sabs,max(K,1));
+  for (k=0; k<nr && bOK; k+=g){
+    for (g=1; k+g<nr && (origin[k+g]+mu[k+g])-(origin[k+g-1]+mu[k+g-1]) <= tol_mult; g++)
+      ;
+    if (g > K){
+      bOK = FALSE;
+      break;
+    }
+    mu_g = 0;
+    for (i=k; i<k+g; i++){
+      mu_g += (origin[i]-origin[k])+mu[i];
+    }
+    mu_g /= g;
+    arrow_schur(&a,origin[k],mu_g);
+    arrow_heev(&a);
+    /* the g eigenvectors of S with the smallest |eigenvalue| */
+    for (n=0; n<K; n++){
+      sabs[n] = fabs(a.sev[n]);
+    }
+    for (i=0; i<g; i++){
+      sel[i] = -1;
+      for (n=0; n<K; n++){
+        if (sabs[n] >= 0 && (sel[i] < 0 || sabs[n] < sabs[sel[i]])){
+          sel[i] = n;
+        }
+      }
+      sabs[sel[i]] = -1;
+    }
+    for (i=0; i<g; i++){
+      row = nfix+k+i;
+      x = &V[row*ndim];
+      wrow[row] = origin[k+i]+mu[k+i];
+      for (n=0; n<K; n++){
+        x[nmol+n] = a.S[n+sel[i]*K];
+      }
+      for (j=0; j<a.nred; j++){
+        d  = arrow_denom(&a,j,origin[k],mu_g);
+        Bj = &a.B[j*K];
+        aj = 0;
+        for (n=0; n<K; n++){
+          aj -= Bj[n]*x[nmol+n];
+        }
+        aj /= d;
+        for (c=a.cstart[j]; c<a.cstart[j+1]; c++){
+          x[a.cidx[c]] += aj*a.coef[c];
+        }
+      }
+      row_normalize(ndim,x);
+      /* orthogonalize against the group and against close eigenvalues,
+       * twice to be safe
+       */
+      for (m=0; m<2; m++){
+        for (j=row-1; j>=nfix && (j >= nfix+k || wrow[row]-wrow[j] <= tol_orth); j--){
+          row_project_out(ndim,x,&V[j*ndim]);
+        }
+        row_normalize(ndim,x);
+      }
+    }
+  }
+
+  if (bOK){
+    /* sort all eigenpairs, permuting the rows of V in place */
+    snew(perm,ndim);
+    snew(done,ndim);
+    snew(rowtmp,ndim);
+    sfree(order);
+    snew(order,ndim);
+    for (i=0; i<ndim; i++){
+      order[i].e = wrow[i];
+      order[i].i = i;
+    }
+    qsort(order,ndim,sizeof(order[0]),qed_sort_comp);
+    for (i=0; i<ndim; i++){
+      perm[i] = order[i].i;
+      w[i] = order[i].e+shift;
+    }
+    for (i=0; i<ndim; i++){
+      if (done[i] || perm[i] == i){
+        continue;
+      }
+      memcpy(rowtmp,&V[i*ndim],ndim*sizeof(dplx));
+      for (j=i; ; j=perm[j]){
+        done[j] = TRUE;
+        if (perm[j] == i){
+          memcpy(&V[j*ndim],rowtmp,ndim*sizeof(dplx));
+          break;
+        }
+        memcpy(&V[j*ndim],&V[perm[j]*ndim],ndim*sizeof(dplx));
+      }
+    }
+    sfree(rowtmp);
+    sfree(done);
+    sfree(perm);
+    /* zheev reads the row major M as its transpose, conj(M), so the
+     * rows diag() returns are the complex conjugates of the eigenvectors
+     */
+    for (i=0; i<ndim*ndim; i++){
+      V[i] = conj(V[i]);
+    }
+  }
+
+  sfree(sabs);
+  sfree(sel);
+  sfree(mu);
+  sfree(origin);
+  if (K > 0){
+    sfree(a.rwork);
+    sfree(a.work);
+    sfree(a.sev);
+    sfree(a.S);
+  }
+  sfree(wrow);
+  sfree(order);
+  sfree(a.coef);
+  sfree(a.cidx);
+  sfree(a.cstart);
+  sfree(a.B2);
+  sfree(a.BB);
+  sfree(a.B);
+  sfree(a.wc);
+  sfree(a.e);
+
+  return bOK;
+}
+
+#else
+int
+gmx_qed_diag_empty;
+#endif
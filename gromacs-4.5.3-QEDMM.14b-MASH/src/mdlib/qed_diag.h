@@ -0,0 +1,85 @@
+/*
+ *
+ *                This source code is part of
+ *
+ *                 G   R   O   M   A   C   S
+ *
+ *          GROningen MAchine for Chemical Simulations
+ *
+ *                        VERSION 3.2.0
+ * Written by David van der Spoel, Erik Lindahl, Berk Hess, and others.
+ * Copyright (c) 1991-2000, University of Groningen, The Netherlands.
+ * Copyright (c) 2001-2004, The GROMACS development team,
+ * check out http://www.gromacs.org for more information.
+
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * If you want to redistribute modifications, please consider that
+ * scientific software is very special. Version control is crucial -
+ * bugs must be traceable. We will be happy to consider code for
+ * inclusion in the official distribution, but derived work must not
+ * be called official GROMACS. Details are found in the README & COPYING
+ * files - if they are missing, get the official version at www.gromacs.org.
+ *
+ * To help us fund GROMACS development, we humbly ask that you cite
+ * the papers on the package - you can find them in the top README file.
+ *
+ * For more info, check our website at http://www.gromacs.org
+ *
+ * And Hey:
+ * Gallium Rubidium Oxygen Manganese Argon Carbon Silicon
+ */
+
+#ifndef _qed_diag_h
+#define _qed_diag_h
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "typedefs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* eigensolvers for the polariton Hamiltonian, selected with $QED_DIAG */
+enum { eqeddiagARROW, eqeddiagDENSE, eqeddiagCHECK, eqeddiagNR };
+
+int qed_diag_type(const char *name);
+/* Returns the eqeddiag entry for name ("arrowhead", "dense" or
+ * "check"), or -1 if the name is unknown.
+ */
+
+gmx_bool qed_diag_arrowhead(int ndim, int nmol, double *w, dplx *V, dplx *M);
+/* Diagonalizes the ndim x ndim polariton Hamiltonian M (row major),
+ * assuming its structure: the first nmol (molecular) states only
+ * couple to the last ndim-nmol (cavity mode) states, and both
+ * diagonal blocks are diagonal. The off-block elements outside
+ * M[m*ndim+nmol+n] and its hermitian counterpart are not read.
+ * On return w holds the eigenvalues in ascending order and row i of V
+ * (V[i*ndim+k]) the corresponding normalized eigenvector, i.e. the same
+ * layout the dense zheev driver in qm_gaussian.c produces.
+ * The cost is O(ndim*nmol*K) memory traffic plus O(ndim*nmol*K^2)
+ * work for the eigenvalues, with K the number of cavity modes.
+ * Returns FALSE, leaving w and V undefined, when the matrix has a
+ * degeneracy the structured solver does not resolve; the caller should
+ * then fall back to a dense diagonalization.
+ */
+
+void qed_cluster_qr(int s, int K, int nq, dplx *A, dplx *Q);
+/* Householder QR of the s x K coupling block A (column major) of a
+ * cluster of s degenerate molecular states. On return Q (s x nq, column
+ * major, min(s,K) <= nq <= s) holds the first nq columns of the unitary
+ * factor: the first min(s,K) are the bright combinations, with their
+ * couplings in the rows of the triangle left in A, the others are dark.
+ */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif	/* _qed_diag_h */
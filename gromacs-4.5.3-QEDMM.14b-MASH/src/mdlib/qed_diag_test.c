@@ -0,0 +1,204 @@
+/* -*- mode: c; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; c-file-style: "stroustrup"; -*-
+ * $Id: gmx_matrix.c,v 1.4 2008/12/02 18:27:57 spoel Exp $
+ * 
+ *                This source code is part of
+ * 
+ *                 G   R   O   M   A   C   S
+ * 
+ *          GROningen MAchine for Chemical Simulations
+ * 
+ *                        VERSION 4.5
+ * Written by David van der Spoel, Erik Lindahl, Berk Hess, and others.
+ * Copyright (c) 1991-2000, University of Groningen, The Netherlands.
+ * Copyright (c) 2001-2008, The GROMACS development team,
+ * check out http://www.gromacs.org for more information.
+ 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * If you want to redistribute modifications, please consider that
+ * scientific software is very special. Version control is crucial -
+ * bugs must be traceable. We will be happy to consider code for
+ * inclusion in the official distribution, but derived work must not
+ * be called official GROMACS. Details are found in the README & COPYING
+ * files - if they are missing, get the official version at www.gromacs.org.
+ * 
+ * To help us fund GROMACS development, we humbly ask that you cite
+ * the papers on the package - you can find them in the top README file.
+ * 
+ * For more info, check our website at http://www.gromacs.org
+ * 
+ * And Hey:
+ * Groningen Machine for Chemical Simulation
+ */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "smalloc.h"
+#include "macros.h"
+#include "qed_linalg.h"
+#include "qed_diag.h"
+
+#include <complex.h>
+#ifdef I
+#undef I
+#endif
+#define IMAG _Complex_I
+
+/* Checks the arrowhead eigensolver of qed_diag.c against zheev on
+ * random polariton Hamiltonians: distinct molecular energies,
+ * clusters of degenerate molecules (fewer and more than the modes),
+ * and molecules that do not couple. For every case it reports the
+ * largest deviation of the eigenvalues from zheev, the largest
+ * residual |H v - w v| and the deviation of V from unitarity, and
+ * exits with 1 if any is above -tol (default 1e-9 times the spectral
+ * range). A case the arrowhead solver hands back to zheev (FALSE) is
+ * reported, but only fails with -nofallback.
+ */
+
+/* row major, molecules 0..nmol-1 then nmodes cavity modes */
+static void arrow_ham(int nmol, int nmodes, int ncluster, double fzero,
+                      dplx *H)
+{
+  int ndim=nmol+nmodes,m,k;
+
+  memset(H,0,ndim*ndim*sizeof(*H));
+  for (m=0; m<nmol; m++){
+    /* ncluster > 0: molecules share ncluster energies */
+    H[m*ndim+m] = (ncluster > 0) ? 0.1*(m % ncluster)/ncluster :
+      0.1*drand48();
+    for (k=0; k<nmodes; k++){
+      if (drand48() < fzero){
+        continue;
+      }
+      H[m*ndim+nmol+k] = 0.01*((drand48()-0.5)+IMAG*(drand48()-0.5));
+      H[(nmol+k)*ndim+m] = conj(H[m*ndim+nmol+k]);
+    }
+  }
+  for (k=0; k<nmodes; k++){
+    H[(nmol+k)*ndim+nmol+k] = 0.02+0.06*k/max(nmodes-1,1);
+  }
+}
+
+/* max_i |H v_i - w_i v_i|, v_i row i of V as diag() returns it */
+static double residual(int n, dplx *H, double *w, dplx *V)
+{
+  int    i,j,k;
+  double r=0;
+  dplx   y;
+
+  for (i=0; i<n; i++){
+    for (k=0; k<n; k++){
+      y = 0;
+      for (j=0; j<n; j++){
+        y += H[k*n+j]*conj(V[i*n+j]);
+      }
+      r = max(r,cabs(y-w[i]*conj(V[i*n+k])));
+    }
+  }
+  return r;
+}
+
+static double unitarity(int n, dplx *V)
+{
+  int    i,j,k;
+  double r=0;
+  dplx   s;
+
+  for (i=0; i<n; i++){
+    for (j=0; j<n; j++){
+      s = 0;
+      for (k=0; k<n; k++){
+        s += conj(V[i*n+k])*V[j*n+k];
+      }
+      r = max(r,cabs(s-(i == j)));
+    }
+  }
+  return r;
+}
+
+int main(int argc,char *argv[])
+{
+  /* nmol, nmodes, ncluster, fraction of zero couplings */
+  static const struct { int nmol,nmodes,ncluster; double fzero; } cases[] = {
+    {   1,  1,  0, 0.0 },
+    {  10,  1,  0, 0.0 },
+    {  50,  5,  0, 0.0 },
+    { 200, 11,  0, 0.0 },
+    {  60,  5, 30, 0.0 },   /* clusters of 2 <= nmodes */
+    {  60,  3,  6, 0.0 },   /* clusters of 10 > nmodes */
+    { 100,  7,  0, 0.5 },   /* half the couplings zero */
+    {  80,  4, 10, 0.3 }
+  };
+  int           ncase=asize(cases),c,i,n,nfail=0,bFallback=1;
+  double        tol=1e-9,*w,*wz,dw,res,res_z,unit,range;
+  dplx          *H,*V,*Vz;
+  gmx_qed_work_t work;
+  gmx_bool      bOK;
+
+  for (i=1; i<argc; i++){
+    if (strcmp(argv[i],"-tol") == 0 && i+1 < argc){
+      tol = strtod(argv[++i],NULL);
+    }
+    else if (strcmp(argv[i],"-nofallback") == 0){
+      bFallback = 0;
+    }
+  }
+  work = qed_work_init();
+  srand48(1);
+
+  printf("%6s %6s %6s %6s %10s %10s %10s %10s\n","nmol","modes",
+         "clust","zero","dw","res","res zheev","unitarity");
+  for (c=0; c<ncase; c++){
+    n = cases[c].nmol+cases[c].nmodes;
+    snew(H,n*n);
+    snew(V,n*n);
+    snew(Vz,n*n);
+    snew(w,n);
+    snew(wz,n);
+    arrow_ham(cases[c].nmol,cases[c].nmodes,cases[c].ncluster,
+              cases[c].fzero,H);
+    qed_zheev(work,n,wz,Vz,H);
+    bOK = qed_diag_arrowhead(n,cases[c].nmol,w,V,H);
+    printf("%6d %6d %6d %6.2f",cases[c].nmol,cases[c].nmodes,
+           cases[c].ncluster,cases[c].fzero);
+    if (!bOK){
+      printf("   handed back to zheev\n");
+      if (!bFallback){
+        nfail++;
+      }
+    }
+    else{
+      range = max(fabs(wz[0]),fabs(wz[n-1]));
+      for (i=0,dw=0; i<n; i++){
+        dw = max(dw,fabs(w[i]-wz[i]));
+      }
+      res   = residual(n,H,w,V);
+      res_z = residual(n,H,wz,Vz);
+      unit  = unitarity(n,V);
+      printf(" %10.2e %10.2e %10.2e %10.2e\n",dw,res,res_z,unit);
+      if (dw > tol*range || res > tol*range || unit > tol){
+        nfail++;
+      }
+    }
+    sfree(H);
+    sfree(V);
+    sfree(Vz);
+    sfree(w);
+    sfree(wz);
+  }
+  if (nfail > 0){
+    printf("FAILED: %d of %d cases\n",nfail,ncase);
+    return 1;
+  }
+  printf("passed\n");
+
+  return 0;
+}
@@ -0,0 +1,323 @@
+/*
+ *
+ *                This source code is part of
+ *
+ *                 G   R   O   M   A   C   S
+ *
+ *          GROningen MAchine for Chemical Simulations
+ *
+ *                        VERSION 3.2.0
+ * Written by David van der Spoel, Erik Lindahl, Berk Hess, and others.
+ * Copyright (c) 1991-2000, University of Groningen, The Netherlands.
+ * Copyright (c) 2001-2004, The GROMACS development team,
+ * check out http://www.gromacs.org for more information.
+
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * If you want to redistribute modifications, please consider that
+ * scientific software is very special. Version control is crucial -
+ * bugs must be traceable. We will be happy to consider code for
+ * inclusion in the official distribution, but derived work must not
+ * be called official GROMACS. Details are found in the README & COPYING
+ * files - if they are missing, get the official version at www.gromacs.org.
+ *
+ * To help us fund GROMACS development, we humbly ask that you cite
+ * the papers on the package - you can find them in the top README file.
+ *
+ * For more info, check our website at http://www.gromacs.org
+ *
+ * And Hey:
+ * GROwing Monsters And Cloning Shrimps
+ */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#ifdef GMX_QMMM_GAUSSIAN
+
+#include <math.h>
+#include <string.h>
+#include "typedefs.h"
+#include "smalloc.h"
+#include "macros.h"
+#include "network.h"
+#include "gmx_fatal.h"
+#include "qed_dist.h"
+#include "qed_linalg.h"
+
+#ifndef F77_FUNC
+#define F77_FUNC(name,NAME) name ## _
+#endif
+
+#include <complex.h>
+#ifdef I
+#undef I
+#endif
+
+#if (defined GMX_SCALAPACK && defined GMX_MPI)
+#define QED_SCALAPACK
+/* BLACS and ScaLAPACK do not come with C headers */
+extern void Cblacs_get(int ictxt, int what, int *val);
+extern void Cblacs_gridinit(int *ictxt, char *order, int nprow, int npcol);
+extern void Cblacs_gridinfo(int ictxt, int *nprow, int *npcol,
+                            int *myrow, int *mycol);
+extern int  Csys2blacs_handle(MPI_Comm comm);
+extern int  F77_FUNC(numroc,NUMROC)(int *n, int *nb, int *iproc,
+                                    int *isrcproc, int *nprocs);
+extern void F77_FUNC(descinit,DESCINIT)(int *desc, int *m, int *n,
+                                        int *mb, int *nb, int *irsrc,
+                                        int *icsrc, int *ictxt, int *lld,
+                                        int *info);
+extern void F77_FUNC(pzheevd,PZHEEVD)(char *jobz, char *uplo, int *n,
+                                      dplx *a, int *ia, int *ja, int *desca,
+                                      double *w,
+                                      dplx *z, int *iz, int *jz, int *descz,
+                                      dplx *work, int *lwork,
+                                      double *rwork, int *lrwork,
+                                      int *iwork, int *liwork, int *info);
+#endif
+
+enum { eqdistZGEMM, eqdistZHEEV, eqdistEND, eqdistNR };
+
+typedef struct gmx_qed_dist {
+  const gmx_multisim_t *ms;
+  int      nb;       /* block size of the block-cyclic distribution  */
+  gmx_bool bActive;  /* inside qed_dist_begin/end on the master       */
+#ifdef QED_SCALAPACK
+  int      ctxt;     /* BLACS grid over the simulation masters        */
+  int      nprow,npcol,myrow,mycol;
+#endif
+} t_qed_dist;
+
+gmx_qed_dist_t qed_dist_init(const gmx_multisim_t *ms, int nb)
+{
+  gmx_qed_dist_t
+    d;
+
+  snew(d,1);
+  d->ms = ms;
+  d->nb = max(1,nb);
+  d->bActive = FALSE;
+#ifdef QED_SCALAPACK
+  /* the most square grid that uses all simulations */
+  for (d->nprow=(int)sqrt(ms->nsim); ms->nsim % d->nprow; d->nprow--)
+    ;
+  d->npcol = ms->nsim/d->nprow;
+  d->ctxt  = Csys2blacs_handle(ms->mpi_comm_masters);
+  Cblacs_gridinit(&d->ctxt,"Row",d->nprow,d->npcol);
+  Cblacs_gridinfo(d->ctxt,&d->nprow,&d->npcol,&d->myrow,&d->mycol);
+#endif
+
+  return d;
+}
+
+static void send_cmd(gmx_qed_dist_t d, int cmd, int n, char opa, char opb)
+{
+  int
+    hdr[4];
+
+  hdr[0] = cmd;
+  hdr[1] = n;
+  hdr[2] = opa;
+  hdr[3] = opb;
+  gmx_bcast_masters(sizeof(hdr),hdr,0,d->ms);
+}
+
+void qed_dist_begin(gmx_qed_dist_t d)
+{
+  if (d && d->ms->nsim > 1){
+    d->bActive = TRUE;
+  }
+}
+
+void qed_dist_end(gmx_qed_dist_t d)
+{
+  if (d && d->bActive){
+    send_cmd(d,eqdistEND,0,'N','N');
+    d->bActive = FALSE;
+  }
+}
+
+/* our share of C = op(A) op(B): the row blocks b with b % nsim == sim,
+ * gathered block by block on the master simulation, the only one that
+ * uses C
+ */
+static void zgemm_rows(gmx_qed_dist_t d, char opa, char opb, int n,
+                       dplx *A, dplx *B, dplx *C)
+{
+  int
+    b,i0,nr,src;
+
+  for (b=0,i0=0; i0<n; b++,i0+=d->nb){
+    nr  = min(n-i0,d->nb);
+    src = b % d->ms->nsim;
+    if (src == d->ms->sim){
+      /* rows i0.. of op(A) are rows of A for 'N', columns otherwise */
+      qed_zgemm(opa,opb,nr,n,n,1,opa=='N' ? A+i0*n : A+i0,n,B,n,
+                0,C+i0*n,n);
+      if (src != 0){
+        gmx_send_sim(nr*n*sizeof(dplx),C+i0*n,0,d->ms);
+      }
+    }
+    else if (d->ms->sim == 0){
+      gmx_recv_sim(nr*n*sizeof(dplx),C+i0*n,src,d->ms);
+    }
+  }
+}
+
+void qed_dist_zgemm(gmx_qed_dist_t d, char opa, char opb, int n,
+                    dplx *A, dplx *B, dplx *C)
+{
+  if (d && d->bActive){
+    send_cmd(d,eqdistZGEMM,n,opa,opb);
+    gmx_bcast_masters(n*n*sizeof(dplx),A,0,d->ms);
+    gmx_bcast_masters(n*n*sizeof(dplx),B,0,d->ms);
+    zgemm_rows(d,opa,opb,n,A,B,C);
+  }
+  else{
+    qed_zgemm(opa,opb,n,n,n,1,A,n,B,n,0,C,n);
+  }
+}
+
+#ifdef QED_SCALAPACK
+/* global row or column of local index l on grid row/column p of np */
+static int l2g(int l, int nb, int p, int np)
+{
+  return ((l/nb)*np+p)*nb+l%nb;
+}
+
+static void zheev_grid(gmx_qed_dist_t d, int n, double *w, dplx *V, dplx *M)
+{
+  char
+    jobz='V',uplo='U';
+  int
+    izero=0,ione=1,mloc,nloc,lld,desc[9],info,
+    lwork=-1,lrwork=-1,liwork=-1,*iwork,iwkopt,
+    i,j,r,c;
+  double
+    *rwork,rwkopt;
+  dplx
+    *A,*Z,*work,wkopt;
+
+  mloc = F77_FUNC(numroc,NUMROC)(&n,&d->nb,&d->myrow,&izero,&d->nprow);
+  nloc = F77_FUNC(numroc,NUMROC)(&n,&d->nb,&d->mycol,&izero,&d->npcol);
+  lld  = max(1,mloc);
+  F77_FUNC(descinit,DESCINIT)(desc,&n,&n,&d->nb,&d->nb,&izero,&izero,
+                              &d->ctxt,&lld,&info);
+  if (info != 0){
+    gmx_fatal(FARGS,"ScaLAPACK returned error code: %d in descinit",info);
+  }
+  snew(A,lld*max(1,nloc));
+  snew(Z,lld*max(1,nloc));
+  /* as in diag(), the Fortran matrix is A(r,c) = M[c*n+r] */
+  for (j=0; j<nloc; j++){
+    c = l2g(j,d->nb,d->mycol,d->npcol);
+    for (i=0; i<mloc; i++){
+      r = l2g(i,d->nb,d->myrow,d->nprow);
+      A[i+j*lld] = M[c*n+r];
+    }
+  }
+  F77_FUNC(pzheevd,PZHEEVD)(&jobz,&uplo,&n,A,&ione,&ione,desc,w,
+                            Z,&ione,&ione,desc,&wkopt,&lwork,
+                            &rwkopt,&lrwork,&iwkopt,&liwork,&info);
+  lwork  = (int)creal(wkopt);
+  lrwork = (int)rwkopt;
+  liwork = iwkopt;
+  snew(work,lwork);
+  snew(rwork,lrwork);
+  snew(iwork,liwork);
+  F77_FUNC(pzheevd,PZHEEVD)(&jobz,&uplo,&n,A,&ione,&ione,desc,w,
+                            Z,&ione,&ione,desc,work,&lwork,
+                            rwork,&lrwork,iwork,&liwork,&info);
+  if (info != 0){
+    gmx_fatal(FARGS,"ScaLAPACK returned error code: %d in pzheevd",info);
+  }
+  /* and V[c*n+r] = Z(r,c), i.e. the eigenvectors are rows of V */
+  for (i=0; i<n*n; i++){
+    V[i] = 0;
+  }
+  for (j=0; j<nloc; j++){
+    c = l2g(j,d->nb,d->mycol,d->npcol);
+    for (i=0; i<mloc; i++){
+      r = l2g(i,d->nb,d->myrow,d->nprow);
+      V[c*n+r] = Z[i+j*lld];
+    }
+  }
+  gmx_sumd_sim(2*n*n,(double *)V,d->ms);
+
+  sfree(iwork);
+  sfree(rwork);
+  sfree(work);
+  sfree(Z);
+  sfree(A);
+}
+#endif
+
+gmx_bool qed_dist_zheev(gmx_qed_dist_t d, int n, double *w, dplx *V, dplx *M)
+{
+#ifdef QED_SCALAPACK
+  if (d && d->bActive){
+    send_cmd(d,eqdistZHEEV,n,'N','N');
+    gmx_bcast_masters(n*n*sizeof(dplx),M,0,d->ms);
+    zheev_grid(d,n,w,V,M);
+
+    return TRUE;
+  }
+#endif
+
+  return FALSE;
+}
+
+void qed_dist_serve(gmx_qed_dist_t d)
+{
+  int
+    hdr[4],nalloc=0;
+  double
+    *w=NULL;
+  dplx
+    *A=NULL,*B=NULL,*C=NULL;
+
+  if (d == NULL || d->ms->nsim == 1){
+    return;
+  }
+  do {
+    gmx_bcast_masters(sizeof(hdr),hdr,0,d->ms);
+    if (hdr[1] > nalloc){
+      nalloc = hdr[1];
+      srenew(A,nalloc*nalloc);
+      srenew(B,nalloc*nalloc);
+      srenew(C,nalloc*nalloc);
+      srenew(w,nalloc);
+    }
+    switch (hdr[0]){
+    case eqdistZGEMM:
+      gmx_bcast_masters(hdr[1]*hdr[1]*sizeof(dplx),A,0,d->ms);
+      gmx_bcast_masters(hdr[1]*hdr[1]*sizeof(dplx),B,0,d->ms);
+      zgemm_rows(d,hdr[2],hdr[3],hdr[1],A,B,C);
+      break;
+#ifdef QED_SCALAPACK
+    case eqdistZHEEV:
+      gmx_bcast_masters(hdr[1]*hdr[1]*sizeof(dplx),A,0,d->ms);
+      zheev_grid(d,hdr[1],w,C,A);
+      break;
+#endif
+    case eqdistEND:
+      break;
+    default:
+      gmx_fatal(FARGS,"Unknown distributed QED operation %d",hdr[0]);
+    }
+  } while (hdr[0] != eqdistEND);
+
+  sfree(w);
+  sfree(C);
+  sfree(B);
+  sfree(A);
+}
+
+#else
+int
+gmx_qed_dist_empty;
+#endif
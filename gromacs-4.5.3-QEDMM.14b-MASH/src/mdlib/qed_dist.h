@@ -0,0 +1,100 @@
+/*
+ *
+ *                This source code is part of
+ *
+ *                 G   R   O   M   A   C   S
+ *
+ *          GROningen MAchine for Chemical Simulations
+ *
+ *                        VERSION 3.2.0
+ * Written by David van der Spoel, Erik Lindahl, Berk Hess, and others.
+ * Copyright (c) 1991-2000, University of Groningen, The Netherlands.
+ * Copyright (c) 2001-2004, The GROMACS development team,
+ * check out http://www.gromacs.org for more information.
+
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * If you want to redistribute modifications, please consider that
+ * scientific software is very special. Version control is crucial -
+ * bugs must be traceable. We will be happy to consider code for
+ * inclusion in the official distribution, but derived work must not
+ * be called official GROMACS. Details are found in the README & COPYING
+ * files - if they are missing, get the official version at www.gromacs.org.
+ *
+ * To help us fund GROMACS development, we humbly ask that you cite
+ * the papers on the package - you can find them in the top README file.
+ *
+ * For more info, check our website at http://www.gromacs.org
+ *
+ * And Hey:
+ * Gallium Rubidium Oxygen Manganese Argon Carbon Silicon
+ */
+
+#ifndef _qed_dist_h
+#define _qed_dist_h
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "typedefs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Linear algebra of the polariton matrix, shared by all simulations of
+ * a multisim QED run. Only the master simulation diagonalizes and
+ * propagates; with $QED_DIST set the other simulations, which would
+ * otherwise wait in the next gmx_sumd_sim, serve its dense eigensolver
+ * and matrix products instead:
+ *
+ *   master simulation            other simulations
+ *   qed_dist_begin(d);           qed_dist_serve(d);
+ *   ... qed_dist_zgemm(d,..) ...
+ *   qed_dist_end(d);
+ *
+ * Outside such a section, or with d NULL, everything runs locally.
+ * Matrix products are distributed over row blocks of nb rows, dealt
+ * block-cyclically over the simulations and sent back to the master.
+ * The eigensolver uses ScaLAPACK pzheevd on a block-cyclic nb x nb
+ * distribution when compiled with GMX_SCALAPACK (cmake
+ * -DGMX_SCALAPACK=ON or configure --with-scalapack, both with MPI);
+ * without it qed_dist_zheev returns FALSE and the caller diagonalizes
+ * locally.
+ */
+
+typedef struct gmx_qed_dist *gmx_qed_dist_t;
+
+gmx_qed_dist_t qed_dist_init(const gmx_multisim_t *ms, int nb);
+/* Sets up the distribution over the masters of all simulations in ms,
+ * collective over them.
+ */
+
+void qed_dist_begin(gmx_qed_dist_t d);
+void qed_dist_end(gmx_qed_dist_t d);
+/* Open and close a distributed section on the master simulation */
+
+void qed_dist_serve(gmx_qed_dist_t d);
+/* Take part in the operations of the master simulation until it calls
+ * qed_dist_end. Returns immediately if d is NULL.
+ */
+
+void qed_dist_zgemm(gmx_qed_dist_t d, char opa, char opb, int n,
+                    dplx *A, dplx *B, dplx *C);
+/* C = op(A) op(B) for row major n x n matrices, see qed_zgemm */
+
+gmx_bool qed_dist_zheev(gmx_qed_dist_t d, int n, double *w, dplx *V, dplx *M);
+/* Diagonalizes the hermitian M with the same conventions as diag() in
+ * qm_gaussian.c. Returns FALSE, without touching w and V, when no
+ * distributed eigensolver is available.
+ */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif	/* _qed_dist_h */
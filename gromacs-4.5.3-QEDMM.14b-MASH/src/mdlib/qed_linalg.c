@@ -0,0 +1,608 @@
+/*
+ *
+ *                This source code is part of
+ *
+ *                 G   R   O   M   A   C   S
+ *
+ *          GROningen MAchine for Chemical Simulations
+ *
+ *                        VERSION 3.2.0
+ * Written by David van der Spoel, Erik Lindahl, Berk Hess, and others.
+ * Copyright (c) 1991-2000, University of Groningen, The Netherlands.
+ * Copyright (c) 2001-2004, The GROMACS development team,
+ * check out http://www.gromacs.org for more information.
+
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * If you want to redistribute modifications, please consider that
+ * scientific software is very special. Version control is crucial -
+ * bugs must be traceable. We will be happy to consider code for
+ * inclusion in the official distribution, but derived work must not
+ * be called official GROMACS. Details are found in the README & COPYING
+ * files - if they are missing, get the official version at www.gromacs.org.
+ *
+ * To help us fund GROMACS development, we humbly ask that you cite
+ * the papers on the package - you can find them in the top README file.
+ *
+ * For more info, check our website at http://www.gromacs.org
+ *
+ * And Hey:
+ * GROwing Monsters And Cloning Shrimps
+ */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#ifdef GMX_QMMM_GAUSSIAN
+
+#include <math.h>
+#include <float.h>
+#include <string.h>
+#include "typedefs.h"
+#include "smalloc.h"
+#include "macros.h"
+#include "string2.h"
+#include "gmx_fatal.h"
+#include "qed_linalg.h"
+
+#ifndef F77_FUNC
+#define F77_FUNC(name,NAME) name ## _
+#endif
+
+#include <complex.h>
+#ifdef I
+#undef I
+#endif
+
+#ifdef MKL
+#include <mkl_types.h>
+#include <mkl_blas.h>
+#include <mkl_lapack.h>
+typedef MKL_Complex16 t_lapack_cplx;
+#define QED_ZGEMM  zgemm
+#define QED_ZHERK  zherk
+#define QED_ZGEMV  zgemv
+#define QED_ZHEEV  zheev
+#define QED_ZGESV  zgesv
+#else
+#include <lapacke.h>
+typedef lapack_complex_double t_lapack_cplx;
+#define QED_ZGEMM  F77_FUNC(zgemm,ZGEMM)
+#define QED_ZHERK  F77_FUNC(zherk,ZHERK)
+#define QED_ZGEMV  F77_FUNC(zgemv,ZGEMV)
+#define QED_ZHEEV  F77_FUNC(zheev,ZHEEV)
+#define QED_ZGESV  F77_FUNC(zgesv,ZGESV)
+/* the reference BLAS has no C header */
+extern void QED_ZGEMM(char *transa, char *transb, int *m, int *n, int *k,
+                      t_lapack_cplx *alpha, t_lapack_cplx *a, int *lda,
+                      t_lapack_cplx *b, int *ldb,
+                      t_lapack_cplx *beta, t_lapack_cplx *c, int *ldc);
+extern void QED_ZHERK(char *uplo, char *trans, int *n, int *k,
+                      double *alpha, t_lapack_cplx *a, int *lda,
+                      double *beta, t_lapack_cplx *c, int *ldc);
+extern void QED_ZGEMV(char *trans, int *m, int *n,
+                      t_lapack_cplx *alpha, t_lapack_cplx *a, int *lda,
+                      t_lapack_cplx *x, int *incx,
+                      t_lapack_cplx *beta, t_lapack_cplx *y, int *incy);
+extern void QED_ZHEEV(char *jobz, char *uplo, int *n,
+                      t_lapack_cplx *a, int *lda, double *w,
+                      t_lapack_cplx *work, int *lwork, double *rwork,
+                      int *info);
+extern void QED_ZGESV(int *n, int *nrhs, t_lapack_cplx *a, int *lda,
+                      int *ipiv, t_lapack_cplx *b, int *ldb, int *info);
+#endif
+
+#define IMAG _Complex_I
+
+void qed_zgemm(char opa, char opb, int m, int n, int k,
+               dplx alpha, dplx *A, int lda, dplx *B, int ldb,
+               dplx beta, dplx *C, int ldc)
+{
+  /* read column major, C^T = op(B)^T op(A)^T and op(X)^T is op applied
+   * to the column major X^T
+   */
+  if (m == 0 || n == 0){
+    return;
+  }
+  QED_ZGEMM(&opb,&opa,&n,&m,&k,(t_lapack_cplx *)&alpha,
+            (t_lapack_cplx *)B,&ldb,(t_lapack_cplx *)A,&lda,
+            (t_lapack_cplx *)&beta,(t_lapack_cplx *)C,&ldc);
+}
+
+void qed_zherk_ctc(int n, dplx *S, dplx *C)
+{
+  char
+    uplo='U',trans='N';
+  double
+    one=1,zero=0;
+  int
+    i,j;
+
+  /* column major C^T = conj(S^H S) = S^T conj(S) is the product of
+   * the column major S^T with its adjoint
+   */
+  QED_ZHERK(&uplo,&trans,&n,&n,&one,(t_lapack_cplx *)S,&n,
+            &zero,(t_lapack_cplx *)C,&n);
+  for (j=0; j<n; j++){
+    for (i=j+1; i<n; i++){
+      C[i+j*n] = conj(C[j+i*n]);
+    }
+  }
+}
+
+typedef struct gmx_qed_work {
+  int     nalloc;
+  dplx   *S,*R,*T,*W,*X,*Y,*ct;  /* n x n, ct n                 */
+  double *w;
+  int     nlwork;                /* zheev work, for nlwork == n */
+  int     lwork;
+  dplx   *work;
+  double *rwork;
+  int     nkv;                   /* Krylov vectors, for qed_expv */
+  dplx   *kv;
+  int     nkalloc;               /* and (mmax+1)^2 matrices     */
+  dplx   *kh,*ka,*kx,*kd,*kt,*kf;
+  int    *kpiv;
+  int     nS;                    /* S holds the overlaps of the  */
+  dplx   *Svecold,*Svec;         /* pair below, from track_states */
+} t_qed_work;
+
+gmx_qed_work_t qed_work_init(void)
+{
+  gmx_qed_work_t
+    work;
+
+  snew(work,1);
+
+  return work;
+}
+
+int qed_prop_type(const char *name)
+{
+  if (gmx_strcasecmp(name,"krylov") == 0)
+    return eqedpropKRYLOV;
+  if (gmx_strcasecmp(name,"diag") == 0)
+    return eqedpropDIAG;
+  return -1;
+}
+
+static void qed_work_realloc(gmx_qed_work_t work, int n)
+{
+  if (n > work->nalloc){
+    work->nalloc = n;
+    srenew(work->S,n*n);
+    srenew(work->R,n*n);
+    srenew(work->T,n*n);
+    srenew(work->W,n*n);
+    srenew(work->X,n*n);
+    srenew(work->Y,n*n);
+    srenew(work->ct,n);
+    srenew(work->w,n);
+    srenew(work->rwork,max(1,3*n-2));
+  }
+}
+
+void qed_zheev(gmx_qed_work_t work, int n, double *w, dplx *V, dplx *M)
+{
+  char
+    jobz='V',uplo='U';
+  int
+    lwork=-1,info;
+  dplx
+    wkopt;
+
+  qed_work_realloc(work,n);
+  /* zheev on the memory of M as is gives diag()'s layout directly */
+  memcpy(V,M,n*n*sizeof(dplx));
+  if (work->nlwork != n){
+    QED_ZHEEV(&jobz,&uplo,&n,(t_lapack_cplx *)V,&n,w,
+              (t_lapack_cplx *)&wkopt,&lwork,work->rwork,&info);
+    work->nlwork = n;
+    work->lwork  = max(1,(int)creal(wkopt));
+    srenew(work->work,work->lwork);
+  }
+  QED_ZHEEV(&jobz,&uplo,&n,(t_lapack_cplx *)V,&n,w,
+            (t_lapack_cplx *)work->work,&work->lwork,work->rwork,&info);
+  if (info != 0){
+    gmx_fatal(FARGS,"Lapack returned error code: %d in zheev",info);
+  }
+}
+
+enum { efINVSQRT, efEXP };
+
+/* F = X^H diag(f(w)) X with X = conj(V), V and w from diagonalizing M
+ * as in qed_zheev, i.e. F is the function f of M: M^-1/2, or the
+ * propagator exp(-0.5 I dt M), the 0.5 because M is the sum of the
+ * Hamiltonians at t and t+dt.
+ */
+static void hermfunc(gmx_qed_work_t work, gmx_qed_dist_t dist, int n,
+                     dplx *M, int f, double dt, dplx *F)
+{
+  int
+    i,j;
+  dplx
+    fw,*X=work->X,*Y=work->Y;
+
+  if (!qed_dist_zheev(dist,n,work->w,X,M)){
+    qed_zheev(work,n,work->w,X,M);
+  }
+  for (i=0; i<n; i++){
+    if (f == efINVSQRT){
+      fw = 1.0/csqrt(work->w[i]);
+    }
+    else{
+      fw = cexp(-0.5*IMAG*dt*work->w[i]);
+    }
+    for (j=0; j<n; j++){
+      X[i*n+j] = conj(X[i*n+j]);
+      Y[i*n+j] = fw*X[i*n+j];
+    }
+  }
+  qed_dist_zgemm(dist,'C','N',n,X,Y,F);
+}
+
+void qed_propagate_local_dia(gmx_qed_work_t work, gmx_qed_dist_t dist,
+                             int n, double dt, dplx *C,
+                             dplx *vec, dplx *vecold,
+                             double *E, double *Eold, dplx *U)
+{
+  int
+    i,j,inc=1;
+  char
+    trans='T';
+  dplx
+    one=1,zero=0,*S,*R,*T,*W;
+
+  qed_work_realloc(work,n);
+  S = work->S;
+  R = work->R;
+  T = work->T;
+  W = work->W;
+
+  /* overlaps S_ij = <old i|new j> = conj(vecold vec^H)_ij, unless
+   * qed_track_states left them for this pair of vectors
+   */
+  if (work->nS != n || work->Svecold != vecold || work->Svec != vec){
+    qed_dist_zgemm(dist,'N','C',n,vecold,vec,S);
+    for (i=0; i<n*n; i++){
+      S[i] = conj(S[i]);
+    }
+  }
+  work->nS = 0;
+  /* T = S (S^H S)^-1/2 is the closest unitary matrix to S */
+  qed_zherk_ctc(n,S,W);
+  hermfunc(work,dist,n,W,efINVSQRT,0,R);
+  qed_dist_zgemm(dist,'N','N',n,S,R,T);
+
+  /* the Hamiltonian at t+dt in the basis at t, T E T^H, plus that
+   * at t
+   */
+  for (i=0; i<n; i++){
+    for (j=0; j<n; j++){
+      W[i*n+j] = T[i*n+j]*E[j];
+    }
+  }
+  qed_dist_zgemm(dist,'N','C',n,W,T,R);
+  for (i=0; i<n; i++){
+    R[i*n+i] += Eold[i];
+  }
+  hermfunc(work,dist,n,R,efEXP,dt,W);
+
+  /* U = T^H exp(-0.5 I dt H) and C = U C */
+  qed_dist_zgemm(dist,'C','N',n,T,W,U);
+  QED_ZGEMV(&trans,&n,&n,(t_lapack_cplx *)&one,(t_lapack_cplx *)U,&n,
+            (t_lapack_cplx *)C,&inc,(t_lapack_cplx *)&zero,
+            (t_lapack_cplx *)work->ct,&inc);
+  memcpy(C,work->ct,n*sizeof(dplx));
+}
+
+static dplx zdotc(int n, dplx *x, dplx *y)
+{
+  int
+    i;
+  dplx
+    d=0;
+
+  for (i=0; i<n; i++){
+    d += conj(x[i])*y[i];
+  }
+
+  return d;
+}
+
+void qed_track_states(gmx_qed_work_t work, gmx_qed_dist_t dist, int n,
+                      dplx *vecold, dplx *vecnew,
+                      double *Eold, double *Enew, double window,
+                      gmx_bool bKeepS)
+{
+  int
+    i,j,jmax;
+  double
+    o,omax;
+  dplx
+    *S;
+
+  qed_work_realloc(work,n);
+  S = work->S;
+  work->nS = 0;
+
+  if (bKeepS){
+    /* the propagator needs all of S_ji = <old j|new i>, one zgemm */
+    qed_dist_zgemm(dist,'N','C',n,vecold,vecnew,S);
+    for (i=0; i<n*n; i++){
+      S[i] = conj(S[i]);
+    }
+  }
+  for (i=0; i<n; i++){
+    /* the old state with the largest overlap, within the window */
+    jmax = -1;
+    omax = -1;
+    for (j=0; j<n; j++){
+      if (window > 0 && fabs(Enew[i]-Eold[j]) >= window){
+        continue;
+      }
+      if (!bKeepS){
+        S[j*n+i] = zdotc(n,&vecold[j*n],&vecnew[i*n]);
+      }
+      o = cabs(S[j*n+i]);
+      if (o > omax){
+        omax = o;
+        jmax = j;
+      }
+    }
+    if (jmax < 0){
+      /* nothing in the window, the energies jumped; search all states */
+      for (j=0; j<n; j++){
+        if (!bKeepS){
+          S[j*n+i] = zdotc(n,&vecold[j*n],&vecnew[i*n]);
+        }
+        o = cabs(S[j*n+i]);
+        if (o > omax){
+          omax = o;
+          jmax = j;
+        }
+      }
+    }
+    /* fix the sign of state i, and of its column of S */
+    if (creal(S[jmax*n+i]) < 0){
+      for (j=0; j<n; j++){
+        vecnew[i*n+j] = -vecnew[i*n+j];
+      }
+      if (bKeepS){
+        for (j=0; j<n; j++){
+          S[j*n+i] = -S[j*n+i];
+        }
+      }
+    }
+  }
+  if (bKeepS){
+    work->nS      = n;
+    work->Svecold = vecold;
+    work->Svec    = vecnew;
+  }
+}
+
+static void zaxpy(int n, dplx a, dplx *x, dplx *y)
+{
+  int
+    i;
+
+  for (i=0; i<n; i++){
+    y[i] += a*x[i];
+  }
+}
+
+/* F = exp(A) for a small m x m matrix, Pade (6,6) with scaling and
+ * squaring. N and D are polynomials of A and commute, so F = N D^-1,
+ * which read column major is zgesv's D^T F^T = N^T.
+ */
+static void small_expm(gmx_qed_work_t work, int m, dplx *A, dplx *F)
+{
+  const int
+    p=6;
+  int
+    i,j,k,sq=0,info;
+  double
+    nrm=0,rowsum,c=1;
+  dplx
+    *X=work->kx,*D=work->kd,*T=work->kt;
+
+  for (i=0; i<m; i++){
+    for (j=0,rowsum=0; j<m; j++){
+      rowsum += cabs(A[i*m+j]);
+    }
+    nrm = max(nrm,rowsum);
+  }
+  while (nrm > 0.5){
+    nrm *= 0.5;
+    sq++;
+  }
+  for (i=0; i<m*m; i++){
+    X[i] = A[i]/(double)(1 << sq);
+    F[i] = D[i] = 0;
+  }
+  for (i=0; i<m; i++){
+    F[i*m+i] = D[i*m+i] = 1;
+  }
+  /* T runs over the powers of X */
+  memcpy(T,X,m*m*sizeof(dplx));
+  for (k=1; k<=p; k++){
+    c *= (double)(p-k+1)/(k*(2*p-k+1));
+    for (i=0; i<m*m; i++){
+      F[i] += c*T[i];
+      D[i] += ((k & 1) ? -c : c)*T[i];
+    }
+    if (k < p){
+      qed_zgemm('N','N',m,m,m,1,X,m,T,m,0,A,m);
+      memcpy(T,A,m*m*sizeof(dplx));
+    }
+  }
+  QED_ZGESV(&m,&m,(t_lapack_cplx *)D,&m,work->kpiv,(t_lapack_cplx *)F,&m,
+            &info);
+  if (info != 0){
+    gmx_fatal(FARGS,"Lapack returned error code: %d in zgesv",info);
+  }
+  for (k=0; k<sq; k++){
+    qed_zgemm('N','N',m,m,m,1,F,m,F,m,0,T,m);
+    memcpy(F,T,m*m*sizeof(dplx));
+  }
+}
+
+typedef struct {
+  dplx *H;
+} t_dense_op;
+
+static void dense_matvec(void *op, int n, dplx *x, dplx *y)
+{
+  int
+    inc=1;
+  char
+    trans='T';
+  dplx
+    one=1,zero=0;
+
+  QED_ZGEMV(&trans,&n,&n,(t_lapack_cplx *)&one,
+            (t_lapack_cplx *)((t_dense_op *)op)->H,&n,
+            (t_lapack_cplx *)x,&inc,(t_lapack_cplx *)&zero,
+            (t_lapack_cplx *)y,&inc);
+}
+
+int qed_expv(gmx_qed_work_t work, int n, dplx *H, double tau, dplx *v)
+{
+  int
+    i;
+  double
+    shift=0;
+  t_dense_op
+    op;
+
+  /* the diagonal is dominated by the ground state energy; its mean
+   * only contributes a phase, so we take it out of the Krylov space
+   */
+  for (i=0; i<n; i++){
+    shift += creal(H[i*n+i])/n;
+  }
+  op.H = H;
+
+  return qed_expv_op(work,n,dense_matvec,&op,shift,tau,v);
+}
+
+int qed_expv_op(gmx_qed_work_t work, int n, qed_matvec_t matvec, void *op,
+                double shift, double tau, dplx *v)
+{
+  int
+    i,j,k,m,mmax=min(n,QED_EXPV_MMAX),nmv=0;
+  double
+    t=0,dt,beta,wnorm,hnext,err;
+  dplx
+    h,*V,*Hm,*A,*F;
+  gmx_bool
+    bBreak;
+
+  if (mmax+1 > work->nkalloc){
+    work->nkalloc = mmax+1;
+    k = work->nkalloc*work->nkalloc;
+    srenew(work->kh,k);
+    srenew(work->ka,k);
+    srenew(work->kx,k);
+    srenew(work->kd,k);
+    srenew(work->kt,k);
+    srenew(work->kf,k);
+    srenew(work->kpiv,work->nkalloc);
+  }
+  if (n*(mmax+1) > work->nkv){
+    work->nkv = n*(mmax+1);
+    srenew(work->kv,work->nkv);
+  }
+  V  = work->kv;
+  Hm = work->kh;
+  A  = work->ka;
+  F  = work->kf;
+
+  dt = tau;
+  while (t < tau){
+    beta = sqrt(creal(zdotc(n,v,v)));
+    if (beta == 0){
+      break;
+    }
+    /* Arnoldi with one reorthogonalization pass, which for hermitian H
+     * reduces to Lanczos up to round-off
+     */
+    for (i=0; i<n; i++){
+      V[i] = v[i]/beta;
+    }
+    for (i=0; i<mmax*mmax; i++){
+      Hm[i] = 0;
+    }
+    m      = mmax;
+    hnext  = 0;
+    bBreak = FALSE;
+    for (j=0; j<mmax; j++){
+      matvec(op,n,V+j*n,V+(j+1)*n);
+      zaxpy(n,-shift,V+j*n,V+(j+1)*n);
+      nmv++;
+      wnorm = sqrt(creal(zdotc(n,V+(j+1)*n,V+(j+1)*n)));
+      for (k=0; k<2; k++){
+        for (i=0; i<=j; i++){
+          h = zdotc(n,V+i*n,V+(j+1)*n);
+          zaxpy(n,-h,V+i*n,V+(j+1)*n);
+          Hm[i*mmax+j] += h;
+        }
+      }
+      hnext = sqrt(creal(zdotc(n,V+(j+1)*n,V+(j+1)*n)));
+      if (hnext <= QED_EXPV_BREAK*wnorm){
+        /* invariant subspace, the projection is exact */
+        m      = j+1;
+        bBreak = TRUE;
+        break;
+      }
+      if (j+1 < mmax){
+        Hm[(j+1)*mmax+j] = hnext;
+      }
+      for (i=0; i<n; i++){
+        V[(j+1)*n+i] /= hnext;
+      }
+    }
+    /* exp(-I dt Hm) e_1, shrinking dt until the error estimate of the
+     * truncated basis, beta hnext |F_m1|, is within tol per unit time
+     */
+    dt = min(dt,tau-t);
+    do {
+      for (i=0; i<m; i++){
+        for (j=0; j<m; j++){
+          A[i*m+j] = -IMAG*dt*Hm[i*mmax+j];
+        }
+      }
+      small_expm(work,m,A,F);
+      err = bBreak ? 0 : beta*hnext*cabs(F[(m-1)*m]);
+      if (err > QED_EXPV_TOL*beta*dt/tau){
+        dt *= 0.5;
+      }
+    } while (err > QED_EXPV_TOL*beta*dt/tau && dt > tau*DBL_EPSILON);
+    for (i=0; i<n; i++){
+      v[i] = 0;
+    }
+    for (j=0; j<m; j++){
+      zaxpy(n,beta*F[j*m],V+j*n,v);
+    }
+    t += dt;
+    /* and try a longer one if this step was easy */
+    if (err < 0.1*QED_EXPV_TOL*beta*dt/tau){
+      dt *= 2;
+    }
+  }
+  h = cexp(-IMAG*tau*shift);
+  for (i=0; i<n; i++){
+    v[i] *= h;
+  }
+
+  return nmv;
+}
+
+#else
+int
+gmx_qed_linalg_empty;
+#endif
@@ -0,0 +1,140 @@
+/*
+ *
+ *                This source code is part of
+ *
+ *                 G   R   O   M   A   C   S
+ *
+ *          GROningen MAchine for Chemical Simulations
+ *
+ *                        VERSION 3.2.0
+ * Written by David van der Spoel, Erik Lindahl, Berk Hess, and others.
+ * Copyright (c) 1991-2000, University of Groningen, The Netherlands.
+ * Copyright (c) 2001-2004, The GROMACS development team,
+ * check out http://www.gromacs.org for more information.
+
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * If you want to redistribute modifications, please consider that
+ * scientific software is very special. Version control is crucial -
+ * bugs must be traceable. We will be happy to consider code for
+ * inclusion in the official distribution, but derived work must not
+ * be called official GROMACS. Details are found in the README & COPYING
+ * files - if they are missing, get the official version at www.gromacs.org.
+ *
+ * To help us fund GROMACS development, we humbly ask that you cite
+ * the papers on the package - you can find them in the top README file.
+ *
+ * For more info, check our website at http://www.gromacs.org
+ *
+ * And Hey:
+ * Gallium Rubidium Oxygen Manganese Argon Carbon Silicon
+ */
+
+#ifndef _qed_linalg_h
+#define _qed_linalg_h
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "typedefs.h"
+#include "qed_dist.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Dense complex kernels for the QED propagators, on row major matrices
+ * as used throughout qm_gaussian.c, calling BLAS/LAPACK without
+ * explicit transposes: a row major matrix is the transpose of the same
+ * memory read column major, so op(A) op(B) is obtained by swapping
+ * the operands, keeping the op characters.
+ */
+
+void qed_zgemm(char opa, char opb, int m, int n, int k,
+               dplx alpha, dplx *A, int lda, dplx *B, int ldb,
+               dplx beta, dplx *C, int ldc);
+/* C = alpha op(A) op(B) + beta C, with C m x n, op 'N', 'T' or 'C'
+ * and ld* the row strides.
+ */
+
+void qed_zherk_ctc(int n, dplx *S, dplx *C);
+/* C = S^H S, both triangles filled */
+
+/* Workspace of the propagator, kept in t_QMrec across steps and only
+ * reallocated when ndim grows.
+ */
+typedef struct gmx_qed_work *gmx_qed_work_t;
+
+gmx_qed_work_t qed_work_init(void);
+
+void qed_zheev(gmx_qed_work_t work, int n, double *w, dplx *V, dplx *M);
+/* Diagonalizes the hermitian M, with the conventions of diag() in
+ * qm_gaussian.c: row i of V is the complex conjugate of the i-th
+ * eigenvector of M, w ascending. M is not modified.
+ */
+
+void qed_propagate_local_dia(gmx_qed_work_t work, gmx_qed_dist_t dist,
+                             int n, double dt, dplx *C,
+                             dplx *vec, dplx *vecold,
+                             double *E, double *Eold, dplx *U);
+/* Propagates the adiabatic expansion coefficients C over dt (atomic
+ * units) in the local diabatic basis (Granucci, Persico and Toniolo,
+ * J. Chem. Phys. 114 (2001) 10608), with vecold/Eold the eigenvectors
+ * (rows) and energies at t and vec/E those at t+dt. Returns the
+ * propagator in U. The products go through qed_dist_zgemm.
+ */
+
+void qed_track_states(gmx_qed_work_t work, gmx_qed_dist_t dist, int n,
+                      dplx *vecold, dplx *vecnew,
+                      double *Eold, double *Enew, double window,
+                      gmx_bool bKeepS);
+/* Follows the states from vecold/Eold to vecnew/Enew: every new state
+ * is matched to the old state it overlaps most with, among those less
+ * than window (atomic units, 0 for all) apart in energy, and its sign
+ * flipped if needed to keep that overlap positive. With bKeepS all
+ * overlaps are computed with one zgemm and kept, sign fixes included,
+ * for the qed_propagate_local_dia call on the same vectors; otherwise
+ * only the overlaps in the window are computed.
+ */
+
+/* Propagators of the expansion coefficients, selected with $QED_PROP:
+ * krylov applies exp(-I dt H) to the coefficient vectors with
+ * qed_expv, diag forms the full exponential by diagonalization.
+ */
+enum { eqedpropKRYLOV, eqedpropDIAG, eqedpropNR };
+
+int qed_prop_type(const char *name);
+/* Returns the eqedprop entry for name, or -1 if it is unknown */
+
+#define QED_EXPV_MMAX  30     /* maximum Krylov dimension              */
+#define QED_EXPV_TOL   1e-10  /* error in v over tau, relative to |v|  */
+#define QED_EXPV_BREAK 1e-12  /* relative residual of a happy breakdown */
+
+int qed_expv(gmx_qed_work_t work, int n, dplx *H, double tau, dplx *v);
+/* v = exp(-I tau H) v for a general (hermitian or with losses) row
+ * major n x n H, from the Arnoldi projection of H on the Krylov space
+ * of v, with substeps when tau is too long for QED_EXPV_MMAX vectors.
+ * Costs a few matrix-vector products instead of an n^3 eigensolve;
+ * returns their number.
+ */
+
+typedef void (*qed_matvec_t)(void *op, int n, dplx *x, dplx *y);
+/* y = H x for the operator op, x and y do not overlap */
+
+int qed_expv_op(gmx_qed_work_t work, int n, qed_matvec_t matvec, void *op,
+                double shift, double tau, dplx *v);
+/* qed_expv for an H that is only available through matvec, e.g. the
+ * cavity Hamiltonian of qed_cavity.h. shift should be about the mean
+ * of the diagonal of H, which only adds a phase and is taken out of
+ * the Krylov space.
+ */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif	/* _qed_linalg_h */
@@ -0,0 +1,314 @@
+/* -*- mode: c; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; c-file-style: "stroustrup"; -*-
+ * $Id: gmx_matrix.c,v 1.4 2008/12/02 18:27:57 spoel Exp $
+ * 
+ *                This source code is part of
+ * 
+ *                 G   R   O   M   A   C   S
+ * 
+ *          GROningen MAchine for Chemical Simulations
+ * 
+ *                        VERSION 4.5
+ * Written by David van der Spoel, Erik Lindahl, Berk Hess, and others.
+ * Copyright (c) 1991-2000, University of Groningen, The Netherlands.
+ * Copyright (c) 2001-2008, The GROMACS development team,
+ * check out http://www.gromacs.org for more information.
+ 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * If you want to redistribute modifications, please consider that
+ * scientific software is very special. Version control is crucial -
+ * bugs must be traceable. We will be happy to consider code for
+ * inclusion in the official distribution, but derived work must not
+ * be called official GROMACS. Details are found in the README & COPYING
+ * files - if they are missing, get the official version at www.gromacs.org.
+ * 
+ * To help us fund GROMACS development, we humbly ask that you cite
+ * the papers on the package - you can find them in the top README file.
+ * 
+ * For more info, check our website at http://www.gromacs.org
+ * 
+ * And Hey:
+ * Groningen Machine for Chemical Simulation
+ */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include "smalloc.h"
+#include "macros.h"
+#include "qed_linalg.h"
+
+#include <complex.h>
+#ifdef I
+#undef I
+#endif
+#define IMAG _Complex_I
+
+/* Micro-benchmark of the local diabatic propagator: qed_linalg.c
+ * against the triple loop version propagate_local_dia() had before,
+ * reproduced below. For each ndim on the command line (default
+ * 10 ... 5000) it propagates random coefficients between the
+ * eigenvectors of two nearby random hermitian matrices and reports
+ * the time per call and the largest deviation of U and C. The
+ * reference is skipped above -ref <ndim> (default 1000), as it scales
+ * badly.
+ */
+
+/* ------- reference: the loops formerly in qm_gaussian.c ------- */
+
+static void ref_mm(int n, dplx *A, dplx *B, dplx *C)
+{
+  int i,j,k;
+
+  for (i=0; i<n; i++){
+    for (j=0; j<n; j++){
+      C[i*n+j] = 0.0;
+      for (k=0; k<n; k++){
+        C[i*n+j] += A[i*n+k]*B[k*n+j];
+      }
+    }
+  }
+}
+
+static void ref_dagger(int n, dplx *A, dplx *At)
+{
+  int i,j;
+
+  for (i=0; i<n; i++){
+    for (j=0; j<n; j++){
+      At[i*n+j] = conj(A[j*n+i]);
+    }
+  }
+}
+
+static void ref_diag(gmx_qed_work_t work, int n, double *w, dplx *V, dplx *M)
+{
+  /* same LAPACK call and layout as diag() */
+  qed_zheev(work,n,w,V,M);
+}
+
+/* V^H diag(f) V with V = conj(eigenvectors), as in invsqrtM_complex
+ * and expM_complex2
+ */
+static void ref_func(gmx_qed_work_t work, int n, dplx *A, double dt,
+                     gmx_bool bExp, dplx *B)
+{
+  int i;
+  double *w;
+  dplx *V,*Vt,*wm,*tmp;
+
+  snew(w,n);
+  snew(V,n*n);
+  snew(Vt,n*n);
+  snew(wm,n*n);
+  snew(tmp,n*n);
+  ref_diag(work,n,w,V,A);
+  for (i=0; i<n; i++){
+    wm[i*n+i] = bExp ? cexp(-0.5*IMAG*dt*w[i]) : 1.0/csqrt(w[i]);
+  }
+  for (i=0; i<n*n; i++){
+    V[i] = conj(V[i]);
+  }
+  ref_dagger(n,V,Vt);
+  if (bExp){
+    ref_mm(n,wm,V,tmp);
+    ref_mm(n,Vt,tmp,B);
+  }
+  else{
+    ref_mm(n,Vt,wm,tmp);
+    ref_mm(n,tmp,V,B);
+  }
+  sfree(tmp);
+  sfree(wm);
+  sfree(Vt);
+  sfree(V);
+  sfree(w);
+}
+
+static void ref_propagate(gmx_qed_work_t work, int n, double dt, dplx *C,
+                          dplx *vec, dplx *vecold, double *E,
+                          double *Eold, dplx *U)
+{
+  int i,j,k;
+  dplx *S,*St,*SS,*R,*T,*Tt,*ham,*expH,*ct;
+
+  snew(S,n*n);
+  snew(St,n*n);
+  snew(SS,n*n);
+  snew(R,n*n);
+  snew(T,n*n);
+  snew(Tt,n*n);
+  snew(ham,n*n);
+  snew(expH,n*n);
+  snew(ct,n);
+  for (i=0; i<n; i++){
+    for (j=0; j<n; j++){
+      for (k=0; k<n; k++){
+        S[i*n+j] += conj(vecold[i*n+k])*vec[j*n+k];
+      }
+    }
+  }
+  ref_dagger(n,S,St);
+  ref_mm(n,St,S,SS);
+  ref_func(work,n,SS,0,FALSE,R);
+  ref_mm(n,S,R,T);
+  ref_dagger(n,T,Tt);
+  for (i=0; i<n; i++){
+    for (j=0; j<n; j++){
+      R[i*n+j] = E[i]*Tt[i*n+j];
+    }
+  }
+  ref_mm(n,T,R,ham);
+  for (i=0; i<n; i++){
+    ham[i*n+i] += Eold[i];
+  }
+  ref_func(work,n,ham,dt,TRUE,expH);
+  ref_mm(n,Tt,expH,U);
+  for (i=0; i<n; i++){
+    for (k=0; k<n; k++){
+      ct[i] += U[i*n+k]*C[k];
+    }
+  }
+  memcpy(C,ct,n*sizeof(dplx));
+  sfree(ct);
+  sfree(expH);
+  sfree(ham);
+  sfree(Tt);
+  sfree(T);
+  sfree(R);
+  sfree(SS);
+  sfree(St);
+  sfree(S);
+}
+
+/* ------------------------------------------------------------- */
+
+static double wallclock(void)
+{
+  struct timeval tv;
+
+  gettimeofday(&tv,NULL);
+
+  return tv.tv_sec+1e-6*tv.tv_usec;
+}
+
+/* H = H0 + a random hermitian matrix of size eps */
+static void random_ham(int n, double eps, dplx *H0, dplx *H)
+{
+  int i,j;
+
+  for (i=0; i<n; i++){
+    for (j=i; j<n; j++){
+      H[i*n+j] = H0[i*n+j] +
+        eps*((drand48()-0.5)+IMAG*(i == j ? 0 : drand48()-0.5));
+      H[j*n+i] = conj(H[i*n+j]);
+    }
+  }
+}
+
+int main(int argc,char *argv[])
+{
+  int    def[] = { 10, 20, 50, 100, 200, 500, 1000, 2000, 5000 };
+  int    i,s,n,nrep,refmax=1000,nsize=0,*size;
+  double t0,tnew,tref,dt=0.5,du,dc,norm;
+  double *E,*Eold;
+  dplx   *H0,*H1,*vec,*vecold,*C,*Cr,*U,*Ur;
+  gmx_qed_work_t work;
+
+  snew(size,argc+asize(def));
+  for (i=1; i<argc; i++){
+    if (strcmp(argv[i],"-ref") == 0 && i+1 < argc){
+      refmax = atoi(argv[++i]);
+    }
+    else{
+      size[nsize++] = atoi(argv[i]);
+    }
+  }
+  if (nsize == 0){
+    for (i=0; i<asize(def); i++){
+      size[nsize++] = def[i];
+    }
+  }
+  work = qed_work_init();
+  srand48(1993);
+
+  printf("%6s %5s %12s %12s %8s %10s %10s\n",
+         "ndim","nrep","new (s)","ref (s)","speedup","max|dU|","max|dC|");
+  for (s=0; s<nsize; s++){
+    n = size[s];
+    snew(H0,n*n);
+    snew(H1,n*n);
+    snew(vec,n*n);
+    snew(vecold,n*n);
+    snew(E,n);
+    snew(Eold,n);
+    snew(C,n);
+    snew(Cr,n);
+    snew(U,n*n);
+    snew(Ur,n*n);
+    random_ham(n,1.0,H0,H0);
+    random_ham(n,1e-3,H0,H1);
+    qed_zheev(work,n,Eold,vecold,H0);
+    qed_zheev(work,n,E,vec,H1);
+    for (i=0,norm=0; i<n; i++){
+      C[i] = drand48()+IMAG*drand48();
+      norm += creal(conj(C[i])*C[i]);
+    }
+    for (i=0; i<n; i++){
+      C[i] /= sqrt(norm);
+      Cr[i] = C[i];
+    }
+
+    nrep = max(1,(int)(2e7/((double)n*n*n)));
+    t0 = wallclock();
+    for (i=0; i<nrep; i++){
+      qed_propagate_local_dia(work,NULL,n,dt,C,vec,vecold,E,Eold,U);
+    }
+    tnew = (wallclock()-t0)/nrep;
+
+    tref = 0;
+    du = dc = 0;
+    if (n <= refmax){
+      t0 = wallclock();
+      for (i=0; i<nrep; i++){
+        ref_propagate(work,n,dt,Cr,vec,vecold,E,Eold,Ur);
+      }
+      tref = (wallclock()-t0)/nrep;
+      for (i=0; i<n*n; i++){
+        du = max(du,cabs(U[i]-Ur[i]));
+      }
+      for (i=0; i<n; i++){
+        dc = max(dc,cabs(C[i]-Cr[i]));
+      }
+      printf("%6d %5d %12.4e %12.4e %8.1f %10.2e %10.2e\n",
+             n,nrep,tnew,tref,tref/tnew,du,dc);
+    }
+    else{
+      printf("%6d %5d %12.4e %12s %8s %10s %10s\n",
+             n,nrep,tnew,"-","-","-","-");
+    }
+    fflush(stdout);
+
+    sfree(Ur);
+    sfree(U);
+    sfree(Cr);
+    sfree(C);
+    sfree(Eold);
+    sfree(E);
+    sfree(vecold);
+    sfree(vec);
+    sfree(H1);
+    sfree(H0);
+  }
+  sfree(size);
+
+  return 0;
+}
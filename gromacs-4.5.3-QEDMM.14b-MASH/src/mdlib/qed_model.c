@@ -0,0 +1,202 @@
+/*
+ *
+ *                This source code is part of
+ *
+ *                 G   R   O   M   A   C   S
+ *
+ *          GROningen MAchine for Chemical Simulations
+ *
+ *                        VERSION 3.2.0
+ * Written by David van der Spoel, Erik Lindahl, Berk Hess, and others.
+ * Copyright (c) 1991-2000, University of Groningen, The Netherlands.
+ * Copyright (c) 2001-2004, The GROMACS development team,
+ * check out http://www.gromacs.org for more information.
+
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * If you want to redistribute modifications, please consider that
+ * scientific software is very special. Version control is crucial -
+ * bugs must be traceable. We will be happy to consider code for
+ * inclusion in the official distribution, but derived work must not
+ * be called official GROMACS. Details are found in the README & COPYING
+ * files - if they are missing, get the official version at www.gromacs.org.
+ *
+ * To help us fund GROMACS development, we humbly ask that you cite
+ * the papers on the package - you can find them in the top README file.
+ *
+ * For more info, check our website at http://www.gromacs.org
+ *
+ * And Hey:
+ * GROwing Monsters And Cloning Shrimps
+ */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "typedefs.h"
+#include "smalloc.h"
+#include "vec.h"
+#include "physics.h"
+#include "string2.h"
+#include "gmx_fatal.h"
+#include "qed_model.h"
+
+struct gmx_qed_model {
+  double dE,k,lambda,mu,alpha,sigma;
+  double dEm;      /* dE of this molecule, with the disorder */
+  dvec   u;        /* direction of the transition dipole */
+  double *r0;      /* reference pair distances (bohr), upper triangle */
+};
+
+static void set_param(gmx_qed_model_t model, const char *name, double v)
+{
+  if (gmx_strcasecmp(name,"dE") == 0)
+    model->dE = v;
+  else if (gmx_strcasecmp(name,"k") == 0)
+    model->k = v;
+  else if (gmx_strcasecmp(name,"lambda") == 0)
+    model->lambda = v;
+  else if (gmx_strcasecmp(name,"mu") == 0)
+    model->mu = v;
+  else if (gmx_strcasecmp(name,"alpha") == 0)
+    model->alpha = v;
+  else if (gmx_strcasecmp(name,"sigma") == 0)
+    model->sigma = v;
+  else
+    gmx_fatal(FARGS,"Unknown $QED_MODEL parameter '%s'\n",name);
+}
+
+gmx_qed_model_t qed_model_init(const char *spec, int mol, t_QMrec *qm)
+{
+  gmx_qed_model_t model;
+  char            buf[STRLEN],name[STRLEN],*p;
+  double          v,E2;
+  unsigned int    h;
+
+  snew(model,1);
+  model->dE     = 0.15;
+  model->k      = 0.3;
+  model->lambda = 0.01;
+  model->mu     = 1;
+  model->alpha  = 0.1;
+  model->sigma  = 0;
+  strncpy(buf,spec,STRLEN-1);
+  buf[STRLEN-1] = '\0';
+  for (p = strtok(buf,","); p; p = strtok(NULL,",")){
+    if (gmx_strcasecmp(p,"holstein") == 0)
+      continue;
+    if (sscanf(p,"%[^=]=%lf",name,&v) != 2)
+      gmx_fatal(FARGS,"$QED_MODEL should be name=value,..., not '%s'\n",p);
+    set_param(model,name,v);
+  }
+  /* the same disorder for molecule mol in every run */
+  h = 2654435761u*(unsigned int)(mol+1);
+  h ^= h >> 16;
+  model->dEm = model->dE + model->sigma*(2.0*(h & 0xffff)/0xffff - 1);
+
+  E2 = iprod(qm->E,qm->E);
+  if (E2 > 0){
+    model->u[XX] = qm->E[XX]/sqrt(E2);
+    model->u[YY] = qm->E[YY]/sqrt(E2);
+    model->u[ZZ] = qm->E[ZZ]/sqrt(E2);
+  }
+  else{
+    model->u[XX] = 1;
+  }
+  if (mol == 0)
+    fprintf(stderr,"QED model molecules: dE %g k %g lambda %g mu %g alpha %g "
+            "sigma %g (au)\n",model->dE,model->k,model->lambda,model->mu,
+            model->alpha,model->sigma);
+
+  return model;
+}
+
+real qed_model_compute(gmx_qed_model_t model, t_QMrec *qm, t_MMrec *mm,
+                       rvec QMgrad_S1[], rvec MMgrad_S1[],
+                       rvec QMgrad_S0[], rvec MMgrad_S0[],
+                       rvec *tdm,
+                       rvec tdmX[], rvec tdmY[], rvec tdmZ[],
+                       rvec tdmXMM[], rvec tdmYMM[], rvec tdmZMM[],
+                       double *Eground)
+{
+  int    i,j,d,n=qm->nrQMatoms,p;
+  double r,dr,sdr=0,E0=0;
+  dvec   dx;
+
+  if (model->r0 == NULL){
+    snew(model->r0,n*(n-1)/2+1);
+    for (i=0,p=0; i<n; i++){
+      for (j=i+1; j<n; j++,p++){
+        for (d=0; d<DIM; d++){
+          dx[d] = (qm->xQM[i][d]-qm->xQM[j][d])/BOHR2NM;
+        }
+        model->r0[p] = dnorm(dx);
+      }
+    }
+  }
+  for (i=0; i<n; i++){
+    clear_rvec(QMgrad_S0[i]);
+    clear_rvec(QMgrad_S1[i]);
+    clear_rvec(tdmX[i]);
+    clear_rvec(tdmY[i]);
+    clear_rvec(tdmZ[i]);
+  }
+  for (i=0; i<mm->nrMMatoms; i++){
+    clear_rvec(MMgrad_S0[i]);
+    clear_rvec(MMgrad_S1[i]);
+    clear_rvec(tdmXMM[i]);
+    clear_rvec(tdmYMM[i]);
+    clear_rvec(tdmZMM[i]);
+  }
+  /* every pair adds a spring to E0 and a displacement to E1 and the
+   * transition dipole, all along the unit vector of the pair
+   */
+  for (i=0,p=0; i<n; i++){
+    for (j=i+1; j<n; j++,p++){
+      for (d=0; d<DIM; d++){
+        dx[d] = (qm->xQM[i][d]-qm->xQM[j][d])/BOHR2NM;
+      }
+      r    = dnorm(dx);
+      dr   = r-model->r0[p];
+      E0  += 0.5*model->k*dr*dr;
+      sdr += dr;
+      if (r == 0)
+        continue;
+      for (d=0; d<DIM; d++){
+        dx[d] /= r;
+        QMgrad_S0[i][d] += model->k*dr*dx[d];
+        QMgrad_S0[j][d] -= model->k*dr*dx[d];
+        QMgrad_S1[i][d] += model->lambda*dx[d];
+        QMgrad_S1[j][d] -= model->lambda*dx[d];
+        tdmX[i][d] += model->mu*model->alpha*model->u[XX]*dx[d];
+        tdmX[j][d] -= model->mu*model->alpha*model->u[XX]*dx[d];
+        tdmY[i][d] += model->mu*model->alpha*model->u[YY]*dx[d];
+        tdmY[j][d] -= model->mu*model->alpha*model->u[YY]*dx[d];
+        tdmZ[i][d] += model->mu*model->alpha*model->u[ZZ]*dx[d];
+        tdmZ[j][d] -= model->mu*model->alpha*model->u[ZZ]*dx[d];
+      }
+    }
+  }
+  for (i=0; i<n; i++){
+    rvec_inc(QMgrad_S1[i],QMgrad_S0[i]);
+  }
+  for (d=0; d<DIM; d++){
+    (*tdm)[d] = model->mu*model->u[d]*(1+model->alpha*sdr);
+  }
+  *Eground = E0;
+
+  return E0 + model->dEm + model->lambda*sdr;
+}
+
+void qed_model_done(gmx_qed_model_t model)
+{
+  sfree(model->r0);
+  sfree(model);
+}
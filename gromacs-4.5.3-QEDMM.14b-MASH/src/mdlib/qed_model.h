@@ -0,0 +1,91 @@
+/*
+ *
+ *                This source code is part of
+ *
+ *                 G   R   O   M   A   C   S
+ *
+ *          GROningen MAchine for Chemical Simulations
+ *
+ *                        VERSION 3.2.0
+ * Written by David van der Spoel, Erik Lindahl, Berk Hess, and others.
+ * Copyright (c) 1991-2000, University of Groningen, The Netherlands.
+ * Copyright (c) 2001-2004, The GROMACS development team,
+ * check out http://www.gromacs.org for more information.
+
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * If you want to redistribute modifications, please consider that
+ * scientific software is very special. Version control is crucial -
+ * bugs must be traceable. We will be happy to consider code for
+ * inclusion in the official distribution, but derived work must not
+ * be called official GROMACS. Details are found in the README & COPYING
+ * files - if they are missing, get the official version at www.gromacs.org.
+ *
+ * To help us fund GROMACS development, we humbly ask that you cite
+ * the papers on the package - you can find them in the top README file.
+ *
+ * For more info, check our website at http://www.gromacs.org
+ *
+ * And Hey:
+ * Gallium Rubidium Oxygen Manganese Argon Carbon Silicon
+ */
+
+#ifndef _qed_model_h
+#define _qed_model_h
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "typedefs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Analytic stand-in for the QM program of the cavity QED runs, a
+ * displaced harmonic (Holstein-type) molecule, in atomic units:
+ *
+ *   E0  = sum_p k/2 (r_p - r0_p)^2
+ *   E1  = E0 + dE_m + lambda sum_p (r_p - r0_p)
+ *   tdm = mu u (1 + alpha sum_p (r_p - r0_p))
+ *
+ * over the pairs p of QM atoms, r0 their distances at the first call,
+ * u the direction of the cavity field (x without field) and
+ * dE_m = dE + sigma h(m), h a fixed pseudo-random number in [-1,1] of
+ * molecule m, for static disorder. The MM atoms do not interact with
+ * the model. It returns the energies, gradients, transition dipole and
+ * its gradients as read_gaussian_output_QED does, so everything after
+ * the QM call, the polariton propagation in particular, runs and can
+ * be timed without a QM program.
+ *
+ * Selected with QMprogram = QEDmodel (builds with gaussian, which has
+ * the QED driver), the parameters are in $QED_MODEL, a comma separated
+ * list of name=value of dE (default 0.15), k (0.3), lambda (0.01),
+ * mu (1), alpha (0.1) and sigma (0), or "holstein" for the defaults.
+ */
+
+typedef struct gmx_qed_model *gmx_qed_model_t;
+
+gmx_qed_model_t qed_model_init(const char *spec, int mol, t_QMrec *qm);
+/* The model molecule mol, fatal error on an unknown parameter */
+
+real qed_model_compute(gmx_qed_model_t model, t_QMrec *qm, t_MMrec *mm,
+                       rvec QMgrad_S1[], rvec MMgrad_S1[],
+                       rvec QMgrad_S0[], rvec MMgrad_S0[],
+                       rvec *tdm,
+                       rvec tdmX[], rvec tdmY[], rvec tdmZ[],
+                       rvec tdmXMM[], rvec tdmYMM[], rvec tdmZMM[],
+                       double *Eground);
+/* Returns E(S1) at qm->xQM, the rest as qm_server_compute */
+
+void qed_model_done(gmx_qed_model_t model);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif	/* _qed_model_h */
@@ -0,0 +1,271 @@
+/*
+ *
+ *                This source code is part of
+ *
+ *                 G   R   O   M   A   C   S
+ *
+ *          GROningen MAchine for Chemical Simulations
+ *
+ *                        VERSION 3.2.0
+ * Written by David van der Spoel, Erik Lindahl, Berk Hess, and others.
+ * Copyright (c) 1991-2000, University of Groningen, The Netherlands.
+ * Copyright (c) 2001-2004, The GROMACS development team,
+ * check out http://www.gromacs.org for more information.
+
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * If you want to redistribute modifications, please consider that
+ * scientific software is very special. Version control is crucial -
+ * bugs must be traceable. We will be happy to consider code for
+ * inclusion in the official distribution, but derived work must not
+ * be called official GROMACS. Details are found in the README & COPYING
+ * files - if they are missing, get the official version at www.gromacs.org.
+ *
+ * To help us fund GROMACS development, we humbly ask that you cite
+ * the papers on the package - you can find them in the top README file.
+ *
+ * For more info, check our website at http://www.gromacs.org
+ *
+ * And Hey:
+ * GROwing Monsters And Cloning Shrimps
+ */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "typedefs.h"
+#include "smalloc.h"
+#include "macros.h"
+#include "string2.h"
+#include "gmx_fatal.h"
+#include "qed_modes.h"
+
+#include <complex.h>
+#ifdef I
+#undef I
+#endif
+#define IMAG _Complex_I
+
+struct gmx_qed_modes {
+  double   ratio,hyst,pop;
+  int      nmodes;
+  gmx_bool *bActive;
+  int      nactive;
+  int      *idx;      /* molecules and active modes, see qed_modes_active */
+  int      nidx;      /* size of idx, -1: out of date                */
+  double   popmax;    /* largest population left in inactive modes   */
+};
+
+static void set_param(gmx_qed_modes_t sel, const char *name, double v)
+{
+  if (gmx_strcasecmp(name,"ratio") == 0)
+    sel->ratio = v;
+  else if (gmx_strcasecmp(name,"hyst") == 0)
+    sel->hyst = v;
+  else if (gmx_strcasecmp(name,"pop") == 0)
+    sel->pop = v;
+  else
+    gmx_fatal(FARGS,"Unknown $QED_MODES parameter '%s'\n",name);
+}
+
+gmx_qed_modes_t qed_modes_init(const char *spec, int nmodes)
+{
+  gmx_qed_modes_t sel;
+  char            buf[STRLEN],name[STRLEN],*p;
+  double          v;
+  int             j;
+
+  snew(sel,1);
+  sel->ratio = 10;
+  sel->hyst  = 0.2;
+  sel->pop   = 1e-3;
+  strncpy(buf,spec,STRLEN-1);
+  buf[STRLEN-1] = '\0';
+  for (p = strtok(buf,","); p; p = strtok(NULL,",")){
+    if (sscanf(p,"%[^=]=%lf",name,&v) != 2)
+      gmx_fatal(FARGS,"$QED_MODES should be name=value,..., not '%s'\n",p);
+    set_param(sel,name,v);
+  }
+  if (sel->ratio <= 0 || sel->hyst < 0 || sel->pop < 0)
+    gmx_fatal(FARGS,"$QED_MODES: ratio should be positive, hyst and pop not negative\n");
+  sel->nmodes  = nmodes;
+  sel->nactive = nmodes;
+  sel->nidx    = -1;
+  snew(sel->bActive,nmodes);
+  for (j=0; j<nmodes; j++)
+    sel->bActive[j] = TRUE;
+  fprintf(stderr,"adaptive cavity modes: detuning/coupling ratio %g, "
+          "hysteresis %g, population %g\n",sel->ratio,sel->hyst,sel->pop);
+
+  return sel;
+}
+
+void qed_modes_select(gmx_qed_modes_t sel, int step, int ndim, int nmol,
+                      dplx *M, const double *cre, const double *cim)
+{
+  double   emin,emax,e,det,G,p,pout=0;
+  int      m,j,k,nchange=0;
+  gmx_bool bIn;
+
+  emin = emax = creal(M[0]);
+  for (m=1; m<nmol; m++){
+    e    = creal(M[m*ndim+m]);
+    emin = min(emin,e);
+    emax = max(emax,e);
+  }
+  for (j=0; j<sel->nmodes; j++){
+    k   = nmol+j;
+    e   = creal(M[k*ndim+k]);
+    det = e < emin ? emin-e : (e > emax ? e-emax : 0);
+    G   = 0;
+    for (m=0; m<nmol; m++)
+      G += creal(conj(M[m*ndim+k])*M[m*ndim+k]);
+    G   = sqrt(G);
+    p   = cre ? cre[k]*cre[k]+cim[k]*cim[k] : 0;
+    if (sel->bActive[j])
+      bIn = (det <= sel->ratio*(1+sel->hyst)*G || p >= sel->pop || !cre);
+    else
+      bIn = (det < sel->ratio*G);
+    if (bIn != sel->bActive[j]){
+      fprintf(stderr,"step %d: %s cavity mode %d, detuning/coupling %g, "
+              "population %g\n",step,bIn ? "adding" : "dropping",j,
+              G > 0 ? det/G : HUGE_VAL,p);
+      sel->bActive[j] = bIn;
+      sel->nactive   += bIn ? 1 : -1;
+      nchange++;
+    }
+    if (!bIn){
+      /* a free photon from now on */
+      for (m=0; m<nmol; m++){
+        M[m*ndim+k] = 0;
+        M[k*ndim+m] = 0;
+      }
+      pout += p;
+    }
+  }
+  if (nchange){
+    sel->nidx = -1;
+    fprintf(stderr,"step %d: %d of %d cavity modes active, population "
+            "%g in the others\n",step,sel->nactive,sel->nmodes,pout);
+  }
+  sel->popmax = max(sel->popmax,pout);
+}
+
+gmx_bool qed_modes_diabatic(int ndim, int nmol, const dplx *V,
+                            const double *cre, const double *cim,
+                            double *dre, double *dim)
+{
+  double norm=0;
+  dplx   d;
+  int    i,k;
+
+  for (k=0; k<ndim; k++){
+    dre[k] = dim[k] = 0;
+  }
+  /* the mode columns of an eigenbasis hold ndim-nmol in total */
+  for (i=0; i<ndim; i++){
+    for (k=nmol; k<ndim; k++){
+      norm += creal(conj(V[i*ndim+k])*V[i*ndim+k]);
+    }
+  }
+  if (norm < 0.5*(ndim-nmol))
+    return FALSE;
+  /* row i of V is the conjugate of eigenvector i */
+  for (k=nmol; k<ndim; k++){
+    d = 0;
+    for (i=0; i<ndim; i++){
+      d += (cre[i]+IMAG*cim[i])*conj(V[i*ndim+k]);
+    }
+    dre[k] = creal(d);
+    dim[k] = cimag(d);
+  }
+
+  return TRUE;
+}
+
+gmx_bool qed_modes_coupled(gmx_qed_modes_t sel, int j)
+{
+  return sel == NULL || sel->bActive[j];
+}
+
+const int *qed_modes_active(gmx_qed_modes_t sel, int ndim, int nmol,
+                            int *nr)
+{
+  int j,n;
+
+  if (sel == NULL || sel->nactive == sel->nmodes)
+    return NULL;
+  if (sel->nidx != nmol+sel->nactive){
+    srenew(sel->idx,nmol+sel->nactive);
+    for (n=0; n<nmol; n++)
+      sel->idx[n] = n;
+    for (j=0; j<sel->nmodes; j++)
+      if (sel->bActive[j])
+        sel->idx[n++] = nmol+j;
+    sel->nidx = n;
+  }
+  *nr = sel->nidx;
+
+  return sel->idx;
+}
+
+void qed_modes_gather(int nr, const int *idx, int ndim, const dplx *M,
+                      dplx *Mr)
+{
+  int a,b;
+
+  for (a=0; a<nr; a++)
+    for (b=0; b<nr; b++)
+      Mr[a*nr+b] = M[idx[a]*ndim+idx[b]];
+}
+
+void qed_modes_expand(int nr, const int *idx, int ndim, const dplx *M,
+                      const double *wr, const dplx *Vr,
+                      double *w, dplx *V)
+{
+  int      a,b,i,k;
+  gmx_bool *bIn;
+
+  snew(bIn,ndim);
+  for (a=0; a<nr; a++)
+    bIn[idx[a]] = TRUE;
+  memset(V,0,ndim*ndim*sizeof(*V));
+  /* merge the ascending wr with the diagonal of the other states */
+  a = 0;
+  k = 0;
+  for (i=0; i<ndim; i++){
+    while (k < ndim && bIn[k])
+      k++;
+    if (k < ndim && (a == nr || creal(M[k*ndim+k]) < wr[a])){
+      w[i]        = creal(M[k*ndim+k]);
+      V[i*ndim+k] = 1;
+      k++;
+    }
+    else{
+      w[i] = wr[a];
+      for (b=0; b<nr; b++)
+        V[i*ndim+idx[b]] = Vr[a*nr+b];
+      a++;
+    }
+  }
+  if (a != nr)
+    gmx_incons("qed_modes_expand lost eigenpairs");
+  sfree(bIn);
+}
+
+void qed_modes_done(gmx_qed_modes_t sel)
+{
+  if (sel->popmax > 0)
+    fprintf(stderr,"adaptive cavity modes: at most %g of the population "
+            "in inactive modes\n",sel->popmax);
+  sfree(sel->idx);
+  sfree(sel->bActive);
+  sfree(sel);
+}
@@ -0,0 +1,124 @@
+/*
+ *
+ *                This source code is part of
+ *
+ *                 G   R   O   M   A   C   S
+ *
+ *          GROningen MAchine for Chemical Simulations
+ *
+ *                        VERSION 3.2.0
+ * Written by David van der Spoel, Erik Lindahl, Berk Hess, and others.
+ * Copyright (c) 1991-2000, University of Groningen, The Netherlands.
+ * Copyright (c) 2001-2004, The GROMACS development team,
+ * check out http://www.gromacs.org for more information.
+
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * If you want to redistribute modifications, please consider that
+ * scientific software is very special. Version control is crucial -
+ * bugs must be traceable. We will be happy to consider code for
+ * inclusion in the official distribution, but derived work must not
+ * be called official GROMACS. Details are found in the README & COPYING
+ * files - if they are missing, get the official version at www.gromacs.org.
+ *
+ * To help us fund GROMACS development, we humbly ask that you cite
+ * the papers on the package - you can find them in the top README file.
+ *
+ * For more info, check our website at http://www.gromacs.org
+ *
+ * And Hey:
+ * Gallium Rubidium Oxygen Manganese Argon Carbon Silicon
+ */
+
+#ifndef _qed_modes_h
+#define _qed_modes_h
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "typedefs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Adaptive truncation of the cavity modes, $QED_MODES. Of the ndim =
+ * nmol+nmodes polariton basis states, mode j only takes part in the
+ * dynamics while it is close to the molecular band compared to its
+ * collective coupling,
+ *
+ *   detuning_j < ratio G_j,   G_j = sqrt(sum_m |H[m][nmol+j]|^2),
+ *
+ * with the detuning the distance of H[nmol+j][nmol+j] to the range of
+ * the molecular diagonal. An active mode is only dropped once it is
+ * more than ratio (1+hyst) G_j away and holds less than pop of the
+ * population, so modes near the threshold do not flip every step.
+ *
+ * The couplings of an inactive mode are set to zero: it is a free
+ * photon state that keeps its amplitude, which only changes phase and
+ * decays, so no population is lost when it is dropped or added again.
+ * The diagonalization and propagation then work on the nmol+nactive
+ * states of the active modes only.
+ *
+ * $QED_MODES is a comma separated list of name=value of ratio (default
+ * 10), hyst (0.2) and pop (1e-3).
+ */
+
+typedef struct gmx_qed_modes *gmx_qed_modes_t;
+
+gmx_qed_modes_t qed_modes_init(const char *spec, int nmodes);
+/* All modes start active, fatal error on an unknown parameter */
+
+void qed_modes_select(gmx_qed_modes_t sel, int step, int ndim, int nmol,
+                      dplx *M, const double *cre, const double *cim);
+/* Updates the selection for the Hamiltonian M (row major) and the
+ * coefficients cre + I cim of the diabatic states (molecules, then
+ * modes) of a new step, reports the changes on stderr, and zeroes the
+ * couplings of the inactive modes in M. With cre and cim NULL the
+ * populations are not known and no active mode is dropped.
+ */
+
+gmx_bool qed_modes_diabatic(int ndim, int nmol, const dplx *V,
+                            const double *cre, const double *cim,
+                            double *dre, double *dim);
+/* The mode amplitudes dre + I dim (at nmol ... ndim-1) of the state
+ * with coefficients cre + I cim in the eigenstates, rows of V as diag()
+ * in qm_gaussian.c, for qed_modes_select in the adiabatic
+ * representation. Only the mode columns of V are used, the molecular
+ * entries of dre and dim are zero. FALSE when V holds no eigenvectors
+ * yet (the first step).
+ */
+
+gmx_bool qed_modes_coupled(gmx_qed_modes_t sel, int j);
+/* Whether mode j couples to the molecules, TRUE if sel is NULL */
+
+const int *qed_modes_active(gmx_qed_modes_t sel, int ndim, int nmol,
+                            int *nr);
+/* The nr basis states of the molecules and the active modes, in
+ * order, or NULL when all modes are active (or sel is NULL).
+ */
+
+void qed_modes_gather(int nr, const int *idx, int ndim, const dplx *M,
+                      dplx *Mr);
+/* Mr = M restricted to the states idx, nr x nr */
+
+void qed_modes_expand(int nr, const int *idx, int ndim, const dplx *M,
+                      const double *wr, const dplx *Vr,
+                      double *w, dplx *V);
+/* The eigenpairs of the ndim x ndim M from those (wr, rows of Vr) of
+ * its restriction to idx: the other states are eigenvectors of their
+ * own, with the diagonal of M as eigenvalue. w ascending and the rows
+ * of V the eigenvectors, as diag() in qm_gaussian.c.
+ */
+
+void qed_modes_done(gmx_qed_modes_t sel);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif	/* _qed_modes_h */
@@ -0,0 +1,206 @@
+/* -*- mode: c; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; c-file-style: "stroustrup"; -*-
+ * $Id: gmx_matrix.c,v 1.4 2008/12/02 18:27:57 spoel Exp $
+ * 
+ *                This source code is part of
+ * 
+ *                 G   R   O   M   A   C   S
+ * 
+ *          GROningen MAchine for Chemical Simulations
+ * 
+ *                        VERSION 4.5
+ * Written by David van der Spoel, Erik Lindahl, Berk Hess, and others.
+ * Copyright (c) 1991-2000, University of Groningen, The Netherlands.
+ * Copyright (c) 2001-2008, The GROMACS development team,
+ * check out http://www.gromacs.org for more information.
+ 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * If you want to redistribute modifications, please consider that
+ * scientific software is very special. Version control is crucial -
+ * bugs must be traceable. We will be happy to consider code for
+ * inclusion in the official distribution, but derived work must not
+ * be called official GROMACS. Details are found in the README & COPYING
+ * files - if they are missing, get the official version at www.gromacs.org.
+ * 
+ * To help us fund GROMACS development, we humbly ask that you cite
+ * the papers on the package - you can find them in the top README file.
+ * 
+ * For more info, check our website at http://www.gromacs.org
+ * 
+ * And Hey:
+ * Groningen Machine for Chemical Simulation
+ */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "smalloc.h"
+#include "macros.h"
+#include "qed_linalg.h"
+#include "qed_modes.h"
+
+#include <complex.h>
+#ifdef I
+#undef I
+#endif
+#define IMAG _Complex_I
+
+/* Checks the adaptive cavity modes of qed_modes.c in the adiabatic
+ * representation, where the coefficients are those of the eigenstates.
+ * The lowest mode lies far below the molecular band, but holds the
+ * population, the next one is as far off and empty, the others are in
+ * the band. The mode amplitudes of qed_modes_diabatic are compared to
+ * the diabatic state built from the eigenvectors, which is checked
+ * against H, and with them the selection should keep the populated
+ * mode and drop only the empty one. Without eigenvectors (the first
+ * step) no active mode may be dropped. Exits with 1 if a deviation is
+ * above -tol (default 1e-10) or a mode is selected wrongly.
+ */
+
+#define NMOL   8
+#define NMODES 5
+
+int main(int argc,char *argv[])
+{
+  /* mode energies (au), the first two far below the band at 0.15 */
+  static const double wmode[NMODES] = { 0.02, 0.03, 0.15, 0.152, 0.16 };
+  static const gmx_bool bKeep[NMODES] = { TRUE, FALSE, TRUE, TRUE, TRUE };
+  int              n=NMOL+NMODES,i,j,k,m,nfail=0;
+  double           tol=1e-10,*w,*cre,*cim,*dre,*dim,dev=0,res=0,p0;
+  dplx             *H,*M,*V,*psi,y;
+  gmx_qed_work_t   work;
+  gmx_qed_modes_t  sel;
+
+  for (i=1; i<argc; i++){
+    if (strcmp(argv[i],"-tol") == 0 && i+1 < argc){
+      tol = strtod(argv[++i],NULL);
+    }
+  }
+  work = qed_work_init();
+  srand48(1);
+  snew(H,n*n);
+  snew(M,n*n);
+  snew(V,n*n);
+  snew(w,n);
+  snew(cre,n);
+  snew(cim,n);
+  snew(dre,n);
+  snew(dim,n);
+  snew(psi,n);
+
+  /* the polariton Hamiltonian as call_gaussian_QED builds it */
+  for (m=0; m<NMOL; m++){
+    H[m*n+m] = 0.15+0.005*(2*drand48()-1);
+    for (j=0; j<NMODES; j++){
+      y = 1e-3*(1+0.1*j)*cexp(IMAG*2*M_PI*(j-NMODES/2)*m/NMOL);
+      H[m*n+NMOL+j] = y;
+      H[(NMOL+j)*n+m] = conj(y);
+    }
+  }
+  for (j=0; j<NMODES; j++){
+    H[(NMOL+j)*n+NMOL+j] = wmode[j];
+  }
+  qed_zheev(work,n,w,V,H);
+
+  /* the population in the eigenstate of the lowest mode, with a
+   * little in all others
+   */
+  for (i=0; i<n; i++){
+    cre[i] = 1e-3*(2*drand48()-1);
+    cim[i] = 1e-3*(2*drand48()-1);
+  }
+  k = 0;
+  for (i=1; i<n; i++){
+    if (cabs(V[i*n+NMOL]) > cabs(V[k*n+NMOL])){
+      k = i;
+    }
+  }
+  cre[k] = 0.8;
+  cim[k] = 0.6;
+
+  /* psi = sum_i c_i v_i, with H psi = sum_i c_i w_i v_i */
+  for (m=0; m<n; m++){
+    psi[m] = 0;
+    for (i=0; i<n; i++){
+      psi[m] += (cre[i]+IMAG*cim[i])*conj(V[i*n+m]);
+    }
+  }
+  for (m=0; m<n; m++){
+    y = 0;
+    for (i=0; i<n; i++){
+      y += H[m*n+i]*psi[i];
+      y -= w[i]*(cre[i]+IMAG*cim[i])*conj(V[i*n+m]);
+    }
+    res = max(res,cabs(y));
+  }
+  if (!qed_modes_diabatic(n,NMOL,V,cre,cim,dre,dim)){
+    printf("FAILED: no eigenvectors found\n");
+    return 1;
+  }
+  for (m=0; m<n; m++){
+    dev = max(dev,cabs((m < NMOL ? 0 : psi[m])-(dre[m]+IMAG*dim[m])));
+  }
+  p0 = dre[NMOL]*dre[NMOL]+dim[NMOL]*dim[NMOL];
+  printf("%-34s %10.2e\n","residual of the diabatic state",res);
+  printf("%-34s %10.2e\n","deviation of the mode amplitudes",dev);
+  printf("%-34s %10.4f\n","population of mode 0",p0);
+  printf("%-34s %10.4f\n","eigenstate coefficient at mode 0",
+         cre[NMOL]*cre[NMOL]+cim[NMOL]*cim[NMOL]);
+  if (res > tol || dev > tol || p0 < 0.9){
+    nfail++;
+  }
+
+  sel = qed_modes_init("ratio=10,hyst=0.2,pop=1e-3",NMODES);
+  memcpy(M,H,n*n*sizeof(*M));
+  qed_modes_select(sel,1,n,NMOL,M,dre,dim);
+  for (j=0; j<NMODES; j++){
+    printf("mode %d %-8s (expected %s)\n",j,
+           qed_modes_coupled(sel,j) ? "active" : "dropped",
+           bKeep[j] ? "active" : "dropped");
+    if (qed_modes_coupled(sel,j) != bKeep[j]){
+      nfail++;
+    }
+  }
+  qed_modes_done(sel);
+
+  /* the first step, no eigenvectors and so no populations yet */
+  memset(V,0,n*n*sizeof(*V));
+  sel = qed_modes_init("ratio=10,hyst=0.2,pop=1e-3",NMODES);
+  memcpy(M,H,n*n*sizeof(*M));
+  if (qed_modes_diabatic(n,NMOL,V,cre,cim,dre,dim)){
+    printf("mode amplitudes without eigenvectors\n");
+    nfail++;
+  }
+  qed_modes_select(sel,0,n,NMOL,M,NULL,NULL);
+  for (j=0; j<NMODES; j++){
+    if (!qed_modes_coupled(sel,j)){
+      printf("mode %d dropped without populations\n",j);
+      nfail++;
+    }
+  }
+  qed_modes_done(sel);
+
+  sfree(H);
+  sfree(M);
+  sfree(V);
+  sfree(w);
+  sfree(cre);
+  sfree(cim);
+  sfree(dre);
+  sfree(dim);
+  sfree(psi);
+  if (nfail > 0){
+    printf("FAILED: %d checks\n",nfail);
+    return 1;
+  }
+  printf("passed\n");
+
+  return 0;
+}
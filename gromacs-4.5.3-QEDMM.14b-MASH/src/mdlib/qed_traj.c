@@ -0,0 +1,217 @@
+/*
+ *
+ *                This source code is part of
+ *
+ *                 G   R   O   M   A   C   S
+ *
+ *          GROningen MAchine for Chemical Simulations
+ *
+ *                        VERSION 3.2.0
+ * Written by David van der Spoel, Erik Lindahl, Berk Hess, and others.
+ * Copyright (c) 1991-2000, University of Groningen, The Netherlands.
+ * Copyright (c) 2001-2004, The GROMACS development team,
+ * check out http://www.gromacs.org for more information.
+
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * If you want to redistribute modifications, please consider that
+ * scientific software is very special. Version control is crucial -
+ * bugs must be traceable. We will be happy to consider code for
+ * inclusion in the official distribution, but derived work must not
+ * be called official GROMACS. Details are found in the README & COPYING
+ * files - if they are missing, get the official version at www.gromacs.org.
+ *
+ * To help us fund GROMACS development, we humbly ask that you cite
+ * the papers on the package - you can find them in the top README file.
+ *
+ * For more info, check our website at http://www.gromacs.org
+ *
+ * And Hey:
+ * GROwing Monsters And Cloning Shrimps
+ */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "typedefs.h"
+#include "smalloc.h"
+#include "string2.h"
+#include "gmx_fatal.h"
+#include "qtrio.h"
+#include "qed_traj.h"
+
+struct gmx_qed_traj {
+  char       *fn;
+  float       prec;
+  int         stride,evstride;
+  t_qtrframe *fr;          /* being filled, NULL once handed to the writer */
+  int         molstep;     /* step of the molecules in mol, -1: none */
+  int         nmol;
+  double     *mol;
+};
+
+gmx_qed_traj_t qed_traj_init(const char *spec, const char *fn)
+{
+  gmx_qed_traj_t traj;
+  char           buf[STRLEN],name[STRLEN],*p;
+  double         v;
+
+  snew(traj,1);
+  /* before the QM runs chdir into their subdirectories */
+  traj->fn       = qed_writer_path(fn);
+  traj->stride   = 1;
+  traj->evstride = 1;
+  traj->molstep  = -1;
+  strncpy(buf,spec,STRLEN-1);
+  buf[STRLEN-1] = '\0';
+  for (p = strtok(buf,","); p; p = strtok(NULL,",")){
+    if (gmx_strcasecmp(p,"lossless") == 0)
+      continue;
+    if (sscanf(p,"%[^=]=%lf",name,&v) != 2)
+      gmx_fatal(FARGS,"$QED_TRAJ should be name=value,..., not '%s'\n",p);
+    if (gmx_strcasecmp(name,"prec") == 0)
+      traj->prec = v;
+    else if (gmx_strcasecmp(name,"stride") == 0)
+      traj->stride = (int)v;
+    else if (gmx_strcasecmp(name,"evstride") == 0)
+      traj->evstride = (int)v;
+    else
+      gmx_fatal(FARGS,"Unknown $QED_TRAJ parameter '%s'\n",name);
+  }
+  if (traj->prec < 0 || traj->stride < 1 || traj->evstride < 0)
+    gmx_fatal(FARGS,"$QED_TRAJ needs prec >= 0, stride >= 1 and evstride >= 0\n");
+
+  return traj;
+}
+
+gmx_bool qed_traj_step(gmx_qed_traj_t traj, int step)
+{
+  return (step % traj->stride == 0);
+}
+
+void qed_traj_molecules(gmx_qed_traj_t traj, int step, int nmol,
+                        const double *mol)
+{
+  if (nmol != traj->nmol){
+    traj->nmol = nmol;
+    srenew(traj->mol,5*nmol);
+  }
+  memcpy(traj->mol,mol,5*nmol*sizeof(*mol));
+  traj->molstep = step;
+}
+
+t_qtrframe *qed_traj_frame(gmx_qed_traj_t traj, int step, int layout,
+                           int ndim, int nstate)
+{
+  t_qtrframe *fr;
+  int         i;
+
+  if (traj->fr == NULL)
+    snew(traj->fr,1);
+  fr = traj->fr;
+  fr->step   = step;
+  fr->layout = layout;
+  fr->ndim   = ndim;
+  fr->nstate = nstate;
+  fr->prec   = traj->prec;
+  switch (layout){
+    case eqtrEIGEN:
+      fr->flags = QTR_GAP | QTR_C;
+      break;
+    case eqtrHYBRID:
+      fr->flags = QTR_GAP | QTR_C | QTR_D;
+      break;
+    case eqtrCOEFF:
+      fr->flags = QTR_C;
+      break;
+    case eqtrBRIGHT:
+      fr->flags = QTR_GAP | QTR_POP | QTR_PHOTON;
+      break;
+    default:
+      gmx_incons("Unknown polariton trajectory layout");
+  }
+  if ((layout == eqtrEIGEN || layout == eqtrHYBRID) && traj->evstride > 0 &&
+      (step/traj->stride) % traj->evstride == 0)
+    fr->flags |= QTR_EIGVEC;
+  fr->nmol = 0;
+  if (traj->molstep == step){
+    fr->flags |= QTR_MOL;
+    fr->nmol   = traj->nmol;
+  }
+  qtr_alloc_frame(fr);
+  for (i=0; i<fr->nmol; i++){
+    fr->E0[i]       = traj->mol[5*i];
+    fr->E1[i]       = traj->mol[5*i+1];
+    fr->tdm[3*i]    = traj->mol[5*i+2];
+    fr->tdm[3*i+1]  = traj->mol[5*i+3];
+    fr->tdm[3*i+2]  = traj->mol[5*i+4];
+  }
+
+  return fr;
+}
+
+/* in the writer thread */
+static gmx_bool encode_frame(FILE *fp, void *data)
+{
+  return write_qtr_frame(fp,(t_qtrframe *)data);
+}
+
+static void release_frame(void *data)
+{
+  done_qtrframe((t_qtrframe *)data);
+  sfree(data);
+}
+
+/* the bytes of the arrays of fr, those its flags say it has */
+static size_t frame_size(const t_qtrframe *fr)
+{
+  size_t n=0;
+
+  if (fr->flags & QTR_MOL)
+    n += 5*(size_t)fr->nmol*sizeof(double);
+  if (fr->flags & QTR_GAP)
+    n += fr->nstate*sizeof(double);
+  if (fr->flags & QTR_POP)
+    n += fr->nstate*sizeof(double);
+  if (fr->flags & QTR_PHOTON)
+    n += fr->nstate*(sizeof(double)+sizeof(int));
+  if (fr->flags & QTR_C)
+    n += 2*(size_t)fr->ndim*sizeof(double);
+  if (fr->flags & QTR_D)
+    n += 2*(size_t)fr->ndim*sizeof(double);
+  if (fr->flags & QTR_EIGVEC)
+    n += 2*(size_t)fr->nstate*fr->ndim*sizeof(double);
+
+  return n;
+}
+
+gmx_qed_record_t qed_traj_record(gmx_qed_traj_t traj)
+{
+  t_qtrframe *fr=traj->fr;
+  size_t      size;
+
+  if (fr == NULL)
+    gmx_incons("Polariton trajectory record without a frame");
+  size = frame_size(fr);
+  /* the next frame allocates anew */
+  traj->fr = NULL;
+
+  return qed_record_open_data(traj->fn,"a",encode_frame,release_frame,fr,size);
+}
+
+void qed_traj_done(gmx_qed_traj_t traj)
+{
+  if (traj->fr){
+    done_qtrframe(traj->fr);
+    sfree(traj->fr);
+  }
+  sfree(traj->fn);
+  sfree(traj->mol);
+  sfree(traj);
+}
@@ -0,0 +1,93 @@
+/*
+ *
+ *                This source code is part of
+ *
+ *                 G   R   O   M   A   C   S
+ *
+ *          GROningen MAchine for Chemical Simulations
+ *
+ *                        VERSION 3.2.0
+ * Written by David van der Spoel, Erik Lindahl, Berk Hess, and others.
+ * Copyright (c) 1991-2000, University of Groningen, The Netherlands.
+ * Copyright (c) 2001-2004, The GROMACS development team,
+ * check out http://www.gromacs.org for more information.
+
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * If you want to redistribute modifications, please consider that
+ * scientific software is very special. Version control is crucial -
+ * bugs must be traceable. We will be happy to consider code for
+ * inclusion in the official distribution, but derived work must not
+ * be called official GROMACS. Details are found in the README & COPYING
+ * files - if they are missing, get the official version at www.gromacs.org.
+ *
+ * To help us fund GROMACS development, we humbly ask that you cite
+ * the papers on the package - you can find them in the top README file.
+ *
+ * For more info, check our website at http://www.gromacs.org
+ *
+ * And Hey:
+ * Gallium Rubidium Oxygen Manganese Argon Carbon Silicon
+ */
+
+#ifndef _qed_traj_h
+#define _qed_traj_h
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "typedefs.h"
+#include "qtrio.h"
+#include "qed_writer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* The per-step output of the QED runs as a polariton trajectory,
+ * work_dir/polariton.qtr (see qtrio.h), instead of the text of
+ * eigenvectors.dat, coefficients.dat and energies%d.dat. g_qedtraj
+ * converts it back to these files.
+ *
+ * Selected with $QED_TRAJ, a comma separated list of name=value of
+ *   prec      precision of the compression, 0 (default): lossless
+ *   stride    QM steps between frames (1)
+ *   evstride  frames between frames with the eigenvectors (1), 0: none
+ * or "lossless" for the defaults.
+ *
+ * Every simulation calls qed_traj_molecules, on the steps with a frame;
+ * only the master fills and writes the frames.
+ */
+
+typedef struct gmx_qed_traj *gmx_qed_traj_t;
+
+gmx_qed_traj_t qed_traj_init(const char *spec, const char *fn);
+/* Fatal error on an unknown parameter */
+
+gmx_bool qed_traj_step(gmx_qed_traj_t traj, int step);
+/* Whether step has a frame */
+
+void qed_traj_molecules(gmx_qed_traj_t traj, int step, int nmol,
+                        const double *mol);
+/* E0, E1 and tdm x,y,z of molecule i at mol[5 i], for the frame of step */
+
+t_qtrframe *qed_traj_frame(gmx_qed_traj_t traj, int step, int layout,
+                           int ndim, int nstate);
+/* The frame of step, with the arrays of layout allocated for the caller
+ * to fill and the molecules set; eigvec only at the eigenvector stride
+ */
+
+gmx_qed_record_t qed_traj_record(gmx_qed_traj_t traj);
+/* The frame as a record for the writer, which takes the frame over */
+
+void qed_traj_done(gmx_qed_traj_t traj);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif	/* _qed_traj_h */
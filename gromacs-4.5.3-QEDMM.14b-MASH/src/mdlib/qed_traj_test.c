@@ -0,0 +1,253 @@
+/* -*- mode: c; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; c-file-style: "stroustrup"; -*-
+ * $Id: gmx_matrix.c,v 1.4 2008/12/02 18:27:57 spoel Exp $
+ * 
+ *                This source code is part of
+ * 
+ *                 G   R   O   M   A   C   S
+ * 
+ *          GROningen MAchine for Chemical Simulations
+ * 
+ *                        VERSION 4.5
+ * Written by David van der Spoel, Erik Lindahl, Berk Hess, and others.
+ * Copyright (c) 1991-2000, University of Groningen, The Netherlands.
+ * Copyright (c) 2001-2008, The GROMACS development team,
+ * check out http://www.gromacs.org for more information.
+ 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * If you want to redistribute modifications, please consider that
+ * scientific software is very special. Version control is crucial -
+ * bugs must be traceable. We will be happy to consider code for
+ * inclusion in the official distribution, but derived work must not
+ * be called official GROMACS. Details are found in the README & COPYING
+ * files - if they are missing, get the official version at www.gromacs.org.
+ * 
+ * To help us fund GROMACS development, we humbly ask that you cite
+ * the papers on the package - you can find them in the top README file.
+ * 
+ * For more info, check our website at http://www.gromacs.org
+ * 
+ * And Hey:
+ * Groningen Machine for Chemical Simulation
+ */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "typedefs.h"
+#include "smalloc.h"
+#include "macros.h"
+#include "qtrio.h"
+#include "qed_traj.h"
+#include "qed_writer.h"
+
+/* Round trip of the polariton trajectory: frames of every layout, with
+ * and without the molecules and eigenvectors, are written through
+ * qed_traj.c and the writer thread to -o (default qed_traj_test.qtr)
+ * with $QED_TRAJ lossless, compressed and with strides, and read back
+ * with read_next_qtr_frame. Checks the frames present, their flags and
+ * the arrays: the energies of the molecules exactly, the rest exactly
+ * when lossless, else to 1/prec. Exits with 1 on any difference.
+ */
+
+#define NSTEP 20
+#define NMOL  7
+#define NDIM  12
+
+/* the value of element i of the array with flag a at step */
+static double value(int a, int i, int step)
+{
+  switch (a){
+    case QTR_MOL:
+      return -1000.123456789+0.1*i+step;
+    case QTR_GAP:
+      return 0.001*i+1e-4*step;
+    default:
+      return sin(0.37*i+a+step)/sqrt(NDIM);
+  }
+}
+
+static int layout_of(int step)
+{
+  return step % eqtrNR;
+}
+
+static int nstate_of(int layout)
+{
+  return layout == eqtrCOEFF ? 0 : (layout == eqtrBRIGHT ? 5 : NDIM);
+}
+
+static void fill(int n, double *x, int a, int step)
+{
+  int i;
+
+  for (i=0; i<n; i++)
+    x[i] = value(a,i,step);
+}
+
+static double check(int n, const double *x, int a, int step, double tol,
+                    const char *name, int *nfail)
+{
+  int    i;
+  double dev=0;
+
+  for (i=0; i<n; i++)
+    dev = max(dev,fabs(x[i]-value(a,i,step)));
+  if (dev > tol){
+    printf("step %d: %s deviates by %g\n",step,name,dev);
+    (*nfail)++;
+  }
+  return dev;
+}
+
+int main(int argc,char *argv[])
+{
+  static const char *specs[] = { "lossless", "prec=1000", "stride=2,evstride=3" };
+  static const float prec[]  = { 0, 1000, 0 };
+  static const int   stride[] = { 1, 1, 2 }, evstride[] = { 1, 1, 3 };
+  const char         *fn="qed_traj_test.qtr";
+  int                s,i,step,nframe,nexp,flags,nfail=0;
+  double             mol[5*NMOL],tol,dev;
+  gmx_qed_writer_t   w;
+  gmx_qed_traj_t     traj;
+  t_qtrframe         *fr,rd;
+  FILE               *fp;
+
+  for (i=1; i<argc; i++){
+    if (strcmp(argv[i],"-o") == 0 && i+1 < argc)
+      fn = argv[++i];
+  }
+
+  printf("%-22s %8s %8s %10s\n","$QED_TRAJ","frames","expected","max dev");
+  for (s=0; s<asize(specs); s++){
+    remove(fn);
+    w    = qed_writer_init();
+    traj = qed_traj_init(specs[s],fn);
+    for (step=0; step<NSTEP; step++){
+      if (!qed_traj_step(traj,step))
+        continue;
+      /* the molecules every other step */
+      if (step % 2 == 0){
+        for (i=0; i<NMOL; i++){
+          mol[5*i]   = value(QTR_MOL,i,step);
+          mol[5*i+1] = value(QTR_MOL,NMOL+i,step);
+          mol[5*i+2] = value(QTR_C,3*i,step);
+          mol[5*i+3] = value(QTR_C,3*i+1,step);
+          mol[5*i+4] = value(QTR_C,3*i+2,step);
+        }
+        qed_traj_molecules(traj,step,NMOL,mol);
+      }
+      fr = qed_traj_frame(traj,step,layout_of(step),NDIM,
+                          nstate_of(layout_of(step)));
+      fr->energy      = step;
+      fr->ref         = -0.5;
+      fr->groundstate = 0.25;
+      fr->npol        = (layout_of(step) == eqtrBRIGHT) ? 3 : 0;
+      if (fr->flags & QTR_GAP)
+        fill(fr->nstate,fr->gap,QTR_GAP,step);
+      if (fr->flags & QTR_POP)
+        fill(fr->nstate,fr->pop,QTR_POP,step);
+      if (fr->flags & QTR_PHOTON){
+        fill(fr->nstate,fr->photon,QTR_PHOTON,step);
+        for (i=0; i<fr->nstate; i++)
+          fr->ndeg[i] = (i < fr->npol) ? 1 : i+step;
+      }
+      if (fr->flags & QTR_C)
+        fill(2*NDIM,fr->c,QTR_C,step);
+      if (fr->flags & QTR_D)
+        fill(2*NDIM,fr->d,QTR_D,step);
+      if (fr->flags & QTR_EIGVEC)
+        fill(2*fr->nstate*NDIM,fr->eigvec,QTR_EIGVEC,step);
+      qed_record_close(w,qed_traj_record(traj));
+    }
+    qed_writer_flush(w);
+    qed_traj_done(traj);
+
+    tol    = prec[s] > 0 ? 1/prec[s] : 0;
+    nframe = 0;
+    dev    = 0;
+    memset(&rd,0,sizeof(rd));
+    fp = fopen(fn,"r");
+    if (fp == NULL){
+      printf("FAILED: can not open %s\n",fn);
+      return 1;
+    }
+    for (step=0; step<NSTEP; step+=stride[s]){
+      if (!read_next_qtr_frame(fp,&rd))
+        break;
+      nframe++;
+      flags = 0;
+      if (layout_of(step) == eqtrEIGEN || layout_of(step) == eqtrHYBRID)
+        flags = ((step/stride[s]) % evstride[s] == 0) ? QTR_EIGVEC : 0;
+      if (step % 2 == 0)
+        flags |= QTR_MOL;
+      if (rd.step != step || rd.layout != layout_of(step) ||
+          (rd.flags & (QTR_EIGVEC | QTR_MOL)) != flags ||
+          rd.ndim != NDIM || rd.nstate != nstate_of(rd.layout) ||
+          rd.prec != prec[s] || rd.energy != step || rd.ref != -0.5 ||
+          rd.groundstate != 0.25){
+        printf("step %d: header of step %d, layout %d, flags %d\n",
+               step,rd.step,rd.layout,rd.flags);
+        nfail++;
+        continue;
+      }
+      if (rd.flags & QTR_MOL){
+        for (i=0; i<NMOL; i++){
+          if (rd.E0[i] != value(QTR_MOL,i,step) ||
+              rd.E1[i] != value(QTR_MOL,NMOL+i,step)){
+            printf("step %d: energies of molecule %d\n",step,i);
+            nfail++;
+          }
+        }
+        dev = max(dev,check(3*NMOL,rd.tdm,QTR_C,step,tol,"tdm",&nfail));
+      }
+      if (rd.flags & QTR_GAP)
+        dev = max(dev,check(rd.nstate,rd.gap,QTR_GAP,step,tol,"gap",&nfail));
+      if (rd.flags & QTR_POP)
+        dev = max(dev,check(rd.nstate,rd.pop,QTR_POP,step,tol,"pop",&nfail));
+      if (rd.flags & QTR_PHOTON){
+        dev = max(dev,check(rd.nstate,rd.photon,QTR_PHOTON,step,tol,
+                            "photon",&nfail));
+        for (i=0; i<rd.nstate; i++){
+          if (rd.ndeg[i] != ((i < rd.npol) ? 1 : i+step)){
+            printf("step %d: ndeg of state %d\n",step,i);
+            nfail++;
+          }
+        }
+      }
+      if (rd.flags & QTR_C)
+        dev = max(dev,check(2*NDIM,rd.c,QTR_C,step,tol,"c",&nfail));
+      if (rd.flags & QTR_D)
+        dev = max(dev,check(2*NDIM,rd.d,QTR_D,step,tol,"d",&nfail));
+      if (rd.flags & QTR_EIGVEC)
+        dev = max(dev,check(2*rd.nstate*NDIM,rd.eigvec,QTR_EIGVEC,step,tol,
+                            "eigvec",&nfail));
+    }
+    /* nothing may follow the last frame */
+    if (step >= NSTEP && read_next_qtr_frame(fp,&rd)){
+      printf("frames after the last step\n");
+      nfail++;
+    }
+    fclose(fp);
+    done_qtrframe(&rd);
+    nexp = (NSTEP+stride[s]-1)/stride[s];
+    printf("%-22s %8d %8d %10.2e\n",specs[s],nframe,nexp,dev);
+    if (nframe != nexp)
+      nfail++;
+  }
+  remove(fn);
+  if (nfail > 0){
+    printf("FAILED: %d checks\n",nfail);
+    return 1;
+  }
+  printf("passed\n");
+
+  return 0;
+}
@@ -0,0 +1,341 @@
+/*
+ *
+ *                This source code is part of
+ *
+ *                 G   R   O   M   A   C   S
+ *
+ *          GROningen MAchine for Chemical Simulations
+ *
+ *                        VERSION 3.2.0
+ * Written by David van der Spoel, Erik Lindahl, Berk Hess, and others.
+ * Copyright (c) 1991-2000, University of Groningen, The Netherlands.
+ * Copyright (c) 2001-2004, The GROMACS development team,
+ * check out http://www.gromacs.org for more information.
+
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * If you want to redistribute modifications, please consider that
+ * scientific software is very special. Version control is crucial -
+ * bugs must be traceable. We will be happy to consider code for
+ * inclusion in the official distribution, but derived work must not
+ * be called official GROMACS. Details are found in the README & COPYING
+ * files - if they are missing, get the official version at www.gromacs.org.
+ *
+ * To help us fund GROMACS development, we humbly ask that you cite
+ * the papers on the package - you can find them in the top README file.
+ *
+ * For more info, check our website at http://www.gromacs.org
+ *
+ * And Hey:
+ * GROwing Monsters And Cloning Shrimps
+ */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "typedefs.h"
+#include "smalloc.h"
+#include "gmx_fatal.h"
+#include "gmx_cyclecounter.h"
+#include "qed_writer.h"
+
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#define QED_WRITER_THREAD
+#endif
+
+typedef struct gmx_qed_record {
+  char   *fn;
+  char    mode[3];
+  char   *buf;
+  size_t  len,nalloc;
+  void   *data;                  /* binary record, see qed_record_open_data */
+  qed_record_encode_t encode;
+  void  (*release)(void *data);
+  struct gmx_qed_record *next;
+} t_qed_record;
+
+typedef struct gmx_qed_writer {
+  t_qed_record   *head,*tail;    /* queue, written from the head     */
+  size_t          nbytes;        /* queued                           */
+  gmx_bool        bBusy;         /* the thread is writing a record   */
+  gmx_bool        bQuit;
+  gmx_cycles_t    cycles;        /* spent writing, for wallcycle     */
+  int             nwritten;
+#ifdef QED_WRITER_THREAD
+  pthread_t       thread;
+  pthread_mutex_t mtx;
+  pthread_cond_t  cond_work;     /* records queued or bQuit          */
+  pthread_cond_t  cond_done;     /* a record was written             */
+#endif
+} t_qed_writer;
+
+static void write_record(t_qed_record *r)
+{
+  FILE
+    *fp;
+
+  fp = fopen(r->fn,r->mode);
+  if (fp == NULL){
+    /* we may be in the writer thread, do not bring mdrun down for this */
+    fprintf(stderr,"WARNING: could not open %s, %lu bytes of QED output lost\n",
+            r->fn,(unsigned long)r->len);
+    return;
+  }
+  if (r->encode){
+    if (!r->encode(fp,r->data)){
+      fprintf(stderr,"WARNING: error writing %s\n",r->fn);
+    }
+  }
+  else if (r->len > 0 && fwrite(r->buf,1,r->len,fp) != r->len){
+    fprintf(stderr,"WARNING: error writing %s\n",r->fn);
+  }
+  fclose(fp);
+}
+
+static void free_record(t_qed_record *r)
+{
+  if (r->release){
+    r->release(r->data);
+  }
+  sfree(r->fn);
+  sfree(r->buf);
+  sfree(r);
+}
+
+#ifdef QED_WRITER_THREAD
+static void *writer_thread(void *arg)
+{
+  t_qed_writer
+    *w=(t_qed_writer *)arg;
+  t_qed_record
+    *r;
+  gmx_cycles_t
+    start;
+
+  pthread_mutex_lock(&w->mtx);
+  for(;;){
+    while (w->head == NULL && !w->bQuit){
+      pthread_cond_wait(&w->cond_work,&w->mtx);
+    }
+    if (w->head == NULL){
+      break;
+    }
+    r = w->head;
+    w->head = r->next;
+    if (w->head == NULL){
+      w->tail = NULL;
+    }
+    w->bBusy = TRUE;
+    pthread_mutex_unlock(&w->mtx);
+
+    start = gmx_cycles_read();
+    write_record(r);
+
+    pthread_mutex_lock(&w->mtx);
+    w->cycles += gmx_cycles_read()-start;
+    w->nwritten++;
+    w->nbytes -= r->len;
+    w->bBusy = FALSE;
+    free_record(r);
+    pthread_cond_broadcast(&w->cond_done);
+  }
+  pthread_mutex_unlock(&w->mtx);
+
+  return NULL;
+}
+
+/* there is one writer per process, flushed and stopped at exit so the
+ * restart files are complete
+ */
+static t_qed_writer *the_writer=NULL;
+
+static void writer_atexit(void)
+{
+  t_qed_writer
+    *w=the_writer;
+
+  if (w == NULL){
+    return;
+  }
+  pthread_mutex_lock(&w->mtx);
+  w->bQuit = TRUE;
+  pthread_cond_signal(&w->cond_work);
+  pthread_mutex_unlock(&w->mtx);
+  pthread_join(w->thread,NULL);
+  the_writer = NULL;
+}
+#endif
+
+gmx_qed_writer_t qed_writer_init(void)
+{
+  gmx_qed_writer_t
+    w;
+
+  snew(w,1);
+#ifdef QED_WRITER_THREAD
+  if (the_writer != NULL){
+    gmx_fatal(FARGS,"Only one QED writer per process");
+  }
+  pthread_mutex_init(&w->mtx,NULL);
+  pthread_cond_init(&w->cond_work,NULL);
+  pthread_cond_init(&w->cond_done,NULL);
+  if (pthread_create(&w->thread,NULL,writer_thread,w) != 0){
+    gmx_fatal(FARGS,"Could not start the QED writer thread");
+  }
+  the_writer = w;
+  atexit(writer_atexit);
+#endif
+
+  return w;
+}
+
+char *qed_writer_path(const char *fn)
+{
+  char
+    cwd[STRLEN],*path;
+
+  if (fn[0] == '/')
+    return strdup(fn);
+  if (getcwd(cwd,STRLEN) == NULL)
+    gmx_fatal(FARGS,"Can not determine the working directory\n");
+  snew(path,strlen(cwd)+strlen(fn)+2);
+  sprintf(path,"%s/%s",cwd,fn);
+
+  return path;
+}
+
+gmx_qed_record_t qed_record_open(const char *fn, const char *mode)
+{
+  gmx_qed_record_t
+    r;
+
+  snew(r,1);
+  /* the writer thread opens fn later, the working directory may have
+   * changed by then (the QM runs chdir into qm->subdir)
+   */
+  r->fn      = qed_writer_path(fn);
+  r->mode[0] = (mode[0] == 'w') ? 'w' : 'a';
+  r->mode[1] = '\0';
+
+  return r;
+}
+
+gmx_qed_record_t qed_record_open_data(const char *fn, const char *mode,
+                                      qed_record_encode_t encode,
+                                      void (*release)(void *data),
+                                      void *data, size_t size)
+{
+  gmx_qed_record_t
+    r;
+
+  r = qed_record_open(fn,mode);
+  r->mode[1] = 'b';
+  r->mode[2] = '\0';
+  r->encode  = encode;
+  r->release = release;
+  r->data    = data;
+  /* only for the limit on the queue */
+  r->len     = size;
+
+  return r;
+}
+
+void qed_record_printf(gmx_qed_record_t r, const char *fmt, ...)
+{
+  va_list
+    ap;
+  int
+    n;
+
+  for(;;){
+    va_start(ap,fmt);
+    n = vsnprintf(r->buf ? r->buf+r->len : NULL,r->nalloc-r->len,fmt,ap);
+    va_end(ap);
+    if (n < 0){
+      gmx_fatal(FARGS,"Formatting QED output for %s",r->fn);
+    }
+    if (r->len+n < r->nalloc){
+      r->len += n;
+      return;
+    }
+    r->nalloc = 2*(r->len+n)+256;
+    srenew(r->buf,r->nalloc);
+  }
+}
+
+double qed_record_close(gmx_qed_writer_t w, gmx_qed_record_t r)
+{
+  gmx_cycles_t
+    start=gmx_cycles_read();
+
+#ifdef QED_WRITER_THREAD
+  if (w != NULL){
+    pthread_mutex_lock(&w->mtx);
+    while (w->nbytes > 0 && w->nbytes+r->len > QED_WRITER_MAXBYTES){
+      pthread_cond_wait(&w->cond_done,&w->mtx);
+    }
+    r->next = NULL;
+    if (w->tail){
+      w->tail->next = r;
+    }
+    else{
+      w->head = r;
+    }
+    w->tail    = r;
+    w->nbytes += r->len;
+    pthread_cond_signal(&w->cond_work);
+    pthread_mutex_unlock(&w->mtx);
+
+    return gmx_cycles_read()-start;
+  }
+#endif
+  write_record(r);
+  free_record(r);
+
+  return gmx_cycles_read()-start;
+}
+
+void qed_writer_flush(gmx_qed_writer_t w)
+{
+#ifdef QED_WRITER_THREAD
+  if (w != NULL){
+    pthread_mutex_lock(&w->mtx);
+    while (w->head != NULL || w->bBusy){
+      pthread_cond_wait(&w->cond_done,&w->mtx);
+    }
+    pthread_mutex_unlock(&w->mtx);
+  }
+#endif
+}
+
+double qed_writer_cycles(gmx_qed_writer_t w, int *n)
+{
+  double
+    c=0;
+
+  *n = 0;
+  if (w == NULL){
+    return 0;
+  }
+#ifdef QED_WRITER_THREAD
+  pthread_mutex_lock(&w->mtx);
+#endif
+  c  = w->cycles;
+  *n = w->nwritten;
+  w->cycles   = 0;
+  w->nwritten = 0;
+#ifdef QED_WRITER_THREAD
+  pthread_mutex_unlock(&w->mtx);
+#endif
+
+  return c;
+}
@@ -0,0 +1,115 @@
+/*
+ *
+ *                This source code is part of
+ *
+ *                 G   R   O   M   A   C   S
+ *
+ *          GROningen MAchine for Chemical Simulations
+ *
+ *                        VERSION 3.2.0
+ * Written by David van der Spoel, Erik Lindahl, Berk Hess, and others.
+ * Copyright (c) 1991-2000, University of Groningen, The Netherlands.
+ * Copyright (c) 2001-2004, The GROMACS development team,
+ * check out http://www.gromacs.org for more information.
+
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * If you want to redistribute modifications, please consider that
+ * scientific software is very special. Version control is crucial -
+ * bugs must be traceable. We will be happy to consider code for
+ * inclusion in the official distribution, but derived work must not
+ * be called official GROMACS. Details are found in the README & COPYING
+ * files - if they are missing, get the official version at www.gromacs.org.
+ *
+ * To help us fund GROMACS development, we humbly ask that you cite
+ * the papers on the package - you can find them in the top README file.
+ *
+ * For more info, check our website at http://www.gromacs.org
+ *
+ * And Hey:
+ * Gallium Rubidium Oxygen Manganese Argon Carbon Silicon
+ */
+
+#ifndef _qed_writer_h
+#define _qed_writer_h
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include "typedefs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Background writer for the per-step output of the QED runs
+ * (energies%d.dat, eigenvectors.dat, C.dat, ...). A record collects the
+ * text for one file in memory and is handed to a writer thread when
+ * closed, so the files are written while mdrun waits for the next QM
+ * calculation instead of on the critical path of the step:
+ *
+ *   r = qed_record_open(fn,"a");
+ *   qed_record_printf(r,...);
+ *   qed_record_close(w,r);
+ *
+ * Records are written in the order they are closed. Without thread
+ * support, or with w NULL, qed_record_close writes immediately.
+ */
+
+typedef struct gmx_qed_writer *gmx_qed_writer_t;
+typedef struct gmx_qed_record *gmx_qed_record_t;
+
+gmx_qed_writer_t qed_writer_init(void);
+/* Starts the writer thread. Queued records are flushed at exit. */
+
+gmx_qed_record_t qed_record_open(const char *fn, const char *mode);
+/* Starts a record for file fn, appended to with mode "a" or replaced
+ * with mode "w". A relative fn is taken from the current working
+ * directory, as fopen would now.
+ */
+
+char *qed_writer_path(const char *fn);
+/* Returns fn made absolute against the current working directory,
+ * free with sfree
+ */
+
+void qed_record_printf(gmx_qed_record_t r, const char *fmt, ...);
+/* As fprintf, into the record */
+
+typedef gmx_bool (*qed_record_encode_t)(FILE *fp, void *data);
+
+gmx_qed_record_t qed_record_open_data(const char *fn, const char *mode,
+                                      qed_record_encode_t encode,
+                                      void (*release)(void *data),
+                                      void *data, size_t size);
+/* A binary record: the writer passes data to encode with fn open in
+ * mode, then to release. It takes data over, which the caller should
+ * not touch anymore, so encode may run in the writer thread. size is
+ * about the bytes encode writes. Not for qed_record_printf.
+ */
+
+double qed_record_close(gmx_qed_writer_t w, gmx_qed_record_t r);
+/* Queues r for writing and frees it. Only blocks when more than
+ * QED_WRITER_MAXBYTES are queued; returns the cycles spent waiting.
+ */
+
+void qed_writer_flush(gmx_qed_writer_t w);
+/* Returns when all queued records have been written */
+
+double qed_writer_cycles(gmx_qed_writer_t w, int *n);
+/* Returns the cycles the writer thread spent writing since the last
+ * call, and in n the number of records written
+ */
+
+#define QED_WRITER_MAXBYTES (64*1024*1024)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif	/* _qed_writer_h */
@@ -0,0 +1,283 @@
+/*
+ *
+ *                This source code is part of
+ *
+ *                 G   R   O   M   A   C   S
+ *
+ *          GROningen MAchine for Chemical Simulations
+ *
+ *                        VERSION 3.2.0
+ * Written by David van der Spoel, Erik Lindahl, Berk Hess, and others.
+ * Copyright (c) 1991-2000, University of Groningen, The Netherlands.
+ * Copyright (c) 2001-2004, The GROMACS development team,
+ * check out http://www.gromacs.org for more information.
+
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * If you want to redistribute modifications, please consider that
+ * scientific software is very special. Version control is crucial -
+ * bugs must be traceable. We will be happy to consider code for
+ * inclusion in the official distribution, but derived work must not
+ * be called official GROMACS. Details are found in the README & COPYING
+ * files - if they are missing, get the official version at www.gromacs.org.
+ *
+ * To help us fund GROMACS development, we humbly ask that you cite
+ * the papers on the package - you can find them in the top README file.
+ *
+ * For more info, check our website at http://www.gromacs.org
+ *
+ * And Hey:
+ * GROwing Monsters And Cloning Shrimps
+ */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include "typedefs.h"
+#include "smalloc.h"
+#include "names.h"
+#include "gmx_fatal.h"
+#include "qm_backend.h"
+
+/* declarations of the interfaces to the QM packages. The _SH indicate
+ * the QM interfaces can be used for Surface Hopping simulations 
+ */
+#ifdef GMX_QMMM_GAMESS
+/* GAMESS interface */
+
+void 
+init_gamess(t_commrec *cr, t_QMrec *qm, t_MMrec *mm);
+
+real 
+call_gamess(t_commrec *cr,t_forcerec *fr,
+            t_QMrec *qm, t_MMrec *mm,rvec f[], rvec fshift[]);
+#endif
+
+#ifdef GMX_QMMM_MOPAC
+/* MOPAC interface */
+
+void 
+init_mopac(t_commrec *cr, t_QMrec *qm, t_MMrec *mm);
+
+real 
+call_mopac(t_commrec *cr,t_forcerec *fr, t_QMrec *qm, 
+           t_MMrec *mm,rvec f[], rvec fshift[]);
+
+real 
+call_mopac_SH(t_commrec *cr,t_forcerec *fr,t_QMrec *qm, 
+              t_MMrec *mm,rvec f[], rvec fshift[]);
+#endif
+
+#ifdef GMX_QMMM_GAUSSIAN
+/* GAUSSIAN interface */
+
+void 
+init_gaussian(t_commrec *cr ,t_QMrec *qm, t_MMrec *mm);
+
+real 
+call_gaussian_SH(t_commrec *cr,t_forcerec *fr,t_QMrec *qm, 
+                 t_MMrec *mm,rvec f[], rvec fshift[]);
+
+real 
+call_gaussian(t_commrec *cr,t_forcerec *fr, t_QMrec *qm,
+              t_MMrec *mm,rvec f[], rvec fshift[]);
+
+real 
+call_gaussian_QED(t_commrec *cr,t_forcerec *fr, t_QMrec *qm,
+              t_MMrec *mm,rvec f[], rvec fshift[]);
+
+void
+done_gaussian(t_QMrec *qm);
+
+void
+checkpoint_gaussian(t_QMrec *qm);
+#endif
+
+/* ORCA interface, qm_orca.c is always compiled */
+
+void 
+init_orca(t_commrec *cr ,t_QMrec *qm, t_MMrec *mm);
+
+real 
+call_orca(t_commrec *cr,t_forcerec *fr, t_QMrec *qm,
+              t_MMrec *mm,rvec f[], rvec fshift[]);
+
+/* analytic mock QM, see qm_mock.c */
+
+void
+init_mock(t_commrec *cr, t_QMrec *qm, t_MMrec *mm);
+
+real
+call_mock(t_commrec *cr,t_forcerec *fr, t_QMrec *qm,
+          t_MMrec *mm,rvec f[], rvec fshift[]);
+
+void
+done_mock(t_QMrec *qm);
+
+
+#ifdef GMX_QMMM_GAUSSIAN
+static real compute_gaussian(t_commrec *cr, t_forcerec *fr, t_QMrec *qm,
+                             t_MMrec *mm, rvec f[], rvec fshift[])
+{
+  if (qm->bSH)
+    return call_gaussian_SH(cr,fr,qm,mm,f,fshift);
+  else if (qm->bQED)
+    return call_gaussian_QED(cr,fr,qm,mm,f,fshift);
+  else
+    return call_gaussian(cr,fr,qm,mm,f,fshift);
+}
+
+static const t_qm_backend qmb_gaussian = {
+  "Gaussian",
+  eQMcapSEMIEMP | eQMcapABINITIO | eQMcapMM | eQMcapSH | eQMcapQED |
+  eQMcapOPT | eQMcapMTS,
+  init_gaussian, compute_gaussian, done_gaussian, checkpoint_gaussian
+};
+
+/* the analytic model molecules of qed_model.c in the QED driver of
+ * qm_gaussian.c, without running gaussian
+ */
+static const t_qm_backend qmb_qedmodel = {
+  "QEDmodel",
+  eQMcapSEMIEMP | eQMcapABINITIO | eQMcapMM | eQMcapQED | eQMcapMTS,
+  init_gaussian, call_gaussian_QED, done_gaussian, checkpoint_gaussian
+};
+#endif
+
+#ifdef GMX_QMMM_GAMESS
+static const t_qm_backend qmb_gamess = {
+  "GAMESS",
+  eQMcapABINITIO | eQMcapMM | eQMcapREINIT,
+  init_gamess, call_gamess, NULL, NULL
+};
+#endif
+
+#ifdef GMX_QMMM_MOPAC
+static real compute_mopac(t_commrec *cr, t_forcerec *fr, t_QMrec *qm,
+                          t_MMrec *mm, rvec f[], rvec fshift[])
+{
+  if (qm->bSH)
+    return call_mopac_SH(cr,fr,qm,mm,f,fshift);
+  else
+    return call_mopac(cr,fr,qm,mm,f,fshift);
+}
+
+static const t_qm_backend qmb_mopac = {
+  "MOPAC",
+  eQMcapSEMIEMP | eQMcapSH | eQMcapREINIT,
+  init_mopac, compute_mopac, NULL, NULL
+};
+#endif
+
+static const t_qm_backend qmb_orca = {
+  "ORCA",
+  eQMcapABINITIO | eQMcapMM | eQMcapOPT,
+  init_orca, call_orca, NULL, NULL
+};
+
+static const t_qm_backend qmb_mock = {
+  "mock",
+  eQMcapSEMIEMP | eQMcapABINITIO | eQMcapMM,
+  init_mock, call_mock, done_mock, NULL
+};
+
+static const t_qm_backend *qm_backends[eQMprogramNR];
+static gmx_bool bRegistered = FALSE;
+
+static void register_builtin(void)
+{
+  /* only called from mdrun's main thread while setting up */
+  if (bRegistered)
+    return;
+  bRegistered = TRUE;
+#ifdef GMX_QMMM_GAUSSIAN
+  qm_backends[eQMprogramGAUSSIAN] = &qmb_gaussian;
+  qm_backends[eQMprogramQEDMODEL] = &qmb_qedmodel;
+#endif
+#ifdef GMX_QMMM_GAMESS
+  qm_backends[eQMprogramGAMESS]   = &qmb_gamess;
+#endif
+#ifdef GMX_QMMM_MOPAC
+  qm_backends[eQMprogramMOPAC]    = &qmb_mopac;
+#endif
+  qm_backends[eQMprogramORCA]     = &qmb_orca;
+  qm_backends[eQMprogramMOCK]     = &qmb_mock;
+}
+
+void qm_backend_register(int program, const t_qm_backend *backend)
+{
+  if (program <= eQMprogramDEFAULT || program >= eQMprogramNR)
+    gmx_incons("registering a QM program with an invalid number");
+  register_builtin();
+  qm_backends[program] = backend;
+}
+
+const t_qm_backend *qm_backend_get(int program)
+{
+  register_builtin();
+  if (program <= eQMprogramDEFAULT || program >= eQMprogramNR)
+    return NULL;
+
+  return qm_backends[program];
+}
+
+static int default_program(t_QMrec *qm, gmx_bool bMM)
+{
+  /* the choice the GMX_QMMM_* defines used to make: semi-empirical
+   * without MM charges with MOPAC, otherwise the ab-initio program
+   */
+  if (qm->QMmethod<eQMmethodRHF && !bMM && qm_backend_get(eQMprogramMOPAC))
+    return eQMprogramMOPAC;
+#ifdef GMX_QMMM_GAMESS
+  return eQMprogramGAMESS;
+#elif defined GMX_QMMM_GAUSSIAN
+  return eQMprogramGAUSSIAN;
+#elif defined GMX_QMMM_ORCA
+  return eQMprogramORCA;
+#else
+  gmx_fatal(FARGS,"mdrun was built without a QM program, select one "
+            "with QMprogram (%s is always available)",
+            eQMprogram_names[eQMprogramMOCK]);
+  return eQMprogramDEFAULT;
+#endif
+}
+
+void qm_backend_select(t_QMrec *qm, int program, gmx_bool bMM)
+{
+  const t_qm_backend
+    *b;
+  int
+    need=0;
+  
+  if (program == eQMprogramDEFAULT)
+    program = default_program(qm,bMM);
+  b = qm_backend_get(program);
+  if (b == NULL)
+    gmx_fatal(FARGS,"QM program %s is not available in this mdrun",
+              EQMPROGRAM(program));
+  
+  need |= (qm->QMmethod<eQMmethodRHF) ? eQMcapSEMIEMP : eQMcapABINITIO;
+  if (bMM)
+    need |= eQMcapMM;
+  if (qm->bSH)
+    need |= eQMcapSH;
+  if (qm->bQED)
+    need |= eQMcapQED;
+  if (qm->bOPT || qm->bTS)
+    need |= eQMcapOPT;
+  if ((b->caps & need) != need)
+    gmx_fatal(FARGS,"QM program %s can not do %s%s%s%s%s",b->name,
+              EQMMETHOD(qm->QMmethod),
+              (need & ~b->caps & eQMcapMM)  ? ", MM point charges" : "",
+              (need & ~b->caps & eQMcapSH)  ? ", surface hopping"  : "",
+              (need & ~b->caps & eQMcapQED) ? ", cavity QED"       : "",
+              (need & ~b->caps & eQMcapOPT) ? ", optimisation"     : "");
+  
+  qm->QMprogram = program;
+  qm->backend   = b;
+}
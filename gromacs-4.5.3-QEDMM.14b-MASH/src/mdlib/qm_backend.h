@@ -0,0 +1,108 @@
+/*
+ *
+ *                This source code is part of
+ *
+ *                 G   R   O   M   A   C   S
+ *
+ *          GROningen MAchine for Chemical Simulations
+ *
+ *                        VERSION 3.2.0
+ * Written by David van der Spoel, Erik Lindahl, Berk Hess, and others.
+ * Copyright (c) 1991-2000, University of Groningen, The Netherlands.
+ * Copyright (c) 2001-2004, The GROMACS development team,
+ * check out http://www.gromacs.org for more information.
+
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * If you want to redistribute modifications, please consider that
+ * scientific software is very special. Version control is crucial -
+ * bugs must be traceable. We will be happy to consider code for
+ * inclusion in the official distribution, but derived work must not
+ * be called official GROMACS. Details are found in the README & COPYING
+ * files - if they are missing, get the official version at www.gromacs.org.
+ *
+ * To help us fund GROMACS development, we humbly ask that you cite
+ * the papers on the package - you can find them in the top README file.
+ *
+ * For more info, check our website at http://www.gromacs.org
+ *
+ * And Hey:
+ * Gallium Rubidium Oxygen Manganese Argon Carbon Silicon
+ */
+
+#ifndef _qm_backend_h
+#define _qm_backend_h
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "typedefs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* QM programs are accessed through a table of functions, one entry
+ * per eQMprogram (see enums.h). The programs mdrun was built with,
+ * and the analytic mock program, are registered on first use, others
+ * can be added with qm_backend_register. Every QM group selects its
+ * program with the QMprogram mdp option; default picks the one of the
+ * build, as the GMX_QMMM_* defines used to.
+ */
+
+/* capabilities of a QM program */
+enum {
+  eQMcapSEMIEMP  = 1<<0, /* semi-empirical methods                   */
+  eQMcapABINITIO = 1<<1, /* ab-initio and DFT methods                */
+  eQMcapMM       = 1<<2, /* MM point charges (normal QM/MM scheme)   */
+  eQMcapSH       = 1<<3, /* surface hopping                          */
+  eQMcapQED      = 1<<4, /* cavity QED                               */
+  eQMcapOPT      = 1<<5, /* QM optimisation and TS search            */
+  eQMcapREINIT   = 1<<6, /* keeps its setup in global (COMMON) state,
+                          * init again before each call when more QM
+                          * groups use it
+                          */
+  eQMcapMTS      = 1<<7  /* propagates cavity QED on the inner steps of
+                          * $QMMM_MTS from the last QM results
+                          */
+};
+
+typedef struct gmx_qm_backend {
+  const char *name;
+  int        caps;       /* eQMcap* flags */
+  void       (*init)(t_commrec *cr, t_QMrec *qm, t_MMrec *mm);
+  real       (*compute)(t_commrec *cr, t_forcerec *fr, t_QMrec *qm,
+                        t_MMrec *mm, rvec f[], rvec fshift[]);
+  /* compute returns the QM energy (kJ/mol) and puts the gradients
+   * (kJ/mol/nm) on the QM atoms and then the MM atoms in f and fshift
+   */
+  void       (*done)(t_QMrec *qm); /* may be NULL */
+  void       (*checkpoint)(t_QMrec *qm); /* store restart files at the
+                                          * checkpoints of mdrun, may
+                                          * be NULL
+                                          */
+} t_qm_backend;
+
+void qm_backend_register(int program, const t_qm_backend *backend);
+/* Makes backend available as QM program eQMprogram program, replaces
+ * an earlier registration. backend should stay valid.
+ */
+
+const t_qm_backend *qm_backend_get(int program);
+/* Returns the backend of program, NULL if it is not available. */
+
+void qm_backend_select(t_QMrec *qm, int program, gmx_bool bMM);
+/* Sets qm->QMprogram and qm->backend to program, resolving
+ * eQMprogramDEFAULT. Fatal error when it is not available or can not
+ * do what qm asks for; bMM when qm gets MM point charges.
+ */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif	/* _qm_backend_h */
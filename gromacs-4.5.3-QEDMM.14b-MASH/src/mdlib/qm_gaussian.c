@@ -70,6 +70,20 @@
 #include "do_fit.h"
 /* eigensolver stuff */
 #include "sparsematrix.h"
+#include "qed_diag.h"
+#include "qm_server.h"
+#include "qm_pool.h"
+#include "qed_modes.h"
+#include "qed_dist.h"
+#include "qed_linalg.h"
+#include "qed_cavity.h"
+#include "qed_bright.h"
+#include "qed_model.h"
+#include "qed_writer.h"
+#include "qed_traj.h"
+#include "qm_guess.h"
+#include "qm_scratch.h"
+#include "gmx_wallcycle.h"
 
 #ifndef F77_FUNC
 #define F77_FUNC(name,NAME) name ## _
@@ -123,6 +137,9 @@ static void diag(int n, double *w, dplx *V, dplx *M);
 
 static double calc_coupling(int J, int K, double dt, int dim, double *vec, double *vecold);
 
+/* photon weights of the cavity modes in the coupling to a molecule */
+static dplx *cavity_factors(t_QMrec *qm, int m, int nmol);
+
 /* used for the fssh algo */
 
 /* \sum_i A_i B_i */
@@ -421,6 +438,148 @@ static void diag(int n, double *w, dplx *V, dplx *M)
   sfree(work);
 }
 
+/* The QM and QED counters of the wallcycle accounting. A QM/MM step
+ * moves through non-overlapping phases, qed_phase() ends the running
+ * one. The communication with the other simulations is counted apart,
+ * with the running phase suspended meanwhile.
+ */
+static gmx_wallcycle_t qed_wcycle=NULL; /* fr->qr->wcycle of the QM call */
+static int             qed_ewc=-1;      /* the running phase, -1: none   */
+
+static void qed_phase(int ewc)
+{
+  if (qed_ewc >= 0){
+    wallcycle_stop(qed_wcycle,qed_ewc);
+  }
+  qed_ewc = ewc;
+  if (ewc >= 0){
+    wallcycle_start(qed_wcycle,ewc);
+  }
+}
+
+static void qed_comm_begin(void)
+{
+  if (qed_ewc >= 0){
+    wallcycle_suspend(qed_wcycle,qed_ewc);
+  }
+  wallcycle_start(qed_wcycle,ewcQED_COMM);
+}
+
+static void qed_comm_end(void)
+{
+  wallcycle_stop(qed_wcycle,ewcQED_COMM);
+  if (qed_ewc >= 0){
+    wallcycle_resume(qed_wcycle,qed_ewc);
+  }
+}
+
+static void qed_sumd_sim(int nr, double r[], const gmx_multisim_t *ms)
+{
+  qed_comm_begin();
+  gmx_sumd_sim(nr,r,ms);
+  qed_comm_end();
+}
+
+static void qed_sumi_sim(int nr, int r[], const gmx_multisim_t *ms)
+{
+  qed_comm_begin();
+  gmx_sumi_sim(nr,r,ms);
+  qed_comm_end();
+}
+
+/* diag() on all simulations if dist is serving them, else locally */
+static void diag_dist(gmx_qed_dist_t dist, int n, double *w, dplx *V, dplx *M)
+{
+  if (!qed_dist_zheev(dist,n,w,V,M)){
+    diag(n,w,V,M);
+  }
+}
+
+/* diagonalize the polariton matrix with the eigensolver selected by
+ * $QED_DIAG. The arrowhead solver falls back on zheev if it cannot
+ * resolve a degeneracy; check runs both and reports the deviation.
+ */
+static void diag_QED_full(t_QMrec *qm, int ndim, int nmol, double *w, dplx *V, dplx *M)
+{
+  static gmx_bool
+    bFallback=FALSE;
+  int
+    i;
+  double
+    *wd,dw=0;
+  dplx
+    *Vd;
+
+  switch (qm->QEDdiag){
+  case eqeddiagDENSE:
+    diag_dist(qm->qeddist,ndim,w,V,M);
+    break;
+  case eqeddiagCHECK:
+    snew(wd,ndim);
+    snew(Vd,ndim*ndim);
+    diag(ndim,wd,Vd,M);
+    if (qed_diag_arrowhead(ndim,nmol,w,V,M)){
+      for (i=0; i<ndim; i++){
+        dw = max(dw,fabs(w[i]-wd[i]));
+      }
+      fprintf(stderr,"arrowhead eigensolver: max eigenvalue deviation from zheev %e\n",dw);
+    }
+    else{
+      fprintf(stderr,"arrowhead eigensolver: degenerate spectrum, no comparison\n");
+    }
+    for (i=0; i<ndim; i++){
+      w[i]=wd[i];
+    }
+    for (i=0; i<ndim*ndim; i++){
+      V[i]=Vd[i];
+    }
+    sfree(Vd);
+    sfree(wd);
+    break;
+  default:
+    if (!qed_diag_arrowhead(ndim,nmol,w,V,M)){
+      /* identical molecules stay degenerate, do not repeat it every step */
+      if (!bFallback){
+        fprintf(stderr,"arrowhead eigensolver: degenerate spectrum, using zheev "
+                "(not reported again)\n");
+        bFallback = TRUE;
+      }
+      diag(ndim,w,V,M);
+    }
+    break;
+  }
+}
+
+/* with $QED_MODES only the molecules and the active cavity modes are
+ * diagonalized, the inactive modes are uncoupled photon states
+ */
+static void diag_QED(t_QMrec *qm, int ndim, int nmol, double *w, dplx *V, dplx *M)
+{
+  const int
+    *idx;
+  int
+    nr;
+  double
+    *wr;
+  dplx
+    *Vr,*Mr;
+
+  idx = qed_modes_active(qm->qedmodes,ndim,nmol,&nr);
+  if (idx == NULL){
+    diag_QED_full(qm,ndim,nmol,w,V,M);
+    return;
+  }
+  snew(wr,nr);
+  snew(Vr,nr*nr);
+  snew(Mr,nr*nr);
+  qed_modes_gather(nr,idx,ndim,M,Mr);
+  diag_QED_full(qm,nr,nmol,wr,Vr,Mr);
+  qed_modes_expand(nr,idx,ndim,M,wr,Vr,w,V);
+  sfree(Mr);
+  sfree(Vr);
+  sfree(wr);
+}
+
 static double calc_coupling(int J, int K, double dt, int dim, double *vec, double *vecold){
   double 
     coupling=0;
@@ -558,61 +717,6 @@ static void invsqrtM (int ndim, double *A, double *B){
   free(newA);
 }
 
-static void invsqrtM_complex(int ndim, dplx *A, dplx *B){
-/* B is A^-1/2 */
-  int
-    i;
-  dplx
-    *wmatrix,*V,*Vt,*temp,*newA,tmp;
-  double
-    *w;
-  snew(newA,ndim*ndim);
-  snew(w,ndim);
-  snew(wmatrix,ndim*ndim);
-  snew(V,ndim*ndim);
-  snew(Vt,ndim*ndim);
-  snew(temp,ndim*ndim);
-
-  /* diagonalize */
-  for(i=0;i<ndim*ndim;i++){
-    newA[i]=A[i];
-  };
-  diag(ndim,w,V,newA);
-
-  /* take the inverse square root of the diagonalo elements */
-  for ( i = 0 ; i < ndim ; i++){
-    wmatrix[i*ndim+i] = 1.0/csqrt(w[i]);
-  }
-  /* Apparently diag (zheev) returns the eigenvectors as rows, not
-   * columns. So tranposing is required and conj(V) is v^\dagger = v^{-1} 
-   * 
-   */
-  /* take the conjugate of V */
-  for(i=0;i<ndim*ndim;i++){
-    tmp=V[i];
-    V[i]=conj(tmp);
-  }
-  dagger(ndim, Vt, V);
-  
-  /* multiple from the left by Vt */
-  M_complextimesM_complex(ndim,Vt,wmatrix,temp);
-  
-  /* and from the right by V */
-  M_complextimesM_complex(ndim,temp,V,wmatrix);
-  //  fprintf(stderr,"in invsqrtM_complex\n");
-  //  printM_complex(ndim,wmatrix);
-  
-  for (i = 0 ; i< ndim*ndim ; i++ ){
-    B[i] = wmatrix[i];
-  }
-  free(Vt);
-  free(V);
-  free(w);
-  free(wmatrix);
-  free(temp);
-  free(newA);
-}
-
 static void expM_complex(int ndim, dplx *A, dplx *expA){
   /* expA = exp(A)*/
   int
@@ -856,6 +960,88 @@ static void expM_non_herm(int ndim, dplx *A, dplx *B,double dt){
   free(temp);
 } /*expM_non_herm */
 
+/* v = exp(-0.5*I*dt*ham) v, with ham the sum of the Hamiltonians at t
+ * and t+dt, as expM_complex2 and expM_non_herm. With $QED_PROP=diag the
+ * full propagator is formed in expH on the first call (*bExpH FALSE)
+ * and reused on later calls in the same step; krylov only does
+ * matrix-vector products with ham, which then must stay unchanged.
+ * ham is NULL with $QED_FFT, the Hamiltonians are then in qm->qedcav.
+ */
+static void expH_times_v_full(t_QMrec *qm, int ndim, dplx *ham, gmx_bool bHerm,
+                              dplx *expH, gmx_bool *bExpH, dplx *v)
+{
+  int
+    i;
+  dplx
+    *vtemp;
+
+  if (ham == NULL){
+    qed_expv_op(qm->qedwork,ndim,qed_cavity_matvec_sum,qm->qedcav,
+                qed_cavity_shift(qm->qedcav),0.5*qm->dt/AU2PS,v);
+  }
+  else if (qm->QEDprop == eqedpropDIAG){
+    if (!*bExpH){
+      if (bHerm)
+        expM_complex2(ndim,ham,expH,qm->dt);
+      else
+        expM_non_herm(ndim,ham,expH,qm->dt);
+      *bExpH = TRUE;
+    }
+    snew(vtemp,ndim);
+    MtimesV_complex(ndim,expH,v,vtemp);
+    for (i=0; i<ndim; i++){
+      v[i] = vtemp[i];
+    }
+    sfree(vtemp);
+  }
+  else{
+    qed_expv(qm->qedwork,ndim,ham,0.5*qm->dt/AU2PS,v);
+  }
+}
+
+/* with $QED_MODES only the molecules and the active cavity modes are
+ * propagated together, the inactive modes on their own; expH then holds
+ * the propagator of the active states
+ */
+static void expH_times_v(t_QMrec *qm, int ndim, dplx *ham, gmx_bool bHerm,
+                         dplx *expH, gmx_bool *bExpH, dplx *v)
+{
+  const int
+    *idx;
+  int
+    i,nr;
+  gmx_bool
+    *bIn;
+  dplx
+    *hamr,*vr;
+
+  idx = ham ? qed_modes_active(qm->qedmodes,ndim,ndim-(qm->n_max-qm->n_min+1),&nr) : NULL;
+  if (idx == NULL){
+    expH_times_v_full(qm,ndim,ham,bHerm,expH,bExpH,v);
+    return;
+  }
+  snew(hamr,nr*nr);
+  snew(vr,nr);
+  snew(bIn,ndim);
+  qed_modes_gather(nr,idx,ndim,ham,hamr);
+  for (i=0; i<nr; i++){
+    vr[i] = v[idx[i]];
+    bIn[idx[i]] = TRUE;
+  }
+  expH_times_v_full(qm,nr,hamr,bHerm,expH,bExpH,vr);
+  for (i=0; i<nr; i++){
+    v[idx[i]] = vr[i];
+  }
+  for (i=0; i<ndim; i++){
+    if (!bIn[i]){
+      v[i] *= cexp(-0.5*IMAG*qm->dt/AU2PS*ham[i*ndim+i]);
+    }
+  }
+  sfree(bIn);
+  sfree(vr);
+  sfree(hamr);
+}
+
 static void printM  ( int ndim, double *A){
   int 
     i,j;
@@ -887,7 +1073,7 @@ static void check_prev_eigvec(t_QMrec *qm,int ndim){
   if(EVin){
     fprintf(stderr,"Reading in the eigenvectors of step -1 from ev.dat, setting qm->restart=TRUE\n");
     qm->restart = 1;
-    snew(buf,(ndim*15+100)*2);
+    snew(buf,2*((ndim+1)*15+100));
     snew(all,2*(1+ndim));
     for(j=0;j<ndim;j++){
       if(!fgets (buf,2*((ndim+1)*15+100),EVin)){
@@ -896,7 +1082,7 @@ static void check_prev_eigvec(t_QMrec *qm,int ndim){
       }
       token = strtok(buf," ");
       m=0;
-      while (token != NULL){
+      while (token != NULL && m < 2*(1+ndim)){
         sscanf(token,"%lf",&all[m++]);
         token=strtok(NULL," ");
       }
@@ -919,150 +1105,15 @@ static void check_prev_eigvec(t_QMrec *qm,int ndim){
  * this could be changed by adding some of the complex
  * Lapack routines to the Gromacs Lapack.
  */
-static void  propagate_local_dia(int ndim,double dt, dplx *C, dplx *vec,
+static void  propagate_local_dia(t_QMrec *qm,
+                                 int ndim,double dt, dplx *C, dplx *vec,
 				 dplx *vecold, double *QMener, 
 				 double *QMenerold,dplx *U){
-  int
-    i,j,k;
-  double
-    *E;
-  dplx
-    *S,*SS, *transposeS;
-  dplx
-    *invsqrtSS,*T,*transposeT,*ham,*transposeham;
-  dplx
-    *H,*expH,*ctemp;
-
-  snew(S,ndim*ndim);
-  snew(SS,ndim*ndim);
-  snew(invsqrtSS,ndim*ndim);
-  snew(transposeS,ndim*ndim);
-  snew(T,ndim*ndim);
-  snew(transposeT,ndim*ndim);
-  snew(E,ndim*ndim);
-  snew(ham,ndim*ndim);
-  snew(transposeham,ndim*ndim);
-  snew(H, ndim*ndim);
-  snew(expH, ndim*ndim);
-  snew(ctemp,ndim);
-
-  for (i = 0 ; i < ndim ; i++){
-    E[i*ndim+i]    = QMener[i];
-    for ( j = 0 ; j < ndim ; j++ ){
-      for ( k = 0 ; k < ndim ; k++ ){
-	S[i*ndim+j] += conj(vecold[i*ndim+k])*vec[j*ndim+k];
-      }
-    }
-  }
-
-//
-//  fprintf(stderr,"\n\nFrom propagate_local_dia, E matrix elements:\n");
-//  printM(ndim,E);
-//  fprintf(stderr,"\n\nFrom propagate_local_dia, S matrix elements:\n");
-//  printM_complex(ndim,S);
-//
-
-  /* build S^dagger S */
-
-  transposeM_complex(ndim,S,transposeS);
-
-//
-//  fprintf(stderr,"\n\nFrom propagate_local_dia, transposeS matrix elements:\n");
-//  printM_complex(ndim,transposeS);
-//
-
-  M_complextimesM_complex(ndim,transposeS,S,SS);
-
-//
-//   fprintf(stderr,"\n\nFrom propagate_local_dia, SS matrix elements:\n");
-//   printM_complex(ndim,SS);
-//
-
-  invsqrtM_complex(ndim,SS,invsqrtSS);
-
-
-  //  fprintf(stderr,"\n\nFrom propagate_local_dia, invsqrtSS matrix elements:\n");
-  // printM_complex(ndim,invsqrtSS);
-//
-
-  M_complextimesM_complex(ndim,S,invsqrtSS,T);
-
-//
-//  fprintf(stderr,"\n\nFrom propagate_local_dia, T matrix elements:\n");
-//printM_complex(ndim,T);
-//
-
-  transposeM_complex(ndim,T,transposeT);
-
-//
-//  fprintf(stderr,"\n\nFrom propagate_local_dia, transposeT matrix elements:\n");
-//  printM_complex(ndim,transposeT);
-//
-//  fprintf(stderr,"testing if T is unitary\n");
-//  M_complextimesM_complex(ndim,transposeT,T,ham);
-//  printM_complex(ndim,ham); 
-  /* reuse invsqrtS */
-
-  MtimesM_complex(ndim,E,transposeT,invsqrtSS);
-
-//
-//  fprintf(stderr,"\n\nFrom propagate_local_dia, invsqrtSS (E times transposeT)  matrix elements:\n");
-//  printM_complex(ndim,invsqrtSS);
-//
- 
-   M_complextimesM_complex(ndim,T,invsqrtSS,ham);
-
-//
-
-//
- 
-  for ( i = 0 ; i< ndim; i++){
-    ham[i+ndim*i] = creal(ham[i+ndim*i]) + QMenerold[i] + IMAG*cimag(ham[i+ndim*i]);
-  }
-
-  //  fprintf(stderr,"\n\nFrom propagate_local_dia, ham matrix elements:\n");
-  //  printM_complex(ndim,ham);
-  
-  expM_complex2(ndim,ham,expH, dt);
-
-  //  fprintf(stderr,"\n\nFrom propagate_local_dia, H matrix elements:\n");
-  //printM_complex(ndim,expH);
-//  MtimesM_complex(ndim,transposeT,expH,U);
-  M_complextimesM_complex(ndim,transposeT,expH,U);
-
-//
-//fprintf(stderr,"\n\nFrom propagate_local_dia, U matrix elements:\n");
-//printM_complex(ndim,U);
-//
- 
-  /* we use U to propagate C, and keep it to compute the hopping
-   * probabilities */
- // printM_complex(ndim,U);
-  MtimesV_complex(ndim,U,C,ctemp);
-  for( i=0;i<ndim;i++){
-      C[i]=ctemp[i];
-  }
-
-//
-//  fprintf(stderr,"From propagate_local_dia, C matrix elements:\n");
-//  for(i=0;i<ndim;i++){
-//    fprintf(stderr,"C[%d]=%lf+%lfI ",i,creal(C[i]),cimag(C[i]));
-//  }
-//  fprintf(stderr,"\n");
+  /* the BLAS kernels and their workspace live in qed_linalg.c */
+  qed_propagate_local_dia(qm->qedwork,qm->qeddist,ndim,dt/AU2PS,C,
+                          vec,vecold,QMener,QMenerold,U);
+}
 
-  free(H);
-  free(ham);
-  free(transposeham);
-  free(T);
-  free(transposeT);
-  free(S);
-   free (SS);
-  free(invsqrtSS);
-  free(transposeS);
-  free(E);
-  free(expH);
-  free(ctemp);
-} 
 
 static void propagate(int dim, double dt, dplx *C, dplx *vec, dplx *vecold, double *QMener, double *QMenerold)
 {
@@ -1443,9 +1494,13 @@ void init_gaussian(t_commrec *cr, t_QMrec *qm, t_MMrec *mm){
 			   {1,6,11},
 			   {4,6,0}};
   char
-    *buf;
+    *buf,*fn;
   int
     i,ndim=1,seed;
+  double
+    *s;
+  gmx_bool
+    bModel;
   
   /* using the ivec above to convert the basis read form the mdp file
    * in a human readable format into some numbers for the gaussian
@@ -1536,34 +1591,40 @@ void init_gaussian(t_commrec *cr, t_QMrec *qm, t_MMrec *mm){
       }
       fclose(out);
     }
-    /* gaussian settings on the system */
-    snew(buf,200);
-    buf = getenv("GAUSS_DIR");
+    /* gaussian settings on the system, the QEDmodel program only
+     * shares the QED part with gaussian
+     */
+    bModel = (qm->QMprogram == eQMprogramQEDMODEL);
+    if (!bModel){
+      snew(buf,200);
+      buf = getenv("GAUSS_DIR");
 
-    if (buf){
-      snew(qm->gauss_dir,200);
-      sscanf(buf,"%s",qm->gauss_dir);
-    }
-    else
-      gmx_fatal(FARGS,"no $GAUSS_DIR, check gaussian manual\n");
+      if (buf){
+        snew(qm->gauss_dir,200);
+        sscanf(buf,"%s",qm->gauss_dir);
+      }
+      else
+        gmx_fatal(FARGS,"no $GAUSS_DIR, check gaussian manual\n");
+      qm->qmguess = qm_guess_init(qm->gauss_dir);
     
-    snew(buf,200);    
-    buf = getenv("GAUSS_EXE");
-    if (buf){
-      snew(qm->gauss_exe,200);
-      sscanf(buf,"%s",qm->gauss_exe);
-    }
-    else
-      gmx_fatal(FARGS,"no $GAUSS_EXE, check gaussian manual\n");
+      snew(buf,200);    
+      buf = getenv("GAUSS_EXE");
+      if (buf){
+        snew(qm->gauss_exe,200);
+        sscanf(buf,"%s",qm->gauss_exe);
+      }
+      else
+        gmx_fatal(FARGS,"no $GAUSS_EXE, check gaussian manual\n");
     
-    snew(buf,200);
-    buf = getenv("DEVEL_DIR");
-    if (buf){
-      snew(qm->devel_dir,200);
-      sscanf(buf,"%s",qm->devel_dir);
+      snew(buf,200);
+      buf = getenv("DEVEL_DIR");
+      if (buf){
+        snew(qm->devel_dir,200);
+        sscanf(buf,"%s",qm->devel_dir);
+      }
+      else
+        gmx_fatal(FARGS,"no $DEVEL_DIR, this is were the modified links reside.\n");
     }
-    else
-      gmx_fatal(FARGS,"no $DEVEL_DIR, this is were the modified links reside.\n");
 
 
     if(qm->bQED){
@@ -1576,11 +1637,11 @@ void init_gaussian(t_commrec *cr, t_QMrec *qm, t_MMrec *mm){
         buf = getenv("TMP_DIR");
         if (buf){
           snew(qm->subdir,3000);
-          /* store the nodeid as the subdir */
-          sprintf(qm->subdir,"%s%s%d",buf,"/molecule",cr->ms->sim);
-          /* and create the directoru on the FS */
-          sprintf(buf,"%s %s","mkdir",qm->subdir);
-          system(buf);
+          /* store the nodeid as the subdir and create it, on the
+           * node-local $QM_SCRATCH if set
+           */
+          qm->qmscratch = qm_scratch_init(buf,cr->ms->sim);
+          sprintf(qm->subdir,"%s",qm_scratch_dir(qm->qmscratch));
           ndim=cr->ms->nsim;
         }
         else
@@ -1591,27 +1652,128 @@ void init_gaussian(t_commrec *cr, t_QMrec *qm, t_MMrec *mm){
         buf = getenv("TMP_DIR");
         if (buf){
           snew(qm->subdir,3000);
-          sprintf(qm->subdir,"%s%s%d",buf,"/molecule",0);
-          sprintf(buf,"%s %s","mkdir",qm->subdir);
-          system(buf);
+          qm->qmscratch = qm_scratch_init(buf,0);
+          sprintf(qm->subdir,"%s",qm_scratch_dir(qm->qmscratch));
         }
         else
           gmx_fatal(FARGS,"no $TMP_DIR, this is were the temporary in/output is written.\n");
       }
+      buf = getenv("QED_DIAG");
+      if (buf){
+        qm->QEDdiag = qed_diag_type(buf);
+        if (qm->QEDdiag < 0)
+          gmx_fatal(FARGS,"$QED_DIAG = %s, should be arrowhead, dense or check\n",buf);
+      }
+      else
+        qm->QEDdiag = eqeddiagDENSE;
+      if (!MULTISIM(cr) || MASTERSIM(cr->ms))
+        fprintf(stderr,"polariton eigensolver: %s\n",buf ? buf : "dense");
+      buf = getenv("QED_PROP");
+      if (buf){
+        qm->QEDprop = qed_prop_type(buf);
+        if (qm->QEDprop < 0)
+          gmx_fatal(FARGS,"$QED_PROP = %s, should be krylov or diag\n",buf);
+      }
+      else
+        qm->QEDprop = eqedpropKRYLOV;
+      fprintf(stderr,"coefficient propagator: %s\n",buf ? buf : "krylov");
+      /* only compare states less than $QED_TRACK (hartree) apart when
+       * following them from step to step
+       */
+      buf = getenv("QED_TRACK");
+      qm->QEDtrack = buf ? strtod(buf,NULL) : 0;
+      qm->qedwork = qed_work_init();
+      qm->qedwriter = qed_writer_init();
+      /* analytic model molecules instead of the QM program,
+       * parameters in $QED_MODEL
+       */
+      buf = getenv("QED_MODEL");
+      if (bModel)
+        qm->qedmodel = qed_model_init(buf ? buf : "holstein",
+                                      MULTISIM(cr) ? cr->ms->sim : 0,qm);
+      else if (buf)
+        gmx_fatal(FARGS,"$QED_MODEL sets the parameters of QMprogram = %s, "
+                  "this QM group uses %s\n",eQMprogram_names[eQMprogramQEDMODEL],
+                  EQMPROGRAM(qm->QMprogram));
+      /* keep the QM program running instead of starting it every step */
+      buf = getenv("QM_SERVER");
+      qm->qmserver = NULL;
+      qm->qmpool = NULL;
+      if (buf && getenv("QM_POOL")){
+        /* $QM_POOL servers, each in $TMP_DIR/worker<w>, do the QM
+         * of all molecules
+         */
+        qm->qmpool = qm_pool_init(MULTISIM(cr) ? cr->ms : NULL,buf,
+                                  strtol(getenv("QM_POOL"),NULL,10),
+                                  getenv("TMP_DIR"));
+      }
+      else if (buf)
+        qm->qmserver = qm_server_start(buf,qm->subdir);
+      else if (getenv("QM_POOL"))
+        gmx_fatal(FARGS,"$QM_POOL needs the command of the workers in $QM_SERVER\n");
+      /* let the idle simulations help with the dense linear algebra,
+       * $QED_DIST is the block size of the distribution
+       */
+      buf = getenv("QED_DIST");
+      if (buf && MULTISIM(cr)){
+        qm->qeddist = qed_dist_init(cr->ms,strtol(buf,NULL,10));
+      }
+      else
+        qm->qeddist = NULL;
+      /* with $QED_FFT the diabatic Hamiltonian is only applied, through
+       * FFTs over the molecules (see qed_cavity.h), and never stored
+       */
+      if (getenv("QED_FFT")){
+        if (qm->QEDprop != eqedpropKRYLOV)
+          gmx_fatal(FARGS,"$QED_FFT needs $QED_PROP=krylov\n");
+        snew(s,qm->n_max-qm->n_min+1);
+        for (i=0;i<qm->n_max-qm->n_min+1;i++){
+          s[i] = creal(cavity_factors(qm,0,ndim)[i]);
+        }
+        qm->qedcav = qed_cavity_init(ndim,qm->n_min,qm->n_max-qm->n_min+1,s);
+        sfree(s);
+        fprintf(stderr,"polariton Hamiltonian applied through FFTs of length %d\n",ndim);
+      }
+      /* with $QED_BRIGHT the adiabatic Ehrenfest dynamics runs in the
+       * polaritons and dark manifolds, see qed_bright.h
+       */
+      buf = getenv("QED_BRIGHT");
+      if (buf){
+        if (qm->qedcav)
+          gmx_fatal(FARGS,"$QED_BRIGHT can not be combined with $QED_FFT\n");
+        snew(s,qm->n_max-qm->n_min+1);
+        for (i=0;i<qm->n_max-qm->n_min+1;i++){
+          s[i] = creal(cavity_factors(qm,0,ndim)[i]);
+        }
+        qm->qedbright = qed_bright_init(ndim,qm->n_min,qm->n_max-qm->n_min+1,s,
+                                        strtod(buf,NULL),qm->qedwork);
+        sfree(s);
+        fprintf(stderr,"bright/dark polariton basis, molecules within %g au "
+                "in one manifold\n",strtod(buf,NULL));
+      }
+      /* keep only the cavity modes near the molecules, see qed_modes.h */
+      buf = getenv("QED_MODES");
+      if (buf){
+        if (qm->qedcav || qm->qedbright)
+          gmx_fatal(FARGS,"$QED_MODES can not be combined with $QED_FFT or $QED_BRIGHT\n");
+        qm->qedmodes = qed_modes_init(buf,qm->n_max-qm->n_min+1);
+      }
       /* now deterimin the actual size of ndim */
       ndim+=qm->n_max-qm->n_min+1;
       snew(qm->creal,ndim);
       snew(qm->cimag,ndim);
       snew(qm->dreal,ndim);
       snew(qm->dimag,ndim);
-      snew(qm->matrix,ndim*ndim);
-      snew(qm->eigvec,ndim*ndim);
       snew(qm->eigval,ndim);
+      if (!qm->qedcav && !qm->qedbright){
+        snew(qm->matrix,ndim*ndim);
+        snew(qm->eigvec,ndim*ndim);
 
-      /* hack to read in previous eigenvector. To use that there should be an ev.dat, created by
-       * sed 's/\I//g' eigenvectors.dat |sed 's/\+//g' | awk '{$1=$2=$3=$4=$5=$6=$7=$10=""; print $0}'
-       */
-      check_prev_eigvec(qm,ndim);
+        /* hack to read in previous eigenvector. To use that there should be an ev.dat, created by
+         * sed 's/\I//g' eigenvectors.dat |sed 's/\+//g' | awk '{$1=$2=$3=$4=$5=$6=$7=$10=""; print $0}'
+         */
+        check_prev_eigvec(qm,ndim);
+      }
       
       Cin=fopen("C.dat","r");
       Din=fopen("D.dat","r");
@@ -1722,6 +1884,15 @@ void init_gaussian(t_commrec *cr, t_QMrec *qm, t_MMrec *mm){
       }
       else
         gmx_fatal(FARGS,"no $WORK_DIR, this is were the QED-specific output is written.\n");
+      /* the per-step output as a binary trajectory, see qed_traj.h */
+      buf = getenv("QED_TRAJ");
+      if (buf){
+        snew(fn,3000);
+        sprintf(fn,"%s/polariton.qtr",qm->work_dir);
+        qm->qedtraj = qed_traj_init(buf,fn);
+        fprintf(stderr,"polariton trajectory %s instead of the text output\n",fn);
+        sfree(fn);
+      }
     }
   }
   fprintf(stderr,"gaussian initialised...\n");
@@ -1926,12 +2097,19 @@ void write_gaussian_input(int step ,t_forcerec *fr, t_QMrec *qm, t_MMrec *mm)
 {
   int
     i;
+  gmx_bool
+    bGuess;
   t_QMMMrec
     *QMMMrec;
   FILE
     *out;
   
   QMMMrec = fr->qr;
+  if (qm->qmguess)
+    bGuess = qm_guess_prepare(qm->qmguess,
+			      qm->QMmethod>=eQMmethodRHF ? "input" : "se");
+  else
+    bGuess = (step != 0);
   out = fopen("input.com","w");
   /* write the route */
 
@@ -1991,7 +2169,7 @@ void write_gaussian_input(int step ,t_forcerec *fr, t_QMrec *qm, t_MMrec *mm)
     fprintf(out," %s",
 	    "Charge ");
   }
-  if (step || qm->QMmethod==eQMmethodCASSCF){
+  if (bGuess || qm->QMmethod==eQMmethodCASSCF){
     /* fetch guess from checkpoint file, always for CASSCF */
     fprintf(out,"%s"," guess=read");
   }
@@ -2115,6 +2293,8 @@ void write_gaussian_input(int step ,t_forcerec *fr, t_QMrec *qm, t_MMrec *mm)
 void write_gaussian_input_QED(t_commrec *cr,int step ,t_forcerec *fr, t_QMrec *qm, t_MMrec *mm){
   int
     i;
+  gmx_bool
+    bGuess;
   t_QMMMrec
     *QMMMrec;
   FILE
@@ -2126,6 +2306,10 @@ void write_gaussian_input_QED(t_commrec *cr,int step ,t_forcerec *fr, t_QMrec *q
   if(MULTISIM(cr)){
     chdir (qm->subdir);
   }
+  bGuess = FALSE;
+  if (qm->qmguess)
+    bGuess = qm_guess_prepare(qm->qmguess,
+			      qm->QMmethod>=eQMmethodRHF ? "input" : "se");
   out = fopen("input.com","w");
   /* write the route */
 
@@ -2186,7 +2370,7 @@ void write_gaussian_input_QED(t_commrec *cr,int step ,t_forcerec *fr, t_QMrec *q
     fprintf(out," %s",
 	    "Charge ");
   }
-  if (qm->QMmethod==eQMmethodCASSCF){
+  if (bGuess || qm->QMmethod==eQMmethodCASSCF){
     /* fetch guess from checkpoint file, always for CASSCF */
     fprintf(out,"%s"," guess=read");
   }
@@ -2306,26 +2490,63 @@ void write_gaussian_input_QED(t_commrec *cr,int step ,t_forcerec *fr, t_QMrec *q
 
 }  /* write_gaussian_input_QED */
 
-real read_gaussian_output_QED(t_commrec *cr,rvec QMgrad_S1[],rvec MMgrad_S1[],
-			      rvec QMgrad_S0[],rvec MMgrad_S0[],int step,
-			      t_QMrec *qm, t_MMrec *mm,rvec *tdm,
-                              rvec tdmX[], rvec tdmY[], rvec tdmZ[],
-                              rvec tdmXMM[], rvec tdmYMM[], rvec tdmZMM[],
-                              real *Eground)
+/* Check if the transition dipole moment has changed sign. If so, we simply
+ * also change the sign of the E field. We use the trick Dmitry used:
+ */
+static void check_tdm_sign(int step, t_QMrec *qm, rvec tdm)
 {
   int
-    i,j,atnum;
-  char
-    buf[3000],*buf2;
+    i;
   real
-    QMener,rinv,qtdm,ri,ro,cosa;
-  FILE
-    *in_S1,*in_S0;
+    ri,ro,cosa;
 
-  if (MULTISIM(cr)){ 
-    chdir (qm->subdir);
-  } 
-  in_S1=fopen("S1.7","r");
+  if (step){
+    ri = sqrt(tdm[XX]*tdm[XX]+tdm[YY]*tdm[YY]+tdm[ZZ]*tdm[ZZ]);
+    ro = sqrt(qm->tdmold[XX]*qm->tdmold[XX]+qm->tdmold[YY]*qm->tdmold[YY]+qm->tdmold[ZZ]*qm->tdmold[ZZ]);
+    cosa = (tdm[XX]*qm->tdmold[XX]+tdm[YY]*qm->tdmold[YY]+tdm[ZZ]*qm->tdmold[ZZ]) / (ri * ro);
+    if (cosa<0.0){
+      fprintf(stderr, "Changing Efield sign\n");
+      for (i=0;i<DIM;i++){
+        qm->E[i]*=-1.0;
+      }
+    }
+  }
+  /* store the TDM in QMrec for the next step */
+  qm->tdmold[XX] = tdm[XX];
+  qm->tdmold[YY] = tdm[YY];
+  qm->tdmold[ZZ] = tdm[ZZ];
+}
+
+real read_gaussian_output_QED(t_commrec *cr,rvec QMgrad_S1[],rvec MMgrad_S1[],
+			      rvec QMgrad_S0[],rvec MMgrad_S0[],int step,
+			      t_QMrec *qm, t_MMrec *mm,rvec *tdm,
+                              rvec tdmX[], rvec tdmY[], rvec tdmZ[],
+                              rvec tdmXMM[], rvec tdmYMM[], rvec tdmZMM[],
+                              real *Eground)
+{
+  int
+    i,j,atnum;
+  char
+    buf[3000],*buf2;
+  real
+    QMener,rinv,qtdm;
+  double
+    E0,E1;
+  FILE
+    *in_S1,*in_S0;
+
+  if (MULTISIM(cr)){ 
+    chdir (qm->subdir);
+  } 
+  /* use the binary output if the QM program wrote it */
+  if (qm_read_binary_output(QMBIN_FILE,qm,mm,QMgrad_S1,MMgrad_S1,
+                            QMgrad_S0,MMgrad_S0,tdm,tdmX,tdmY,tdmZ,
+                            tdmXMM,tdmYMM,tdmZMM,&E1,&E0)){
+    *Eground = E0;
+    check_tdm_sign(step,qm,tdm[0]);
+    return (E1);
+  }
+  in_S1=fopen("S1.7","r");
   
   /* the next line is the energy and in the case of CAS, the energy
    * difference between the two states.
@@ -2389,27 +2610,7 @@ real read_gaussian_output_QED(t_commrec *cr,rvec QMgrad_S1[],rvec MMgrad_S1[],
 	 &tdm[0][ZZ]);
 #endif	
 
-/* now we need to check if the dipole moment has changed sign. If so, we simply
- * also change the sign of the E field. We use the trick Dmitry used:
- */
-  if (step){
-    ri = sqrt(tdm[0][XX]*tdm[0][XX]+tdm[0][YY]*tdm[0][YY]+tdm[0][ZZ]*tdm[0][ZZ]);
-    ro = sqrt(qm->tdmold[XX]*qm->tdmold[XX]+qm->tdmold[YY]*qm->tdmold[YY]+qm->tdmold[ZZ]*qm->tdmold[ZZ]);
-    cosa = (tdm[0][XX]*qm->tdmold[XX]+tdm[0][YY]*qm->tdmold[YY]+tdm[0][ZZ]*qm->tdmold[ZZ]) / (ri * ro);
-//    fprintf(stderr,"tdm = {%f,%f,%f}\n",tdm[0][XX],tdm[0][YY],tdm[0][ZZ]);
-//    fprintf(stderr,"old = {%f,%f,%f}\n", qm->tdmold[XX], qm->tdmold[YY], qm->tdmold[ZZ]);
-//    fprintf(stderr,"dotprod = %lf\n",cosa);
-    if (cosa<0.0){
-      fprintf(stderr, "Changing Efield sign\n");
-      for (i=0;i<DIM;i++){
-        qm->E[i]*=-1.0;
-      }
-    }
-  }
-  /* store the TDM in QMrec for the next step */
-  qm->tdmold[XX] = tdm[0][XX];
-  qm->tdmold[YY] = tdm[0][YY];
-  qm->tdmold[ZZ] = tdm[0][ZZ];
+  check_tdm_sign(step,qm,tdm[0]);
   /* works only in combination with TeraChem
    */
   /* read in sequence nabla tdm[j]_ia
@@ -2840,8 +3041,8 @@ real call_gaussian(t_commrec *cr,  t_forcerec *fr,
 		   t_QMrec *qm, t_MMrec *mm, rvec f[], rvec fshift[])
 {
   /* normal gaussian jobs */
-  static int
-    step=0;
+  int
+    step=qm->QMstep;
   int
     i,j;
   real
@@ -2856,9 +3057,14 @@ real call_gaussian(t_commrec *cr,  t_forcerec *fr,
   snew(QMgrad,qm->nrQMatoms);
   snew(MMgrad,mm->nrMMatoms);
 
+  qed_wcycle = fr->qr->wcycle;
+  qed_phase(ewcQM_INPUT);
   write_gaussian_input(step,fr,qm,mm);
+  qed_phase(ewcQM_RUN);
   do_gaussian(step,exe);
+  qed_phase(ewcQM_OUTPUT);
   QMener = read_gaussian_output(QMgrad,MMgrad,step,qm,mm);
+  qed_phase(-1);
   /* put the QMMM forces in the force array and to the fshift
    */
   for(i=0;i<qm->nrQMatoms;i++){
@@ -2874,54 +3080,74 @@ real call_gaussian(t_commrec *cr,  t_forcerec *fr,
     }
   }
   QMener = QMener*HARTREE2KJ*AVOGADRO;
-  step++;
+  qm->QMstep++;
   free(exe);
   free(QMgrad);
   free(MMgrad);
   return(QMener);
 } /* call_gaussian */
 
-typedef struct {
-  int j;
-  int i;
-} t_perm;
-
-void track_states(dplx *vecold, dplx *vecnew, int ndim){
-  fprintf(stderr,"Call to track_states\n");
-  int
-    *stmap,i,j,k;
-  double
-    maxover,ri,ro,sina,cosa;
+void done_gaussian(t_QMrec *qm)
+{
+  /* stop the QM server and get the QED output on disk */
+  if (qm->qmserver){
+    qm_server_stop(qm->qmserver);
+    qm->qmserver = NULL;
+  }
+  if (qm->qmpool){
+    qm_pool_done(qm->qmpool);
+    qm->qmpool = NULL;
+  }
+  if (qm->qedwriter){
+    qed_writer_flush(qm->qedwriter);
+  }
+  if (qm->qedcav){
+    qed_cavity_done(qm->qedcav);
+    qm->qedcav = NULL;
+  }
+  if (qm->qedmodel){
+    qed_model_done(qm->qedmodel);
+    qm->qedmodel = NULL;
+  }
+  if (qm->qedmodes){
+    qed_modes_done(qm->qedmodes);
+    qm->qedmodes = NULL;
+  }
+  if (qm->qedbright){
+    qed_bright_done(qm->qedbright);
+    qm->qedbright = NULL;
+  }
+  if (qm->qedtraj){
+    qed_traj_done(qm->qedtraj);
+    qm->qedtraj = NULL;
+  }
+  if (qm->qmscratch){
+    qm_scratch_done(qm->qmscratch);
+    qm->qmscratch = NULL;
+  }
+} /* done_gaussian */
 
-  snew(stmap,ndim);
-  for(i=0;i<ndim;i++){
-    maxover=-1.0;
-    for(j=0;j<ndim;j++){
-///      if (fabs(inproduct(&vecnew[i*ndim], &vecold[j*ndim], ndim))>maxover) {
-///        maxover=fabs(inproduct(&vecnew[i*ndim], &vecold[j*ndim], ndim));
-      if (cabs(inproduct_complex(&vecnew[i*ndim], &vecold[j*ndim], ndim))>maxover) {
-	maxover=cabs(inproduct_complex(&vecnew[i*ndim], &vecold[j*ndim], ndim));
-	stmap[i]=j;
-//	fprintf(stderr,"From track_states: maxover_%d=%lf\n",j,maxover);
-      }
-    }
+void checkpoint_gaussian(t_QMrec *qm)
+{
+  /* the checkpoint of mdrun should find the QM restart files and the
+   * coefficients (C.dat) of the same step
+   */
+  if (qm->qedwriter){
+    qed_writer_flush(qm->qedwriter);
   }
-  for(i=0;i<ndim;i++){
-///    ri = sqrt(inproduct(&vecnew[i*ndim], &vecnew[i*ndim],ndim));
-///    ro = sqrt(inproduct(&vecold[stmap[i]*ndim], &vecold[stmap[i]*ndim],ndim));
-///    cosa = inproduct(&vecnew[i*ndim], &vecold[stmap[i]*ndim],ndim)/ (ri * ro);
-    ri = sqrt(inproduct_complex(&vecnew[i*ndim], &vecnew[i*ndim],ndim));
-    ro = sqrt(inproduct_complex(&vecold[stmap[i]*ndim], &vecold[stmap[i]*ndim],ndim));
-    cosa = creal(inproduct_complex(&vecnew[i*ndim], &vecold[stmap[i]*ndim],ndim))/(ri*ro);
-//    fprintf(stderr,"cosa=%lf\n",cosa);
-    if (cosa<0.0){
-      for(j=0;j<ndim;j++){
-	vecnew[i*ndim+j]=-vecnew[i*ndim+j];
-      }
-    }
+  if (qm->qmscratch){
+    qm_scratch_sync(qm->qmscratch);
   }
-  fprintf(stderr,"Done with track_states\n");
-  sfree(stmap);
+} /* checkpoint_gaussian */
+
+/* fix the signs of the new eigenvectors against the previous ones, see
+ * qed_track_states. bKeepS when propagate_local_dia follows, which then
+ * reuses the overlaps.
+ */
+static void track_states(t_QMrec *qm, dplx *vecnew, double *eigval,
+                         int ndim, gmx_bool bKeepS){
+  qed_track_states(qm->qedwork,qm->qeddist,ndim,qm->eigvec,vecnew,
+                   qm->eigval,eigval,qm->QEDtrack,bKeepS);
 }
    
 int QEDFSSHop(int step, t_QMrec *qm, dplx *eigvec, int ndim, double *eigval, real dt,t_QMMMrec *qr){
@@ -2954,7 +3180,7 @@ int QEDFSSHop(int step, t_QMrec *qm, dplx *eigvec, int ndim, double *eigval, rea
     
     /* check for trivial hops and trace the states 
      */
-    track_states(qm->eigvec,eigvec,ndim);
+    track_states(qm,eigvec,eigval,ndim,qr->SHmethod==eSHmethodGranucci);
 //    hopto = trace_states(qm,c,eigvec,ndim);
     if (hopto != current){
       /* we thus have a diabatic hop, and enforce this hop.
@@ -2976,7 +3202,7 @@ int QEDFSSHop(int step, t_QMrec *qm, dplx *eigvec, int ndim, double *eigval, rea
       /* we need to keep the coefficients at t, as we need both c(t) and
        * c(t+dt) to compute the hopping probanilities. We just make a copy
        */
-      propagate_local_dia(ndim,dt,c,eigvec,qm->eigvec,eigval,qm->eigval,U);
+      propagate_local_dia(qm,ndim,dt,c,eigvec,qm->eigvec,eigval,qm->eigval,U);
       fprintf(stderr," population that leaves state %d: %lf\n",current,(conj(cold[current])*cold[current]-conj(c[current])*c[current]));
       fprintf(stderr, "probability to leave state %d is %lf\n",current,(conj(cold[current])*cold[current]-conj(c[current])*c[current])/(conj(cold[current])*cold[current]));
       ptot=(conj(cold[current])*cold[current]-conj(c[current])*c[current])/(conj(cold[current])*cold[current]);
@@ -3071,7 +3297,7 @@ int QEDFSSHop(int step, t_QMrec *qm, dplx *eigvec, int ndim, double *eigval, rea
   else{
     /* hack to read back the eigenvectors from file */
     if(qm->restart){
-      track_states(qm->eigvec, eigvec, ndim);
+      track_states(qm,eigvec,eigval,ndim,FALSE);
     }
 //    qm->creal[current]=1.0;
     fprintf(stderr,"step %d: C: ",step);
@@ -3149,14 +3375,14 @@ void   propagate_TDSE(int step, t_QMrec *qm, dplx *eigvec, int ndim, double *eig
     for (i=0;i<ndim;i++){
       c[i]=qm->creal[i]+IMAG*qm->cimag[i];
     }
-    track_states(qm->eigvec, eigvec, ndim);
+    track_states(qm,eigvec,eigval,ndim,TRUE);
     /* we propagate the wave function in the local diabatic basis, i.e.
      * diabatic along the direction in which the atoms moved.
      * J. CHem. Phys. 114 (2001) 10608  
      *
      */
     snew(U,ndim*ndim);
-    propagate_local_dia(ndim,dt,c,eigvec,qm->eigvec,eigval,qm->eigval,U);
+    propagate_local_dia(qm,ndim,dt,c,eigvec,qm->eigvec,eigval,qm->eigval,U);
 
     for ( i = 0 ; i < ndim ; i++ ){
       
@@ -3175,7 +3401,7 @@ void   propagate_TDSE(int step, t_QMrec *qm, dplx *eigvec, int ndim, double *eig
   else{
     /* hack to read back the eigenvectors from file */
     if(qm->restart){
-      track_states(qm->eigvec, eigvec, ndim);
+      track_states(qm,eigvec,eigval,ndim,FALSE);
     }
     fprintf(stderr,"step %d: |C|^2: ",step);
     for(i=0;i<ndim;i++){
@@ -3208,7 +3434,7 @@ void decoherence(t_commrec *cr, t_QMrec *qm, t_MMrec *mm, int ndim, double *eigv
   /* now we have ekin per node. Now send around the total kinetic energy */
   /* send around */
   if(MULTISIM(cr)){
-    gmx_sumd_sim(1,ekin,cr->ms);
+    qed_sumd_sim(1,ekin,cr->ms);
   }
   /* apply */ 
   sum = 0.0;
@@ -3262,6 +3488,171 @@ double cavity_dispersion(int n, t_QMrec *qm){
   return sqrt(qm->omega*qm->omega+SPEED_OF_LIGHT_AU*SPEED_OF_LIGHT_AU*(2*M_PI*n/(qm->L*microM2BOHR))*(2*M_PI*n/(qm->L*microM2BOHR))/(qm->n_index*qm->n_index));
 } /* cavity_dispersion */
 
+/* sqrt(omega_k/V0_2EP) exp(2 pi I k m/nmol) of modes k = n_min..n_max,
+ * the weights of the photon part of a state in the coupling to molecule
+ * m. These only depend on the cavity and m, so are tabulated once; the
+ * phase is taken for (k m) mod nmol, which keeps it exact for large k m.
+ */
+static dplx *cavity_factors(t_QMrec *qm, int m, int nmol){
+  int
+    i,k,nmodes=qm->n_max-qm->n_min+1;
+  long
+    r;
+  double
+    E0_norm_sq=iprod(qm->E,qm->E),V0_2EP;
+
+  if (qm->cavfac && qm->cavmol == m && qm->cavnmol == nmol){
+    return qm->cavfac;
+  }
+  /* 2 epsilon0 V_cav at k=0, as in the couplings */
+  V0_2EP = E0_norm_sq > 0 ? qm->omega/E0_norm_sq : 1;
+  srenew(qm->cavfac,nmodes);
+  for (i=0;i<nmodes;i++){
+    k = qm->n_min+i;
+    r = ((long)k*m)%nmol;
+    if (r < 0){
+      r += nmol;
+    }
+    qm->cavfac[i] = sqrt(cavity_dispersion(k,qm)/V0_2EP)*cexp(IMAG*2*M_PI*r/((double) nmol));
+  }
+  qm->cavmol  = m;
+  qm->cavnmol = nmol;
+  return qm->cavfac;
+} /* cavity_factors */
+
+/* field amplitude at molecule m of the state with expansion coefficients
+ * v (nmol molecules, then the modes), of the modes that couple to it
+ */
+static dplx photon_amplitude(t_QMrec *qm, int m, int nmol, dplx *v){
+  int
+    i;
+  dplx
+    a=0.0+IMAG*0.0,*fac=cavity_factors(qm,m,nmol);
+
+  for (i=0;i<qm->n_max-qm->n_min+1;i++){
+    if (qed_modes_coupled(qm->qedmodes,i)){
+      a += v[nmol+i]*fac[i];
+    }
+  }
+  return a;
+} /* photon_amplitude */
+
+/* f += c0 G0 + cd (G1-G0) - ct u.tdm for n atoms, and fshift too if not
+ * NULL. All QED forces and couplings are of this form, with the state
+ * dependence in the three scalars, so this is the only loop over atoms;
+ * the rvec arrays are contiguous, the loop runs over all 3n components.
+ */
+static void add_qed_gradient(int n, double c0, double cd, double ct, double *u,
+                             rvec G0[], rvec G1[], rvec tX[], rvec tY[],
+                             rvec tZ[], rvec f[], rvec fshift[]){
+  int
+    k;
+  real
+    *g0=(real *)G0,*g1=(real *)G1,*tx=(real *)tX,*ty=(real *)tY,
+    *tz=(real *)tZ,*fo=(real *)f,*fs=(real *)fshift;
+  double
+    fk;
+
+  for (k=0;k<DIM*n;k++){
+    fk = c0*g0[k]+cd*(g1[k]-g0[k])-ct*(u[0]*tx[k]+u[1]*ty[k]+u[2]*tz[k]);
+    fo[k] += fk;
+    if (fs){
+      fs[k] += fk;
+    }
+  }
+} /* add_qed_gradient */
+
+/* Hellman-Feynman forces on molecule m in the adiabatic (polariton)
+ * basis, for the current polariton or the Ehrenfest mean field, and
+ * returns the energy. The state enters through the excitation b = V_pm
+ * and field a = photon_amplitude of the states p, the mean field through
+ * Z = sum_p c_p b_p and Y = sum_p c_p a_p, as the sum over all pairs
+ * p,q of c_p^* c_q (b_p^* b_q, b_p^* a_q + a_p^* b_q) is |Z|^2 and
+ * 2 Re(Z^* Y).
+ */
+static double polariton_forces(t_forcerec *fr, t_QMrec *qm, t_MMrec *mm,
+                               int ndim, int nmol, int m, dplx *eigvec,
+                               double *eigval, double totpop, double *u,
+                               rvec QMgrad_S0[], rvec QMgrad_S1[],
+                               rvec MMgrad_S0[], rvec MMgrad_S1[],
+                               rvec tdmX[], rvec tdmY[], rvec tdmZ[],
+                               rvec tdmXMM[], rvec tdmYMM[], rvec tdmZMM[],
+                               rvec f[], rvec fshift[]){
+  int
+    p;
+  double
+    c0=0,cd,ct,csq,QMener=0;
+  dplx
+    a,b,c,Z=0.0+IMAG*0.0,Y=0.0+IMAG*0.0;
+
+  if(fr->qr->SHmethod != eSHmethodEhrenfest){
+    p  = qm->polariton;
+    a  = photon_amplitude(qm,m,nmol,&eigvec[p*ndim]);
+    b  = eigvec[p*ndim+m];
+    c0 = 1;
+    cd = creal(conj(b)*b);
+    ct = 2*creal(conj(b)*a);
+    QMener = eigval[p]*HARTREE2KJ*AVOGADRO;
+  }
+  else{
+    /* weights normalized by the norm of the wavefunction, totpop,
+     * in case there are losses
+     */
+    for (p=0;p<ndim;p++){
+      c    = qm->creal[p]+IMAG*qm->cimag[p];
+      csq  = creal(conj(c)*c)/totpop;
+      c0  += csq;
+      Z   += c*eigvec[p*ndim+m];
+      Y   += c*photon_amplitude(qm,m,nmol,&eigvec[p*ndim]);
+      QMener += csq*eigval[p]*HARTREE2KJ*AVOGADRO;
+    }
+    cd = creal(conj(Z)*Z)/totpop;
+    ct = 2*creal(conj(Z)*Y)/totpop;
+  }
+  add_qed_gradient(qm->nrQMatoms,c0*HARTREE_BOHR2MD,cd*HARTREE_BOHR2MD,
+                   ct*HARTREE_BOHR2MD,u,QMgrad_S0,QMgrad_S1,
+                   tdmX,tdmY,tdmZ,f,fshift);
+  add_qed_gradient(mm->nrMMatoms,c0*HARTREE_BOHR2MD,cd*HARTREE_BOHR2MD,
+                   ct*HARTREE_BOHR2MD,u,MMgrad_S0,MMgrad_S1,
+                   tdmXMM,tdmYMM,tdmZMM,
+                   f+qm->nrQMatoms,fshift+qm->nrQMatoms);
+  return QMener;
+} /* polariton_forces */
+
+/* Ehrenfest forces on molecule m in the diabatic basis, with c the
+ * coefficients of the molecular excitations and modes
+ */
+static void diabatic_mf_forces(t_QMrec *qm, t_MMrec *mm, int ndim, int nmol,
+                               int m, double totpop, double *u,
+                               rvec QMgrad_S0[], rvec QMgrad_S1[],
+                               rvec MMgrad_S0[], rvec MMgrad_S1[],
+                               rvec tdmX[], rvec tdmY[], rvec tdmZ[],
+                               rvec tdmXMM[], rvec tdmYMM[], rvec tdmZMM[],
+                               rvec f[], rvec fshift[]){
+  int
+    p;
+  double
+    csq,cd,ct,scale=HARTREE_BOHR2MD/totpop;
+  dplx
+    *c,cm;
+
+  snew(c,ndim);
+  for (p=0;p<ndim;p++){
+    c[p] = qm->creal[p]+IMAG*qm->cimag[p];
+  }
+  cm  = c[m];
+  csq = creal(conj(cm)*cm);
+  /* (totpop-csq) G0 + csq G1 - 2 Re(c_m^* sum_p c_p fac_p) u.tdm */
+  cd  = csq;
+  ct  = 2*creal(conj(cm)*photon_amplitude(qm,m,nmol,c));
+  add_qed_gradient(qm->nrQMatoms,totpop*scale,cd*scale,ct*scale,u,
+                   QMgrad_S0,QMgrad_S1,tdmX,tdmY,tdmZ,f,fshift);
+  add_qed_gradient(mm->nrMMatoms,totpop*scale,cd*scale,ct*scale,u,
+                   MMgrad_S0,MMgrad_S1,tdmXMM,tdmYMM,tdmZMM,
+                   f+qm->nrQMatoms,fshift+qm->nrQMatoms);
+  sfree(c);
+} /* diabatic_mf_forces */
+
 void get_NAC(int ndim, int nmol,dplx  *eigvec,double *eigval,rvec *tdmX,
 	     rvec *tdmY, rvec *tdmZ, rvec *tdmXMM, rvec *tdmYMM,
 	     rvec *tdmZMM,t_QMrec *qm,t_MMrec *mm,int mol,rvec *QMgrad_S0,
@@ -3273,64 +3664,31 @@ void get_NAC(int ndim, int nmol,dplx  *eigvec,double *eigval,rvec *tdmX,
      2Re[F.v], which is what we compute.
      */
   int
-    m,i,j;
+    m;
   dplx
-    fij,bpaq,apbq,bqap,aqbp,a_sump,a_sumq,betasq;
+    bpaq,apbq,a_sump,a_sumq,betasq;
   double
-    gap;
+    gap,scale;
   double E0_norm_sq;
   E0_norm_sq = iprod(qm->E,qm->E);
-  // Square of the magitud of the E-field at k=0
-  double V0_2EP = qm->omega/(E0_norm_sq),L_au=qm->L*microM2BOHR;
   double u[3];
   u[0]=qm->E[0]/sqrt(E0_norm_sq);
   u[1]=qm->E[1]/sqrt(E0_norm_sq);
   u[2]=qm->E[2]/sqrt(E0_norm_sq);
   
-  
   m=mol;
-  a_sump = 0.0+IMAG*0.0;
   gap = eigval[q]-eigval[p];
-  //  if (gap > 0.0001 || gap < -0.0001){
-  for (i=0;i<(qm->n_max)+1;i++){
-    a_sump += eigvec[p*ndim+nmol+i]*sqrt(cavity_dispersion(i,qm)/V0_2EP)*cexp(IMAG*2*M_PI*i/L_au*m*L_au/((double) nmol));
-  }
+  a_sump = photon_amplitude(qm,m,nmol,&eigvec[p*ndim]);
+  a_sumq = photon_amplitude(qm,m,nmol,&eigvec[q*ndim]);
   betasq = conj(eigvec[p*ndim+m])*eigvec[q*ndim+m];
-  a_sumq = 0.0+IMAG*0.0;
-  for (i=0;i<(qm->n_max)+1;i++){
-    a_sumq += eigvec[q*ndim+nmol+i]*sqrt(cavity_dispersion(i,qm)/V0_2EP)*cexp(IMAG*2*M_PI*i/L_au*m*L_au/((double) nmol));
-  }
   bpaq = a_sumq*conj(eigvec[p*ndim+m]);
   apbq = conj(a_sump)*eigvec[q*ndim+m];
-  bqap = conj(eigvec[q*ndim+m])*(a_sump); /* conj(apbq) */
-  aqbp = conj(a_sumq)*eigvec[p*ndim+m]; /* conj(bpaq) */
-  for(i=0;i<qm->nrQMatoms;i++){
-    for(j=0;j<DIM;j++){
-	  /* diagonal term
-	   */
-	  fij = betasq*(QMgrad_S1[i][j]-QMgrad_S0[i][j]);
-	  /* off-diagonal term
-	   */
-      fij-= (bpaq+apbq)*tdmX[i][j]*u[0];
-	  fij-= (bpaq+apbq)*tdmY[i][j]*u[1];
-	  fij-= (bpaq+apbq)*tdmZ[i][j]*u[2];
-	  fij*=HARTREE_BOHR2MD;
-      fij/=(HARTREE2KJ*AVOGADRO*gap);
-	  nacQM[i][j] +=creal(fij);
-    }
-  }
-  for(i=0;i<mm->nrMMatoms;i++){
-    for(j=0;j<DIM;j++){
-	  fij = betasq*(MMgrad_S1[i][j]-MMgrad_S0[i][j]);
-	  fij-= (bpaq+apbq)*tdmXMM[i][j]*u[0];
-      fij-= (bpaq+apbq)*tdmYMM[i][j]*u[1];
-	  fij-= (bpaq+apbq)*tdmZMM[i][j]*u[2];
-	  fij*=HARTREE_BOHR2MD;
-      fij/=(HARTREE2KJ*AVOGADRO*gap);
-	  nacMM[i][j] +=creal(fij);
-    }
-  }
-    //  }
+  /* only the real part of the coupling, see above */
+  scale = HARTREE_BOHR2MD/(HARTREE2KJ*AVOGADRO*gap);
+  add_qed_gradient(qm->nrQMatoms,0,creal(betasq)*scale,creal(bpaq+apbq)*scale,
+                   u,QMgrad_S0,QMgrad_S1,tdmX,tdmY,tdmZ,nacQM,NULL);
+  add_qed_gradient(mm->nrMMatoms,0,creal(betasq)*scale,creal(bpaq+apbq)*scale,
+                   u,MMgrad_S0,MMgrad_S1,tdmXMM,tdmYMM,tdmZMM,nacMM,NULL);
 } /* get_NAC */
 
 static int check_vel(t_commrec *cr,
@@ -3385,8 +3743,8 @@ static int check_vel(t_commrec *cr,
     }
   }
   if(MULTISIM(cr)){
-    gmx_sumd_sim(1,&a,cr->ms);
-    gmx_sumd_sim(1,&b,cr->ms);
+    qed_sumd_sim(1,&a,cr->ms);
+    qed_sumd_sim(1,&b,cr->ms);
     if(cr->ms->sim==0)
       fprintf(stderr,"in check_vel: a = %lf, b = %lf, dE= %lf, (b*b - 4.0*a*dE) = %lf, g = %lf / %lf / %lf\n",a,b,dE,b*b - 4.0*a*dE,( b + sqrt(b*b - 4.0*a*dE))/(2*a),( b - sqrt(b*b - 4.0*a*dE))/(2*a),b/a);
   }
@@ -3543,7 +3901,10 @@ void print_NAC(int ndim, int nmol,dplx  *eigvec,double *eigval,rvec *tdmX, rvec
   }
 } /* print_NAC */
 
-int compute_hopping_probability(int step,t_QMrec *qm, dplx *c, dplx *U, int ndim){
+/* Ucur is the column of the propagator U for the current state,
+ * Ucur[i] = U[i*ndim+qm->polariton], all the Granucci scheme needs.
+ */
+int compute_hopping_probability(int step,t_QMrec *qm, dplx *c, dplx *Ucur, int ndim){
   double
     *p,b,btot=0.0,ptot=0.,rnr;
   int
@@ -3588,7 +3949,7 @@ int compute_hopping_probability(int step,t_QMrec *qm, dplx *c, dplx *U, int ndim
       btot=0.0;
       for ( i = 0 ; i < ndim ; i++ ){
 	if ( i != current ){
-	  b = conj(U[i*ndim+current]*cold[current])*U[i*ndim+current]*cold[current];
+	  b = conj(Ucur[i]*cold[current])*Ucur[i]*cold[current];
 	  if (b>0.0){
 	    btot+=b;
 	    p[i]=b;
@@ -3618,6 +3979,126 @@ int compute_hopping_probability(int step,t_QMrec *qm, dplx *c, dplx *U, int ndim
   return(hopto);
 } /* compute_hopping_probability */
 
+/* Send the adiabatic state around after the eigensolver/propagator on
+ * simulation root did its work: every molecule gets the eigenvalues,
+ * the nscal doubles in scal (expansion coefficients, state, ...) and,
+ * of every eigenvector, only the components on that molecule and on
+ * the cavity modes, which is all the force and NAC code for a molecule
+ * reads. This is a single scatter of O(ndim*K) doubles per molecule
+ * instead of summing the full ndim x ndim eigenvectors over all
+ * simulations. Eigenvector components on other molecules are zero on
+ * return, except on root which keeps everything.
+ */
+static void qed_scatter_state(t_commrec *cr, int root, int ndim, int nmol,
+                              double *eigval, dplx *eigvec,
+                              int nscal, double *scal)
+{
+  int
+    K=ndim-nmol,nper,mol,p,k,i;
+  double
+    *sbuf=NULL,*rbuf,*buf;
+
+  nper = ndim+nscal+2*ndim*(1+K);
+  snew(rbuf,nper);
+  if (cr->ms->sim == root){
+    snew(sbuf,nmol*nper);
+    for (mol=0; mol<nmol; mol++){
+      buf = sbuf+mol*nper;
+      for (i=0; i<ndim; i++){
+        *buf++ = eigval[i];
+      }
+      for (i=0; i<nscal; i++){
+        *buf++ = scal[i];
+      }
+      for (p=0; p<ndim; p++){
+        *buf++ = creal(eigvec[p*ndim+mol]);
+        *buf++ = cimag(eigvec[p*ndim+mol]);
+        for (k=0; k<K; k++){
+          *buf++ = creal(eigvec[p*ndim+nmol+k]);
+          *buf++ = cimag(eigvec[p*ndim+nmol+k]);
+        }
+      }
+    }
+  }
+  qed_comm_begin();
+  gmx_scatter_sim(nper*sizeof(double),sbuf,rbuf,root,cr->ms);
+  qed_comm_end();
+  if (cr->ms->sim != root){
+    mol = cr->ms->sim;
+    buf = rbuf;
+    for (i=0; i<ndim; i++){
+      eigval[i] = *buf++;
+    }
+    for (i=0; i<nscal; i++){
+      scal[i] = *buf++;
+    }
+    for (i=0; i<ndim*ndim; i++){
+      eigvec[i] = 0;
+    }
+    for (p=0; p<ndim; p++){
+      eigvec[p*ndim+mol] = buf[0]+IMAG*buf[1];
+      buf += 2;
+      for (k=0; k<K; k++){
+        eigvec[p*ndim+nmol+k] = buf[0]+IMAG*buf[1];
+        buf += 2;
+      }
+    }
+  }
+  sfree(sbuf);
+  sfree(rbuf);
+}
+
+/* hands a record of QED output to the writer thread */
+static void qed_output_close(t_forcerec *fr, t_QMrec *qm, gmx_qed_record_t r){
+  if (qed_ewc >= 0){
+    wallcycle_suspend(qed_wcycle,qed_ewc);
+  }
+  wallcycle_add(fr->qr->wcycle,ewcQED_WRITE,1,qed_record_close(qm->qedwriter,r));
+  if (qed_ewc >= 0){
+    wallcycle_resume(qed_wcycle,qed_ewc);
+  }
+} /* qed_output_close */
+
+/* a frame of the polariton trajectory instead of eigenvectors.dat and
+ * coefficients.dat, eigval and eigvec may be NULL for eqtrCOEFF
+ */
+static void qed_traj_output(t_forcerec *fr, t_QMrec *qm, int step, int layout,
+                            int ndim, double energy, double ref,
+                            double *eigval, dplx *eigvec){
+  t_qtrframe
+    *frame;
+  int
+    i;
+
+  frame = qed_traj_frame(qm->qedtraj,step,layout,ndim,
+                         layout == eqtrCOEFF ? 0 : ndim);
+  frame->energy      = energy;
+  frame->ref         = ref;
+  frame->groundstate = qm->groundstate;
+  for (i=0;i<ndim;i++){
+    frame->c[2*i]   = qm->creal[i];
+    frame->c[2*i+1] = qm->cimag[i];
+  }
+  if (frame->flags & QTR_D){
+    for (i=0;i<ndim;i++){
+      frame->d[2*i]   = qm->dreal[i];
+      frame->d[2*i+1] = qm->dimag[i];
+    }
+  }
+  if (frame->flags & QTR_GAP){
+    for (i=0;i<ndim;i++){
+      frame->gap[i] = eigval[i]-ref;
+    }
+  }
+  if (frame->flags & QTR_EIGVEC){
+    for (i=0;i<ndim*ndim;i++){
+      frame->eigvec[2*i]   = creal(eigvec[i]);
+      frame->eigvec[2*i+1] = cimag(eigvec[i]);
+    }
+  }
+  qed_output_close(fr,qm,qed_traj_record(qm->qedtraj));
+} /* qed_traj_output */
+
 double do_hybrid_non_herm(t_commrec *cr,  t_forcerec *fr, 
 			  t_QMrec *qm, t_MMrec *mm, rvec f[], rvec fshift[],
 			  dplx *matrix, int step,
@@ -3628,20 +4109,22 @@ double do_hybrid_non_herm(t_commrec *cr,  t_forcerec *fr,
 			  double *energies)
 {
   double
-    decay,L_au=qm->L*microM2BOHR,
-    E0_norm_sq,V0_2EP,u[3],QMener=0.,totpop=0.,
-    *eigvec_real,*eigvec_imag,*eigval,ctot=0.,dtot=0.,fcorr;
+    decay,
+    E0_norm_sq,u[3],QMener=0.,totpop=0.,
+    *eigvec_real,*eigvec_imag,*eigval,ctot=0.,dtot=0.,fcorr,*scal;
   dplx
-    fij,csq,cmcp,*ham,
+    *ham,
     *expH,*ctemp,*c,cicj,ener=0.,*d,*dtemp,
-    *eigvec,cpcq,bpaq,apbq,bqap,aqbp,a_sump,a_sumq,
-    a_sum,a_sum2,betasq,ab,ba,*temp,*uold,*udagger,*umatrix;
+    *eigvec,
+    a_sum2,ba,*temp,*uold,*udagger,*umatrix;
   int
-    dodiag=0,doprop=0,*state,i,j,k,p,q,m,nmol,ndim,prop,dohop[1],hopto[1];
+    dodiag=0,doprop=0,*state,i,j,k,m,nmol,ndim,prop,dohop[1],hopto[1];
+  gmx_bool
+    bExpH=FALSE;
   char
     *eigenvectorfile,*coefficientfile,*energyfile,buf[3000];
-  FILE
-    *evout=NULL,*Cout=NULL;
+  gmx_qed_record_t
+    evout=NULL,Cout=NULL;
     /* I think these shoudl be complex... for sigle mode it won't matter though */
   rvec
     *nacQM=NULL,*nacMM=NULL;
@@ -3655,7 +4138,6 @@ double do_hybrid_non_herm(t_commrec *cr,  t_forcerec *fr,
   /* information on field, was already calcualted above...
    */
   E0_norm_sq = iprod(qm->E,qm->E); // Square of the magitud of the E-field at k=0
-  V0_2EP = qm->omega/(E0_norm_sq); //2*Epsilon0*V_cav at k=0 (in a.u.)
   u[0]=qm->E[0]/sqrt(E0_norm_sq);
   u[1]=qm->E[1]/sqrt(E0_norm_sq);
   u[2]=qm->E[2]/sqrt(E0_norm_sq);
@@ -3697,11 +4179,12 @@ double do_hybrid_non_herm(t_commrec *cr,  t_forcerec *fr,
   snew(udagger,ndim*ndim);
   snew(umatrix,ndim*ndim);
   hopto[0]=qm->polariton;
+  qed_phase(ewcQED_DIAG);
   if(dodiag){
     /* node 1 diagonalizes the matrix 
      */
     fprintf(stderr,"\n\ndiagonalizing matrix on node %d\n",m);
-    diag(ndim,eigval,eigvec,matrix);
+    diag_QED(qm,ndim,nmol,eigval,eigvec,matrix);
     fprintf(stderr,"step %d Eigenvalues: ",step);
     for ( i = 0 ; i<ndim;i++){
       fprintf(stderr,"%lf ",eigval[i]);
@@ -3713,6 +4196,7 @@ double do_hybrid_non_herm(t_commrec *cr,  t_forcerec *fr,
       eigvec_imag[i]=cimag(eigvec[i]);
     }
   }
+  qed_phase(ewcQED_PROP);
   /* while node 0 performs propagation in the diabatic basis
    */
   if(doprop){
@@ -3736,11 +4220,7 @@ double do_hybrid_non_herm(t_commrec *cr,  t_forcerec *fr,
       }
       /* propagate the coefficients 
        */
-      expM_non_herm(ndim,ham,expH, qm->dt);
-      MtimesV_complex(ndim,expH,d,dtemp);
-      for( i=0;i<ndim;i++){
-        d[i]=dtemp[i];
-      }
+      expH_times_v(qm,ndim,ham,FALSE,expH,&bExpH,d);
       for ( i = 0 ; i < ndim ; i++ ){	
         qm->dreal[i] = creal(d[i]);
         qm->dimag[i] = cimag(d[i]);
@@ -3772,8 +4252,8 @@ double do_hybrid_non_herm(t_commrec *cr,  t_forcerec *fr,
      * adiabatic coefficients are supplied in init_QMMM, we check this by computing the norms.
      */
     if(MULTISIM(cr)){
-      gmx_sumd_sim(ndim,qm->dreal ,cr->ms);
-      gmx_sumd_sim(ndim,qm->dimag ,cr->ms);
+      qed_sumd_sim(ndim,qm->dreal ,cr->ms);
+      qed_sumd_sim(ndim,qm->dimag ,cr->ms);
     }
     if(dodiag){
       ctot=dtot=0.0;
@@ -3840,28 +4320,31 @@ double do_hybrid_non_herm(t_commrec *cr,  t_forcerec *fr,
     }
   }
   if(MULTISIM(cr)){
-    gmx_sumd_sim(ndim,qm->creal ,cr->ms);
-    gmx_sumd_sim(ndim,qm->cimag ,cr->ms);
+    qed_sumd_sim(ndim,qm->creal ,cr->ms);
+    qed_sumd_sim(ndim,qm->cimag ,cr->ms);
+    qed_sumd_sim(ndim,qm->dreal ,cr->ms);
+    qed_sumd_sim(ndim,qm->dimag ,cr->ms);
   }
 }
 /* communicate eigenvectors from node 0 and diabatic expansion coefficients from node1
  */
 if(MULTISIM(cr)){
-  /* One processor has the eigenvectors. Another one has the
-   * time-dependent diabatic expansion coefficients.
-   * Eigenvectors, and coefficients are now communicates to the other
-   * nodes, so that every one can compute the mean-field forces to the
-   * other nodes, etc. We also communication the eigenvalues,
-   * even we don't seem to need them.
+  /* Only the node that propagates needs the full eigenvectors here,
+   * the other nodes get their part of them together with the new
+   * expansion coefficients below.
    */
-  gmx_sumd_sim(ndim*ndim,eigvec_real,cr->ms);
-  gmx_sumd_sim(ndim*ndim,eigvec_imag,cr->ms);
-  gmx_sumd_sim(ndim,eigval,cr->ms);
-  gmx_sumd_sim(ndim,qm->dreal ,cr->ms);
-  gmx_sumd_sim(ndim,qm->dimag ,cr->ms);
-}
-for(i=0;i<ndim*ndim;i++){
-  eigvec[i]=eigvec_real[i]+IMAG*eigvec_imag[i];
+  if(cr->ms->nsim > 1){
+    qed_comm_begin();
+    if(dodiag){
+      gmx_send_sim(ndim*ndim*sizeof(dplx),eigvec,0,cr->ms);
+      gmx_send_sim(ndim*sizeof(double),eigval,0,cr->ms);
+    }
+    else if(doprop){
+      gmx_recv_sim(ndim*ndim*sizeof(dplx),eigvec,1,cr->ms);
+      gmx_recv_sim(ndim*sizeof(double),eigval,1,cr->ms);
+    }
+    qed_comm_end();
+  }
 }
   
 /* now all MPI tasks have the diabatic expansion coefficients,
@@ -3886,7 +4369,7 @@ if (doprop){
     for (j=0;j<ndim;j++){
       /* hermitian adjoint of U
        */
-      udagger[i*ndim+j]=eigvec_real[i*ndim+j]-IMAG*eigvec_imag[i*ndim+j];
+      udagger[i*ndim+j]=conj(eigvec[i*ndim+j]);
       /* transpose of U, i.e. eigenvectors are columns
 	   */
       uold[i*ndim+j] = qm->eigvec[j*ndim+i];
@@ -3897,15 +4380,20 @@ if (doprop){
 	  d[i]=qm->dreal[i]+IMAG*qm->dimag[i];
 	  c[i]=qm->creal[i]+IMAG*qm->cimag[i];
     }
-    M_complextimesM_complex(ndim,udagger,expH,temp);
-    M_complextimesM_complex(ndim,temp,uold,expH);
-    MtimesV_complex(ndim,expH,c,ctemp);
-    for( i=0;i<ndim;i++){
-	  c[i]=ctemp[i];
-    }
+    /* c(t+dt) = U^dagger(t+dt) exp(-iH dt) U(t) c(t), one vector
+     * at a time instead of forming the product of the matrices
+     */
+    MtimesV_complex(ndim,uold,c,ctemp);
+    expH_times_v(qm,ndim,ham,FALSE,expH,&bExpH,ctemp);
+    MtimesV_complex(ndim,udagger,ctemp,c);
     if (fr->qr->SHmethod == eSHmethodGranucci){
-	  //qm->polariton = state[0] =
-	  hopto[0]= compute_hopping_probability(step,qm,c,expH,ndim);
+      /* the column of that propagator for the current state */
+      for(i=0;i<ndim;i++){
+        dtemp[i]=uold[i*ndim+qm->polariton];
+      }
+      expH_times_v(qm,ndim,ham,FALSE,expH,&bExpH,dtemp);
+      MtimesV_complex(ndim,udagger,dtemp,ctemp);
+      hopto[0]= compute_hopping_probability(step,qm,c,ctemp,ndim);
     }
     for ( i = 0 ; i < ndim ; i++ ){
       qm->creal[i] = creal(c[i]);
@@ -3933,13 +4421,39 @@ if (doprop){
   /* comunicate the information on adiabatic coefficient to all
    * nodes to compute forces... 
    */
+  /* the nodes holding all the eigenvectors keep them in qmrec (old
+   * vectors of the next step, written out by dodiag below) before the
+   * scatter leaves only the components each molecule needs
+   */
+  if(dodiag || doprop){
+    for(i=0;i<ndim*ndim;i++){
+      qm->eigvec[i]=eigvec[i];
+    }
+  }
   if(MULTISIM(cr)){
-    gmx_sumi_sim(1,state,cr->ms);
-    gmx_sumi_sim(1,hopto,cr->ms);
-    /* not sure abotu the next line... */
-    //    qm->polariton = state[0];
-    gmx_sumd_sim(ndim,qm->creal ,cr->ms);
-    gmx_sumd_sim(ndim,qm->cimag ,cr->ms);
+    /* one message from the propagating node with the eigenvalues,
+     * our part of the eigenvectors, both sets of coefficients and
+     * the state we may hop to
+     */
+    snew(scal,4*ndim+1);
+    if(doprop){
+      for(i=0;i<ndim;i++){
+        scal[i]        = qm->creal[i];
+        scal[ndim+i]   = qm->cimag[i];
+        scal[2*ndim+i] = qm->dreal[i];
+        scal[3*ndim+i] = qm->dimag[i];
+      }
+      scal[4*ndim] = hopto[0];
+    }
+    qed_scatter_state(cr,0,ndim,nmol,eigval,eigvec,4*ndim+1,scal);
+    for(i=0;i<ndim;i++){
+      qm->creal[i] = scal[i];
+      qm->cimag[i] = scal[ndim+i];
+      qm->dreal[i] = scal[2*ndim+i];
+      qm->dimag[i] = scal[3*ndim+i];
+    }
+    hopto[0] = (int)scal[4*ndim];
+    sfree(scal);
   }
   /* compute the norm of the wavefunction when there are losses
    */
@@ -3949,14 +4463,17 @@ if (doprop){
   qm->groundstate=1-totpop;
   /* copy the new eigenvectors to qmrec (become old vectors)
    */
-  for(i=0;i<ndim*ndim;i++){
-    qm->eigvec[i]=eigvec[i];
+  if(!dodiag && !doprop){
+    for(i=0;i<ndim*ndim;i++){
+      qm->eigvec[i]=eigvec[i];
+    }
   }
   /* Step 2b: If we want to make a hop, we check if there is sufficent kinetic energy
    * for that. If we do hop we also need to adjust the velocities, as the
    * work is done in the direction of the NAC. We thus first compute
    * the contributions of each molecule to the total NAC vector
    */ 
+  qed_phase(ewcQED_NAC);
   if(hopto[0] != qm->polariton){
     fprintf(stderr,"checking if there is sufficient energy to hop from %d to %d\n",
 	      qm->polariton,hopto[0]);
@@ -3968,7 +4485,7 @@ if (doprop){
     dohop[0] = check_vel(cr,eigval,nacQM,nacMM,qm,mm,
 			 qm->polariton,hopto[0],&fcorr);
     if(MULTISIM(cr)){
-      gmx_sumi_sim(1,dohop,cr->ms);
+      qed_sumi_sim(1,dohop,cr->ms);
     }
     /* Only if there is sufficient kinetic energy on all nodes, we hop
      */
@@ -3988,214 +4505,77 @@ if (doprop){
   }
   /* step 3: compute the gradients and sum up the energy
    */
-  if(fr->qr->SHmethod != eSHmethodEhrenfest){
-    p=qm->polariton;
-    betasq = conj(eigvec[p*ndim+m])*eigvec[p*ndim+m];
-    a_sump = 0.0+IMAG*0.0;
-    for (i=0;i<(qm->n_max-qm->n_min)+1;i++){
-      a_sump += eigvec[p*ndim+nmol+i]*sqrt(cavity_dispersion(i+qm->n_min,qm)/V0_2EP)*cexp(IMAG*2*M_PI*(i+qm->n_min)/L_au*m*L_au/((double) nmol));
-    }
-    ab = conj(eigvec[p*ndim+m])*a_sump; //actually sum of alphas * beta_j
-    ab += conj(a_sump)*eigvec[p*ndim+m];
-    for(i=0;i<qm->nrQMatoms;i++){
-      for(j=0;j<DIM;j++){
-        /* diagonal term
-         */
-        fij =(betasq*QMgrad_S1[i][j]+(1-betasq)*QMgrad_S0[i][j]);
-        /* off-diagonal term
-         */
-        fij-= ab*tdmX[i][j]*u[0];
-        fij-= ab*tdmY[i][j]*u[1];
-        fij-= ab*tdmZ[i][j]*u[2];
-        fij*=HARTREE_BOHR2MD;
-        f[i][j]      += creal(fij);
-        fshift[i][j] += creal(fij);
-      }
+  qed_phase(ewcQED_FORCE);
+  QMener = polariton_forces(fr,qm,mm,ndim,nmol,m,eigvec,eigval,totpop,u,
+                            QMgrad_S0,QMgrad_S1,MMgrad_S0,MMgrad_S1,
+                            tdmX,tdmY,tdmZ,tdmXMM,tdmYMM,tdmZMM,f,fshift);
+  /* printing the coefficients to C.dat 
+   * print the adiabatic eigenvectors to a file 
+   */
+  if( dodiag && qm->qedtraj ){
+    if (qed_traj_step(qm->qedtraj,step)){
+      qed_traj_output(fr,qm,step,eqtrHYBRID,ndim,QMener,
+                      energies[ndim-1]-cavity_dispersion(qm->n_max,qm),
+                      eigval,qm->eigvec);
     }
-    for(i=0;i<mm->nrMMatoms;i++){
-      for(j=0;j<DIM;j++){
-        /* diagonal term
-         */
-        fij =(betasq*MMgrad_S1[i][j]+(1-betasq)*MMgrad_S0[i][j]);
-        /* off-diagonal term
-         */
-        fij-= ab*tdmXMM[i][j]*u[0];
-        fij-= ab*tdmYMM[i][j]*u[1];
-        fij-= ab*tdmZMM[i][j]*u[2];
-        fij*=HARTREE_BOHR2MD;
-        f[i+qm->nrQMatoms][j]      += creal(fij);
-        fshift[i+qm->nrQMatoms][j] += creal(fij);
+  }
+  else if( dodiag ){
+    snew(eigenvectorfile,3000);
+    sprintf(eigenvectorfile,"%s/eigenvectors.dat",qm->work_dir);
+    evout=qed_record_open(eigenvectorfile,"a");
+    for(i=0;i<ndim;i++){
+      qed_record_printf(evout,
+	      "step %4d Eigenvector %4d gap %12.8lf (c: %12.8lf + %12.8lf I):",
+	      step,i,eigval[i]-(
+				energies[ndim-1]-cavity_dispersion(qm->n_max,qm)),
+	      qm->creal[i],qm->cimag[i]);
+      for(k=0;k<ndim;k++){
+        qed_record_printf(evout," %12.8lf + %12.8lf I",creal(qm->eigvec[i*ndim+k]),cimag(qm->eigvec[i*ndim+k]));
       }
+      qed_record_printf(evout,"\n");
     }
-    QMener = eigval[p]*HARTREE2KJ*AVOGADRO;
+    qed_output_close(fr,qm,evout);
+    free(eigenvectorfile);
+    snew(coefficientfile,3000);
+    sprintf(coefficientfile,"%s/coefficients.dat",qm->work_dir);
+    evout=qed_record_open(coefficientfile,"a");
+    qed_record_printf(evout,
+	    "step %4d energy: %12.8lf coeff: ", step,QMener);
+    for(k=0;k<ndim;k++){
+      qed_record_printf(evout," %12.8lf + %12.8lf I",qm->dreal[k],qm->dimag[k]);
+      //      totpop+=qm->creal[k]*qm->creal[k]+qm->cimag[k]*qm->cimag[k];
+    }
+    qed_record_printf(evout,"\n");
+    qed_output_close(fr,qm,evout);
+    free(coefficientfile);    
   }
-  else {
-    /* Ehrenfest dynamics, need to compute gradients of all polaritonic
-     * states and weigh them with weights of the states. Also the
-     * nonadiabatic couplings between polaritonic states are needed now
+  if( dodiag ){
+    fprintf(stderr,"rho0 (%d) = %lf, Energy = %lf\n",step,qm->groundstate,energies[ndim-1]-cavity_dispersion(qm->n_max,qm));
+    sprintf(buf,"%s/C.dat",qm->work_dir);
+    Cout=qed_record_open(buf,"w");
+    qed_record_printf(Cout,"%d\n",step);
+    for(i=0;i<ndim;i++){
+      qed_record_printf(Cout,"%.5lf %.5lf\n ",qm->creal[i],qm->cimag[i]);
+    }
+    qed_record_printf(Cout,"%.5lf\n",qm->groundstate);
+    qed_output_close(fr,qm,Cout);
+  }
+  /* now do the decoherence that will happen in the next timestep 
+   * we thus use the current total kinetic energy. I suppose this is the kinetic energy 
+   * after the velocity correct? 
+   * We need to send this 
+   * around we wrote separate routine. Decoherence corrections make sense
+   * only for surface hopping methods, so we check for that.
+   */
+  if ( ( fr->qr->SHmethod == eSHmethodGranucci )
+       && (qm->QEDdecoherence > 0.) ){
+    qed_phase(ewcQED_NAC);
+    decoherence(cr,qm,mm,ndim,eigval);
+    /* to capture the effect on d, we transform: d=Uc;
      */
-    QMener=0.0; 
-    for (p=0;p<ndim;p++){
-      /* do the diagonal terms first p=q. These terems are same as above for 
-       * single state procedure. If losses are included, we divide by the norm of 
-       * the wavefunction: totpop
-       */
-      csq = conj(qm->creal[p]+IMAG*qm->cimag[p])*(qm->creal[p]+IMAG*qm->cimag[p]);
-      betasq = conj(eigvec[p*ndim+m])*eigvec[p*ndim+m];
-      a_sump = 0.0+IMAG*0.0;
-      for (i=0;i<(qm->n_max-qm->n_min)+1;i++){
-        a_sump += eigvec[p*ndim+nmol+i]*sqrt(cavity_dispersion(i+qm->n_min,qm)/V0_2EP)*cexp(IMAG*2*M_PI*(i+qm->n_min)/L_au*m*L_au/((double) nmol));
-      }
-      ab = conj(eigvec[p*ndim+m])*a_sump; //actually sum of alphas * beta_j
-      ab += conj(a_sump)*eigvec[p*ndim+m]; // ADDED GG, this accounts for the 3rd and 4th term together in equation 13.
-      /* we normalize the total energy: 
-       */
-      QMener += csq*eigval[p]*HARTREE2KJ*AVOGADRO/totpop;
-      for(i=0;i<qm->nrQMatoms;i++){
-        for(j=0;j<DIM;j++){
-          /* diagonal term
-           */
-          fij =(betasq*QMgrad_S1[i][j]+(1-betasq)*QMgrad_S0[i][j]);
-          /* off-diagonal term, Because coeficients are real: ab = ba
-           */
-          fij-= ab*tdmX[i][j]*u[0];
-          fij-= ab*tdmY[i][j]*u[1];
-          fij-= ab*tdmZ[i][j]*u[2];
-          fij*=HARTREE_BOHR2MD*csq/totpop;
-          f[i][j]      += creal(fij);
-          fshift[i][j] += creal(fij);
-        }
-      }
-      for(i=0;i<mm->nrMMatoms;i++){
-        for(j=0;j<DIM;j++){
-          /* diagonal terms
-           */
-          fij =(betasq*MMgrad_S1[i][j]+(1-betasq)*MMgrad_S0[i][j]);
-          /* off-diagonal term
-           */
-          fij-= ab*tdmXMM[i][j]*u[0];
-          fij-= ab*tdmYMM[i][j]*u[1];
-          fij-= ab*tdmZMM[i][j]*u[2];
-          fij*=HARTREE_BOHR2MD*csq/totpop;
-          f[i+qm->nrQMatoms][j]      += creal(fij);
-          fshift[i+qm->nrQMatoms][j] += creal(fij);
-        }
-      }    
-      /* now off-diagonals 
-       */
-      for (q=p+1;q<ndim;q++){
-	    /* normalize
-	     */
-        cpcq = conj(qm->creal[p]+IMAG*(qm->cimag[p]))*(qm->creal[q]+IMAG*(qm->cimag[q]));
-        betasq = conj(eigvec[p*ndim+m])*eigvec[q*ndim+m];
-        bpaq = conj(a_sum)*eigvec[q*ndim+m];
-        a_sumq = 0.0+IMAG*0.0;
-        for (i=0;i<(qm->n_max)+1;i++){
-          a_sumq += eigvec[q*ndim+nmol+i]*sqrt(cavity_dispersion(i+qm->n_min,qm)/V0_2EP)*cexp(IMAG*2*M_PI*(i+qm->n_min)/L_au*m*L_au/((double) nmol));
-        }
-        bpaq = conj(eigvec[p*ndim+m])*a_sumq;
-        apbq = conj(a_sump)*eigvec[q*ndim+m];
-        bqap = conj(eigvec[q*ndim+m])*a_sump; /* conj(apbq) */
-        aqbp = conj(a_sumq)*eigvec[p*ndim+m]; /* conj(bpaq) */
-        for(i=0;i<qm->nrQMatoms;i++){
-          for(j=0;j<DIM;j++){
-            /* diagonal term
-             */
-            fij=0;
-	        fij = cpcq*betasq*(QMgrad_S1[i][j]-QMgrad_S0[i][j]);
-            fij+= conj(cpcq)*conj(betasq)*(QMgrad_S1[i][j]-QMgrad_S0[i][j]);
-	        /* off-diagonal term
-	         */
-            fij-= cpcq*(bpaq+apbq)*tdmX[i][j]*u[0];
-            fij-= cpcq*(bpaq+apbq)*tdmY[i][j]*u[1];
-            fij-= cpcq*(bpaq+apbq)*tdmZ[i][j]*u[2];
-            fij-= conj(cpcq)*(bqap+aqbp)*tdmX[i][j]*u[0];
-            fij-= conj(cpcq)*(bqap+aqbp)*tdmY[i][j]*u[1];
-            fij-= conj(cpcq)*(bqap+aqbp)*tdmZ[i][j]*u[2];
-            fij*=HARTREE_BOHR2MD/totpop;
-	        f[i][j]      += creal(fij);
-            fshift[i][j] += creal(fij);
-	      }
-        }
-        for(i=0;i<mm->nrMMatoms;i++){
-          for(j=0;j<DIM;j++){
-            /* diagonal term
-             */
-            fij = cpcq*betasq*(MMgrad_S1[i][j]-MMgrad_S0[i][j]);
-            fij+= conj(cpcq)*conj(betasq)*(MMgrad_S1[i][j]-MMgrad_S0[i][j]);
-            /* off-diagonal term
-             */
-            fij-= cpcq*(bpaq+apbq)*tdmXMM[i][j]*u[0];
-            fij-= cpcq*(bpaq+apbq)*tdmYMM[i][j]*u[1];
-            fij-= cpcq*(bpaq+apbq)*tdmZMM[i][j]*u[2];
-            fij-= conj(cpcq)*(bqap+aqbp)*tdmXMM[i][j]*u[0];
-            fij-= conj(cpcq)*(bqap+aqbp)*tdmYMM[i][j]*u[1];
-            fij-= conj(cpcq)*(bqap+aqbp)*tdmZMM[i][j]*u[2];
-            fij*=HARTREE_BOHR2MD/totpop;
-            f[i+qm->nrQMatoms][j]      += creal(fij);
-            fshift[i+qm->nrQMatoms][j] += creal(fij);
-          }
-        }
-      }
-    }
-  }
-  /* printing the coefficients to C.dat 
-   * print the adiabatic eigenvectors to a file 
-   */
-  if( dodiag ){
-    snew(eigenvectorfile,3000);
-    sprintf(eigenvectorfile,"%s/eigenvectors.dat",qm->work_dir);
-    evout=fopen(eigenvectorfile,"a");
-    for(i=0;i<ndim;i++){
-      fprintf(evout,
-	      "step %4d Eigenvector %4d gap %12.8lf (c: %12.8lf + %12.8lf I):",
-	      step,i,eigval[i]-(
-				energies[ndim-1]-cavity_dispersion(qm->n_max,qm)),
-	      qm->creal[i],qm->cimag[i]);
-      for(k=0;k<ndim;k++){
-        fprintf(evout," %12.8lf + %12.8lf I",creal(eigvec[i*ndim+k]),cimag(eigvec[i*ndim+k]));
-      }
-      fprintf(evout,"\n");
-    }
-    fclose(evout);
-    free(eigenvectorfile);
-    snew(coefficientfile,3000);
-    sprintf(coefficientfile,"%s/coefficients.dat",qm->work_dir);
-    evout=fopen(coefficientfile,"a");
-    fprintf(evout,
-	    "step %4d energy: %12.8lf coeff: ", step,QMener);
-    for(k=0;k<ndim;k++){
-      fprintf(evout," %12.8lf + %12.8lf I",qm->dreal[k],qm->dimag[k]);
-      //      totpop+=qm->creal[k]*qm->creal[k]+qm->cimag[k]*qm->cimag[k];
-    }
-    fprintf(evout,"\n");
-    fclose(evout);
-    free(coefficientfile);    
-    fprintf(stderr,"rho0 (%d) = %lf, Energy = %lf\n",step,qm->groundstate,energies[ndim-1]-cavity_dispersion(qm->n_max,qm));
-    sprintf(buf,"%s/C.dat",qm->work_dir);
-    Cout= fopen(buf,"w");
-    fprintf(Cout,"%d\n",step);
-    for(i=0;i<ndim;i++){
-      fprintf (Cout,"%.5lf %.5lf\n ",qm->creal[i],qm->cimag[i]);
-    }
-    fprintf (Cout,"%.5lf\n",qm->groundstate);
-    fclose(Cout);
-  }
-  /* now do the decoherence that will happen in the next timestep 
-   * we thus use the current total kinetic energy. I suppose this is the kinetic energy 
-   * after the velocity correct? 
-   * We need to send this 
-   * around we wrote separate routine. Decoherence corrections make sense
-   * only for surface hopping methods, so we check for that.
-   */
-  if ( ( fr->qr->SHmethod == eSHmethodGranucci )
-       && (qm->QEDdecoherence > 0.) ){
-    decoherence(cr,qm,mm,ndim,eigval);
-    /* to capture the effect on d, we transform: d=Uc;
-     */
-    if (doprop){ 
-      for(i=0;i<ndim;i++){
-        c[i] = qm->creal[i]+ IMAG*qm->cimag[i];
+    if (doprop){ 
+      for(i=0;i<ndim;i++){
+        c[i] = qm->creal[i]+ IMAG*qm->cimag[i];
       }
       transposeM_complex(ndim,udagger,umatrix);
       MtimesV_complex(ndim,umatrix,c,d);
@@ -4216,8 +4596,8 @@ if (doprop){
       }
     } 
     if(MULTISIM(cr)){
-      gmx_sumd_sim(ndim,qm->dreal ,cr->ms);
-      gmx_sumd_sim(ndim,qm->dimag ,cr->ms);
+      qed_sumd_sim(ndim,qm->dreal ,cr->ms);
+      qed_sumd_sim(ndim,qm->dimag ,cr->ms);
     }
   }
   free (eigval);
@@ -4247,25 +4627,24 @@ double do_hybrid(t_commrec *cr,  t_forcerec *fr,
 		   rvec tdmXMM[], rvec tdmYMM[], rvec tdmZMM[],double *energies)
 {
   double
-    decay,L_au=qm->L*microM2BOHR,
-    E0_norm_sq,V0_2EP,u[3],QMener=0.,totpop=0.,
-    *eigvec_real,*eigvec_imag,*eigval,ctot=0.,dtot=0.,fcorr;
+    decay,
+    E0_norm_sq,u[3],QMener=0.,totpop=0.,
+    *eigvec_real,*eigvec_imag,*eigval,ctot=0.,dtot=0.,fcorr,*scal;
   dplx
-    fij,csq,cmcp,*ham,
+    *ham,
     *expH,*ctemp,*c,cicj,ener=0.,*d,*dtemp,
-    *eigvec,cpcq,bpaq,apbq,bqap,aqbp,a_sump,a_sumq,
-    a_sum,a_sum2,betasq,ab,ba,*temp,*uold,*udagger,*umatrix;
-  time_t 
-    start,end,interval;
+    *eigvec,
+    a_sum2,ba,*temp,*uold,*udagger,*umatrix;
   int
-    dodiag=0,doprop=0,*state,i,j,k,p,q,m,nmol,ndim,prop,hopto[1],dohop[1];
+    dodiag=0,doprop=0,*state,i,j,k,m,nmol,ndim,prop,hopto[1],dohop[1];
+  gmx_bool
+    bExpH=FALSE;
   char
     *eigenvectorfile,*coefficientfile,*energyfile,buf[3000];
-  FILE
-    *evout=NULL,*Cout=NULL;
+  gmx_qed_record_t
+    evout=NULL,Cout=NULL;
   rvec
     *nacQM=NULL,*nacMM=NULL;
-  start = time(NULL);
   if (fr->qr->SHmethod != eSHmethodGranucci && fr->qr->SHmethod != eSHmethodEhrenfest){
     gmx_fatal(FARGS,
 	      "Running in hybrid diabatic/adiabatic only possible for Ehrenfest of Surface hopping with local diabatization\n");
@@ -4275,7 +4654,6 @@ double do_hybrid(t_commrec *cr,  t_forcerec *fr,
   /* information on field, was already calcualted above...
    */
   E0_norm_sq = iprod(qm->E,qm->E); // Square of the magitud of the E-field at k=0
-  V0_2EP = qm->omega/(E0_norm_sq); //2*Epsilon0*V_cav at k=0 (in a.u.)
   u[0]=qm->E[0]/sqrt(E0_norm_sq);
   u[1]=qm->E[1]/sqrt(E0_norm_sq);
   u[2]=qm->E[2]/sqrt(E0_norm_sq);
@@ -4318,11 +4696,12 @@ double do_hybrid(t_commrec *cr,  t_forcerec *fr,
   snew(umatrix,ndim*ndim);
   hopto[0]=qm->polariton;
 
+  qed_phase(ewcQED_DIAG);
   if(dodiag){
     /* diagonalize the matrix to get the adiabatic basis states
      */
     fprintf(stderr,"\n\ndiagonalizing matrix on node %d\n",m);
-    diag(ndim,eigval,eigvec,matrix);
+    diag_QED(qm,ndim,nmol,eigval,eigvec,matrix);
     fprintf(stderr,"step %d Eigenvalues: ",step);
     for ( i = 0 ; i<ndim;i++){
       fprintf(stderr,"%lf ",eigval[i]);
@@ -4334,6 +4713,7 @@ double do_hybrid(t_commrec *cr,  t_forcerec *fr,
       eigvec_imag[i]=cimag(eigvec[i]);
     }
   }
+  qed_phase(ewcQED_PROP);
   /* while node 0 performs propagation in the diabatic basis
    */
   if(doprop){
@@ -4348,11 +4728,7 @@ double do_hybrid(t_commrec *cr,  t_forcerec *fr,
       }
       /* propagate the coefficients 
        */
-      expM_complex2(ndim,ham,expH, qm->dt);
-      MtimesV_complex(ndim,expH,d,dtemp);
-      for( i=0;i<ndim;i++){
-        d[i]=dtemp[i];
-      }
+      expH_times_v(qm,ndim,ham,TRUE,expH,&bExpH,d);
       for ( i = 0 ; i < ndim ; i++ ){	
         qm->dreal[i] = creal(d[i]);
         qm->dimag[i] = cimag(d[i]);
@@ -4385,8 +4761,8 @@ double do_hybrid(t_commrec *cr,  t_forcerec *fr,
      * adiabatic coefficients are supplied in init_QMMM, we check this by computing the norms.
      */
     if(MULTISIM(cr)){
-      gmx_sumd_sim(ndim,qm->dreal ,cr->ms);
-      gmx_sumd_sim(ndim,qm->dimag ,cr->ms);
+      qed_sumd_sim(ndim,qm->dreal ,cr->ms);
+      qed_sumd_sim(ndim,qm->dimag ,cr->ms);
     }
     if(dodiag){
       ctot=dtot=0.0;
@@ -4453,29 +4829,32 @@ double do_hybrid(t_commrec *cr,  t_forcerec *fr,
       }
     }
     if(MULTISIM(cr)){
-      gmx_sumd_sim(ndim,qm->creal ,cr->ms);
-      gmx_sumd_sim(ndim,qm->cimag ,cr->ms);
+      qed_sumd_sim(ndim,qm->creal ,cr->ms);
+      qed_sumd_sim(ndim,qm->cimag ,cr->ms);
+      qed_sumd_sim(ndim,qm->dreal ,cr->ms);
+      qed_sumd_sim(ndim,qm->dimag ,cr->ms);
     }
   }
 
   /* communicate eigenvectors from node 0 and diabatic expansion coefficients from node1
    */
   if(MULTISIM(cr)){
-    /* One processor has the eigenvectors. Another one has the 
-     * time-dependent diabatic expansion coefficients.
-     * Eigenvectors, and coefficients are now communicates to the other 
-     * nodes, so that every one can compute the mean-field forces to the 
-     * other nodes, etc. We also communication the eigenvalues, 
-     * even we don't seem to need them. 
+    /* Only the node that propagates needs the full eigenvectors here,
+     * the other nodes get their part of them together with the new
+     * expansion coefficients below.
      */
-    gmx_sumd_sim(ndim*ndim,eigvec_real,cr->ms);
-    gmx_sumd_sim(ndim*ndim,eigvec_imag,cr->ms);
-    gmx_sumd_sim(ndim,eigval,cr->ms);
-    gmx_sumd_sim(ndim,qm->dreal ,cr->ms);
-    gmx_sumd_sim(ndim,qm->dimag ,cr->ms);  
-  }
-  for(i=0;i<ndim*ndim;i++){
-    eigvec[i]=eigvec_real[i]+IMAG*eigvec_imag[i];
+    if(cr->ms->nsim > 1){
+      qed_comm_begin();
+      if(dodiag){
+        gmx_send_sim(ndim*ndim*sizeof(dplx),eigvec,0,cr->ms);
+        gmx_send_sim(ndim*sizeof(double),eigval,0,cr->ms);
+      }
+      else if(doprop){
+        gmx_recv_sim(ndim*ndim*sizeof(dplx),eigvec,1,cr->ms);
+        gmx_recv_sim(ndim*sizeof(double),eigval,1,cr->ms);
+      }
+      qed_comm_end();
+    }
   }
 
   /* now all MPI tasks have the diabatic expansion coefficients, the 
@@ -4498,7 +4877,7 @@ double do_hybrid(t_commrec *cr,  t_forcerec *fr,
       for (j=0;j<ndim;j++){
         /* hermitian adjoint of U
          */
-        udagger[i*ndim+j]=eigvec_real[i*ndim+j]-IMAG*eigvec_imag[i*ndim+j];
+        udagger[i*ndim+j]=conj(eigvec[i*ndim+j]);
         /* transpose of U, i.e. eigenvectors are columns
          */
         uold[i*ndim+j] = qm->eigvec[j*ndim+i];
@@ -4509,15 +4888,20 @@ double do_hybrid(t_commrec *cr,  t_forcerec *fr,
         d[i]=qm->dreal[i]+IMAG*qm->dimag[i];
         c[i]=qm->creal[i]+IMAG*qm->cimag[i];
       }
-      M_complextimesM_complex(ndim,udagger,expH,temp);
-      M_complextimesM_complex(ndim,temp,uold,expH);
-      MtimesV_complex(ndim,expH,c,ctemp);
-      for( i=0;i<ndim;i++){
-        c[i]=ctemp[i];
-      }
+      /* c(t+dt) = U^dagger(t+dt) exp(-iH dt) U(t) c(t), one vector
+       * at a time instead of forming the product of the matrices
+       */
+      MtimesV_complex(ndim,uold,c,ctemp);
+      expH_times_v(qm,ndim,ham,TRUE,expH,&bExpH,ctemp);
+      MtimesV_complex(ndim,udagger,ctemp,c);
       if (fr->qr->SHmethod == eSHmethodGranucci){
-          //qm->polariton = state[0] =
-        hopto[0]= compute_hopping_probability(step,qm,c,expH,ndim);
+        /* the column of that propagator for the current state */
+        for(i=0;i<ndim;i++){
+          dtemp[i]=uold[i*ndim+qm->polariton];
+        }
+        expH_times_v(qm,ndim,ham,TRUE,expH,&bExpH,dtemp);
+        MtimesV_complex(ndim,udagger,dtemp,ctemp);
+        hopto[0]= compute_hopping_probability(step,qm,c,ctemp,ndim);
       }
       for ( i = 0 ; i < ndim ; i++ ){	
         qm->creal[i] = creal(c[i]);
@@ -4545,11 +4929,39 @@ double do_hybrid(t_commrec *cr,  t_forcerec *fr,
   /* comunicate the information on adiabatic coefficient to all nodes to
    * compute forces... 
    */
+  /* the nodes holding all the eigenvectors keep them in qmrec (old
+   * vectors of the next step, written out by dodiag below) before the
+   * scatter leaves only the components each molecule needs
+   */
+  if(dodiag || doprop){
+    for(i=0;i<ndim*ndim;i++){
+      qm->eigvec[i]=eigvec[i];
+    }
+  }
   if(MULTISIM(cr)){
-    gmx_sumi_sim(1,state,cr->ms);
-    gmx_sumi_sim(1,hopto,cr->ms);
-    gmx_sumd_sim(ndim,qm->creal ,cr->ms);
-    gmx_sumd_sim(ndim,qm->cimag ,cr->ms);
+    /* one message from the propagating node with the eigenvalues,
+     * our part of the eigenvectors, both sets of coefficients and
+     * the state we may hop to
+     */
+    snew(scal,4*ndim+1);
+    if(doprop){
+      for(i=0;i<ndim;i++){
+        scal[i]        = qm->creal[i];
+        scal[ndim+i]   = qm->cimag[i];
+        scal[2*ndim+i] = qm->dreal[i];
+        scal[3*ndim+i] = qm->dimag[i];
+      }
+      scal[4*ndim] = hopto[0];
+    }
+    qed_scatter_state(cr,0,ndim,nmol,eigval,eigvec,4*ndim+1,scal);
+    for(i=0;i<ndim;i++){
+      qm->creal[i] = scal[i];
+      qm->cimag[i] = scal[ndim+i];
+      qm->dreal[i] = scal[2*ndim+i];
+      qm->dimag[i] = scal[3*ndim+i];
+    }
+    hopto[0] = (int)scal[4*ndim];
+    sfree(scal);
   }
   /* compute norm of the wavefunction 
    */
@@ -4559,14 +4971,17 @@ double do_hybrid(t_commrec *cr,  t_forcerec *fr,
   qm->groundstate=1-totpop;
   /* copy the eigenvectors to qmrec 
    */
-  for(i=0;i<ndim*ndim;i++){
-    qm->eigvec[i]=eigvec[i];
+  if(!dodiag && !doprop){
+    for(i=0;i<ndim*ndim;i++){
+      qm->eigvec[i]=eigvec[i];
+    }
   }
   /* If we want to make a hop, we check if there is sufficent kinetic energy
    * for that. If we do hop we also need to adjust the velocities, as the
    * work is done in the direction of the NAC. We thus first compute
    * the contributions of each molecule to the total NAC vector
    */ 
+  qed_phase(ewcQED_NAC);
   if(hopto[0] != qm->polariton){
     snew(nacQM,qm->nrQMatoms);
     snew(nacMM,mm->nrMMatoms);
@@ -4575,7 +4990,7 @@ double do_hybrid(t_commrec *cr,  t_forcerec *fr,
             nacQM, nacMM);
     dohop[0] = check_vel(cr,eigval,nacQM,nacMM,qm,mm,qm->polariton,hopto[0],&fcorr);
     if(MULTISIM(cr)){
-      gmx_sumi_sim(1,dohop,cr->ms);
+      qed_sumi_sim(1,dohop,cr->ms);
     }
     /* Only if there is sufficient kinetic energy on all nodes, we hop
      */
@@ -4593,197 +5008,60 @@ double do_hybrid(t_commrec *cr,  t_forcerec *fr,
   }
   /* step 3: compute the gradients and sum up the energy
    */
-  if(fr->qr->SHmethod != eSHmethodEhrenfest){
-    p=qm->polariton;
-    betasq = conj(eigvec[p*ndim+m])*eigvec[p*ndim+m];
-    a_sump = 0.0+IMAG*0.0;
-    for (i=0;i<(qm->n_max)+1;i++){
-      a_sump += eigvec[p*ndim+nmol+i]*sqrt(cavity_dispersion(i+qm->n_min,qm)/V0_2EP)*cexp(IMAG*2*M_PI*(i+qm->n_min)/L_au*m*L_au/((double) nmol));
-    }
-    ab = conj(eigvec[p*ndim+m])*a_sump; //actually sum of alphas * beta_j
-    ab += conj(a_sump)*eigvec[p*ndim+m];
-    for(i=0;i<qm->nrQMatoms;i++){
-      for(j=0;j<DIM;j++){
-        /* diagonal term
-         */
-        fij =(betasq*QMgrad_S1[i][j]+(1-betasq)*QMgrad_S0[i][j]);
-        /* off-diagonal term
-         */
-        fij-= ab*tdmX[i][j]*u[0];
-        fij-= ab*tdmY[i][j]*u[1];
-        fij-= ab*tdmZ[i][j]*u[2];
-        fij*=HARTREE_BOHR2MD;
-        f[i][j]      += creal(fij);
-        fshift[i][j] += creal(fij);
-      }
-    }
-    for(i=0;i<mm->nrMMatoms;i++){
-      for(j=0;j<DIM;j++){
-        /* diagonal term
-         */
-        fij =(betasq*MMgrad_S1[i][j]+(1-betasq)*MMgrad_S0[i][j]);
-        /* off-diagonal term
-         */
-        fij-= ab*tdmXMM[i][j]*u[0];
-        fij-= ab*tdmYMM[i][j]*u[1];
-        fij-= ab*tdmZMM[i][j]*u[2];
-        fij*=HARTREE_BOHR2MD;
-        f[i+qm->nrQMatoms][j]      += creal(fij);
-        fshift[i+qm->nrQMatoms][j] += creal(fij);
-      }
-    }
-    QMener = eigval[p]*HARTREE2KJ*AVOGADRO;
-  }
-  else {
-    /* Ehrenfest dynamics, need to compute gradients of all polaritonic
-     * states and weight them with weights of the states. Also the
-     * nonadiabatic couplings between polaritonic states are needed now
-     */
-    QMener=0.0; 
-    for (p=0;p<ndim;p++){
-      /* do the diagonal terms first p=q. These terems are same as above for 
-       * single state procedred  
-       *
-       * We normalize by the sq of the wave function: totpop
-       */
-      csq = conj(qm->creal[p]+IMAG*qm->cimag[p])*(qm->creal[p]+IMAG*qm->cimag[p]);
-      betasq = conj(eigvec[p*ndim+m])*eigvec[p*ndim+m];
-      a_sump = 0.0+IMAG*0.0;
-      for (i=0;i<(qm->n_max)+1;i++){
-        a_sump += eigvec[p*ndim+nmol+i]*sqrt(cavity_dispersion(i+qm->n_min,qm)/V0_2EP)*cexp(IMAG*2*M_PI*(i+qm->n_min)/L_au*m*L_au/((double) nmol));
-      }
-      ab = conj(eigvec[p*ndim+m])*a_sump; //actually sum of alphas * beta_j
-      ab += conj(a_sump)*eigvec[p*ndim+m]; // ADDED GG, this accounts for the 3rd and 4th term together in equation 13. 
-      QMener += csq*eigval[p]*HARTREE2KJ*AVOGADRO/totpop;
-      for(i=0;i<qm->nrQMatoms;i++){
-        for(j=0;j<DIM;j++){
-          /* diagonal term
-           */
-          fij =(betasq*QMgrad_S1[i][j]+(1-betasq)*QMgrad_S0[i][j]);
-          /* off-diagonal term, Because coeficients are real: ab = ba
-           */
-          fij-= ab*tdmX[i][j]*u[0];
-          fij-= ab*tdmY[i][j]*u[1];
-          fij-= ab*tdmZ[i][j]*u[2];
-          fij*=HARTREE_BOHR2MD*csq/totpop;
-          f[i][j]      += creal(fij);
-          fshift[i][j] += creal(fij);
-        }
-      }
-      for(i=0;i<mm->nrMMatoms;i++){
-        for(j=0;j<DIM;j++){
-          /* diagonal terms
-           */
-          fij =(betasq*MMgrad_S1[i][j]+(1-betasq)*MMgrad_S0[i][j]);
-          /* off-diagonal term
-           */
-          fij-= ab*tdmXMM[i][j]*u[0];
-	      fij-= ab*tdmYMM[i][j]*u[1];
-          fij-= ab*tdmZMM[i][j]*u[2];
-          fij*=HARTREE_BOHR2MD*csq/totpop;
-          f[i+qm->nrQMatoms][j]      += creal(fij);
-          fshift[i+qm->nrQMatoms][j] += creal(fij);
-        }
-      }    
-      /* now off-diagonals 
-       */
-      for (q=p+1;q<ndim;q++){
-        /* normalize
-         */
-        cpcq = conj(qm->creal[p]+IMAG*(qm->cimag[p]))*(qm->creal[q]+IMAG*(qm->cimag[q]));
-        betasq = conj(eigvec[p*ndim+m])*eigvec[q*ndim+m];
-        bpaq = conj(a_sum)*eigvec[q*ndim+m];
-        a_sumq = 0.0+IMAG*0.0;
-        for (i=0;i<(qm->n_max)+1;i++){
-          a_sumq += eigvec[q*ndim+nmol+i]*sqrt(cavity_dispersion(i-qm->n_max,qm)/V0_2EP)*cexp(IMAG*2*M_PI*(i-qm->n_max)/L_au*m*L_au/((double) nmol));
-        }
-        bpaq = conj(eigvec[p*ndim+m])*a_sumq;
-        apbq = conj(a_sump)*eigvec[q*ndim+m];
-        bqap = conj(eigvec[q*ndim+m])*a_sump; /* conj(apbq) */
-        aqbp = conj(a_sumq)*eigvec[p*ndim+m]; /* conj(bpaq) */
-        for(i=0;i<qm->nrQMatoms;i++){
-          for(j=0;j<DIM;j++){
-	        /* diagonal term
-             */
-            fij=0;
-            fij = cpcq*betasq*(QMgrad_S1[i][j]-QMgrad_S0[i][j]);
-            fij+= conj(cpcq)*conj(betasq)*(QMgrad_S1[i][j]-QMgrad_S0[i][j]);
-            /* off-diagonal term
-             */
-            fij-= cpcq*(bpaq+apbq)*tdmX[i][j]*u[0];
-            fij-= cpcq*(bpaq+apbq)*tdmY[i][j]*u[1];
-            fij-= cpcq*(bpaq+apbq)*tdmZ[i][j]*u[2];
-            fij-= conj(cpcq)*(bqap+aqbp)*tdmX[i][j]*u[0];
-            fij-= conj(cpcq)*(bqap+aqbp)*tdmY[i][j]*u[1];
-            fij-= conj(cpcq)*(bqap+aqbp)*tdmZ[i][j]*u[2];
-            fij*=HARTREE_BOHR2MD/totpop;
-            f[i][j]      += creal(fij);
-            fshift[i][j] += creal(fij);
-          }
-        }
-        for(i=0;i<mm->nrMMatoms;i++){
-          for(j=0;j<DIM;j++){
-            /* diagonal term
-             */
-            fij = cpcq*betasq*(MMgrad_S1[i][j]-MMgrad_S0[i][j]);
-            fij+= conj(cpcq)*conj(betasq)*(MMgrad_S1[i][j]-MMgrad_S0[i][j]);
-            /* off-diagonal term
-             */
-            fij-= cpcq*(bpaq+apbq)*tdmXMM[i][j]*u[0];
-            fij-= cpcq*(bpaq+apbq)*tdmYMM[i][j]*u[1];
-            fij-= cpcq*(bpaq+apbq)*tdmZMM[i][j]*u[2];
-            fij-= conj(cpcq)*(bqap+aqbp)*tdmXMM[i][j]*u[0];
-            fij-= conj(cpcq)*(bqap+aqbp)*tdmYMM[i][j]*u[1];
-            fij-= conj(cpcq)*(bqap+aqbp)*tdmZMM[i][j]*u[2];
-            fij*=HARTREE_BOHR2MD/totpop;
-            f[i+qm->nrQMatoms][j]      += creal(fij);
-            fshift[i+qm->nrQMatoms][j] += creal(fij);
-          }
-        }
-      }
-    }
-  }
+  qed_phase(ewcQED_FORCE);
+  QMener = polariton_forces(fr,qm,mm,ndim,nmol,m,eigvec,eigval,totpop,u,
+                            QMgrad_S0,QMgrad_S1,MMgrad_S0,MMgrad_S1,
+                            tdmX,tdmY,tdmZ,tdmXMM,tdmYMM,tdmZMM,f,fshift);
   /* printing the coefficients to C.dat 
    * print the adiabatic eigenvectors to a file 
    */
-  if( dodiag ){
+  if( dodiag && qm->qedtraj ){
+    if (qed_traj_step(qm->qedtraj,step)){
+      qed_traj_output(fr,qm,step,eqtrHYBRID,ndim,QMener,
+                      energies[ndim-1]-cavity_dispersion(qm->n_max,qm),
+                      eigval,qm->eigvec);
+    }
+  }
+  else if( dodiag ){
     snew(eigenvectorfile,3000);
     sprintf(eigenvectorfile,"%s/eigenvectors.dat",qm->work_dir);
-    evout=fopen(eigenvectorfile,"a");
+    evout=qed_record_open(eigenvectorfile,"a");
     for(i=0;i<ndim;i++){
-      fprintf(evout,
+      qed_record_printf(evout,
 	      "step %4d Eigenvector %4d gap %12.8lf (c: %12.8lf + %12.8lf I):",
 	      step,i,eigval[i]-(
 				energies[ndim-1]-cavity_dispersion(qm->n_max,qm)),
 	      qm->creal[i],qm->cimag[i]);
       for(k=0;k<ndim;k++){
-        fprintf(evout," %12.8lf + %12.8lf I",creal(eigvec[i*ndim+k]),cimag(eigvec[i*ndim+k]));
+        qed_record_printf(evout," %12.8lf + %12.8lf I",creal(qm->eigvec[i*ndim+k]),cimag(qm->eigvec[i*ndim+k]));
       }
-      fprintf(evout,"\n");
+      qed_record_printf(evout,"\n");
     }
-    fclose(evout);
+    qed_output_close(fr,qm,evout);
     free(eigenvectorfile);
     snew(coefficientfile,3000);
     sprintf(coefficientfile,"%s/coefficients.dat",qm->work_dir);
-    evout=fopen(coefficientfile,"a");
-    fprintf(evout,
+    evout=qed_record_open(coefficientfile,"a");
+    qed_record_printf(evout,
 	    "step %4d energy: %12.8lf coeff: ", step,QMener);
     for(k=0;k<ndim;k++){
-      fprintf(evout," %12.8lf + %12.8lf I",qm->dreal[k],qm->dimag[k]);
+      qed_record_printf(evout," %12.8lf + %12.8lf I",qm->dreal[k],qm->dimag[k]);
       //      totpop+=qm->creal[k]*qm->creal[k]+qm->cimag[k]*qm->cimag[k];
     }
-    fprintf(evout,"\n");
-    fclose(evout);
+    qed_record_printf(evout,"\n");
+    qed_output_close(fr,qm,evout);
     free(coefficientfile);    
+  }
+  if( dodiag ){
     fprintf(stderr,"rho0 (%d) = %lf, Energy = %lf\n",step,qm->groundstate,energies[ndim-1]-cavity_dispersion(qm->n_max,qm));
     sprintf(buf,"%s/C.dat",qm->work_dir);
-    Cout= fopen(buf,"w");
-    fprintf(Cout,"%d\n",step);
+    Cout=qed_record_open(buf,"w");
+    qed_record_printf(Cout,"%d\n",step);
     for(i=0;i<ndim;i++){
-      fprintf (Cout,"%.5lf %.5lf\n ",qm->creal[i],qm->cimag[i]);
+      qed_record_printf(Cout,"%.5lf %.5lf\n ",qm->creal[i],qm->cimag[i]);
     }
-    fprintf (Cout,"%.5lf\n",qm->groundstate);
-    fclose(Cout);
+    qed_record_printf(Cout,"%.5lf\n",qm->groundstate);
+    qed_output_close(fr,qm,Cout);
   }
   /* now account for the decay that will happen in the next timestep 
    */
@@ -4814,8 +5092,8 @@ double do_hybrid(t_commrec *cr,  t_forcerec *fr,
       }      
     }
     if(MULTISIM(cr)){
-      gmx_sumd_sim(ndim,qm->creal ,cr->ms);
-      gmx_sumd_sim(ndim,qm->cimag ,cr->ms);
+      qed_sumd_sim(ndim,qm->creal ,cr->ms);
+      qed_sumd_sim(ndim,qm->cimag ,cr->ms);
     }
   }
   /* now do the decoherence that will happen in the next timestep 
@@ -4827,6 +5105,7 @@ double do_hybrid(t_commrec *cr,  t_forcerec *fr,
    */  
   if ( ( fr->qr->SHmethod == eSHmethodGranucci )
        && (qm->QEDdecoherence > 0.) ){
+    qed_phase(ewcQED_NAC);
     decoherence(cr,qm,mm,ndim,eigval);
     /* to capture the effect on d, we transform: d=Uc;
      */
@@ -4853,8 +5132,8 @@ double do_hybrid(t_commrec *cr,  t_forcerec *fr,
       }
     } 
     if(MULTISIM(cr)){
-      gmx_sumd_sim(ndim,qm->dreal ,cr->ms);
-      gmx_sumd_sim(ndim,qm->dimag ,cr->ms);
+      qed_sumd_sim(ndim,qm->dreal ,cr->ms);
+      qed_sumd_sim(ndim,qm->dimag ,cr->ms);
     }
   }  
   free (eigval);
@@ -4885,22 +5164,20 @@ double do_diabatic_non_herm(t_commrec *cr,  t_forcerec *fr,
 			    rvec tdmXMM[], rvec tdmYMM[], rvec tdmZMM[],double *energies)
 {
   double
-    decay,asq,L_au=qm->L*microM2BOHR,
-    E0_norm_sq,V0_2EP,u[3],QMener=0.,totpop=0.;
+    decay,asq,
+    E0_norm_sq,u[3],QMener=0.,totpop=0.;
   dplx
-    fij,csq,cmcp,*ham,
+    fij,*ham,
     *expH,*ctemp,*c,cicj,ener;
-  time_t 
-    start,end,interval;
   int
-    dodia=1,*state,i,j,k,p,q,m,nmol,ndim;
+    dodia=1,*state,i,j,k,m,nmol,ndim;
+  gmx_bool
+    bExpH=FALSE;
   char
     *eigenvectorfile,*final_eigenvecfile,*energyfile,buf[3000];
-  FILE
-    *evout=NULL,*final_evout=NULL,*Cout=NULL;
+  gmx_qed_record_t
+    evout=NULL,Cout=NULL;
   
-  start = time(NULL);
-
   if (fr->qr->SHmethod != eSHmethodGranucci && fr->qr->SHmethod != eSHmethodEhrenfest){
     gmx_fatal(FARGS, "Running in diabatic basis only possible for Ehrenfest of Surface hopping. Latter  local diabatization\n");
   }
@@ -4909,7 +5186,6 @@ double do_diabatic_non_herm(t_commrec *cr,  t_forcerec *fr,
   /* information on field, was already calcualted above...
    */
   E0_norm_sq = iprod(qm->E,qm->E); // Square of the magitud of the E-field at k=0
-  V0_2EP = qm->omega/(E0_norm_sq); //2*Epsilon0*V_cav at k=0 (in a.u.)
   u[0]=qm->E[0]/sqrt(E0_norm_sq);
   u[1]=qm->E[1]/sqrt(E0_norm_sq);
   u[2]=qm->E[2]/sqrt(E0_norm_sq);
@@ -4930,13 +5206,13 @@ double do_diabatic_non_herm(t_commrec *cr,  t_forcerec *fr,
     ndim=1+(qm->n_max-qm->n_min)+1;
     m=0;
     nmol=1;
-    interval=time(NULL);
   }
   snew(expH, ndim*ndim);
   snew(ctemp,ndim);
   snew(c,ndim);
   snew(ham,ndim*ndim);
     
+  qed_phase(ewcQED_PROP);
   if(dodia){
     if (step){
       for (i=0;i<ndim;i++){
@@ -4958,13 +5234,14 @@ double do_diabatic_non_herm(t_commrec *cr,  t_forcerec *fr,
       }
       /* propagate the coefficients 
        */
-      expM_non_herm(ndim,ham,expH, qm->dt);
-      MtimesV_complex(ndim,expH,c,ctemp);
-      for( i=0;i<ndim;i++){
-        c[i]=ctemp[i];
-      }
+      expH_times_v(qm,ndim,ham,FALSE,expH,&bExpH,c);
       if (fr->qr->SHmethod == eSHmethodGranucci){
-        qm->polariton = state[0] = compute_hopping_probability(step,qm,c,expH,ndim);
+        /* the column of the propagator for the current state */
+        for(i=0;i<ndim;i++){
+          ctemp[i]=(i==qm->polariton);
+        }
+        expH_times_v(qm,ndim,ham,FALSE,expH,&bExpH,ctemp);
+        qm->polariton = state[0] = compute_hopping_probability(step,qm,c,ctemp,ndim);
       }
       for ( i = 0 ; i < ndim ; i++ ){	
         qm->creal[i] = creal(c[i]);
@@ -4999,10 +5276,10 @@ double do_diabatic_non_herm(t_commrec *cr,  t_forcerec *fr,
   }
   if(MULTISIM(cr)){
     /* communicate the time-dependent expansion coefficients needed for computing mean-field forces */
-    gmx_sumd_sim(ndim,qm->creal ,cr->ms);
-    gmx_sumd_sim(ndim,qm->cimag ,cr->ms);
+    qed_sumd_sim(ndim,qm->creal ,cr->ms);
+    qed_sumd_sim(ndim,qm->cimag ,cr->ms);
     if(fr->qr->SHmethod != eSHmethodEhrenfest){
-      gmx_sumi_sim(1,state,cr->ms);
+      qed_sumi_sim(1,state,cr->ms);
       qm->polariton = state[0];
     }
   }
@@ -5035,20 +5312,28 @@ double do_diabatic_non_herm(t_commrec *cr,  t_forcerec *fr,
   QMener = creal(ener)*HARTREE2KJ*AVOGADRO;
 
   /* write the coefficients to a file */
-  if(dodia){
+  if(dodia && qm->qedtraj){
+    if (qed_traj_step(qm->qedtraj,step)){
+      qed_traj_output(fr,qm,step,eqtrCOEFF,ndim,QMener,
+                      energies[ndim-1]-cavity_dispersion(qm->n_max,qm),
+                      NULL,NULL);
+    }
+  }
+  else if(dodia){
     snew(eigenvectorfile,3000);
     sprintf(eigenvectorfile,"%s/eigenvectors.dat",qm->work_dir);
-    evout=fopen(eigenvectorfile,"a");
-    fprintf(evout,
+    evout=qed_record_open(eigenvectorfile,"a");
+    qed_record_printf(evout,
 	    "step %4d energy: %12.8lf coeff: ", step,QMener);
     for(k=0;k<ndim;k++){
-      fprintf(evout," %12.8lf + %12.8lf I",qm->creal[k],qm->cimag[k]);
+      qed_record_printf(evout," %12.8lf + %12.8lf I",qm->creal[k],qm->cimag[k]);
       //      totpop+=qm->creal[k]*qm->creal[k]+qm->cimag[k]*qm->cimag[k];
     }
-    fprintf(evout,"\n");
-    fclose(evout);
+    qed_record_printf(evout,"\n");
+    qed_output_close(fr,qm,evout);
     free(eigenvectorfile);
   }
+  qed_phase(ewcQED_FORCE);
   /* compute Hellman-Feynman forces. */
   if(fr->qr->SHmethod == eSHmethodGranucci){
     if(m==qm->polariton){
@@ -5091,66 +5376,28 @@ double do_diabatic_non_herm(t_commrec *cr,  t_forcerec *fr,
     }
   }
   else{ /* Ehrenfest, mean field gradient, normalized in case losses are included */
-    csq = conj(qm->creal[m]+IMAG*qm->cimag[m])*(qm->creal[m]+IMAG*qm->cimag[m]);
-    for(i=0;i<qm->nrQMatoms;i++){
-      for(j=0;j<DIM;j++){
-        /* the states are no longer orthonormal, as the norm |c_m(t)|^2 = totpop <= 1
-         */
-        fij = csq*QMgrad_S1[i][j]+(totpop-csq)*QMgrad_S0[i][j];
-        for(p=nmol;p<ndim;p++){
-          cmcp=conj(qm->creal[m]+IMAG*qm->cimag[m])*(qm->creal[p]+IMAG*qm->cimag[p]);
-            /* replace the m*L_au by the actual position z[m]
-             */
-	      cmcp*=sqrt(cavity_dispersion((p-nmol)+qm->n_min,qm)/V0_2EP)*cexp(IMAG*2*M_PI*(p-nmol+qm->n_min)/L_au*m*L_au/((double) nmol));
-            /* safe some cycles by 2Re() */
-          fij -= cmcp*tdmX[i][j]*u[0];
-          fij -= cmcp*tdmY[i][j]*u[1];
-          fij -= cmcp*tdmZ[i][j]*u[2];
-          fij -= conj(cmcp)*tdmX[i][j]*u[0];
-          fij -= conj(cmcp)*tdmY[i][j]*u[1];
-          fij -= conj(cmcp)*tdmZ[i][j]*u[2];
-        }
-        fij*=HARTREE_BOHR2MD/totpop;
-        f[i][j]      += creal(fij);
-        fshift[i][j] += creal(fij);
-      }
-    }
-    for(i=0;i<mm->nrMMatoms;i++){
-      for(j=0;j<DIM;j++){
-        fij = csq*MMgrad_S1[i][j]+(totpop-csq)*MMgrad_S0[i][j];
-        for(p=nmol;p<ndim;p++){
-          cmcp=conj(qm->creal[m]+IMAG*qm->cimag[m])*(qm->creal[p]+IMAG*qm->cimag[p]);
-          cmcp*=sqrt(cavity_dispersion((p-nmol)+qm->n_min,qm)/V0_2EP)*cexp(IMAG*2*M_PI*(p-nmol+qm->n_min)/L_au*m*L_au/((double) nmol));
-          fij -= cmcp*tdmXMM[i][j]*u[0];
-          fij -= cmcp*tdmYMM[i][j]*u[1];
-          fij -= cmcp*tdmZMM[i][j]*u[2];
-          fij -= conj(cmcp)*tdmXMM[i][j]*u[0];
-          fij -= conj(cmcp)*tdmYMM[i][j]*u[1];
-          fij -= conj(cmcp)*tdmZMM[i][j]*u[2];
-        }
-        fij*=HARTREE_BOHR2MD/totpop;
-        f[i+qm->nrQMatoms][j]      += creal(fij);
-        fshift[i+qm->nrQMatoms][j] += creal(fij);
-      }
-    }
+    diabatic_mf_forces(qm,mm,ndim,nmol,m,totpop,u,
+                       QMgrad_S0,QMgrad_S1,MMgrad_S0,MMgrad_S1,
+                       tdmX,tdmY,tdmZ,tdmXMM,tdmYMM,tdmZMM,f,fshift);
   }
   if (dodia){
     ///      fprintf(stderr,"rho0 (%d) = %lf, Energy = %lf\n",step,qm->groundstate,energies[ndim-1]-(qm->omega));
     fprintf(stderr,"rho0 (%d) = %lf, Energy = %lf\n",step,qm->groundstate,energies[ndim-1]-cavity_dispersion(qm->n_max,qm));
     sprintf(buf,"%s/C.dat",qm->work_dir);
-    Cout= fopen(buf,"w");
-    fprintf(Cout,"%d\n",step);
+    Cout=qed_record_open(buf,"w");
+    qed_record_printf(Cout,"%d\n",step);
     for(i=0;i<ndim;i++){
-      fprintf (Cout,"%.5lf %.5lf\n ",qm->creal[i],qm->cimag[i]);
+      qed_record_printf(Cout,"%.5lf %.5lf\n ",qm->creal[i],qm->cimag[i]);
     }
-    fprintf (Cout,"%.5lf\n",qm->groundstate);
-    fclose(Cout);
+    qed_record_printf(Cout,"%.5lf\n",qm->groundstate);
+    qed_output_close(fr,qm,Cout);
   }
   /* now account also for the decoherence that will also happen in the next timestep */
   /* we thus use the current total kinetic energy. We need to send this around we wrote separate routine */
   /* Decoherence corrections make sense only for surface hopping methods, so we check for that.
    */
   if ( (fr->qr->SHmethod == eSHmethodGranucci) && (qm->QEDdecoherence > 0.) ){ 
+    qed_phase(ewcQED_NAC);
     decoherence(cr,qm,mm,ndim,energies);
   }
   free(expH);
@@ -5171,21 +5418,20 @@ double do_diabatic(t_commrec *cr,  t_forcerec *fr,
 		   double *energies)
 {
   double
-    decay,L_au=qm->L*microM2BOHR,
-    E0_norm_sq,V0_2EP,u[3],QMener=0.,totpop=0.0;
+    decay,
+    E0_norm_sq,u[3],QMener=0.,totpop=0.0;
   dplx
-    fij,csq,cmcp,*ham,
-    *expH,*ctemp,*c,cicj,ener=0.;
-  time_t 
-    start,end,interval;
+    fij,*ham=NULL,
+    *expH=NULL,*ctemp,*c,cicj,ener=0.;
   int
-    dodia=1,*state,i,j,k,p,q,m,nmol,ndim;
+    dodia=1,*state,i,j,k,m,nmol,ndim;
+  gmx_bool
+    bExpH=FALSE;
   char
     *eigenvectorfile,*final_eigenvecfile,*energyfile,buf[3000];
-  FILE
-    *evout=NULL,*final_evout=NULL,*Cout=NULL;
+  gmx_qed_record_t
+    evout=NULL,Cout=NULL;
   
-  start = time(NULL);
   if (fr->qr->SHmethod != eSHmethodGranucci && fr->qr->SHmethod != eSHmethodEhrenfest){
     gmx_fatal(FARGS,
 	      "Running in diabatic basis only possible for Ehrenfest of Surface hopping with local diabatization\n");
@@ -5194,14 +5440,14 @@ double do_diabatic(t_commrec *cr,  t_forcerec *fr,
   /* information on field, was already calcualted above...*/
   E0_norm_sq = iprod(qm->E,qm->E); // Square of the magitud of the E-field at k=0
   if (E0_norm_sq>0.000000000){
-    V0_2EP = qm->omega/(E0_norm_sq); //2*Epsilon0*V_cav at k=0 (in a.u.)
     u[0]=qm->E[0]/sqrt(E0_norm_sq);
     u[1]=qm->E[1]/sqrt(E0_norm_sq);
     u[2]=qm->E[2]/sqrt(E0_norm_sq);
   } 
   else {
-      /* we set V to 1, even if it sbould be infinite, but simply put u, the vector along whcih the field is directed to zero */
-    V0_2EP=1;
+      /* no field: put u, the vector along which the field is directed, to zero
+       * (cavity_factors() then takes V to be 1)
+       */
     u[0]=u[1]=u[2]=0;
   }
   /* silly array to communicate the courrent state*/
@@ -5220,30 +5466,35 @@ double do_diabatic(t_commrec *cr,  t_forcerec *fr,
     ndim=1+(qm->n_max-qm->n_min)+1;
     m=0;
     nmol=1;
-    interval=time(NULL);
   }
-  snew(expH, ndim*ndim);
   snew(ctemp,ndim);
   snew(c,ndim);
-  snew(ham,ndim*ndim);
+  if (!qm->qedcav){
+    snew(expH, ndim*ndim);
+    snew(ham,ndim*ndim);
+  }
     
+  qed_phase(ewcQED_PROP);
   if(dodia){
     if (step){
       for (i=0;i<ndim;i++){
         c[i]=qm->creal[i]+IMAG*qm->cimag[i];
       }
-      /* interpolate the Hamiltonian */
-      for(i=0;i<ndim*ndim;i++){
-        ham[i]=matrix[i]+qm->matrix[i];
+      /* interpolate the Hamiltonian, qm->qedcav keeps both steps */
+      if (ham){
+        for(i=0;i<ndim*ndim;i++){
+          ham[i]=matrix[i]+qm->matrix[i];
+        }
       }
       /* propagate the coefficients */
-      expM_complex2(ndim,ham,expH, qm->dt);
-      MtimesV_complex(ndim,expH,c,ctemp);
-      for( i=0;i<ndim;i++){
-        c[i]=ctemp[i];
-      }
+      expH_times_v(qm,ndim,ham,TRUE,expH,&bExpH,c);
       if (fr->qr->SHmethod == eSHmethodGranucci){
-        qm->polariton = state[0]= compute_hopping_probability(step,qm,c,expH,ndim);
+        /* the column of the propagator for the current state */
+        for(i=0;i<ndim;i++){
+          ctemp[i]=(i==qm->polariton);
+        }
+        expH_times_v(qm,ndim,ham,TRUE,expH,&bExpH,ctemp);
+        qm->polariton = state[0]= compute_hopping_probability(step,qm,c,ctemp,ndim);
       }
       for ( i = 0 ; i < ndim ; i++ ){	
         qm->creal[i] = creal(c[i]);
@@ -5278,10 +5529,10 @@ double do_diabatic(t_commrec *cr,  t_forcerec *fr,
   }
   if(MULTISIM(cr)){
     /* communicate the time-dependent expansion coefficients needed for computing mean-field forces */
-    gmx_sumd_sim(ndim,qm->creal ,cr->ms);
-    gmx_sumd_sim(ndim,qm->cimag ,cr->ms);
+    qed_sumd_sim(ndim,qm->creal ,cr->ms);
+    qed_sumd_sim(ndim,qm->cimag ,cr->ms);
     if(fr->qr->SHmethod != eSHmethodEhrenfest){
-      gmx_sumi_sim(1,state,cr->ms);
+      qed_sumi_sim(1,state,cr->ms);
       qm->polariton = state[0];
     }
   }
@@ -5293,10 +5544,18 @@ double do_diabatic(t_commrec *cr,  t_forcerec *fr,
     }
   }
   else { /* Ehrenfest */
-    for(i=0;i<ndim;i++){
-      for(j=0;j<ndim;j++){
-        cicj=conj(qm->creal[i]+IMAG*qm->cimag[i])*(qm->creal[j]+IMAG*qm->cimag[j]);
-        ener += creal(matrix[i*ndim+j]*cicj)+cimag(matrix[i*ndim+j]*cicj)*IMAG;
+    if (qm->qedcav){
+      for(i=0;i<ndim;i++){
+        c[i]=qm->creal[i]+IMAG*qm->cimag[i];
+      }
+      ener = qed_cavity_expect(qm->qedcav,c);
+    }
+    else{
+      for(i=0;i<ndim;i++){
+        for(j=0;j<ndim;j++){
+          cicj=conj(qm->creal[i]+IMAG*qm->cimag[i])*(qm->creal[j]+IMAG*qm->cimag[j]);
+          ener += creal(matrix[i*ndim+j]*cicj)+cimag(matrix[i*ndim+j]*cicj)*IMAG;
+        }
       }
     }
     /* determine the normalization and (virtual) ground state population
@@ -5313,19 +5572,27 @@ double do_diabatic(t_commrec *cr,  t_forcerec *fr,
   QMener = creal(ener)*HARTREE2KJ*AVOGADRO/totpop;
   
   /* write the coefficients to a file */
-  if(dodia){
+  if(dodia && qm->qedtraj){
+    if (qed_traj_step(qm->qedtraj,step)){
+      qed_traj_output(fr,qm,step,eqtrCOEFF,ndim,QMener,
+                      energies[ndim-1]-cavity_dispersion(qm->n_max,qm),
+                      NULL,NULL);
+    }
+  }
+  else if(dodia){
     snew(eigenvectorfile,3000);
     sprintf(eigenvectorfile,"%s/eigenvectors.dat",qm->work_dir);
-    evout=fopen(eigenvectorfile,"a");
-    fprintf(evout,
+    evout=qed_record_open(eigenvectorfile,"a");
+    qed_record_printf(evout,
 	    "step %4d energy: %12.8lf coeff: ", step,QMener);
     for(k=0;k<ndim;k++){
-      fprintf(evout," %12.8lf + %12.8lf I",qm->creal[k],qm->cimag[k]);
+      qed_record_printf(evout," %12.8lf + %12.8lf I",qm->creal[k],qm->cimag[k]);
     }
-    fprintf(evout,"\n");
-    fclose(evout);
+    qed_record_printf(evout,"\n");
+    qed_output_close(fr,qm,evout);
     free(eigenvectorfile);
   }
+  qed_phase(ewcQED_FORCE);
   /* compute Hellman-Feynman forces.  */
   if(fr->qr->SHmethod == eSHmethodGranucci){
     if(m==qm->polariton){
@@ -5373,56 +5640,23 @@ double do_diabatic(t_commrec *cr,  t_forcerec *fr,
     /* Hellman Feynman terms, see https://www.overleaf.com/read/wkbkwybcjtdb
      * Every processor for him/her self!
      */
-    csq = conj(qm->creal[m]+IMAG*qm->cimag[m])*(qm->creal[m]+IMAG*qm->cimag[m]);
-    for(i=0;i<qm->nrQMatoms;i++){
-      for(j=0;j<DIM;j++){
-        fij = csq*QMgrad_S1[i][j]+(totpop-csq)*QMgrad_S0[i][j];
-        for(p=nmol;p<ndim;p++){
-          cmcp=conj(qm->creal[m]+IMAG*qm->cimag[m])*(qm->creal[p]+IMAG*qm->cimag[p]);
-          cmcp*=sqrt(cavity_dispersion((p-nmol)+qm->n_min,qm)/V0_2EP)*cexp(IMAG*2*M_PI*((p-nmol)+qm->n_min)/L_au*m*L_au/((double) nmol));
-          fij -= cmcp*tdmX[i][j]*u[0];
-          fij -= cmcp*tdmY[i][j]*u[1];
-          fij -= cmcp*tdmZ[i][j]*u[2];
-	      fij -= conj(cmcp)*tdmX[i][j]*u[0];
-	      fij -= conj(cmcp)*tdmY[i][j]*u[1];
-	      fij -= conj(cmcp)*tdmZ[i][j]*u[2];
-        }
-        fij*=HARTREE_BOHR2MD/totpop;
-        f[i][j]      += creal(fij);
-        fshift[i][j] += creal(fij);
-      }
-    }
-    for(i=0;i<mm->nrMMatoms;i++){
-      for(j=0;j<DIM;j++){
-        fij = csq*MMgrad_S1[i][j]+(totpop-csq)*MMgrad_S0[i][j];
-        for(p=nmol;p<ndim;p++){
-          cmcp=conj(qm->creal[m]+IMAG*qm->cimag[m])*(qm->creal[p]+IMAG*qm->cimag[p]);
-	      cmcp*=sqrt(cavity_dispersion((p-nmol)+qm->n_min,qm)/V0_2EP)*cexp(IMAG*2*M_PI*((p-nmol)+qm->n_min)/L_au*m*L_au/((double) nmol));
-	      fij -= cmcp*tdmXMM[i][j]*u[0];
-	      fij -= cmcp*tdmYMM[i][j]*u[1];
-	      fij -= cmcp*tdmZMM[i][j]*u[2];
-	      fij -= conj(cmcp)*tdmXMM[i][j]*u[0];
-	      fij -= conj(cmcp)*tdmYMM[i][j]*u[1];
-	      fij -= conj(cmcp)*tdmZMM[i][j]*u[2];
-        }
-        fij*=HARTREE_BOHR2MD/totpop;
-        f[i+qm->nrQMatoms][j]      += creal(fij);
-        fshift[i+qm->nrQMatoms][j] += creal(fij);
-      }
-    }
+    diabatic_mf_forces(qm,mm,ndim,nmol,m,totpop,u,
+                       QMgrad_S0,QMgrad_S1,MMgrad_S0,MMgrad_S1,
+                       tdmX,tdmY,tdmZ,tdmXMM,tdmYMM,tdmZMM,f,fshift);
   }
   /* printing the coefficients to C.dat */
   if (dodia){
     fprintf(stderr,"rho0 (%d) = %lf, Energy = %lf\n",step,qm->groundstate,energies[ndim-1]-cavity_dispersion(qm->n_max,qm));
     sprintf(buf,"%s/C.dat",qm->work_dir);
-    Cout= fopen(buf,"w");
-    fprintf(Cout,"%d\n",step);
+    Cout=qed_record_open(buf,"w");
+    qed_record_printf(Cout,"%d\n",step);
     for(i=0;i<ndim;i++){
-      fprintf (Cout,"%.5lf %.5lf\n ",qm->creal[i],qm->cimag[i]);
+      qed_record_printf(Cout,"%.5lf %.5lf\n ",qm->creal[i],qm->cimag[i]);
     }
-    fprintf (Cout,"%.5lf\n",qm->groundstate);
-    fclose(Cout);
+    qed_record_printf(Cout,"%.5lf\n",qm->groundstate);
+    qed_output_close(fr,qm,Cout);
   }
+  qed_phase(ewcQED_PROP);
   /* only the cavity modes can decay. Decay will occur in the next timestep */
   decay=exp(-0.5*(qm->QEDdecay)*(qm->dt));
   qm->groundstate=0;
@@ -5436,6 +5670,7 @@ double do_diabatic(t_commrec *cr,  t_forcerec *fr,
   /* Decoherence corrections make sense only for surface hopping methods, so we check for that.
    */
   if (fr->qr->SHmethod == eSHmethodGranucci && (qm->QEDdecoherence > 0.) ){
+    qed_phase(ewcQED_NAC);
     decoherence(cr,qm,mm,ndim,energies);
   }
   
@@ -5457,22 +5692,18 @@ double do_adiabatic(t_commrec *cr,  t_forcerec *fr,
                     rvec tdmXMM[], rvec tdmYMM[], rvec tdmZMM[],double *energies)
 {
   double
-    *eigvec_real,*eigvec_imag,*eigval,decay,asq,L_au=qm->L*microM2BOHR,
-    E0_norm_sq,V0_2EP,u[3],QMener=0.,totpop=0.0;
+    *eigval,*scal,decay,asq,
+    E0_norm_sq,u[3],QMener=0.,totpop=0.0;
   dplx
-    *eigvec,cpcq,bpaq,apbq,bqap,aqbp,a_sump,a_sumq,
-    a_sum,a_sum2,betasq,ab,ba,fij,csq;
-  time_t 
-    start,end,interval;
+    *eigvec,
+    a_sum2,ba;
   int
-    dodia=1,*state,i,j,k,p,q,m,nmol,ndim;
+    dodia=1,*state,i,j,k,m,nmol,ndim;
   char
     *eigenvectorfile,*final_eigenvecfile,*energyfile,buf[3000];
-  FILE
-    *evout=NULL,*final_evout=NULL,*Cout=NULL;;
+  gmx_qed_record_t
+    evout=NULL,Cout=NULL;
   
-  start = time(NULL);
-
   snew(eigenvectorfile,3000);
   sprintf(eigenvectorfile,"%s/eigenvectors.dat",qm->work_dir);
   snew(final_eigenvecfile,3000);
@@ -5480,7 +5711,6 @@ double do_adiabatic(t_commrec *cr,  t_forcerec *fr,
 
   /* information on field, was already calcualted above...*/
   E0_norm_sq = iprod(qm->E,qm->E); // Square of the magitud of the E-field at k=0
-  V0_2EP = qm->omega/(E0_norm_sq); //2*Epsilon0*V_cav at k=0 (in a.u.)
   u[0]=qm->E[0]/sqrt(E0_norm_sq);
   u[1]=qm->E[1]/sqrt(E0_norm_sq);
   u[2]=qm->E[2]/sqrt(E0_norm_sq);
@@ -5500,28 +5730,22 @@ double do_adiabatic(t_commrec *cr,  t_forcerec *fr,
     ndim=1+(qm->n_max-qm->n_min)+1;
     m=0;
     nmol=1;
-    interval=time(NULL);
   }
   snew(eigval,ndim);
   snew(eigvec,ndim*ndim);
-  snew(eigvec_real,ndim*ndim);
-  snew(eigvec_imag,ndim*ndim);
   if(dodia){
+    /* the other simulations serve our linear algebra in the meantime */
+    qed_dist_begin(qm->qeddist);
+    qed_phase(ewcQED_DIAG);
     fprintf(stderr,"\n\ndiagonalizing matrix\n");
-    diag(ndim,eigval,eigvec,matrix);
+    diag_QED(qm,ndim,nmol,eigval,eigvec,matrix);
     fprintf(stderr,"step %d Eigenvalues: ",step);
     for ( i = 0 ; i<ndim;i++){
       fprintf(stderr,"%lf ",eigval[i]);
       qm->eigval[i]=eigval[i]; 
     }
     fprintf(stderr,"\n");
-    interval=time(NULL);
-    if(MULTISIM(cr)){
-      fprintf(stderr,"node %d: eigensolver done at %ld\n",cr->ms->sim,interval-start);
-    }
-    else{
-      fprintf(stderr,"eigensolver done at %ld\n",interval-start);
-    }
+    qed_phase(ewcQED_PROP);
     /* lots of duplicate code now... we should use switch() instead
      */
     if(fr->qr->SHmethod != eSHmethodEhrenfest){
@@ -5536,36 +5760,39 @@ double do_adiabatic(t_commrec *cr,  t_forcerec *fr,
     else{
       propagate_TDSE(step,qm,eigvec,ndim,eigval,qm->dt,fr->qr);
     } 
-    interval=time(NULL);
-    if(MULTISIM(cr)){
-      fprintf(stderr,"node %d: wavefunction propagation done at %ld\n",cr->ms->sim,interval-start); 
-    }
-    else{
-      fprintf(stderr,"wavefunction propagation done at %ld\n",interval-start);
-    }
+    qed_dist_end(qm->qeddist);
   }
   else{/* zero the expansion coefficient on all other nodes */
+    qed_comm_begin();
+    qed_dist_serve(qm->qeddist);
+    qed_comm_end();
     for(i=0;i<ndim;i++){
       qm->cimag[i]=0.;
       qm->creal[i]=0.;
     }
   }  
-  /* send the eigenvalues and eigenvectors around */
-  for(i=0;i<ndim*ndim;i++){
-    eigvec_real[i]=creal(eigvec[i]);
-    eigvec_imag[i]=cimag(eigvec[i]);
-  }
+  /* send the eigenvalues, the eigenvector components each molecule
+   * needs for its forces, the time-dependent expansion coefficients and
+   * the current state around in one go
+   */
   if(MULTISIM(cr)){
-    gmx_sumd_sim(ndim*ndim,eigvec_real,cr->ms);
-    gmx_sumd_sim(ndim*ndim,eigvec_imag,cr->ms);
-    gmx_sumd_sim(ndim,eigval,cr->ms);
+    snew(scal,2*ndim+1);
+    if(dodia){
+      for(i=0;i<ndim;i++){
+        scal[i]      = qm->creal[i];
+        scal[ndim+i] = qm->cimag[i];
+      }
+      scal[2*ndim] = state[0];
+    }
+    qed_scatter_state(cr,0,ndim,nmol,eigval,eigvec,2*ndim+1,scal);
+    for(i=0;i<ndim;i++){
+      qm->creal[i] = scal[i];
+      qm->cimag[i] = scal[ndim+i];
+    }
     if(fr->qr->SHmethod != eSHmethodEhrenfest){
-      gmx_sumi_sim(1,state,cr->ms);
-      qm->polariton = state[0];
+      qm->polariton = (int)scal[2*ndim];
     }
-    /* communicate the time-dependent expansion coefficients needed for computing mean-field forces */
-    gmx_sumd_sim(ndim,qm->creal ,cr->ms);
-    gmx_sumd_sim(ndim,qm->cimag ,cr->ms);
+    sfree(scal);
   }
     /* compute norm of the wavefunction 
    */
@@ -5573,207 +5800,52 @@ double do_adiabatic(t_commrec *cr,  t_forcerec *fr,
     totpop+=qm->creal[i]*qm->creal[i]+qm->cimag[i]*qm->cimag[i];
   }
   qm->groundstate=1-totpop;
-  for(i=0;i<ndim*ndim;i++){
-    eigvec[i]=eigvec_real[i]+IMAG*eigvec_imag[i];
-  }
-  interval=time(NULL);
-  if(MULTISIM(cr)){
-    if (cr->ms->sim==0)
-      fprintf(stderr,"node %d: gmx_sumd_sim  done at %ld\n",cr->ms->sim,interval-start); 
-  } 
-  else{
-    fprintf(stderr,"node 0: gmx_sumd_sim done at %ld\n",interval-start);
-  }
   /* copy the eigenvectors to qmrec */
   for(i=0;i<ndim*ndim;i++){
     qm->eigvec[i]=eigvec[i];
   }
-  if((dodia) ){
-    evout=fopen(eigenvectorfile,"a");
+  if( dodia && !qm->qedtraj ){
+    evout=qed_record_open(eigenvectorfile,"a");
     for(i=0;i<ndim;i++){
-      fprintf(evout,
+      qed_record_printf(evout,
 	      "step %4d Eigenvector %4d gap %12.8lf (c: %12.8lf + %12.8lf I):",
 	      step,i,eigval[i]-(
 				energies[ndim-1]-cavity_dispersion(qm->n_max,qm)),
 	      qm->creal[i],qm->cimag[i]);
       for(k=0;k<ndim;k++){
-        fprintf(evout," %12.8lf + %12.8lf I",creal(eigvec[i*ndim+k]),cimag(eigvec[i*ndim+k]));
+        qed_record_printf(evout," %12.8lf + %12.8lf I",creal(eigvec[i*ndim+k]),cimag(eigvec[i*ndim+k]));
       }
-      fprintf(evout,"\n");
+      qed_record_printf(evout,"\n");
     }
-    fclose(evout);
+    qed_output_close(fr,qm,evout);
   }
-  interval=time(NULL);
   
   /* compute Hellman Feynman forces. 
    */
- 
-  if(fr->qr->SHmethod != eSHmethodEhrenfest){
-    p=qm->polariton;
-    betasq = conj(eigvec[p*ndim+m])*eigvec[p*ndim+m];
-    a_sump = 0.0+IMAG*0.0;
-    for (i=0;i<(qm->n_max)+1;i++){
-      a_sump += eigvec[p*ndim+nmol+i]*sqrt(cavity_dispersion((i+qm->n_min),qm)/V0_2EP)*cexp(IMAG*2*M_PI*(i+qm->n_min)/L_au*m*L_au/((double) nmol));
-    }
-    ab = conj(eigvec[p*ndim+m])*a_sump; //actually sum of alphas * beta_j
-    ab += conj(a_sump)*eigvec[p*ndim+m];
-    for(i=0;i<qm->nrQMatoms;i++){
-      for(j=0;j<DIM;j++){
-        /* diagonal term */
-        fij =(betasq*QMgrad_S1[i][j]+(1-betasq)*QMgrad_S0[i][j]);
-        /* off-diagonal term */
-        fij-= ab*tdmX[i][j]*u[0];
-        fij-= ab*tdmY[i][j]*u[1];
-        fij-= ab*tdmZ[i][j]*u[2];
-        fij*=HARTREE_BOHR2MD;
-        f[i][j]      += creal(fij);
-        fshift[i][j] += creal(fij);
-      }
-    }
-    for(i=0;i<mm->nrMMatoms;i++){
-      for(j=0;j<DIM;j++){
-        /* diagonal term */
-        fij =(betasq*MMgrad_S1[i][j]+(1-betasq)*MMgrad_S0[i][j]);
-        /* off-diagonal term */
-        fij-= ab*tdmXMM[i][j]*u[0];
-        fij-= ab*tdmYMM[i][j]*u[1];
-        fij-= ab*tdmZMM[i][j]*u[2];
-        fij*=HARTREE_BOHR2MD;
-        f[i+qm->nrQMatoms][j]      += creal(fij);
-        fshift[i+qm->nrQMatoms][j] += creal(fij);
-      }
-    }
-    QMener = eigval[p]*HARTREE2KJ*AVOGADRO;
-  }
-  else {
-    /* Ehrenfest dynamics, need to compute gradients of all polaritonic
-     * states and weight them with weights of the states. Also the
-     * nonadiabatic couplings between polaritonic states are needed now
-     */
-    QMener=0.0; 
-    for (p=0;p<ndim;p++){
-      /* do the diagonal terms first p=q. These terems are same as above for 
-       * single state procedred  
-       */
-      csq = conj(qm->creal[p]+IMAG*qm->cimag[p])*(qm->creal[p]+IMAG*qm->cimag[p])/totpop;
-      betasq = conj(eigvec[p*ndim+m])*eigvec[p*ndim+m];
-      a_sump = 0.0+IMAG*0.0;
-      for (i=0;i<(qm->n_max)+1;i++){
-        a_sump += eigvec[p*ndim+nmol+i]*sqrt(cavity_dispersion((i+qm->n_min),qm)/V0_2EP)*cexp(IMAG*2*M_PI*(i+qm->n_min)/L_au*m*L_au/((double) nmol));
-      }
-      ab = conj(eigvec[p*ndim+m])*a_sump; //actually sum of alphas * beta_j
-      ab += conj(a_sump)*eigvec[p*ndim+m]; // ADDED GG, this accounts for the 3rd and 4th term together in equation 13. 
-      QMener += csq*eigval[p]*HARTREE2KJ*AVOGADRO;
-      for(i=0;i<qm->nrQMatoms;i++){
-        for(j=0;j<DIM;j++){
-          /* diagonal term
-           */
-          fij =(betasq*QMgrad_S1[i][j]+(1-betasq)*QMgrad_S0[i][j]);
-          /* off-diagonal term, Because coeficients are real: ab = ba
-           */
-          fij-= ab*tdmX[i][j]*u[0];
-          fij-= ab*tdmY[i][j]*u[1];
-          fij-= ab*tdmZ[i][j]*u[2];
-          fij*=HARTREE_BOHR2MD*csq;
-          f[i][j]      += creal(fij);
-          fshift[i][j] += creal(fij);
-        }
-      }
-      for(i=0;i<mm->nrMMatoms;i++){
-        for(j=0;j<DIM;j++){
-          /* diagonal terms
-	       */
-          fij =(betasq*MMgrad_S1[i][j]+(1-betasq)*MMgrad_S0[i][j]);
-           /* off-diagonal term
-            */
-	      fij-= ab*tdmXMM[i][j]*u[0];
-	      fij-= ab*tdmYMM[i][j]*u[1];
-	      fij-= ab*tdmZMM[i][j]*u[2];
-	      fij*=HARTREE_BOHR2MD*csq;
-	      f[i+qm->nrQMatoms][j]      += creal(fij);
-	      fshift[i+qm->nrQMatoms][j] += creal(fij);
-        }
-      }    
-      /* now off-diagonals . Normalized
-       */
-      for (q=p+1;q<ndim;q++){
-        cpcq = conj(qm->creal[p]+IMAG*(qm->cimag[p]))*(qm->creal[q]+IMAG*(qm->cimag[q]))/totpop;
-        betasq = conj(eigvec[p*ndim+m])*eigvec[q*ndim+m];
-
-        bpaq = conj(a_sum)*eigvec[q*ndim+m];
-        a_sumq = 0.0+IMAG*0.0;
-	
-        for (i=0;i<(qm->n_max)+1;i++){
-          a_sumq += eigvec[q*ndim+nmol+i]*sqrt(cavity_dispersion((i+qm->n_min),qm)/V0_2EP)*cexp(IMAG*2*M_PI*(i+qm->n_min)/L_au*m*L_au/((double) nmol));
-        }
-        bpaq = conj(eigvec[p*ndim+m])*a_sumq;
-        apbq = conj(a_sump)*eigvec[q*ndim+m];
-        bqap = conj(eigvec[q*ndim+m])*a_sump; /* conj(apbq) */
-        aqbp = conj(a_sumq)*eigvec[p*ndim+m]; /* conj(bpaq) */
-        for(i=0;i<qm->nrQMatoms;i++){
-          for(j=0;j<DIM;j++){
-	        /* diagonal term
-             */
-            fij=0;
-            fij = cpcq*betasq*(QMgrad_S1[i][j]-QMgrad_S0[i][j]);
-            fij+= conj(cpcq)*conj(betasq)*(QMgrad_S1[i][j]-QMgrad_S0[i][j]);
-	        /* off-diagonal term
-	         */
-            fij-= cpcq*(bpaq+apbq)*tdmX[i][j]*u[0];
-            fij-= cpcq*(bpaq+apbq)*tdmY[i][j]*u[1];
-            fij-= cpcq*(bpaq+apbq)*tdmZ[i][j]*u[2];
-            fij-= conj(cpcq)*(bqap+aqbp)*tdmX[i][j]*u[0];
-            fij-= conj(cpcq)*(bqap+aqbp)*tdmY[i][j]*u[1];
-            fij-= conj(cpcq)*(bqap+aqbp)*tdmZ[i][j]*u[2];
-            fij*=HARTREE_BOHR2MD;
-            f[i][j]      += creal(fij);
-            fshift[i][j] += creal(fij);
-          }
-        }
-        for(i=0;i<mm->nrMMatoms;i++){
-          for(j=0;j<DIM;j++){
-            /* diagonal term
-             */
-            fij = cpcq*betasq*(MMgrad_S1[i][j]-MMgrad_S0[i][j]);
-            fij+= conj(cpcq)*conj(betasq)*(MMgrad_S1[i][j]-MMgrad_S0[i][j]);
-            /*l off-diagonal term
-             */
-            fij-= cpcq*(bpaq+apbq)*tdmXMM[i][j]*u[0];
-            fij-= cpcq*(bpaq+apbq)*tdmYMM[i][j]*u[1];
-            fij-= cpcq*(bpaq+apbq)*tdmZMM[i][j]*u[2];
-            fij-= conj(cpcq)*(bqap+aqbp)*tdmXMM[i][j]*u[0];
-            fij-= conj(cpcq)*(bqap+aqbp)*tdmYMM[i][j]*u[1];
-            fij-= conj(cpcq)*(bqap+aqbp)*tdmZMM[i][j]*u[2];
-            fij*=HARTREE_BOHR2MD;
-            f[i+qm->nrQMatoms][j]      += creal(fij);
-            fshift[i+qm->nrQMatoms][j] += creal(fij);
-          }
-        }
-      }
-    }
-  }
-  interval=time(NULL);
-  if(MULTISIM(cr)){
-    if (cr->ms->sim==0) 
-      fprintf(stderr,"node %d: Forces done at %ld\n",cr->ms->sim,interval-start);
-  }
-  else{
-    fprintf(stderr,"Forces done at %ld\n",interval-start);
+  qed_phase(ewcQED_FORCE);
+  QMener = polariton_forces(fr,qm,mm,ndim,nmol,m,eigvec,eigval,totpop,u,
+                            QMgrad_S0,QMgrad_S1,MMgrad_S0,MMgrad_S1,
+                            tdmX,tdmY,tdmZ,tdmXMM,tdmYMM,tdmZMM,f,fshift);
+  if (dodia && qm->qedtraj && qed_traj_step(qm->qedtraj,step)){
+    qed_traj_output(fr,qm,step,eqtrEIGEN,ndim,QMener,
+                    energies[ndim-1]-cavity_dispersion(qm->n_max,qm),
+                    eigval,eigvec);
   }
   if ( fr->qr->SHmethod !=  eSHmethoddiabatic ){
     /* printing the coefficients to C.dat */
     if (dodia){
       fprintf(stderr,"rho0 (%d) = %lf, Energy = %lf\n",step,qm->groundstate,energies[ndim-1]-cavity_dispersion(qm->n_max,qm));
       sprintf(buf,"%s/C.dat",qm->work_dir);
-      Cout= fopen(buf,"w");
-      fprintf(Cout,"%d\n",step);
+      Cout=qed_record_open(buf,"w");
+      qed_record_printf(Cout,"%d\n",step);
       for(i=0;i<ndim;i++){
-        fprintf (Cout,"%.5lf %.5lf\n ",qm->creal[i],qm->cimag[i]);
+        qed_record_printf(Cout,"%.5lf %.5lf\n ",qm->creal[i],qm->cimag[i]);
       }
-      fprintf (Cout,"%.5lf\n",qm->groundstate);
-      fclose(Cout);
+      qed_record_printf(Cout,"%.5lf\n",qm->groundstate);
+      qed_output_close(fr,qm,Cout);
     }
     /* now account for the decay that will happen in the next timestep */
+    qed_phase(ewcQED_PROP);
     if(qm->QEDdecay>0.0){
       qm->groundstate=0;
       for ( i = 0 ; i < ndim ; i++ ){
@@ -5793,29 +5865,248 @@ double do_adiabatic(t_commrec *cr,  t_forcerec *fr,
      */
     if ( (fr->qr->SHmethod == eSHmethodTully ||
 	  fr->qr->SHmethod == eSHmethodGranucci ) && (qm->QEDdecoherence > 0.) ){
+      qed_phase(ewcQED_NAC);
       decoherence(cr,qm,mm,ndim,eigval);
     }
   }
-  interval=time(NULL);
-  if(MULTISIM(cr)){
-    if (cr->ms->sim==0)
-      fprintf(stderr,"node %d: decay done at %ld\n",cr->ms->sim,interval-start);
-  }
-  else{
-    fprintf(stderr,"decay done at %ld\n",interval-start);
-  }
   free(eigenvectorfile);
   free (final_eigenvecfile);
   
   free (eigval);
   free (eigvec);
-  free (eigvec_real);
-  free (eigvec_imag);
   free (state);
   return (QMener);
 } /* do_adiabatic */
 
+/* Ehrenfest dynamics in the polaritons and dark manifolds of
+ * $QED_BRIGHT, see qed_bright.h, without the ndim x ndim eigenvectors
+ * of do_adiabatic. The coefficients in qm->creal, qm->cimag and C.dat
+ * are those of the diabatic states, as in do_diabatic; eigenvectors.dat
+ * gets the energy, photon fraction and population of the polaritons
+ * and dark manifolds.
+ */
+static double do_bright(t_commrec *cr,  t_forcerec *fr,
+                        t_QMrec *qm, t_MMrec *mm, rvec f[], rvec fshift[],
+                        int step,
+                        rvec QMgrad_S1[],rvec MMgrad_S1[],
+                        rvec QMgrad_S0[],rvec MMgrad_S0[],
+                        rvec tdmX[], rvec tdmY[], rvec tdmZ[],
+                        rvec tdmXMM[], rvec tdmYMM[], rvec tdmZMM[],
+                        double *energies)
+{
+  double
+    *e,*photon,*pop,*scal,E0_norm_sq,u[3],decay,gs,scale,cd,ct,norm,
+    ener=0.,QMener=0.,totpop=0.0;
+  dplx
+    *c;
+  int
+    dodia=1,*ndeg,i,m,nmol,ndim,ns,npol;
+  char
+    buf[3000];
+  gmx_qed_record_t
+    evout=NULL,Cout=NULL;
+  t_qtrframe
+    *frame;
+
+  E0_norm_sq = iprod(qm->E,qm->E);
+  if (E0_norm_sq>0.000000000){
+    u[0]=qm->E[0]/sqrt(E0_norm_sq);
+    u[1]=qm->E[1]/sqrt(E0_norm_sq);
+    u[2]=qm->E[2]/sqrt(E0_norm_sq);
+  }
+  else {
+    u[0]=u[1]=u[2]=0;
+  }
+  if(MULTISIM(cr)){
+    ndim=cr->ms->nsim+(qm->n_max-qm->n_min)+1;
+    m=cr->ms->sim;
+    nmol=cr->ms->nsim;
+    if (!MASTERSIM(cr->ms)){
+      dodia = 0;
+    }
+  }
+  else{
+    ndim=1+(qm->n_max-qm->n_min)+1;
+    m=0;
+    nmol=1;
+  }
+  snew(c,ndim);
+  /* the coefficients, the excited state weights of the molecules in
+   * the forces and the energy, sent around in one go
+   */
+  snew(scal,2*ndim+nmol+1);
+  gs = energies[ndim-1]-cavity_dispersion(qm->n_max,qm);
+
+  qed_phase(ewcQED_PROP);
+  if (dodia){
+    for (i=0;i<ndim;i++){
+      c[i] = qm->creal[i]+IMAG*qm->cimag[i];
+    }
+    if (step){
+      qed_bright_propagate(qm->qedbright,qm->dt/AU2PS,c);
+    }
+    qed_phase(ewcQED_DIAG);
+    snew(e,ndim);
+    snew(photon,ndim);
+    snew(pop,ndim);
+    snew(ndeg,ndim);
+    ns = qed_bright_states(qm->qedbright,c,e,photon,pop,ndeg,&npol);
+    for (i=0;i<ns;i++){
+      ener += e[i]*pop[i];
+    }
+    if (qm->qedtraj){
+      if (qed_traj_step(qm->qedtraj,step)){
+        frame = qed_traj_frame(qm->qedtraj,step,eqtrBRIGHT,ndim,ns);
+        frame->npol        = npol;
+        frame->ref         = gs;
+        frame->groundstate = qm->groundstate;
+        for (i=0,norm=0;i<ns;i++){
+          frame->gap[i]    = e[i]-gs;
+          frame->pop[i]    = pop[i];
+          frame->photon[i] = photon[i];
+          frame->ndeg[i]   = ndeg[i];
+          norm += pop[i];
+        }
+        frame->energy = ener/norm*HARTREE2KJ*AVOGADRO;
+        qed_output_close(fr,qm,qed_traj_record(qm->qedtraj));
+      }
+    }
+    else{
+      sprintf(buf,"%s/eigenvectors.dat",qm->work_dir);
+      evout=qed_record_open(buf,"a");
+      for (i=0;i<ns;i++){
+        if (i < npol){
+          qed_record_printf(evout,
+                            "step %4d polariton %4d gap %12.8lf photon %8.5lf pop %12.8lf\n",
+                            step,i,e[i]-gs,photon[i],pop[i]);
+        }
+        else{
+          qed_record_printf(evout,
+                            "step %4d dark %4d states %6d gap %12.8lf pop %12.8lf\n",
+                            step,i-npol,ndeg[i],e[i]-gs,pop[i]);
+        }
+      }
+      qed_output_close(fr,qm,evout);
+    }
+    for (i=0;i<ndim;i++){
+      scal[i]      = creal(c[i]);
+      scal[ndim+i] = cimag(c[i]);
+    }
+    qed_bright_weights(qm->qedbright,c,scal+2*ndim);
+    scal[2*ndim+nmol] = ener;
+    sfree(e);
+    sfree(photon);
+    sfree(pop);
+    sfree(ndeg);
+  }
+  if(MULTISIM(cr)){
+    qed_sumd_sim(2*ndim+nmol+1,scal,cr->ms);
+  }
+  for (i=0;i<ndim;i++){
+    qm->creal[i] = scal[i];
+    qm->cimag[i] = scal[ndim+i];
+    c[i] = qm->creal[i]+IMAG*qm->cimag[i];
+    totpop += qm->creal[i]*qm->creal[i]+qm->cimag[i]*qm->cimag[i];
+  }
+  qm->groundstate=1-totpop;
+  ener = scal[2*ndim+nmol]/totpop;
+  QMener = ener*HARTREE2KJ*AVOGADRO;
+  if (dodia){
+    fprintf(stderr,"Step %d, Energy: %12.8lf\n",step,ener);
+  }
+
+  /* Hellman-Feynman forces of <c|H|c> with the molecules of a manifold
+   * at its mean energy, as propagated
+   */
+  qed_phase(ewcQED_FORCE);
+  scale = HARTREE_BOHR2MD/totpop;
+  cd    = scal[2*ndim+m];
+  ct    = 2*creal(conj(c[m])*photon_amplitude(qm,m,nmol,c));
+  add_qed_gradient(qm->nrQMatoms,totpop*scale,cd*scale,ct*scale,u,
+                   QMgrad_S0,QMgrad_S1,tdmX,tdmY,tdmZ,f,fshift);
+  add_qed_gradient(mm->nrMMatoms,totpop*scale,cd*scale,ct*scale,u,
+                   MMgrad_S0,MMgrad_S1,tdmXMM,tdmYMM,tdmZMM,
+                   f+qm->nrQMatoms,fshift+qm->nrQMatoms);
+
+  /* printing the coefficients to C.dat */
+  if (dodia){
+    fprintf(stderr,"rho0 (%d) = %lf, Energy = %lf\n",step,qm->groundstate,gs);
+    sprintf(buf,"%s/C.dat",qm->work_dir);
+    Cout=qed_record_open(buf,"w");
+    qed_record_printf(Cout,"%d\n",step);
+    for(i=0;i<ndim;i++){
+      qed_record_printf(Cout,"%.5lf %.5lf\n ",qm->creal[i],qm->cimag[i]);
+    }
+    qed_record_printf(Cout,"%.5lf\n",qm->groundstate);
+    qed_output_close(fr,qm,Cout);
+  }
+  qed_phase(ewcQED_PROP);
+  /* only the cavity modes decay, in the next timestep */
+  decay=exp(-0.5*(qm->QEDdecay)*(qm->dt));
+  qm->groundstate=0;
+  for ( i = nmol ; i < ndim ; i++ ){
+    qm->groundstate-=(qm->creal[i]*qm->creal[i]+qm->cimag[i]*qm->cimag[i])*(decay*decay-1);
+    qm->creal[i] *= decay;
+    qm->cimag[i] *= decay;
+  }
+
+  sfree(scal);
+  sfree(c);
+  return(QMener);
+} /* do_bright */
+
    
+/* QM results of the last QM step, the inner steps of $QMMM_MTS
+ * propagate with these instead of calling the QM program
+ */
+struct gmx_qed_mts {
+  int    ndim,nQM,nMM;
+  double *energies;
+  rvec   *grad[10];
+};
+
+static void qed_mts_copy(t_QMrec *qm, t_MMrec *mm, int ndim,
+                         double *energies, rvec *grads[], gmx_bool bStore){
+  /* grads: the S1 and S0 gradients and the tdm gradients, on the QM
+   * and the MM atoms, in the order of call_gaussian_QED
+   */
+  struct gmx_qed_mts
+    *c;
+  int
+    i,n;
+
+  if (qm->qedmts == NULL){
+    snew(qm->qedmts,1);
+  }
+  c = qm->qedmts;
+  if (bStore){
+    c->ndim = ndim;
+    c->nQM  = qm->nrQMatoms;
+    c->nMM  = mm->nrMMatoms;
+    srenew(c->energies,ndim);
+    for (i=0;i<10;i++){
+      n = (i==0 || i==2 || (i>=4 && i<7)) ? c->nQM : c->nMM;
+      srenew(c->grad[i],n);
+    }
+  }
+  else if (c->nQM != qm->nrQMatoms || c->nMM != mm->nrMMatoms){
+    gmx_incons("the MM embedding changed on an inner $QMMM_MTS step");
+  }
+  for (i=0;i<ndim;i++){
+    if (bStore)
+      c->energies[i] = energies[i];
+    else
+      energies[i] = c->energies[i];
+  }
+  for (i=0;i<10;i++){
+    n = (i==0 || i==2 || (i>=4 && i<7)) ? c->nQM : c->nMM;
+    if (bStore)
+      memcpy(c->grad[i],grads[i],n*sizeof(rvec));
+    else
+      memcpy(grads[i],c->grad[i],n*sizeof(rvec));
+  }
+} /* qed_mts_copy */
+
 real call_gaussian_QED(t_commrec *cr,  t_forcerec *fr, 
 		   t_QMrec *qm, t_MMrec *mm, rvec f[], rvec fshift[])
 {
@@ -5823,31 +6114,28 @@ real call_gaussian_QED(t_commrec *cr,  t_forcerec *fr,
   static int
     step=0;
   int
-    i,j=0,k,m,ndim,nmol;
+    i,j=0,k,m,ndim,nmol,nwrite;
   double
     *energies,Eground,c, QMener=0.0;
   rvec
     *QMgrad_S0,*MMgrad_S0,*QMgrad_S1,*MMgrad_S1,tdm;
   rvec
-    *tdmX,*tdmY,*tdmZ,*tdmXMM,*tdmYMM,*tdmZMM;
+    *tdmX,*tdmY,*tdmZ,*tdmXMM,*tdmYMM,*tdmZMM,*grads[10];
   char
-    *exe,*energyfile,buf[3000];
+    *exe,*energyfile=NULL,buf[3000];
   double
-    *tmp=NULL,L_au=qm->L*microM2BOHR;
+    *tmp=NULL,*mol=NULL,*dre,*dim;
   dplx
     *matrix=NULL,*couplings=NULL;
   double
-    *send_couple_real,*send_couple_imag;
+    *send_couple_real=NULL,*send_couple_imag=NULL;
   int
-    dodia=1,p,q;
-  FILE
-    *enerout=NULL;
-  time_t 
-    start,end,interval;
+    dodia=1;
+  gmx_qed_record_t
+    enerout=NULL;
 
-  start = time(NULL);
+  qed_wcycle = fr->qr->wcycle;
   snew(exe,300000);
-  sprintf(exe,"%s/%s",qm->gauss_dir,qm->gauss_exe);
 
   /*  excited state forces */
   snew(QMgrad_S1,qm->nrQMatoms);
@@ -5862,135 +6150,263 @@ real call_gaussian_QED(t_commrec *cr,  t_forcerec *fr,
   snew(tdmXMM,mm->nrMMatoms);
   snew(tdmYMM,mm->nrMMatoms);
   snew(tdmZMM,mm->nrMMatoms);
-  write_gaussian_input_QED(cr,step,fr,qm,mm);
-
-
-
-  /* we use the script to use QM code */ 
-  do_gaussian(step,exe);
-  interval=time(NULL);
-  if (MULTISIM(cr)){
-    if (cr->ms->sim==0)
-      fprintf(stderr,"node %d: do_gaussian done at %ld\n",cr->ms->sim,interval-start);
-  }
-  else{
-    fprintf(stderr,"node 0: read_gaussian done at %ld\n",interval-start);
-  }
-  QMener = read_gaussian_output_QED(cr,QMgrad_S1,MMgrad_S1,QMgrad_S0,MMgrad_S0,
-				    step,qm,mm,&tdm,tdmX,tdmY,tdmZ,
-                                    tdmXMM,tdmYMM,tdmZMM,&Eground);
-  interval=time(NULL);
-  if(MULTISIM(cr)){
-    if (cr->ms->sim==0){
-      fprintf(stderr,"node %d: read_gaussian done at %ld\n",cr->ms->sim,interval-start);
+  grads[0] = QMgrad_S1; grads[1] = MMgrad_S1;
+  grads[2] = QMgrad_S0; grads[3] = MMgrad_S0;
+  grads[4] = tdmX;      grads[5] = tdmY;      grads[6] = tdmZ;
+  grads[7] = tdmXMM;    grads[8] = tdmYMM;    grads[9] = tdmZMM;
+  if (qm->bMTSinner){
+    /* inner step of $QMMM_MTS, propagate in the Hamiltonian of the
+     * last QM step
+     */
+    qed_phase(ewcQED_HAM);
+    ndim = qm->qedmts->ndim;
+    snew(energies,ndim);
+    if (qm->qedcav){
+      qed_cavity_step(qm->qedcav,NULL,NULL);
     }
-    ndim=cr->ms->nsim+(qm->n_max-qm->n_min)+1;
-    m=cr->ms->sim;
-    nmol=cr->ms->nsim;
+    else if (qm->qedbright){
+      qed_bright_step(qm->qedbright,NULL,NULL);
+    }
+    else{
+      snew(matrix,ndim*ndim);
+      for (i=0;i<ndim*ndim;i++){
+        matrix[i] = qm->matrix[i];
+      }
+    }
+    qed_mts_copy(qm,mm,ndim,energies,grads,FALSE);
   }
   else{
-    fprintf(stderr,"read_gaussian done at %ld\n",interval-start);
-    ndim=1+(qm->n_max-qm->n_min)+1;
-    m=0;
-    nmol=1;
-  }
-  snew(energyfile,3000);
-  sprintf(energyfile,"%s/%s%d.dat",qm->work_dir,"energies",m);
-  enerout=fopen(energyfile,"a");
-  fprintf(enerout,"step %d E(S0): %12.8lf E(S1) %12.8lf TDM: %12.8lf %12.8lf %12.8lf\n",step,Eground, QMener, tdm[XX],tdm[YY],tdm[ZZ]);
-  fclose(enerout);
-
-  snew(energies,ndim);
-  /* on the diagonal there is the excited state energy of the molecule
-   * plus the ground state energies of all other molecules
-   */
-  for (i=0;i<ndim;i++){
-    energies[i]=Eground;
-  }
-  energies[m]=QMener; /* the excited state energy, overwrites
-			 the ground state energie */
-  /* send around */
-  if(MULTISIM(cr)){
-    gmx_sumd_sim(ndim,energies,cr->ms);
-  }
-//  for (i=qm->n_max;i>0;i--){
-//    energies[ndim-(qm->n_max+1)-i]+=cavity_dispersion(i,qm);
-//  }
-  for (i=0;i< (qm->n_max-qm->n_min)+1;i++){
-    energies[nmol+i]+=cavity_dispersion(qm->n_min+i,qm);
-  } /* after summing the ground state energies, the photon energy of the cavity 
-      (such that w[k]=w[-k]) is added to the last 2*n_max+1 diagonal terms,  */
-
-  /* now we fill up the off-diagonals, basically the dot product of the dipole
-     moment with the unit vector of the E-field of the cavity/plasmon times the
-     E-field magnitud that is now k-dependent through w(k)
-  */
-  snew(couplings,nmol*((qm->n_max-qm->n_min)+1));
-  double E0_norm_sq;
-  E0_norm_sq = iprod(qm->E,qm->E); // Square of the magitud of the E-field at k=0
-  double V0_2EP = qm->omega/(E0_norm_sq); //2*Epsilon0*V_cav at k=0 (in a.u.)
-  double u[3];
-//  fprintf(stderr,"E0_norm_sq = %lf\n",E0_norm_sq);
-    if(E0_norm_sq>0.0){
-        u[0]=qm->E[0]/sqrt(E0_norm_sq);
-        u[1]=qm->E[1]/sqrt(E0_norm_sq);
-        u[2]=qm->E[2]/sqrt(E0_norm_sq); //unit vector in E=Ex*u1+Ey*u2+Ez*u3
+    if (qm->qedmodel){
+      qed_phase(ewcQM_RUN);
+      QMener = qed_model_compute(qm->qedmodel,qm,mm,
+                                 QMgrad_S1,MMgrad_S1,QMgrad_S0,MMgrad_S0,
+                                 &tdm,tdmX,tdmY,tdmZ,
+                                 tdmXMM,tdmYMM,tdmZMM,&Eground);
+    }
+    else if (qm->qmpool){
+      /* the QM of all molecules on the workers of the pool */
+      qed_phase(ewcQM_RUN);
+      QMener = qm_pool_compute(qm->qmpool,step,qm,mm,
+                               QMgrad_S1,MMgrad_S1,QMgrad_S0,MMgrad_S0,
+                               &tdm,tdmX,tdmY,tdmZ,
+                               tdmXMM,tdmYMM,tdmZMM,&Eground);
+      check_tdm_sign(step,qm,tdm);
+    }
+    else if (qm->qmserver){
+      /* the QM program is kept running, no files involved */
+      qed_phase(ewcQM_RUN);
+      QMener = qm_server_compute(qm->qmserver,step,qm,mm,
+                                 QMgrad_S1,MMgrad_S1,QMgrad_S0,MMgrad_S0,
+                                 &tdm,tdmX,tdmY,tdmZ,
+                                 tdmXMM,tdmYMM,tdmZMM,&Eground);
+      check_tdm_sign(step,qm,tdm);
     }
     else{
-        V0_2EP=1;
-        u[0]=u[1]=u[2]=0.0;
+      qed_phase(ewcQM_INPUT);
+      write_gaussian_input_QED(cr,step,fr,qm,mm);
+      /* we use the script to use QM code */ 
+      qed_phase(ewcQM_RUN);
+      sprintf(exe,"%s/%s",qm->gauss_dir,qm->gauss_exe);
+      do_gaussian(step,exe);
+      qed_phase(ewcQM_OUTPUT);
+      QMener = read_gaussian_output_QED(cr,QMgrad_S1,MMgrad_S1,QMgrad_S0,MMgrad_S0,
+                                        step,qm,mm,&tdm,tdmX,tdmY,tdmZ,
+                                        tdmXMM,tdmYMM,tdmZMM,&Eground);
+      /* back to where mdrun writes the checkpoint and confout */
+      if (MULTISIM(cr)){
+        qm_scratch_leave(qm->qmscratch);
+      }
+    }
+    qed_phase(ewcQED_HAM);
+    if(MULTISIM(cr)){
+      ndim=cr->ms->nsim+(qm->n_max-qm->n_min)+1;
+      m=cr->ms->sim;
+      nmol=cr->ms->nsim;
+    }
+    else{
+      ndim=1+(qm->n_max-qm->n_min)+1;
+      m=0;
+      nmol=1;
+    }
+    if (qm->qedtraj){
+      /* the molecules go into the trajectory frame of this step */
+      if (qed_traj_step(qm->qedtraj,step)){
+        snew(mol,5*nmol);
+        mol[5*m]   = Eground;
+        mol[5*m+1] = QMener;
+        mol[5*m+2] = tdm[XX];
+        mol[5*m+3] = tdm[YY];
+        mol[5*m+4] = tdm[ZZ];
+        if(MULTISIM(cr)){
+          qed_sumd_sim(5*nmol,mol,cr->ms);
+        }
+        qed_traj_molecules(qm->qedtraj,step,nmol,mol);
+        sfree(mol);
+      }
+    }
+    else{
+      snew(energyfile,3000);
+      sprintf(energyfile,"%s/%s%d.dat",qm->work_dir,"energies",m);
+      enerout=qed_record_open(energyfile,"a");
+      qed_record_printf(enerout,"step %d E(S0): %12.8lf E(S1) %12.8lf TDM: %12.8lf %12.8lf %12.8lf\n",step,Eground, QMener, tdm[XX],tdm[YY],tdm[ZZ]);
+      qed_output_close(fr,qm,enerout);
+    }
+
+    snew(energies,ndim);
+    /* on the diagonal there is the excited state energy of the molecule
+     * plus the ground state energies of all other molecules
+     */
+    for (i=0;i<ndim;i++){
+      energies[i]=Eground;
     }
+    energies[m]=QMener; /* the excited state energy, overwrites
+  			 the ground state energie */
+    /* send around */
+    if(MULTISIM(cr)){
+      qed_sumd_sim(ndim,energies,cr->ms);
+    }
+  //  for (i=qm->n_max;i>0;i--){
+  //    energies[ndim-(qm->n_max+1)-i]+=cavity_dispersion(i,qm);
+  //  }
+    for (i=0;i< (qm->n_max-qm->n_min)+1;i++){
+      energies[nmol+i]+=cavity_dispersion(qm->n_min+i,qm);
+    } /* after summing the ground state energies, the photon energy of the cavity 
+        (such that w[k]=w[-k]) is added to the last 2*n_max+1 diagonal terms,  */
+
+    /* now we fill up the off-diagonals, basically the dot product of the dipole
+       moment with the unit vector of the E-field of the cavity/plasmon times the
+       E-field magnitud that is now k-dependent through w(k)
+    */
+    double E0_norm_sq;
+    E0_norm_sq = iprod(qm->E,qm->E); // Square of the magitud of the E-field at k=0
+    double u[3];
+  //  fprintf(stderr,"E0_norm_sq = %lf\n",E0_norm_sq);
+      if(E0_norm_sq>0.0){
+          u[0]=qm->E[0]/sqrt(E0_norm_sq);
+          u[1]=qm->E[1]/sqrt(E0_norm_sq);
+          u[2]=qm->E[2]/sqrt(E0_norm_sq); //unit vector in E=Ex*u1+Ey*u2+Ez*u3
+      }
+      else{
+          u[0]=u[1]=u[2]=0.0;
+      }
       
-  for (i=0;i<(qm->n_max-qm->n_min+1);i++){
-//    couplings[m*((qm->n_max)+1)+i] = -iprod(tdm,u)*sqrt(cavity_dispersion(i,qm)/V0_2EP)*cexp(IMAG*2*M_PI*i/L_au*m*L_au/((double) nmol));
-    couplings[m*((qm->n_max-qm->n_min)+1)+i] = -iprod(tdm,u)*sqrt(cavity_dispersion(qm->n_min+i,qm)/V0_2EP)*cexp(IMAG*2*M_PI*(qm->n_min+i)/L_au*m*L_au/((double) nmol));
-  }
-  /* send couplings around */
-  snew(send_couple_real,nmol*((qm->n_max-qm->n_min)+1));
-  snew(send_couple_imag,nmol*((qm->n_max-qm->n_min)+1));
-  for (i=0;i<nmol*((qm->n_max-qm->n_min)+1);i++){
-    send_couple_real[i]=creal(couplings[i]);
-    send_couple_imag[i]=cimag(couplings[i]);
-  }
-  if(MULTISIM(cr)){
-    gmx_sumd_sim(nmol*((qm->n_max-qm->n_min)+1),send_couple_real,cr->ms);
-    gmx_sumd_sim(nmol*((qm->n_max-qm->n_min)+1),send_couple_imag,cr->ms);
-  }
-  for (i=0;i<nmol*((qm->n_max-qm->n_min)+1);i++){
-    couplings[i]=send_couple_real[i]+IMAG*send_couple_imag[i];
-  }
+    if (qm->qedcav || qm->qedbright){
+      /* only -tdm.u of every molecule, the Hamiltonian is applied
+       * through qm->qedcav or decomposed by qm->qedbright
+       */
+      snew(tmp,nmol);
+      tmp[m] = -(tdm[XX]*u[0]+tdm[YY]*u[1]+tdm[ZZ]*u[2]);
+      if(MULTISIM(cr)){
+        qed_sumd_sim(nmol,tmp,cr->ms);
+      }
+      if (qm->qedcav){
+        qed_cavity_step(qm->qedcav,energies,tmp);
+      }
+      else{
+        qed_bright_step(qm->qedbright,energies,tmp);
+      }
+    }
+    else{
+      snew(couplings,nmol*((qm->n_max-qm->n_min)+1));
+      for (i=0;i<(qm->n_max-qm->n_min+1);i++){
+    //    couplings[m*((qm->n_max)+1)+i] = -iprod(tdm,u)*sqrt(cavity_dispersion(i,qm)/V0_2EP)*cexp(IMAG*2*M_PI*i/L_au*m*L_au/((double) nmol));
+        couplings[m*((qm->n_max-qm->n_min)+1)+i] = -iprod(tdm,u)*cavity_factors(qm,m,nmol)[i];
+      }
+      /* send couplings around */
+      snew(send_couple_real,nmol*((qm->n_max-qm->n_min)+1));
+      snew(send_couple_imag,nmol*((qm->n_max-qm->n_min)+1));
+      for (i=0;i<nmol*((qm->n_max-qm->n_min)+1);i++){
+        send_couple_real[i]=creal(couplings[i]);
+        send_couple_imag[i]=cimag(couplings[i]);
+      }
+      if(MULTISIM(cr)){
+        qed_sumd_sim(nmol*((qm->n_max-qm->n_min)+1),send_couple_real,cr->ms);
+        qed_sumd_sim(nmol*((qm->n_max-qm->n_min)+1),send_couple_imag,cr->ms);
+      }
+      for (i=0;i<nmol*((qm->n_max-qm->n_min)+1);i++){
+        couplings[i]=send_couple_real[i]+IMAG*send_couple_imag[i];
+      }
 
 
 
-  snew(matrix,ndim*ndim);
-  for (i=0;i<ndim;i++){
-    matrix[i+(i*ndim)]=energies[i];
-  }
-  for (k=0;k<nmol;k++){
-    for (j=0;j<((qm->n_max-qm->n_min)+1);j++){
-      /* GG @ 5.1.2023: altered which block we take the complex conjugate
-       * of. Turns out that when running in the diabatic
-       * representation, with the adjoint of the upper right block, the
-       * molecular wavepacket is moving in the wrong directon.
+      snew(matrix,ndim*ndim);
+      for (i=0;i<ndim;i++){
+        matrix[i+(i*ndim)]=energies[i];
+      }
+      for (k=0;k<nmol;k++){
+        for (j=0;j<((qm->n_max-qm->n_min)+1);j++){
+          /* GG @ 5.1.2023: altered which block we take the complex conjugate
+           * of. Turns out that when running in the diabatic
+           * representation, with the adjoint of the upper right block, the
+           * molecular wavepacket is moving in the wrong directon.
+           */
+          matrix[nmol+j+(k*ndim)]= (couplings[k*((qm->n_max-qm->n_min)+1)+j]);
+          matrix[ndim*nmol+k+(j*ndim)]=conj(couplings[k*((qm->n_max-qm->n_min)+1)+j]);
+        }
+      }
+      /* decouple the cavity modes far from the molecules, by the mode
+       * populations in the diabatic basis: qm->creal and qm->cimag
+       * hold the coefficients of the eigenstates of the last step in
+       * the adiabatic representation, and the hybrid ones keep the
+       * diabatic coefficients in qm->dreal and qm->dimag
        */
-      matrix[nmol+j+(k*ndim)]= (couplings[k*((qm->n_max-qm->n_min)+1)+j]);
-      matrix[ndim*nmol+k+(j*ndim)]=conj(couplings[k*((qm->n_max-qm->n_min)+1)+j]);
+      if (qm->qedmodes){
+        switch (fr->qr->QEDrepresentation){
+        case eQEDrepresentationadiabatic:
+          snew(dre,ndim);
+          snew(dim,ndim);
+          if (qed_modes_diabatic(ndim,nmol,qm->eigvec,qm->creal,qm->cimag,
+                                 dre,dim)){
+            qed_modes_select(qm->qedmodes,step,ndim,nmol,matrix,dre,dim);
+          }
+          else{
+            qed_modes_select(qm->qedmodes,step,ndim,nmol,matrix,NULL,NULL);
+          }
+          sfree(dre);
+          sfree(dim);
+          break;
+        case eQEDrepresentationHybrid:
+        case eQEDrepresentationHybridNonHerm:
+          qed_modes_select(qm->qedmodes,step,ndim,nmol,matrix,
+                           qm->dreal,qm->dimag);
+          break;
+        default:
+          qed_modes_select(qm->qedmodes,step,ndim,nmol,matrix,
+                           qm->creal,qm->cimag);
+        }
+      }
     }
-  }
-  
-  
-  //  if (m==0){
-  //  fprintf(stderr,"in main routine Matrix:\n");
-  //  printM_complex(ndim,matrix);
-  // }
+
+    //  if (m==0){
+    //  fprintf(stderr,"in main routine Matrix:\n");
+    //  printM_complex(ndim,matrix);
+    // }
   
+    if (fr->qr->mts){
+      qed_mts_copy(qm,mm,ndim,energies,grads,TRUE);
+    }
+  }
   /* Matrix build, now let's do something with it. For the diabatic
      code, we directly propagate, whereas for the adiabatic we diagonalize it
   */
+  if (qm->qedcav && fr->qr->QEDrepresentation != eQEDrepresentationdiabatic){
+    gmx_fatal(FARGS,"$QED_FFT is only supported in the diabatic representation\n");
+  }
+  if (qm->qedbright && (fr->qr->QEDrepresentation != eQEDrepresentationadiabatic ||
+                        fr->qr->SHmethod != eSHmethodEhrenfest)){
+    gmx_fatal(FARGS,"$QED_BRIGHT is only supported for Ehrenfest in the adiabatic representation\n");
+  }
+  qed_phase(-1);
   switch (fr->qr->QEDrepresentation){
     case ( eQEDrepresentationadiabatic ):
       
       //if(fr->qr->QEDrepresentation==eQEDrepresentationadiabatic){
+      if (qm->qedbright){
+        QMener=do_bright(cr, fr, qm, mm, f, fshift,step,
+                         QMgrad_S1, MMgrad_S1, QMgrad_S0,MMgrad_S0,
+                         tdmX, tdmY, tdmZ,tdmXMM,tdmYMM,tdmZMM,energies);
+        break;
+      }
       QMener=do_adiabatic(cr, fr, qm, mm, f, fshift,matrix,step,
 			  QMgrad_S1, MMgrad_S1, QMgrad_S0,MMgrad_S0,
 			  tdmX, tdmY, tdmZ,tdmXMM,tdmYMM,tdmZMM,energies);
@@ -6016,10 +6432,18 @@ real call_gaussian_QED(t_commrec *cr,  t_forcerec *fr,
 				    tdmX, tdmY, tdmZ,tdmXMM,tdmYMM,tdmZMM,energies);
       break;
   }
+  qed_phase(-1);
+  /* the writer thread worked through the records while we waited for
+   * the QM program, its time is reported but not spent by mdrun
+   */
+  c = qed_writer_cycles(qm->qedwriter,&nwrite);
+  wallcycle_add(fr->qr->wcycle,ewcQED_WRITER,nwrite,c);
   
   /* store the Hamiltonian for the next step in QMrec */
-  for(i=0;i<ndim*ndim;i++){
-    qm->matrix[i]=matrix[i];
+  if (matrix){
+    for(i=0;i<ndim*ndim;i++){
+      qm->matrix[i]=matrix[i];
+    }
   }
   step++;
   free(exe);
@@ -6041,6 +6465,7 @@ real call_gaussian_QED(t_commrec *cr,  t_forcerec *fr,
   free (send_couple_real);
   free (send_couple_imag);
   free(energies);
+  free(tmp);
   return(QMener);
 } /* call_gaussian_QED */
 
@@ -6093,10 +6518,14 @@ real call_gaussian_SH(t_commrec *cr, t_forcerec *fr, t_QMrec *qm, t_MMrec *mm,
   /*  if(!step)
    * qr->bSA=FALSE;*/
   /* temporray set to step + 1, since there is a chk start */
+  qed_wcycle = fr->qr->wcycle;
+  qed_phase(ewcQM_INPUT);
   write_gaussian_SH_input(step,swapped,fr,qm,mm);
-
+  qed_phase(ewcQM_RUN);
   do_gaussian(step,exe);
+  qed_phase(ewcQM_OUTPUT);
   QMener = read_gaussian_SH_output(QMgrad,MMgrad,step,swapped,qm,mm,&deltaE);
+  qed_phase(-1);
 
   /* check for a surface hop. Only possible if we were already state
    * averaging.
@@ -6111,9 +6540,13 @@ real call_gaussian_SH(t_commrec *cr, t_forcerec *fr, t_QMrec *qm, t_MMrec *mm,
       swapped =!swap; /* so swapped shoud be false again */
     }
     if (swap){/* change surface, so do another call */
+      qed_phase(ewcQM_INPUT);
       write_gaussian_SH_input(step,swapped,fr,qm,mm);
+      qed_phase(ewcQM_RUN);
       do_gaussian(step,exe);
+      qed_phase(ewcQM_OUTPUT);
       QMener = read_gaussian_SH_output(QMgrad,MMgrad,step,swapped,qm,mm,&deltaE);
+      qed_phase(-1);
     }
   }
   /* add the QMMM forces to the gmx force array and fshift
@@ -0,0 +1,292 @@
+/*
+ *
+ *                This source code is part of
+ *
+ *                 G   R   O   M   A   C   S
+ *
+ *          GROningen MAchine for Chemical Simulations
+ *
+ *                        VERSION 3.2.0
+ * Written by David van der Spoel, Erik Lindahl, Berk Hess, and others.
+ * Copyright (c) 1991-2000, University of Groningen, The Netherlands.
+ * Copyright (c) 2001-2004, The GROMACS development team,
+ * check out http://www.gromacs.org for more information.
+
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * If you want to redistribute modifications, please consider that
+ * scientific software is very special. Version control is crucial -
+ * bugs must be traceable. We will be happy to consider code for
+ * inclusion in the official distribution, but derived work must not
+ * be called official GROMACS. Details are found in the README & COPYING
+ * files - if they are missing, get the official version at www.gromacs.org.
+ *
+ * To help us fund GROMACS development, we humbly ask that you cite
+ * the papers on the package - you can find them in the top README file.
+ *
+ * For more info, check our website at http://www.gromacs.org
+ *
+ * And Hey:
+ * GROwing Monsters And Cloning Shrimps
+ */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "typedefs.h"
+#include "smalloc.h"
+#include "string2.h"
+#include "gmx_fatal.h"
+#include "qm_guess.h"
+
+enum { eguessREAD, eguessASPC };
+
+struct gmx_qm_guess {
+  int     mode;
+  int     order;   /* ASPC order k, k+2 steps of history         */
+  char    *dir;    /* with formchk and unfchk                     */
+  int     nbas;    /* basis functions, coefficients per MO        */
+  int     ncoef;   /* alpha and beta MO coefficients              */
+  int     nhist;   /* stored steps, at most order+2               */
+  int     ihist;   /* slot of the newest step                     */
+  double  **hist;
+  double  *guess;
+};
+
+/* fchk arrays that are extrapolated, in the order they are stored */
+static const char *mo_blocks[] = { "Alpha MO coefficients", "Beta MO coefficients" };
+#define EGUESS_MAXORDER 8
+
+#define NMOBLOCK (sizeof(mo_blocks)/sizeof(mo_blocks[0]))
+
+gmx_qm_guess_t qm_guess_init(const char *gauss_dir)
+{
+  gmx_qm_guess_t g;
+  char           *env;
+
+  env = getenv("QM_GUESS");
+  if (env == NULL || gmx_strcasecmp(env,"none") == 0)
+    return NULL;
+
+  snew(g,1);
+  if (gmx_strcasecmp(env,"read") == 0)
+    g->mode = eguessREAD;
+  else if (gmx_strcasecmp(env,"aspc") == 0)
+    g->mode = eguessASPC;
+  else
+    gmx_fatal(FARGS,"Unknown $QM_GUESS '%s', use none, read or aspc\n",env);
+
+  g->order = 2;
+  env = getenv("QM_GUESS_ORDER");
+  if (env != NULL){
+    g->order = strtol(env,NULL,10);
+    if (g->order < 0 || g->order > EGUESS_MAXORDER)
+      gmx_fatal(FARGS,"$QM_GUESS_ORDER should be 0 to %d, not '%s'\n",
+		EGUESS_MAXORDER,env);
+  }
+  g->dir = strdup(gauss_dir);
+  snew(g->hist,g->order+2);
+  if (g->mode == eguessASPC)
+    fprintf(stderr,"QM guess: ASPC of order %d, %d steps of MO coefficients\n",
+	    g->order,g->order+2);
+  else
+    fprintf(stderr,"QM guess: orbitals of the previous step\n");
+
+  return g;
+}
+
+void qm_guess_aspc_coeff(int k, int n, double *B)
+{
+  double num,den;
+  int    i,j;
+
+  /* B_j = (-1)^(j+1) j C(2k+4,k+2-j) / C(2k+2,k+1), j = 1..k+2 */
+  if (n < k+2)
+    k = n-2;
+  for (j = 1; j <= k+2; j++){
+    num = 1;
+    for (i = 1; i <= k+2-j; i++)
+      num = num*(k+2+j+i)/i;
+    den = 1;
+    for (i = 1; i <= k+1; i++)
+      den = den*(k+1+i)/i;
+    B[j-1] = ((j % 2) ? 1 : -1)*j*num/den;
+  }
+}
+
+static void guess_system(const char *buf)
+{
+#ifdef GMX_NO_SYSTEM
+  gmx_fatal(FARGS,"Call to '%s' failed, no system(3) on this platform\n",buf);
+#else
+  if (system(buf) != 0)
+    gmx_fatal(FARGS,"Call to '%s' failed\n",buf);
+#endif
+}
+
+/* Returns the block of a header line of the formatted checkpoint file
+ * and its length, -1 when it is not an MO block.
+ */
+static int mo_block(const char *line, int *n)
+{
+  const char *p;
+  int        b;
+
+  for (b = 0; b < NMOBLOCK; b++){
+    if (strncmp(line,mo_blocks[b],strlen(mo_blocks[b])) == 0){
+      p = strstr(line,"N=");
+      if (p == NULL || sscanf(p+2,"%d",n) != 1)
+	gmx_fatal(FARGS,"Can not read the size of '%s' in the formatted checkpoint\n",
+		  mo_blocks[b]);
+      return b;
+    }
+  }
+  return -1;
+}
+
+/* Reads the MO coefficients of fn into c (snew'ed when NULL) */
+static int read_fchk_mo(const char *fn, int *nbas, double **c)
+{
+  FILE   *fp;
+  char   line[STRLEN];
+  int    n,ncoef,i;
+  double *buf;
+
+  fp = fopen(fn,"r");
+  if (fp == NULL)
+    gmx_fatal(FARGS,"Can not open %s\n",fn);
+  ncoef = 0;
+  buf   = NULL;
+  *nbas = 0;
+  while (fgets(line,STRLEN,fp)){
+    if (strncmp(line,"Number of basis functions",25) == 0)
+      sscanf(line+25," I %d",nbas);
+    if (mo_block(line,&n) < 0)
+      continue;
+    srenew(buf,ncoef+n);
+    for (i = 0; i < n; i++)
+      if (fscanf(fp,"%lf",&buf[ncoef+i]) != 1)
+	gmx_fatal(FARGS,"%s ends inside the MO coefficients\n",fn);
+    ncoef += n;
+  }
+  fclose(fp);
+  if (ncoef == 0 || *nbas <= 0 || ncoef % *nbas != 0)
+    gmx_fatal(FARGS,"No MO coefficients in %s\n",fn);
+  *c = buf;
+
+  return ncoef;
+}
+
+/* Copies fin to fout with the MO coefficients replaced by c */
+static void write_fchk_mo(const char *fin, const char *fout, const double *c)
+{
+  FILE *in,*out;
+  char line[STRLEN];
+  int  n,i,ic;
+  double dum;
+
+  in  = fopen(fin,"r");
+  out = fopen(fout,"w");
+  if (in == NULL || out == NULL)
+    gmx_fatal(FARGS,"Can not convert %s to %s\n",fin,fout);
+  ic = 0;
+  while (fgets(line,STRLEN,in)){
+    fputs(line,out);
+    if (mo_block(line,&n) < 0)
+      continue;
+    for (i = 0; i < n; i++){
+      if (fscanf(in,"%lf",&dum) != 1)
+	gmx_fatal(FARGS,"%s ends inside the MO coefficients\n",fin);
+      fprintf(out,"%16.8E",c[ic++]);
+      if (i % 5 == 4 || i == n-1)
+	fprintf(out,"\n");
+    }
+    /* the rest of the last line of values */
+    if (fgets(line,STRLEN,in) == NULL)
+      break;
+  }
+  fclose(in);
+  fclose(out);
+}
+
+/* Flips the phase of the MOs of c that point away from those of ref */
+static void align_phases(int ncoef, int nbas, double *c, const double *ref)
+{
+  double d;
+  int    m,i;
+
+  for (m = 0; m < ncoef; m += nbas){
+    d = 0;
+    for (i = m; i < m+nbas; i++)
+      d += c[i]*ref[i];
+    if (d < 0)
+      for (i = m; i < m+nbas; i++)
+	c[i] = -c[i];
+  }
+}
+
+gmx_bool qm_guess_prepare(gmx_qm_guess_t g, const char *chk)
+{
+  char   chkfn[STRLEN],fchk[STRLEN],buf[3*STRLEN];
+  double *c,*h,B[EGUESS_MAXORDER+2];
+  int    nbas,ncoef,n,j,i,s;
+
+  sprintf(chkfn,"%s.chk",chk);
+  if (access(chkfn,F_OK) != 0){
+    /* first step, or the run directory was cleaned */
+    g->nhist = 0;
+    return FALSE;
+  }
+  if (g->mode == eguessREAD)
+    return TRUE;
+
+  /* the checkpoint holds the converged orbitals of the last step */
+  sprintf(fchk,"%s.fchk",chk);
+  sprintf(buf,"%s/formchk %s %s > /dev/null",g->dir,chkfn,fchk);
+  guess_system(buf);
+  ncoef = read_fchk_mo(fchk,&nbas,&c);
+  if (ncoef != g->ncoef || nbas != g->nbas){
+    for (j = 0; j < g->order+2; j++)
+      srenew(g->hist[j],ncoef);
+    srenew(g->guess,ncoef);
+    g->ncoef = ncoef;
+    g->nbas  = nbas;
+    g->nhist = 0;
+  }
+  for (j = 0; j < g->nhist; j++){
+    s = (g->ihist - j + g->order+2) % (g->order+2);
+    align_phases(ncoef,nbas,g->hist[s],c);
+  }
+  g->ihist = (g->ihist+1) % (g->order+2);
+  memcpy(g->hist[g->ihist],c,ncoef*sizeof(*c));
+  sfree(c);
+  if (g->nhist < g->order+2)
+    g->nhist++;
+  if (g->nhist < 2)
+    return TRUE;
+
+  n = g->nhist;
+  qm_guess_aspc_coeff(g->order,n,B);
+  for (i = 0; i < ncoef; i++)
+    g->guess[i] = 0;
+  for (j = 0; j < n; j++){
+    s = (g->ihist - j + g->order+2) % (g->order+2);
+    h = g->hist[s];
+    for (i = 0; i < ncoef; i++)
+      g->guess[i] += B[j]*h[i];
+  }
+  /* Gaussian orthonormalizes the orbitals it reads */
+  sprintf(buf,"%s.guess.fchk",chk);
+  write_fchk_mo(fchk,buf,g->guess);
+  sprintf(buf,"%s/unfchk %s.guess.fchk %s > /dev/null",g->dir,chk,chkfn);
+  guess_system(buf);
+
+  return TRUE;
+}
@@ -0,0 +1,84 @@
+/*
+ *
+ *                This source code is part of
+ *
+ *                 G   R   O   M   A   C   S
+ *
+ *          GROningen MAchine for Chemical Simulations
+ *
+ *                        VERSION 3.2.0
+ * Written by David van der Spoel, Erik Lindahl, Berk Hess, and others.
+ * Copyright (c) 1991-2000, University of Groningen, The Netherlands.
+ * Copyright (c) 2001-2004, The GROMACS development team,
+ * check out http://www.gromacs.org for more information.
+
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * If you want to redistribute modifications, please consider that
+ * scientific software is very special. Version control is crucial -
+ * bugs must be traceable. We will be happy to consider code for
+ * inclusion in the official distribution, but derived work must not
+ * be called official GROMACS. Details are found in the README & COPYING
+ * files - if they are missing, get the official version at www.gromacs.org.
+ *
+ * To help us fund GROMACS development, we humbly ask that you cite
+ * the papers on the package - you can find them in the top README file.
+ *
+ * For more info, check our website at http://www.gromacs.org
+ *
+ * And Hey:
+ * Gallium Rubidium Oxygen Manganese Argon Carbon Silicon
+ */
+
+#ifndef _qm_guess_h
+#define _qm_guess_h
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "typedefs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Initial guesses for the SCF of the Gaussian runs, set with
+ * $QM_GUESS:
+ *   read  the orbitals of the previous step, from the checkpoint file
+ *   aspc  the orbitals extrapolated from the previous $QM_GUESS_ORDER+2
+ *         (default 4) steps with the predictor of the always stable
+ *         predictor-corrector (Kolafa, J Comput Chem 25, 335 (2004)).
+ *         The checkpoint file is converted with formchk, the MO
+ *         coefficients are replaced and it is converted back with
+ *         unfchk, both from $GAUSS_DIR.
+ * The checkpoint file lives in the directory of the QM run, the
+ * replica subdirectory with multiple simulations.
+ */
+
+typedef struct gmx_qm_guess *gmx_qm_guess_t;
+
+gmx_qm_guess_t qm_guess_init(const char *gauss_dir);
+/* Returns NULL when $QM_GUESS is not set, the QM interface then keeps
+ * its own choice.
+ */
+
+gmx_bool qm_guess_prepare(gmx_qm_guess_t g, const char *chk);
+/* Call in the directory of the QM run, before writing the input that
+ * uses %chk=chk. Puts the guess in chk.chk and returns whether the
+ * input should read it (guess=read).
+ */
+
+void qm_guess_aspc_coeff(int k, int n, double *B);
+/* The n (at most k+2) predictor coefficients of ASPC of order k,
+ * lower order when there are fewer than k+2 previous steps.
+ */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif	/* _qm_guess_h */
@@ -0,0 +1,140 @@
+/*
+ *
+ *                This source code is part of
+ *
+ *                 G   R   O   M   A   C   S
+ *
+ *          GROningen MAchine for Chemical Simulations
+ *
+ *                        VERSION 3.2.0
+ * Written by David van der Spoel, Erik Lindahl, Berk Hess, and others.
+ * Copyright (c) 1991-2000, University of Groningen, The Netherlands.
+ * Copyright (c) 2001-2004, The GROMACS development team,
+ * check out http://www.gromacs.org for more information.
+
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * If you want to redistribute modifications, please consider that
+ * scientific software is very special. Version control is crucial -
+ * bugs must be traceable. We will be happy to consider code for
+ * inclusion in the official distribution, but derived work must not
+ * be called official GROMACS. Details are found in the README & COPYING
+ * files - if they are missing, get the official version at www.gromacs.org.
+ *
+ * To help us fund GROMACS development, we humbly ask that you cite
+ * the papers on the package - you can find them in the top README file.
+ *
+ * For more info, check our website at http://www.gromacs.org
+ *
+ * And Hey:
+ * GROwing Monsters And Cloning Shrimps
+ */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "typedefs.h"
+#include "smalloc.h"
+#include "vec.h"
+#include "physics.h"
+#include "gmx_fatal.h"
+
+/* Analytic stand-in for a QM program, QMprogram = mock. It costs
+ * next to nothing, so the QM/MM set-up, the MM embedding and the
+ * multi-layer schemes can be tested and timed without a QM code.
+ * Every pair of QM atoms is held at its distance of the first call by
+ * a harmonic spring of $QM_MOCK_K kJ/mol/nm^2 (default 1e5), and the
+ * QM atoms carry an equal share of QMcharge that interacts with the
+ * MM point charges through Coulomb.
+ */
+
+struct gmx_qm_mock {
+  real k;
+  real *r0;     /* reference pair distances, upper triangle */
+};
+
+void init_mock(t_commrec *cr, t_QMrec *qm, t_MMrec *mm)
+{
+  char
+    *buf;
+
+  if (qm->qmmock)
+    return;
+  snew(qm->qmmock,1);
+  buf = getenv("QM_MOCK_K");
+  qm->qmmock->k = buf ? strtod(buf,NULL) : 1e5;
+  fprintf(stderr,"mock QM program, force constant %g kJ/mol/nm^2\n",
+          qm->qmmock->k);
+}
+
+real call_mock(t_commrec *cr, t_forcerec *fr, t_QMrec *qm,
+               t_MMrec *mm, rvec f[], rvec fshift[])
+{
+  struct gmx_qm_mock
+    *mock=qm->qmmock;
+  int
+    i,j,n=qm->nrQMatoms,p;
+  real
+    QMener=0,q,r,fscal,vc;
+  rvec
+    dx;
+
+  if (mock->r0 == NULL){
+    snew(mock->r0,n*(n-1)/2+1);
+    for (i=0,p=0; i<n; i++){
+      for (j=i+1; j<n; j++,p++){
+        rvec_sub(qm->xQM[i],qm->xQM[j],dx);
+        mock->r0[p] = norm(dx);
+      }
+    }
+  }
+  for (i=0; i<n+mm->nrMMatoms; i++){
+    clear_rvec(f[i]);
+  }
+  for (i=0,p=0; i<n; i++){
+    for (j=i+1; j<n; j++,p++){
+      rvec_sub(qm->xQM[i],qm->xQM[j],dx);
+      r      = norm(dx);
+      QMener += 0.5*mock->k*sqr(r-mock->r0[p]);
+      if (r > 0){
+        fscal = mock->k*(r-mock->r0[p])/r;
+        svmul(fscal,dx,dx);
+        rvec_inc(f[i],dx);
+        rvec_dec(f[j],dx);
+      }
+    }
+  }
+  q = n > 0 ? (real)qm->QMcharge/n : 0;
+  if (q != 0){
+    for (i=0; i<n; i++){
+      for (j=0; j<mm->nrMMatoms; j++){
+        rvec_sub(qm->xQM[i],mm->xMM[j],dx);
+        r      = norm(dx);
+        vc     = fr->epsfac*q*mm->MMcharges[j]/r;
+        QMener += vc;
+        svmul(-vc/(r*r),dx,dx);
+        rvec_inc(f[i],dx);
+        rvec_dec(f[n+j],dx);
+      }
+    }
+  }
+  for (i=0; i<n+mm->nrMMatoms; i++){
+    copy_rvec(f[i],fshift[i]);
+  }
+  
+  return QMener;
+}
+
+void done_mock(t_QMrec *qm)
+{
+  if (qm->qmmock){
+    sfree(qm->qmmock->r0);
+    sfree(qm->qmmock);
+  }
+}
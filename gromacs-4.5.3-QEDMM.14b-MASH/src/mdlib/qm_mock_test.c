@@ -0,0 +1,184 @@
+/* -*- mode: c; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; c-file-style: "stroustrup"; -*-
+ * $Id: gmx_matrix.c,v 1.4 2008/12/02 18:27:57 spoel Exp $
+ * 
+ *                This source code is part of
+ * 
+ *                 G   R   O   M   A   C   S
+ * 
+ *          GROningen MAchine for Chemical Simulations
+ * 
+ *                        VERSION 4.5
+ * Written by David van der Spoel, Erik Lindahl, Berk Hess, and others.
+ * Copyright (c) 1991-2000, University of Groningen, The Netherlands.
+ * Copyright (c) 2001-2008, The GROMACS development team,
+ * check out http://www.gromacs.org for more information.
+ 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * If you want to redistribute modifications, please consider that
+ * scientific software is very special. Version control is crucial -
+ * bugs must be traceable. We will be happy to consider code for
+ * inclusion in the official distribution, but derived work must not
+ * be called official GROMACS. Details are found in the README & COPYING
+ * files - if they are missing, get the official version at www.gromacs.org.
+ * 
+ * To help us fund GROMACS development, we humbly ask that you cite
+ * the papers on the package - you can find them in the top README file.
+ * 
+ * For more info, check our website at http://www.gromacs.org
+ * 
+ * And Hey:
+ * Groningen Machine for Chemical Simulation
+ */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "typedefs.h"
+#include "smalloc.h"
+#include "macros.h"
+#include "vec.h"
+#include "physics.h"
+#include "qm_backend.h"
+
+/* Finite difference check of the mock QM program (qm_mock.c), called
+ * through the backend registry as mdrun does. The QM atoms are set up
+ * at random, which fixes the spring lengths, then moved off them; the
+ * gradients the backend returns for every QM and MM coordinate are
+ * compared with central differences of its energy, with and without a
+ * QM charge. Exits with 1 if the largest deviation is above -tol times
+ * the largest gradient.
+ */
+
+static real mock_energy(const t_qm_backend *b, t_forcerec *fr,
+                        t_QMrec *qm, t_MMrec *mm, rvec g[], rvec gs[])
+{
+  return b->compute(NULL,fr,qm,mm,g,gs);
+}
+
+int main(int argc,char *argv[])
+{
+  /* nQM, nMM, QM charge */
+  static const struct { int nQM,nMM,charge; } cases[] = {
+    { 2,  0,  0 },
+    { 5, 20,  0 },
+    { 5, 20,  1 },
+    { 9, 50, -2 }
+  };
+  int           ncase=asize(cases),c,i,d,n,nfail=0;
+  real          Ep,Em,x0,*px;
+  double        h,gmax,dmax;
+  rvec          *g,*gs,*gd,*gds;
+  t_forcerec    fr;
+  t_QMrec       qm;
+  t_MMrec       mm;
+  const t_qm_backend *b;
+#ifdef GMX_DOUBLE
+  double        tol=1e-6;
+#else
+  double        tol=1e-2;
+#endif
+
+  for (i=1; i<argc; i++){
+    if (strcmp(argv[i],"-tol") == 0 && i+1 < argc){
+      tol = strtod(argv[++i],NULL);
+    }
+  }
+  b = qm_backend_get(eQMprogramMOCK);
+  if (b == NULL){
+    printf("FAILED: no mock QM program registered\n");
+    return 1;
+  }
+  memset(&fr,0,sizeof(fr));
+  fr.epsfac = ONE_4PI_EPS0;
+  srand48(1);
+
+  printf("%4s %4s %6s %12s %12s %10s\n","nQM","nMM","charge","energy",
+         "max grad","deviation");
+  for (c=0; c<ncase; c++){
+    memset(&qm,0,sizeof(qm));
+    memset(&mm,0,sizeof(mm));
+    qm.nrQMatoms = cases[c].nQM;
+    qm.QMcharge  = cases[c].charge;
+    mm.nrMMatoms = cases[c].nMM;
+    n = qm.nrQMatoms+mm.nrMMatoms;
+    snew(qm.xQM,qm.nrQMatoms);
+    snew(mm.xMM,mm.nrMMatoms+1);
+    snew(mm.MMcharges,mm.nrMMatoms+1);
+    snew(g,n);
+    snew(gs,n);
+    snew(gd,n);
+    snew(gds,n);
+    for (i=0; i<qm.nrQMatoms; i++){
+      for (d=0; d<DIM; d++){
+        qm.xQM[i][d] = 0.3*drand48();
+      }
+    }
+    for (i=0; i<mm.nrMMatoms; i++){
+      mm.MMcharges[i] = drand48()-0.5;
+      for (d=0; d<DIM; d++){
+        mm.xMM[i][d] = 0.5+drand48();
+      }
+    }
+    /* the first call takes the spring lengths */
+    b->init(NULL,&qm,&mm);
+    mock_energy(b,&fr,&qm,&mm,g,gs);
+    for (i=0; i<qm.nrQMatoms; i++){
+      for (d=0; d<DIM; d++){
+        qm.xQM[i][d] += 0.02*(drand48()-0.5);
+      }
+    }
+    mock_energy(b,&fr,&qm,&mm,g,gs);
+
+    /* h in nm, against coordinates of order 0.1-1 nm */
+#ifdef GMX_DOUBLE
+    h = 1e-6;
+#else
+    h = 1e-3;
+#endif
+    gmax = dmax = 0;
+    for (i=0; i<n; i++){
+      for (d=0; d<DIM; d++){
+        px = (i < qm.nrQMatoms) ? &qm.xQM[i][d] :
+          &mm.xMM[i-qm.nrQMatoms][d];
+        x0  = *px;
+        *px = x0+h;
+        Ep  = mock_energy(b,&fr,&qm,&mm,gd,gds);
+        *px = x0-h;
+        Em  = mock_energy(b,&fr,&qm,&mm,gd,gds);
+        *px = x0;
+        gmax = max(gmax,fabs(g[i][d]));
+        dmax = max(dmax,fabs(g[i][d]-(Ep-Em)/(2*h)));
+      }
+    }
+    printf("%4d %4d %6d %12.4f %12.4e %10.2e\n",cases[c].nQM,cases[c].nMM,
+           cases[c].charge,mock_energy(b,&fr,&qm,&mm,gd,gds),gmax,dmax);
+    if (dmax > tol*gmax){
+      nfail++;
+    }
+    if (b->done){
+      b->done(&qm);
+    }
+    sfree(qm.xQM);
+    sfree(mm.xMM);
+    sfree(mm.MMcharges);
+    sfree(g);
+    sfree(gs);
+    sfree(gd);
+    sfree(gds);
+  }
+  if (nfail > 0){
+    printf("FAILED: %d of %d cases\n",nfail,ncase);
+    return 1;
+  }
+  printf("passed\n");
+
+  return 0;
+}
@@ -413,8 +413,8 @@ real call_orca(t_commrec *cr,  t_forcerec *fr,
 		   t_QMrec *qm, t_MMrec *mm, rvec f[], rvec fshift[])
 {
  /* normal orca jobs */
- static int
-   step=0;
+ int
+   step=qm->QMstep;
  int
    i,j;
  real
@@ -447,7 +447,7 @@ real call_orca(t_commrec *cr,  t_forcerec *fr,
      }
  }
  QMener = QMener*HARTREE2KJ*AVOGADRO;
- step++;
+ qm->QMstep++;
  free(exe);
  return(QMener);
 } /* call_orca */
@@ -0,0 +1,349 @@
+/*
+ *
+ *                This source code is part of
+ *
+ *                 G   R   O   M   A   C   S
+ *
+ *          GROningen MAchine for Chemical Simulations
+ *
+ *                        VERSION 3.2.0
+ * Written by David van der Spoel, Erik Lindahl, Berk Hess, and others.
+ * Copyright (c) 1991-2000, University of Groningen, The Netherlands.
+ * Copyright (c) 2001-2004, The GROMACS development team,
+ * check out http://www.gromacs.org for more information.
+
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * If you want to redistribute modifications, please consider that
+ * scientific software is very special. Version control is crucial -
+ * bugs must be traceable. We will be happy to consider code for
+ * inclusion in the official distribution, but derived work must not
+ * be called official GROMACS. Details are found in the README & COPYING
+ * files - if they are missing, get the official version at www.gromacs.org.
+ *
+ * To help us fund GROMACS development, we humbly ask that you cite
+ * the papers on the package - you can find them in the top README file.
+ *
+ * For more info, check our website at http://www.gromacs.org
+ *
+ * And Hey:
+ * GROwing Monsters And Cloning Shrimps
+ */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#ifdef GMX_QMMM_GAUSSIAN
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "typedefs.h"
+#include "smalloc.h"
+#include "macros.h"
+#include "network.h"
+#include "mdrun.h"
+#include "gmx_fatal.h"
+#include "qm_server.h"
+#include "qm_pool.h"
+
+/* the QM calculation of one molecule, on simulation 0 */
+typedef struct {
+  int    nQM,nMM;
+  int    charge,multiplicity;
+  int    *atnum;
+  double *x;        /* the request, see qm_pack_request            */
+  double *res;      /* the reply                                   */
+  int    nalloc;    /* of x and res                                */
+  double cost;      /* wall time of its last run (s), 0: none yet   */
+} t_qm_pool_job;
+
+typedef struct {
+  double cost;
+  int    nQM;
+  int    mol;
+} t_qm_pool_order;
+
+struct gmx_qm_pool {
+  const gmx_multisim_t *ms;
+  int    sim,nmol;
+  /* simulation 0 */
+  int    nworker;
+  gmx_qm_server_t *worker;
+  int    *busy;     /* the molecule of each worker, -1: idle       */
+  double *tstart;   /* when it got that molecule                   */
+  double *tbusy;    /* its total time spent on molecules           */
+  int    *njob;
+  double twall;     /* total time of the QM steps                  */
+  t_qm_pool_job   *job;
+  t_qm_pool_order *order;
+  struct pollfd   *pfd;
+  /* the other simulations, their request and reply */
+  int    nalloc;
+  int    *ibuf;
+  double *buf;
+};
+
+gmx_qm_pool_t qm_pool_init(const gmx_multisim_t *ms, const char *cmd,
+                           int nworker, const char *dir)
+{
+  gmx_qm_pool_t
+    pool;
+  int
+    w,n;
+  char
+    wdir[STRLEN];
+
+  snew(pool,1);
+  pool->ms   = ms;
+  pool->sim  = ms ? ms->sim  : 0;
+  pool->nmol = ms ? ms->nsim : 1;
+  if (pool->sim == 0){
+    if (nworker < 1){
+      gmx_fatal(FARGS,"$QM_POOL should be at least 1, not %d\n",nworker);
+    }
+    /* more workers than molecules would never get work */
+    pool->nworker = min(nworker,pool->nmol);
+    snew(pool->worker,pool->nworker);
+    snew(pool->busy,pool->nworker);
+    snew(pool->tstart,pool->nworker);
+    snew(pool->tbusy,pool->nworker);
+    snew(pool->njob,pool->nworker);
+    snew(pool->pfd,pool->nworker);
+    snew(pool->job,pool->nmol);
+    snew(pool->order,pool->nmol);
+    for (w=0; w<pool->nworker; w++){
+      /* every worker its own directory, for the scratch and
+       * checkpoint files of the QM program
+       */
+      n = snprintf(wdir,STRLEN,"%s/worker%d",dir ? dir : ".",w);
+      if (n < 0 || n >= STRLEN){
+        gmx_fatal(FARGS,"QM pool directory name too long: %s...\n",wdir);
+      }
+      if (mkdir(wdir,0755) != 0 && errno != EEXIST){
+        gmx_fatal(FARGS,"Can not create QM pool directory %s: %s\n",
+                  wdir,strerror(errno));
+      }
+      pool->worker[w] = qm_server_start(cmd,wdir);
+    }
+    fprintf(stderr,"QM pool of %d workers for %d molecules\n",
+            pool->nworker,pool->nmol);
+  }
+
+  return pool;
+}
+
+static void job_alloc(t_qm_pool_job *job, int nQM, int nMM)
+{
+  /* a reply is larger than the request and has more values than atoms */
+  int
+    n=qm_result_size(nQM,nMM);
+
+  job->nQM = nQM;
+  job->nMM = nMM;
+  if (n > job->nalloc){
+    job->nalloc = n;
+    srenew(job->atnum,n);
+    srenew(job->x,n);
+    srenew(job->res,n);
+  }
+}
+
+/* the most expensive first, by the number of QM atoms without a cost */
+static int order_comp(const void *a, const void *b)
+{
+  const t_qm_pool_order
+    *oa=a,*ob=b;
+
+  if (oa->cost != ob->cost){
+    return oa->cost > ob->cost ? -1 : 1;
+  }
+  if (oa->nQM != ob->nQM){
+    return ob->nQM-oa->nQM;
+  }
+  return oa->mol-ob->mol;
+}
+
+static void start_job(gmx_qm_pool_t pool, int w, int mol, int step)
+{
+  t_qm_pool_job
+    *job=&pool->job[mol];
+
+  qm_server_send(pool->worker[w],step,mol,job->charge,job->multiplicity,
+                 job->nQM,job->nMM,job->atnum,job->x);
+  pool->busy[w]   = mol;
+  pool->tstart[w] = gmx_gettime();
+}
+
+/* hands out the molecules of the step to the free workers, and sends
+ * the replies back as they come in
+ */
+static void pool_run(gmx_qm_pool_t pool, int step)
+{
+  int
+    w,m,next=0,nrun=0;
+  double
+    t0;
+  t_qm_pool_job
+    *job;
+
+  t0 = gmx_gettime();
+  for (m=0; m<pool->nmol; m++){
+    pool->order[m].cost = pool->job[m].cost;
+    pool->order[m].nQM  = pool->job[m].nQM;
+    pool->order[m].mol  = m;
+  }
+  qsort(pool->order,pool->nmol,sizeof(pool->order[0]),order_comp);
+  for (w=0; w<pool->nworker; w++){
+    pool->busy[w] = -1;
+    if (next < pool->nmol){
+      start_job(pool,w,pool->order[next++].mol,step);
+      nrun++;
+    }
+  }
+  while (nrun > 0){
+    for (w=0; w<pool->nworker; w++){
+      pool->pfd[w].fd      = pool->busy[w] >= 0 ?
+        qm_server_fd(pool->worker[w]) : -1;
+      pool->pfd[w].events  = POLLIN;
+      pool->pfd[w].revents = 0;
+    }
+    if (poll(pool->pfd,pool->nworker,-1) < 0){
+      if (errno == EINTR){
+        continue;
+      }
+      gmx_fatal(FARGS,"Waiting for the QM pool failed: %s\n",strerror(errno));
+    }
+    for (w=0; w<pool->nworker; w++){
+      if (pool->busy[w] < 0 || pool->pfd[w].revents == 0){
+        continue;
+      }
+      /* a hang-up ends up as a fatal error in qm_server_recv */
+      m   = pool->busy[w];
+      job = &pool->job[m];
+      qm_server_recv(pool->worker[w],step,m,job->charge,job->multiplicity,
+                     job->nQM,job->nMM,job->res);
+      job->cost = gmx_gettime()-pool->tstart[w];
+      pool->tbusy[w] += job->cost;
+      pool->njob[w]++;
+      if (m != 0){
+        gmx_send_sim(qm_result_size(job->nQM,job->nMM)*sizeof(double),
+                     job->res,m,pool->ms);
+      }
+      if (next < pool->nmol){
+        start_job(pool,w,pool->order[next++].mol,step);
+      }
+      else{
+        pool->busy[w] = -1;
+        nrun--;
+      }
+    }
+  }
+  pool->twall += gmx_gettime()-t0;
+}
+
+real qm_pool_compute(gmx_qm_pool_t pool, int step,
+                     t_QMrec *qm, t_MMrec *mm,
+                     rvec QMgrad_S1[], rvec MMgrad_S1[],
+                     rvec QMgrad_S0[], rvec MMgrad_S0[],
+                     rvec *tdm,
+                     rvec tdmX[], rvec tdmY[], rvec tdmZ[],
+                     rvec tdmXMM[], rvec tdmYMM[], rvec tdmZMM[],
+                     double *Eground)
+{
+  int
+    m,size[4],nQM=qm->nrQMatoms,nMM=mm->nrMMatoms,n;
+  double
+    *res,QMener;
+  t_qm_pool_job
+    *job;
+
+  if (pool->sim == 0){
+    job_alloc(&pool->job[0],nQM,nMM);
+    pool->job[0].charge       = qm->QMcharge;
+    pool->job[0].multiplicity = qm->multiplicity;
+    qm_pack_request(qm,mm,pool->job[0].atnum,pool->job[0].x);
+    for (m=1; m<pool->nmol; m++){
+      job = &pool->job[m];
+      gmx_recv_sim(sizeof(size),size,m,pool->ms);
+      job_alloc(job,size[0],size[1]);
+      job->charge       = size[2];
+      job->multiplicity = size[3];
+      gmx_recv_sim(size[0]*sizeof(int),job->atnum,m,pool->ms);
+      gmx_recv_sim(qm_request_size(size[0],size[1])*sizeof(double),
+                   job->x,m,pool->ms);
+    }
+    pool_run(pool,step);
+    res = pool->job[0].res;
+  }
+  else{
+    n = qm_result_size(nQM,nMM);
+    if (n > pool->nalloc){
+      pool->nalloc = n;
+      srenew(pool->ibuf,n);
+      srenew(pool->buf,n);
+    }
+    qm_pack_request(qm,mm,pool->ibuf,pool->buf);
+    size[0] = nQM;
+    size[1] = nMM;
+    size[2] = qm->QMcharge;
+    size[3] = qm->multiplicity;
+    gmx_send_sim(sizeof(size),size,0,pool->ms);
+    gmx_send_sim(nQM*sizeof(int),pool->ibuf,0,pool->ms);
+    gmx_send_sim(qm_request_size(nQM,nMM)*sizeof(double),pool->buf,0,pool->ms);
+    gmx_recv_sim(n*sizeof(double),pool->buf,0,pool->ms);
+    res = pool->buf;
+  }
+  qm_unpack_result(res,nQM,nMM,QMgrad_S1,MMgrad_S1,QMgrad_S0,MMgrad_S0,
+                   tdm,tdmX,tdmY,tdmZ,tdmXMM,tdmYMM,tdmZMM,&QMener,Eground);
+
+  return QMener;
+}
+
+void qm_pool_done(gmx_qm_pool_t pool)
+{
+  int
+    w,m;
+
+  if (pool == NULL){
+    return;
+  }
+  if (pool->sim == 0){
+    fprintf(stderr,"QM pool: %d molecules on %d workers, %.1f s in the QM steps\n",
+            pool->nmol,pool->nworker,pool->twall);
+    for (w=0; w<pool->nworker; w++){
+      fprintf(stderr,"  worker %d: %d molecules, busy %5.1f%%\n",
+              w,pool->njob[w],
+              pool->twall > 0 ? 100*pool->tbusy[w]/pool->twall : 0.0);
+      qm_server_stop(pool->worker[w]);
+    }
+    for (m=0; m<pool->nmol; m++){
+      sfree(pool->job[m].atnum);
+      sfree(pool->job[m].x);
+      sfree(pool->job[m].res);
+    }
+    sfree(pool->worker);
+    sfree(pool->busy);
+    sfree(pool->tstart);
+    sfree(pool->tbusy);
+    sfree(pool->njob);
+    sfree(pool->pfd);
+    sfree(pool->job);
+    sfree(pool->order);
+  }
+  sfree(pool->ibuf);
+  sfree(pool->buf);
+  sfree(pool);
+}
+
+#else
+int
+gmx_qm_pool_empty;
+#endif
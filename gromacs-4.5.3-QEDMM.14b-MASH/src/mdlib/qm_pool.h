@@ -0,0 +1,86 @@
+/*
+ *
+ *                This source code is part of
+ *
+ *                 G   R   O   M   A   C   S
+ *
+ *          GROningen MAchine for Chemical Simulations
+ *
+ *                        VERSION 3.2.0
+ * Written by David van der Spoel, Erik Lindahl, Berk Hess, and others.
+ * Copyright (c) 1991-2000, University of Groningen, The Netherlands.
+ * Copyright (c) 2001-2004, The GROMACS development team,
+ * check out http://www.gromacs.org for more information.
+
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * If you want to redistribute modifications, please consider that
+ * scientific software is very special. Version control is crucial -
+ * bugs must be traceable. We will be happy to consider code for
+ * inclusion in the official distribution, but derived work must not
+ * be called official GROMACS. Details are found in the README & COPYING
+ * files - if they are missing, get the official version at www.gromacs.org.
+ *
+ * To help us fund GROMACS development, we humbly ask that you cite
+ * the papers on the package - you can find them in the top README file.
+ *
+ * For more info, check our website at http://www.gromacs.org
+ *
+ * And Hey:
+ * Gallium Rubidium Oxygen Manganese Argon Carbon Silicon
+ */
+
+
+#ifndef _qm_pool_h
+#define _qm_pool_h
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "typedefs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Pool of QM workers shared by the molecules of a QED run. Without it
+ * every simulation (molecule) runs its own QM calculation and all wait
+ * for the slowest one each step. With $QM_POOL=N the master of
+ * simulation 0 starts N servers of $QM_SERVER (see qm_server.h), each
+ * in its own $TMP_DIR/worker<w>, the other simulations send it their
+ * requests, and it hands them out from a queue to whichever worker is
+ * free, the most expensive molecules of the previous step first. The number of QM
+ * workers, and the cores they use, is thus independent of the number
+ * of molecules, and a slow SCF only delays one worker.
+ */
+
+typedef struct gmx_qm_pool *gmx_qm_pool_t;
+
+gmx_qm_pool_t qm_pool_init(const gmx_multisim_t *ms, const char *cmd,
+                           int nworker, const char *dir);
+/* ms NULL for a single molecule. Only simulation 0 starts the nworker
+ * servers cmd, worker w in dir/worker<w>, which is created if needed.
+ */
+
+real qm_pool_compute(gmx_qm_pool_t pool, int step,
+                     t_QMrec *qm, t_MMrec *mm,
+                     rvec QMgrad_S1[], rvec MMgrad_S1[],
+                     rvec QMgrad_S0[], rvec MMgrad_S0[],
+                     rvec *tdm,
+                     rvec tdmX[], rvec tdmY[], rvec tdmZ[],
+                     rvec tdmXMM[], rvec tdmYMM[], rvec tdmZMM[],
+                     double *Eground);
+/* As qm_server_compute, collective over the simulations */
+
+void qm_pool_done(gmx_qm_pool_t pool);
+/* Stops the workers, with a report of their load on stderr */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif	/* _qm_pool_h */
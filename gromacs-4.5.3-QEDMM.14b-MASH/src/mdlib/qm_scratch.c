@@ -0,0 +1,209 @@
+/*
+ *
+ *                This source code is part of
+ *
+ *                 G   R   O   M   A   C   S
+ *
+ *          GROningen MAchine for Chemical Simulations
+ *
+ *                        VERSION 3.2.0
+ * Written by David van der Spoel, Erik Lindahl, Berk Hess, and others.
+ * Copyright (c) 1991-2000, University of Groningen, The Netherlands.
+ * Copyright (c) 2001-2004, The GROMACS development team,
+ * check out http://www.gromacs.org for more information.
+
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * If you want to redistribute modifications, please consider that
+ * scientific software is very special. Version control is crucial -
+ * bugs must be traceable. We will be happy to consider code for
+ * inclusion in the official distribution, but derived work must not
+ * be called official GROMACS. Details are found in the README & COPYING
+ * files - if they are missing, get the official version at www.gromacs.org.
+ *
+ * To help us fund GROMACS development, we humbly ask that you cite
+ * the papers on the package - you can find them in the top README file.
+ *
+ * For more info, check our website at http://www.gromacs.org
+ *
+ * And Hey:
+ * GROwing Monsters And Cloning Shrimps
+ */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fnmatch.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "typedefs.h"
+#include "smalloc.h"
+#include "futil.h"
+#include "gmx_fatal.h"
+#include "qm_scratch.h"
+
+struct gmx_qm_scratch {
+  char *dir;     /* $TMP_DIR/molecule<N>, the restart files           */
+  char *run;     /* where the QM runs, dir without $QM_SCRATCH        */
+  int  nkeep;
+  char **keep;   /* patterns of the restart files                    */
+  char cwd[STRLEN]; /* of mdrun                                      */
+};
+
+static void make_dir(const char *dir)
+{
+  if (mkdir(dir,0755) != 0 && errno != EEXIST)
+    gmx_fatal(FARGS,"Can not create QM directory %s: %s\n",dir,strerror(errno));
+}
+
+/* Prints a path of at most STRLEN-1 characters into fn */
+static void make_path(char *fn, const char *fmt, ...)
+{
+  va_list ap;
+  int     n;
+
+  va_start(ap,fmt);
+  n = vsnprintf(fn,STRLEN,fmt,ap);
+  va_end(ap);
+  if (n < 0 || n >= STRLEN)
+    gmx_fatal(FARGS,"QM file name too long (%d characters, max %d): %s...\n",
+              n,STRLEN-1,fn);
+}
+
+/* Copies from/name to to/name, through a temporary file in to */
+static void copy_file(const char *from, const char *to, const char *name)
+{
+  char   src[STRLEN],dst[STRLEN],tmp[STRLEN],buf[65536];
+  FILE   *in,*out;
+  size_t n;
+
+  make_path(src,"%s/%s",from,name);
+  make_path(dst,"%s/%s",to,name);
+  make_path(tmp,"%s/.%s.part",to,name);
+  in = fopen(src,"rb");
+  if (in == NULL)
+    return;  /* removed by the QM program in the meantime */
+  out = fopen(tmp,"wb");
+  if (out == NULL)
+    gmx_fatal(FARGS,"Can not write %s: %s\n",tmp,strerror(errno));
+  while ((n = fread(buf,1,sizeof(buf),in)) > 0)
+    if (fwrite(buf,1,n,out) != n)
+      gmx_fatal(FARGS,"Can not write %s: %s\n",tmp,strerror(errno));
+  fclose(in);
+  if (fclose(out) != 0 || rename(tmp,dst) != 0)
+    gmx_fatal(FARGS,"Can not write %s: %s\n",dst,strerror(errno));
+}
+
+static gmx_bool keep_file(gmx_qm_scratch_t s, const char *name)
+{
+  int i;
+
+  for (i = 0; i < s->nkeep; i++)
+    if (fnmatch(s->keep[i],name,0) == 0)
+      return TRUE;
+  return FALSE;
+}
+
+/* Copies the files of from that match the patterns of s to to, all
+ * files when bAll. Unlinks them from from when bRemove.
+ */
+static void copy_dir(gmx_qm_scratch_t s, const char *from, const char *to,
+		     gmx_bool bAll, gmx_bool bRemove)
+{
+  gmx_directory_t d;
+  char            name[STRLEN],fn[STRLEN];
+
+  if (gmx_directory_open(&d,from) != 0)
+    gmx_fatal(FARGS,"Can not read QM directory %s\n",from);
+  while (gmx_directory_nextfile(d,name,STRLEN) == 0){
+    if (strcmp(name,".") == 0 || strcmp(name,"..") == 0)
+      continue;
+    if (to && (bAll || keep_file(s,name)))
+      copy_file(from,to,name);
+    if (bRemove){
+      make_path(fn,"%s/%s",from,name);
+      unlink(fn);
+    }
+  }
+  gmx_directory_close(d);
+}
+
+gmx_qm_scratch_t qm_scratch_init(const char *tmp_dir, int mol)
+{
+  gmx_qm_scratch_t s;
+  char             *env,*p,buf[STRLEN];
+
+  snew(s,1);
+  if (getcwd(s->cwd,STRLEN) == NULL)
+    gmx_fatal(FARGS,"Can not determine the working directory\n");
+  snew(s->dir,strlen(tmp_dir)+32);
+  sprintf(s->dir,"%s/molecule%d",tmp_dir,mol);
+  make_dir(s->dir);
+
+  env = getenv("QM_SCRATCH");
+  if (env == NULL){
+    s->run = s->dir;
+    return s;
+  }
+  snew(s->run,strlen(env)+64);
+  sprintf(s->run,"%s/gmx%d_molecule%d",env,(int)getpid(),mol);
+  make_dir(s->run);
+
+  env = getenv("QM_SCRATCH_KEEP");
+  strncpy(buf,env ? env : "*.chk NAC_*",STRLEN-1);
+  buf[STRLEN-1] = '\0';
+  for (p = strtok(buf," \t"); p; p = strtok(NULL," \t")){
+    srenew(s->keep,s->nkeep+1);
+    s->keep[s->nkeep++] = strdup(p);
+  }
+  /* continue from the restart files of an earlier run */
+  copy_dir(s,s->dir,s->run,TRUE,FALSE);
+  fprintf(stderr,"QM scratch of molecule %d in %s, restart files in %s\n",
+	  mol,s->run,s->dir);
+
+  return s;
+}
+
+const char *qm_scratch_dir(gmx_qm_scratch_t s)
+{
+  return s->run;
+}
+
+void qm_scratch_leave(gmx_qm_scratch_t s)
+{
+  if (chdir(s->cwd) != 0)
+    gmx_fatal(FARGS,"Can not change back to %s: %s\n",s->cwd,strerror(errno));
+}
+
+void qm_scratch_sync(gmx_qm_scratch_t s)
+{
+  if (s->run != s->dir)
+    copy_dir(s,s->run,s->dir,FALSE,FALSE);
+}
+
+void qm_scratch_done(gmx_qm_scratch_t s)
+{
+  int i;
+
+  qm_scratch_leave(s);
+  if (s->run != s->dir){
+    copy_dir(s,s->run,s->dir,FALSE,TRUE);
+    if (rmdir(s->run) != 0)
+      fprintf(stderr,"Can not remove QM scratch %s: %s\n",s->run,strerror(errno));
+    sfree(s->run);
+    for (i = 0; i < s->nkeep; i++)
+      sfree(s->keep[i]);
+    sfree(s->keep);
+  }
+  sfree(s->dir);
+  sfree(s);
+}
@@ -0,0 +1,85 @@
+/*
+ *
+ *                This source code is part of
+ *
+ *                 G   R   O   M   A   C   S
+ *
+ *          GROningen MAchine for Chemical Simulations
+ *
+ *                        VERSION 3.2.0
+ * Written by David van der Spoel, Erik Lindahl, Berk Hess, and others.
+ * Copyright (c) 1991-2000, University of Groningen, The Netherlands.
+ * Copyright (c) 2001-2004, The GROMACS development team,
+ * check out http://www.gromacs.org for more information.
+
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * If you want to redistribute modifications, please consider that
+ * scientific software is very special. Version control is crucial -
+ * bugs must be traceable. We will be happy to consider code for
+ * inclusion in the official distribution, but derived work must not
+ * be called official GROMACS. Details are found in the README & COPYING
+ * files - if they are missing, get the official version at www.gromacs.org.
+ *
+ * To help us fund GROMACS development, we humbly ask that you cite
+ * the papers on the package - you can find them in the top README file.
+ *
+ * For more info, check our website at http://www.gromacs.org
+ *
+ * And Hey:
+ * Gallium Rubidium Oxygen Manganese Argon Carbon Silicon
+ */
+
+#ifndef _qm_scratch_h
+#define _qm_scratch_h
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "typedefs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Working directory of the QM runs of one molecule (simulation).
+ * The directory is $TMP_DIR/molecule<N>. With $QM_SCRATCH set, e.g.
+ * to /dev/shm, the QM runs use $QM_SCRATCH/gmx<pid>_molecule<N>
+ * instead. That directory starts with the files of
+ * $TMP_DIR/molecule<N> (a restart). The restart files are copied
+ * back at the checkpoints of mdrun and at the end, after which it is
+ * removed. $QM_SCRATCH_KEEP lists the restart files as
+ * space-separated shell patterns, default "*.chk NAC_*".
+ */
+
+typedef struct gmx_qm_scratch *gmx_qm_scratch_t;
+
+gmx_qm_scratch_t qm_scratch_init(const char *tmp_dir, int mol);
+/* Creates the directory of molecule mol, fatal error on failure */
+
+const char *qm_scratch_dir(gmx_qm_scratch_t s);
+/* The directory the QM runs should use */
+
+void qm_scratch_leave(gmx_qm_scratch_t s);
+/* Changes back to the working directory of qm_scratch_init, where
+ * mdrun writes its own files
+ */
+
+void qm_scratch_sync(gmx_qm_scratch_t s);
+/* Copies the restart files to $TMP_DIR/molecule<N>, no-op without
+ * $QM_SCRATCH. Each file is written next to its target and renamed,
+ * so an interrupted sync leaves the previous copy.
+ */
+
+void qm_scratch_done(gmx_qm_scratch_t s);
+/* Syncs and removes the scratch directory, leaves it and frees s */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif	/* _qm_scratch_h */
@@ -0,0 +1,447 @@
+/*
+ *
+ *                This source code is part of
+ *
+ *                 G   R   O   M   A   C   S
+ *
+ *          GROningen MAchine for Chemical Simulations
+ *
+ *                        VERSION 3.2.0
+ * Written by David van der Spoel, Erik Lindahl, Berk Hess, and others.
+ * Copyright (c) 1991-2000, University of Groningen, The Netherlands.
+ * Copyright (c) 2001-2004, The GROMACS development team,
+ * check out http://www.gromacs.org for more information.
+
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * If you want to redistribute modifications, please consider that
+ * scientific software is very special. Version control is crucial -
+ * bugs must be traceable. We will be happy to consider code for
+ * inclusion in the official distribution, but derived work must not
+ * be called official GROMACS. Details are found in the README & COPYING
+ * files - if they are missing, get the official version at www.gromacs.org.
+ *
+ * To help us fund GROMACS development, we humbly ask that you cite
+ * the papers on the package - you can find them in the top README file.
+ *
+ * For more info, check our website at http://www.gromacs.org
+ *
+ * And Hey:
+ * GROwing Monsters And Cloning Shrimps
+ */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#ifdef GMX_QMMM_GAUSSIAN
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include "typedefs.h"
+#include "smalloc.h"
+#include "macros.h"
+#include "physics.h"
+#include "gmx_fatal.h"
+#include "qm_server.h"
+
+struct gmx_qm_server {
+  int     fd;       /* our end of the socket                  */
+  pid_t   pid;      /* the server process                     */
+  int     nalloc;   /* size of buf and ibuf                   */
+  double *buf;      /* message buffer                         */
+  int    *ibuf;
+};
+
+int qms_read(int fd, void *buf, size_t n)
+{
+  char
+    *p = buf;
+  ssize_t
+    nr;
+
+  while (n > 0){
+    nr = read(fd,p,n);
+    if (nr < 0 && errno == EINTR){
+      continue;
+    }
+    if (nr <= 0){
+      return -1;
+    }
+    p += nr;
+    n -= nr;
+  }
+  return 0;
+}
+
+int qms_write(int fd, const void *buf, size_t n)
+{
+  const char
+    *p = buf;
+  ssize_t
+    nw;
+  int
+    flags = 0;
+
+#ifdef MSG_NOSIGNAL
+  /* a dead server should give an error message, not a SIGPIPE */
+  flags = MSG_NOSIGNAL;
+#endif
+  while (n > 0){
+    nw = send(fd,p,n,flags);
+    if (nw < 0 && errno == ENOTSOCK){
+      nw = write(fd,p,n);
+    }
+    if (nw < 0 && errno == EINTR){
+      continue;
+    }
+    if (nw <= 0){
+      return -1;
+    }
+    p += nw;
+    n -= nw;
+  }
+  return 0;
+}
+
+gmx_qm_server_t qm_server_start(const char *cmd, const char *dir)
+{
+  int
+    sv[2];
+  pid_t
+    pid;
+  gmx_qm_server_t
+    qms;
+
+#ifdef GMX_NO_SYSTEM
+  gmx_fatal(FARGS,"Can not start QM server '%s', no process creation on this platform\n",cmd);
+#endif
+  if (socketpair(AF_UNIX,SOCK_STREAM,0,sv) != 0){
+    gmx_fatal(FARGS,"Can not create a socket for the QM server: %s\n",
+              strerror(errno));
+  }
+  fflush(stdout);
+  fflush(stderr);
+  pid = fork();
+  if (pid < 0){
+    gmx_fatal(FARGS,"Can not start QM server '%s': %s\n",cmd,strerror(errno));
+  }
+  if (pid == 0){
+    /* the server, only async-signal-safe calls until the exec */
+    close(sv[0]);
+    if (dir && chdir(dir) != 0){
+      _exit(126);
+    }
+    if (dup2(sv[1],STDIN_FILENO) < 0 || dup2(sv[1],STDOUT_FILENO) < 0){
+      _exit(126);
+    }
+    if (sv[1] != STDIN_FILENO && sv[1] != STDOUT_FILENO){
+      close(sv[1]);
+    }
+    execl("/bin/sh","sh","-c",cmd,(char *)NULL);
+    _exit(127);
+  }
+  close(sv[1]);
+  /* later system() calls should not hold on to the server's socket */
+  fcntl(sv[0],F_SETFD,FD_CLOEXEC);
+
+  snew(qms,1);
+  qms->fd  = sv[0];
+  qms->pid = pid;
+  fprintf(stderr,"started QM server '%s' in %s, pid %d\n",
+          cmd,dir ? dir : ".",(int)pid);
+
+  return qms;
+}
+
+void qm_server_stop(gmx_qm_server_t qms)
+{
+  t_qms_header
+    hdr;
+  int
+    status;
+
+  if (qms == NULL){
+    return;
+  }
+  memset(&hdr,0,sizeof(hdr));
+  hdr.magic   = QMS_MAGIC;
+  hdr.version = QMS_VERSION;
+  hdr.type    = eqmsQUIT;
+  qms_write(qms->fd,&hdr,sizeof(hdr));
+  close(qms->fd);
+  waitpid(qms->pid,&status,0);
+  sfree(qms->ibuf);
+  sfree(qms->buf);
+  sfree(qms);
+}
+
+static void unpack_rvec(int n, double **p, rvec *v)
+{
+#ifdef GMX_DOUBLE
+  memcpy(v,*p,n*sizeof(rvec));
+#else
+  int
+    i,d;
+
+  for (i=0; i<n; i++){
+    for (d=0; d<DIM; d++){
+      v[i][d] = (*p)[i*DIM+d];
+    }
+  }
+#endif
+  *p += n*DIM;
+}
+
+int qm_request_size(int nQM, int nMM)
+{
+  return DIM*nQM+(DIM+1)*nMM;
+}
+
+/* the result layout shared by the server reply and QMBIN_FILE */
+int qm_result_size(int nQM, int nMM)
+{
+  return 5+5*DIM*(nQM+nMM);
+}
+
+void qm_unpack_result(double *p, int nQM, int nMM,
+                      rvec QMgrad_S1[], rvec MMgrad_S1[],
+                      rvec QMgrad_S0[], rvec MMgrad_S0[],
+                      rvec *tdm,
+                      rvec tdmX[], rvec tdmY[], rvec tdmZ[],
+                      rvec tdmXMM[], rvec tdmYMM[], rvec tdmZMM[],
+                      double *QMener, double *Eground)
+{
+  int
+    d;
+
+  *QMener  = p[0];
+  *Eground = p[1];
+  for (d=0; d<DIM; d++){
+    tdm[0][d] = p[2+d];
+  }
+  p += 5;
+  unpack_rvec(nQM,&p,QMgrad_S1);
+  unpack_rvec(nMM,&p,MMgrad_S1);
+  unpack_rvec(nQM,&p,QMgrad_S0);
+  unpack_rvec(nMM,&p,MMgrad_S0);
+  unpack_rvec(nQM,&p,tdmX);
+  unpack_rvec(nQM,&p,tdmY);
+  unpack_rvec(nQM,&p,tdmZ);
+  unpack_rvec(nMM,&p,tdmXMM);
+  unpack_rvec(nMM,&p,tdmYMM);
+  unpack_rvec(nMM,&p,tdmZMM);
+}
+
+unsigned int qm_checksum(const double *data, int n)
+{
+  const unsigned int
+    *w = (const unsigned int *)data;
+  unsigned long long
+    s1=0,s2=0;
+  size_t
+    i,nw=n*sizeof(double)/sizeof(unsigned int);
+
+  for (i=0; i<nw; i++){
+    s1 += w[i];
+    s2 += s1;
+  }
+  return (unsigned int)((s1 ^ s2 ^ (s2 >> 32)) & 0xffffffffULL);
+}
+
+gmx_bool qm_read_binary_output(const char *fn, t_QMrec *qm, t_MMrec *mm,
+                               rvec QMgrad_S1[], rvec MMgrad_S1[],
+                               rvec QMgrad_S0[], rvec MMgrad_S0[],
+                               rvec *tdm,
+                               rvec tdmX[], rvec tdmY[], rvec tdmZ[],
+                               rvec tdmXMM[], rvec tdmYMM[], rvec tdmZMM[],
+                               double *QMener, double *Eground)
+{
+  int
+    fd,ndata;
+  struct stat
+    st;
+  void
+    *map;
+  t_qmbin_header
+    *hdr;
+  double
+    *data;
+
+  fd = open(fn,O_RDONLY);
+  if (fd < 0){
+    if (errno == ENOENT){
+      return FALSE;
+    }
+    gmx_fatal(FARGS,"Can not open %s: %s\n",fn,strerror(errno));
+  }
+  if (fstat(fd,&st) != 0 || st.st_size < (off_t)sizeof(t_qmbin_header)){
+    gmx_fatal(FARGS,"%s is too short for a QM output header\n",fn);
+  }
+  map = mmap(NULL,st.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+  if (map == MAP_FAILED){
+    gmx_fatal(FARGS,"Can not map %s: %s\n",fn,strerror(errno));
+  }
+  hdr   = (t_qmbin_header *)map;
+  data  = (double *)(hdr+1);
+  ndata = qm_result_size(qm->nrQMatoms,mm->nrMMatoms);
+  if (hdr->magic != QMBIN_MAGIC || hdr->version != QMBIN_VERSION){
+    gmx_fatal(FARGS,"%s is not a version %d QM output file\n",fn,QMBIN_VERSION);
+  }
+  if (hdr->units != eqmbinAU){
+    gmx_fatal(FARGS,"%s: unsupported units %d\n",fn,hdr->units);
+  }
+  if (hdr->nrQM != qm->nrQMatoms || hdr->nrMM != mm->nrMMatoms ||
+      hdr->ndata != ndata ||
+      st.st_size != (off_t)(sizeof(t_qmbin_header)+ndata*sizeof(double))){
+    gmx_fatal(FARGS,"%s has %d QM and %d MM atoms (%d values), expected %d and %d\n",
+              fn,hdr->nrQM,hdr->nrMM,hdr->ndata,qm->nrQMatoms,mm->nrMMatoms);
+  }
+  if (hdr->checksum != 0 && hdr->checksum != qm_checksum(data,ndata)){
+    gmx_fatal(FARGS,"Checksum mismatch in %s\n",fn);
+  }
+  qm_unpack_result(data,qm->nrQMatoms,mm->nrMMatoms,
+                   QMgrad_S1,MMgrad_S1,QMgrad_S0,MMgrad_S0,
+                   tdm,tdmX,tdmY,tdmZ,tdmXMM,tdmYMM,tdmZMM,QMener,Eground);
+  munmap(map,st.st_size);
+  close(fd);
+  unlink(fn);
+
+  return TRUE;
+}
+
+void qm_pack_request(t_QMrec *qm, t_MMrec *mm, int *atnum, double *x)
+{
+  int
+    i,d;
+
+  for (i=0; i<qm->nrQMatoms; i++){
+    atnum[i] = qm->atomicnumberQM[i];
+    for (d=0; d<DIM; d++){
+      *x++ = qm->xQM[i][d]/BOHR2NM;
+    }
+  }
+  for (i=0; i<mm->nrMMatoms; i++){
+    for (d=0; d<DIM; d++){
+      *x++ = mm->xMM[i][d]/BOHR2NM;
+    }
+  }
+  for (i=0; i<mm->nrMMatoms; i++){
+    *x++ = mm->MMcharges[i];
+  }
+}
+
+int qm_server_fd(gmx_qm_server_t qms)
+{
+  return qms->fd;
+}
+
+void qm_server_send(gmx_qm_server_t qms, int step, int mol,
+                    int charge, int multiplicity,
+                    int nQM, int nMM, const int *atnum, const double *x)
+{
+  t_qms_header
+    hdr;
+
+  memset(&hdr,0,sizeof(hdr));
+  hdr.magic   = QMS_MAGIC;
+  hdr.version = QMS_VERSION;
+  hdr.type    = eqmsCOMPUTE;
+  hdr.step    = step;
+  hdr.nrQM    = nQM;
+  hdr.nrMM    = nMM;
+  hdr.mol     = mol;
+  hdr.charge  = charge;
+  hdr.multiplicity = multiplicity;
+  if (qms_write(qms->fd,&hdr,sizeof(hdr)) ||
+      qms_write(qms->fd,atnum,nQM*sizeof(int)) ||
+      qms_write(qms->fd,x,qm_request_size(nQM,nMM)*sizeof(double))){
+    gmx_fatal(FARGS,"Lost the connection to QM server %d at step %d\n",
+              (int)qms->pid,step);
+  }
+}
+
+void qm_server_recv(gmx_qm_server_t qms, int step, int mol,
+                    int charge, int multiplicity,
+                    int nQM, int nMM, double *res)
+{
+  t_qms_header
+    hdr;
+
+  if (qms_read(qms->fd,&hdr,sizeof(hdr))){
+    gmx_fatal(FARGS,"Lost the connection to QM server %d at step %d\n",
+              (int)qms->pid,step);
+  }
+  if (hdr.magic != QMS_MAGIC || hdr.version != QMS_VERSION ||
+      hdr.type != eqmsRESULT){
+    gmx_fatal(FARGS,"Unexpected message from QM server %d at step %d\n",
+              (int)qms->pid,step);
+  }
+  if (hdr.status != 0){
+    gmx_fatal(FARGS,"QM server %d failed at step %d with status %d\n",
+              (int)qms->pid,step,hdr.status);
+  }
+  if (hdr.nrQM != nQM || hdr.nrMM != nMM){
+    gmx_fatal(FARGS,"QM server %d returned %d QM and %d MM atoms, expected %d and %d\n",
+              (int)qms->pid,hdr.nrQM,hdr.nrMM,nQM,nMM);
+  }
+  if (hdr.step != step || hdr.mol != mol ||
+      hdr.charge != charge || hdr.multiplicity != multiplicity){
+    gmx_fatal(FARGS,"QM server %d answered step %d, molecule %d, charge %d, multiplicity %d;\n"
+              "expected step %d, molecule %d, charge %d, multiplicity %d\n",
+              (int)qms->pid,hdr.step,hdr.mol,hdr.charge,hdr.multiplicity,
+              step,mol,charge,multiplicity);
+  }
+  if (qms_read(qms->fd,res,qm_result_size(nQM,nMM)*sizeof(double))){
+    gmx_fatal(FARGS,"Lost the connection to QM server %d at step %d\n",
+              (int)qms->pid,step);
+  }
+}
+
+real qm_server_compute(gmx_qm_server_t qms, int step,
+                       t_QMrec *qm, t_MMrec *mm,
+                       rvec QMgrad_S1[], rvec MMgrad_S1[],
+                       rvec QMgrad_S0[], rvec MMgrad_S0[],
+                       rvec *tdm,
+                       rvec tdmX[], rvec tdmY[], rvec tdmZ[],
+                       rvec tdmXMM[], rvec tdmYMM[], rvec tdmZMM[],
+                       double *Eground)
+{
+  int
+    nQM=qm->nrQMatoms,nMM=mm->nrMMatoms,nsend,nrecv;
+  double
+    QMener;
+
+  nsend = qm_request_size(nQM,nMM);
+  nrecv = qm_result_size(nQM,nMM);
+  if (max(nsend,nrecv) > qms->nalloc || nQM > qms->nalloc){
+    qms->nalloc = max(max(nsend,nrecv),nQM);
+    srenew(qms->buf,qms->nalloc);
+    srenew(qms->ibuf,qms->nalloc);
+  }
+  qm_pack_request(qm,mm,qms->ibuf,qms->buf);
+  qm_server_send(qms,step,0,qm->QMcharge,qm->multiplicity,
+                 nQM,nMM,qms->ibuf,qms->buf);
+  qm_server_recv(qms,step,0,qm->QMcharge,qm->multiplicity,
+                 nQM,nMM,qms->buf);
+  qm_unpack_result(qms->buf,nQM,nMM,QMgrad_S1,MMgrad_S1,QMgrad_S0,MMgrad_S0,
+                   tdm,tdmX,tdmY,tdmZ,tdmXMM,tdmYMM,tdmZMM,&QMener,Eground);
+
+  return QMener;
+}
+
+#else
+int
+gmx_qm_server_empty;
+#endif
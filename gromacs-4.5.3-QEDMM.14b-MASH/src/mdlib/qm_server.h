@@ -0,0 +1,207 @@
+/*
+ *
+ *                This source code is part of
+ *
+ *                 G   R   O   M   A   C   S
+ *
+ *          GROningen MAchine for Chemical Simulations
+ *
+ *                        VERSION 3.2.0
+ * Written by David van der Spoel, Erik Lindahl, Berk Hess, and others.
+ * Copyright (c) 1991-2000, University of Groningen, The Netherlands.
+ * Copyright (c) 2001-2004, The GROMACS development team,
+ * check out http://www.gromacs.org for more information.
+
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * If you want to redistribute modifications, please consider that
+ * scientific software is very special. Version control is crucial -
+ * bugs must be traceable. We will be happy to consider code for
+ * inclusion in the official distribution, but derived work must not
+ * be called official GROMACS. Details are found in the README & COPYING
+ * files - if they are missing, get the official version at www.gromacs.org.
+ *
+ * To help us fund GROMACS development, we humbly ask that you cite
+ * the papers on the package - you can find them in the top README file.
+ *
+ * For more info, check our website at http://www.gromacs.org
+ *
+ * And Hey:
+ * Gallium Rubidium Oxygen Manganese Argon Carbon Silicon
+ */
+
+#ifndef _qm_server_h
+#define _qm_server_h
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "typedefs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Persistent QM driver for the QED runs. Instead of writing input.com,
+ * running $GAUSS_EXE through system() and parsing S1.7/S0.7 every step,
+ * the command in $QM_SERVER is started once per molecule in its
+ * subdirectory and kept running. mdrun and the server talk over a
+ * socket connected to the stdin/stdout of the server, with native
+ * binary messages:
+ *
+ * request:  t_qms_header (type eqmsCOMPUTE or eqmsQUIT, with the total
+ *           charge and spin multiplicity of the QM region), then for
+ *           eqmsCOMPUTE
+ *             int    atomic numbers           [nrQM]
+ *             double QM coordinates (bohr)    [3*nrQM]
+ *             double MM coordinates (bohr)    [3*nrMM]
+ *             double MM charges               [nrMM]
+ * reply:    t_qms_header (type eqmsRESULT, status 0 on success, the
+ *           rest as in the request), then
+ *             double E(S1), E(S0), tdm        [5]
+ *             double S1 gradients QM, MM      [3*nrQM], [3*nrMM]
+ *             double S0 gradients QM, MM      [3*nrQM], [3*nrMM]
+ *             double d tdm_x/y/z QM           [3*3*nrQM]
+ *             double d tdm_x/y/z MM           [3*3*nrMM]
+ *
+ * The reply carries the same quantities, in the same units and order,
+ * as the S1.7 and S0.7 files. The server should exit on eqmsQUIT or
+ * end of file on its stdin. A server of a QM pool (see qm_pool.h)
+ * computes all molecules, mol is the molecule (simulation) of its
+ * requests, e.g. to keep restart files per molecule; 0 otherwise.
+ */
+
+#define QMS_MAGIC   0x534d5147 /* "GQMS" */
+#define QMS_VERSION 2
+
+enum { eqmsCOMPUTE, eqmsQUIT, eqmsRESULT, eqmsNR };
+
+typedef struct {
+  int magic;
+  int version;
+  int type;
+  int status;
+  int step;
+  int nrQM;
+  int nrMM;
+  int mol;
+  int charge;
+  int multiplicity;
+} t_qms_header;
+
+typedef struct gmx_qm_server *gmx_qm_server_t;
+
+gmx_qm_server_t qm_server_start(const char *cmd, const char *dir);
+/* Starts cmd through /bin/sh in directory dir, with a socket to mdrun
+ * on its stdin and stdout.
+ */
+
+void qm_server_stop(gmx_qm_server_t qms);
+/* Sends eqmsQUIT, waits for the server to exit and frees qms */
+
+real qm_server_compute(gmx_qm_server_t qms, int step,
+                       t_QMrec *qm, t_MMrec *mm,
+                       rvec QMgrad_S1[], rvec MMgrad_S1[],
+                       rvec QMgrad_S0[], rvec MMgrad_S0[],
+                       rvec *tdm,
+                       rvec tdmX[], rvec tdmY[], rvec tdmZ[],
+                       rvec tdmXMM[], rvec tdmYMM[], rvec tdmZMM[],
+                       double *Eground);
+/* Sends the current QM and MM coordinates and MM charges to the server
+ * and returns E(S1), with the other output as read_gaussian_output_QED
+ * returns it. Fatal errors on a broken connection or a failed server.
+ */
+
+/* The two halves of qm_server_compute, for driving several servers at
+ * once. A request is packed by qm_pack_request, a reply of
+ * qm_result_size doubles unpacked by qm_unpack_result.
+ */
+
+int qm_request_size(int nQM, int nMM);
+int qm_result_size(int nQM, int nMM);
+/* The number of doubles in a request and in a reply */
+
+void qm_pack_request(t_QMrec *qm, t_MMrec *mm, int *atnum, double *x);
+/* The atomic numbers (nrQM) and the coordinates and charges
+ * (qm_request_size) of a request, in atomic units
+ */
+
+void qm_unpack_result(double *res, int nQM, int nMM,
+                      rvec QMgrad_S1[], rvec MMgrad_S1[],
+                      rvec QMgrad_S0[], rvec MMgrad_S0[],
+                      rvec *tdm,
+                      rvec tdmX[], rvec tdmY[], rvec tdmZ[],
+                      rvec tdmXMM[], rvec tdmYMM[], rvec tdmZMM[],
+                      double *QMener, double *Eground);
+
+int qm_server_fd(gmx_qm_server_t qms);
+/* Our end of the socket, readable when the reply has arrived */
+
+void qm_server_send(gmx_qm_server_t qms, int step, int mol,
+                    int charge, int multiplicity,
+                    int nQM, int nMM, const int *atnum, const double *x);
+void qm_server_recv(gmx_qm_server_t qms, int step, int mol,
+                    int charge, int multiplicity,
+                    int nQM, int nMM, double *res);
+/* Send a request as packed by qm_pack_request and receive its reply,
+ * which should echo mol, charge and multiplicity. Fatal errors as
+ * qm_server_compute.
+ */
+
+/* Binary replacement for S1.7 and S0.7. If the QM program (or its
+ * wrapper script) writes QMBIN_FILE in the molecule subdirectory,
+ * read_gaussian_output_QED maps it instead of parsing the text files.
+ * The file is a t_qmbin_header followed by the ndata doubles of an
+ * eqmsRESULT reply, see above. The checksum is computed over the data
+ * as 32-bit words w: s1 += w, s2 += s1 in 64-bit unsigned arithmetic,
+ * checksum = (s1 ^ s2 ^ (s2 >> 32)) & 0xffffffff; 0 means not set.
+ * The file is removed once read, so a stale one is never reused.
+ */
+
+#define QMBIN_FILE    "QMout.bin"
+#define QMBIN_MAGIC   0x4e494251 /* "QBIN" */
+#define QMBIN_VERSION 1
+
+enum { eqmbinAU, eqmbinNR }; /* units: hartree and bohr */
+
+typedef struct {
+  int          magic;
+  int          version;
+  int          nrQM;
+  int          nrMM;
+  int          units;
+  int          ndata;
+  unsigned int checksum;
+  int          pad;
+} t_qmbin_header;
+
+unsigned int qm_checksum(const double *data, int n);
+/* The checksum of n doubles as stored in t_qmbin_header */
+
+gmx_bool qm_read_binary_output(const char *fn, t_QMrec *qm, t_MMrec *mm,
+                               rvec QMgrad_S1[], rvec MMgrad_S1[],
+                               rvec QMgrad_S0[], rvec MMgrad_S0[],
+                               rvec *tdm,
+                               rvec tdmX[], rvec tdmY[], rvec tdmZ[],
+                               rvec tdmXMM[], rvec tdmYMM[], rvec tdmZMM[],
+                               double *QMener, double *Eground);
+/* Maps fn and copies its content into the arrays, with the same
+ * meaning as for qm_server_compute. Returns FALSE if fn does not
+ * exist, fatal errors if it is inconsistent with qm and mm.
+ */
+
+int qms_read(int fd, void *buf, size_t n);
+int qms_write(int fd, const void *buf, size_t n);
+/* Read or write exactly n bytes on fd, retrying on short transfers.
+ * Return 0 on success and -1 on error or end of file.
+ */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif	/* _qm_server_h */
@@ -0,0 +1,309 @@
+/* -*- mode: c; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; c-file-style: "stroustrup"; -*-
+ * $Id: gmx_matrix.c,v 1.4 2008/12/02 18:27:57 spoel Exp $
+ * 
+ *                This source code is part of
+ * 
+ *                 G   R   O   M   A   C   S
+ * 
+ *          GROningen MAchine for Chemical Simulations
+ * 
+ *                        VERSION 4.5
+ * Written by David van der Spoel, Erik Lindahl, Berk Hess, and others.
+ * Copyright (c) 1991-2000, University of Groningen, The Netherlands.
+ * Copyright (c) 2001-2008, The GROMACS development team,
+ * check out http://www.gromacs.org for more information.
+ 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * If you want to redistribute modifications, please consider that
+ * scientific software is very special. Version control is crucial -
+ * bugs must be traceable. We will be happy to consider code for
+ * inclusion in the official distribution, but derived work must not
+ * be called official GROMACS. Details are found in the README & COPYING
+ * files - if they are missing, get the official version at www.gromacs.org.
+ * 
+ * To help us fund GROMACS development, we humbly ask that you cite
+ * the papers on the package - you can find them in the top README file.
+ * 
+ * For more info, check our website at http://www.gromacs.org
+ * 
+ * And Hey:
+ * Groningen Machine for Chemical Simulation
+ */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "typedefs.h"
+#include "smalloc.h"
+#include "macros.h"
+#include "physics.h"
+#include "qm_server.h"
+
+/* Round-trip test of the $QM_SERVER protocol. Started as
+ * "qm_server_test -server" it is a mock QM server, for testing the QED
+ * machinery without a QM program: every QM atom is bound harmonically
+ * to the QM centroid, S1 lies a constant gap above S0 with a stiffer
+ * spring, the transition dipole is constant along x and the MM atoms
+ * feel no force. Run mdrun e.g. with
+ * QM_SERVER="/path/to/qm_server_test -server". A request with a
+ * multiplicity below 1 fails with status 1.
+ *
+ * Without -server it starts itself as the server through
+ * qm_server_start, sends QM regions of different charge and
+ * multiplicity through qm_server_compute and checks the reply: the
+ * echo of step, molecule, charge and multiplicity (qm_server_recv),
+ * the energies, and the S1 and S0 gradients against central finite
+ * differences of the energies. Exits with 1 if any check fails.
+ */
+
+#define KS0  0.05
+#define KS1  0.06
+#define GAP  0.10
+#define TDM  1.00
+
+static int mock_server(void)
+{
+  t_qms_header hdr;
+  int    i,d,nQM,nMM,nrecv,nsend,nalloc=0,*ibuf=NULL;
+  double *buf=NULL,*out=NULL,c[3],dx,r2;
+
+  while (qms_read(STDIN_FILENO,&hdr,sizeof(hdr)) == 0) {
+    if (hdr.magic != QMS_MAGIC || hdr.version != QMS_VERSION) {
+      fprintf(stderr,"qm_server_test: bad message header\n");
+      return 1;
+    }
+    if (hdr.type == eqmsQUIT) {
+      break;
+    }
+    nQM   = hdr.nrQM;
+    nMM   = hdr.nrMM;
+    nrecv = qm_request_size(nQM,nMM);
+    nsend = qm_result_size(nQM,nMM);
+    if (nrecv+nsend+nQM > nalloc) {
+      nalloc = nrecv+nsend+nQM;
+      buf  = realloc(buf,nalloc*sizeof(double));
+      ibuf = realloc(ibuf,nalloc*sizeof(int));
+    }
+    out = buf+nrecv;
+    if (qms_read(STDIN_FILENO,ibuf,nQM*sizeof(int)) ||
+        qms_read(STDIN_FILENO,buf,nrecv*sizeof(double))) {
+      fprintf(stderr,"qm_server_test: truncated request\n");
+      return 1;
+    }
+    memset(out,0,nsend*sizeof(double));
+    for(d=0; (d<3); d++) {
+      c[d] = 0;
+      for(i=0; (i<nQM); i++)
+        c[d] += buf[3*i+d]/nQM;
+    }
+    r2 = 0;
+    for(i=0; (i<nQM); i++) {
+      for(d=0; (d<3); d++) {
+        dx = buf[3*i+d]-c[d];
+        r2 += dx*dx;
+        out[5+3*i+d]                 = KS1*dx;
+        out[5+3*(nQM+nMM)+3*i+d]     = KS0*dx;
+      }
+    }
+    out[0] = GAP+0.5*KS1*r2;
+    out[1] = 0.5*KS0*r2;
+    out[2] = TDM;
+
+    /* the rest of the header is echoed */
+    hdr.type   = eqmsRESULT;
+    hdr.status = (hdr.multiplicity < 1) ? 1 : 0;
+    if (qms_write(STDOUT_FILENO,&hdr,sizeof(hdr)) ||
+        qms_write(STDOUT_FILENO,out,nsend*sizeof(double))) {
+      fprintf(stderr,"qm_server_test: can not send the result\n");
+      return 1;
+    }
+  }
+  free(buf);
+  free(ibuf);
+
+  return 0;
+}
+
+typedef struct {
+  rvec   *QMgrad_S1,*MMgrad_S1,*QMgrad_S0,*MMgrad_S0,tdm[1];
+  rvec   *tdmX,*tdmY,*tdmZ,*tdmXMM,*tdmYMM,*tdmZMM;
+  real   E1;
+  double E0;
+} t_reply;
+
+static void init_reply(t_reply *r, int nQM, int nMM)
+{
+  /* nMM+1, snew of 0 elements gives NULL */
+  snew(r->QMgrad_S1,nQM);
+  snew(r->QMgrad_S0,nQM);
+  snew(r->tdmX,nQM);
+  snew(r->tdmY,nQM);
+  snew(r->tdmZ,nQM);
+  snew(r->MMgrad_S1,nMM+1);
+  snew(r->MMgrad_S0,nMM+1);
+  snew(r->tdmXMM,nMM+1);
+  snew(r->tdmYMM,nMM+1);
+  snew(r->tdmZMM,nMM+1);
+}
+
+static void done_reply(t_reply *r)
+{
+  sfree(r->QMgrad_S1);
+  sfree(r->QMgrad_S0);
+  sfree(r->tdmX);
+  sfree(r->tdmY);
+  sfree(r->tdmZ);
+  sfree(r->MMgrad_S1);
+  sfree(r->MMgrad_S0);
+  sfree(r->tdmXMM);
+  sfree(r->tdmYMM);
+  sfree(r->tdmZMM);
+}
+
+static void compute(gmx_qm_server_t qms, int step, t_QMrec *qm, t_MMrec *mm,
+                    t_reply *r)
+{
+  r->E1 = qm_server_compute(qms,step,qm,mm,r->QMgrad_S1,r->MMgrad_S1,
+                            r->QMgrad_S0,r->MMgrad_S0,r->tdm,
+                            r->tdmX,r->tdmY,r->tdmZ,
+                            r->tdmXMM,r->tdmYMM,r->tdmZMM,&r->E0);
+}
+
+/* the energies of the mock for coordinates x (nm) */
+static void mock_energy(int nQM, rvec x[], double *E1, double *E0)
+{
+  int    i,d;
+  double c,dx,r2=0;
+
+  for (d=0; d<DIM; d++){
+    for (i=0,c=0; i<nQM; i++){
+      c += x[i][d]/BOHR2NM/nQM;
+    }
+    for (i=0; i<nQM; i++){
+      dx  = x[i][d]/BOHR2NM-c;
+      r2 += dx*dx;
+    }
+  }
+  *E1 = GAP+0.5*KS1*r2;
+  *E0 = 0.5*KS0*r2;
+}
+
+int main(int argc,char *argv[])
+{
+  /* nQM, nMM, charge, multiplicity */
+  static const struct { int nQM,nMM,charge,mult; } cases[] = {
+    {  1,  0,  0, 1 },
+    {  3,  4,  0, 1 },
+    {  6, 10,  1, 2 },
+    { 12,  2, -2, 3 }
+  };
+  int           ncase=asize(cases),c,i,d,step=0,nfail=0;
+  double        h=1e-3,E1,E0,de,dg1,dg0;
+  real          x0;
+  char          cmd[STRLEN];
+  t_QMrec       qm;
+  t_MMrec       mm;
+  t_reply       r,rp,rm;
+  gmx_qm_server_t qms;
+#ifdef GMX_DOUBLE
+  double        tol=1e-7;
+#else
+  double        tol=1e-3;
+#endif
+
+  for (i=1; i<argc; i++){
+    if (strcmp(argv[i],"-server") == 0){
+      return mock_server();
+    }
+    else if (strcmp(argv[i],"-tol") == 0 && i+1 < argc){
+      tol = strtod(argv[++i],NULL);
+    }
+  }
+  if (snprintf(cmd,STRLEN,"%s -server",argv[0]) >= STRLEN){
+    fprintf(stderr,"qm_server_test: path too long: %s\n",argv[0]);
+    return 1;
+  }
+  qms = qm_server_start(cmd,NULL);
+  srand48(1);
+
+  printf("%4s %4s %6s %4s %10s %10s %10s\n","nQM","nMM","charge","mult",
+         "dE","dgrad S1","dgrad S0");
+  for (c=0; c<ncase; c++){
+    memset(&qm,0,sizeof(qm));
+    memset(&mm,0,sizeof(mm));
+    qm.nrQMatoms    = cases[c].nQM;
+    qm.QMcharge     = cases[c].charge;
+    qm.multiplicity = cases[c].mult;
+    mm.nrMMatoms    = cases[c].nMM;
+    snew(qm.atomicnumberQM,qm.nrQMatoms);
+    snew(qm.xQM,qm.nrQMatoms);
+    snew(mm.xMM,mm.nrMMatoms+1);
+    snew(mm.MMcharges,mm.nrMMatoms+1);
+    for (i=0; i<qm.nrQMatoms; i++){
+      qm.atomicnumberQM[i] = 6;
+      for (d=0; d<DIM; d++){
+        qm.xQM[i][d] = 0.3*drand48();
+      }
+    }
+    for (i=0; i<mm.nrMMatoms; i++){
+      mm.MMcharges[i] = drand48()-0.5;
+      for (d=0; d<DIM; d++){
+        mm.xMM[i][d] = 2*drand48();
+      }
+    }
+    init_reply(&r,qm.nrQMatoms,mm.nrMMatoms);
+    init_reply(&rp,qm.nrQMatoms,mm.nrMMatoms);
+    init_reply(&rm,qm.nrQMatoms,mm.nrMMatoms);
+
+    /* qm_server_recv checks the echo of step, charge and multiplicity */
+    compute(qms,step++,&qm,&mm,&r);
+    mock_energy(qm.nrQMatoms,qm.xQM,&E1,&E0);
+    de = max(fabs(r.E1-E1),fabs(r.E0-E0));
+    de = max(de,fabs(r.tdm[0][XX]-TDM));
+
+    /* central differences of the energies the server returns, h in bohr */
+    dg1 = dg0 = 0;
+    for (i=0; i<qm.nrQMatoms; i++){
+      for (d=0; d<DIM; d++){
+        x0 = qm.xQM[i][d];
+        qm.xQM[i][d] = x0+h*BOHR2NM;
+        compute(qms,step++,&qm,&mm,&rp);
+        qm.xQM[i][d] = x0-h*BOHR2NM;
+        compute(qms,step++,&qm,&mm,&rm);
+        qm.xQM[i][d] = x0;
+        dg1 = max(dg1,fabs(r.QMgrad_S1[i][d]-(rp.E1-rm.E1)/(2*h)));
+        dg0 = max(dg0,fabs(r.QMgrad_S0[i][d]-(rp.E0-rm.E0)/(2*h)));
+      }
+    }
+    printf("%4d %4d %6d %4d %10.2e %10.2e %10.2e\n",cases[c].nQM,
+           cases[c].nMM,cases[c].charge,cases[c].mult,de,dg1,dg0);
+    if (de > tol || dg1 > tol || dg0 > tol){
+      nfail++;
+    }
+    done_reply(&r);
+    done_reply(&rp);
+    done_reply(&rm);
+    sfree(qm.atomicnumberQM);
+    sfree(qm.xQM);
+    sfree(mm.xMM);
+    sfree(mm.MMcharges);
+  }
+  qm_server_stop(qms);
+
+  if (nfail > 0){
+    printf("FAILED: %d of %d cases\n",nfail,ncase);
+    return 1;
+  }
+  printf("passed\n");
+
+  return 0;
+}
@@ -64,66 +64,14 @@
 #include "typedefs.h"
 #include <stdlib.h>
 #include "mtop_util.h"
-
-
-/* declarations of the interfaces to the QM packages. The _SH indicate
- * the QM interfaces can be used for Surface Hopping simulations 
- */
-#ifdef GMX_QMMM_GAMESS
-/* GAMESS interface */
-
-void 
-init_gamess(t_commrec *cr, t_QMrec *qm, t_MMrec *mm);
-
-real 
-call_gamess(t_commrec *cr,t_forcerec *fr,
-            t_QMrec *qm, t_MMrec *mm,rvec f[], rvec fshift[]);
-
-#elif defined GMX_QMMM_MOPAC
-/* MOPAC interface */
-
-void 
-init_mopac(t_commrec *cr, t_QMrec *qm, t_MMrec *mm);
-
-real 
-call_mopac(t_commrec *cr,t_forcerec *fr, t_QMrec *qm, 
-           t_MMrec *mm,rvec f[], rvec fshift[]);
-
-real 
-call_mopac_SH(t_commrec *cr,t_forcerec *fr,t_QMrec *qm, 
-              t_MMrec *mm,rvec f[], rvec fshift[]);
-
-#elif defined GMX_QMMM_GAUSSIAN
-/* GAUSSIAN interface */
-
-void 
-init_gaussian(t_commrec *cr ,t_QMrec *qm, t_MMrec *mm);
-
-real 
-call_gaussian_SH(t_commrec *cr,t_forcerec *fr,t_QMrec *qm, 
-                 t_MMrec *mm,rvec f[], rvec fshift[]);
-
-real 
-call_gaussian(t_commrec *cr,t_forcerec *fr, t_QMrec *qm,
-              t_MMrec *mm,rvec f[], rvec fshift[]);
-
-real 
-call_gaussian_QED(t_commrec *cr,t_forcerec *fr, t_QMrec *qm,
-              t_MMrec *mm,rvec f[], rvec fshift[]);
-
-#elif defined GMX_QMMM_ORCA
-/* ORCA interface */
-
-void 
-init_orca(t_commrec *cr ,t_QMrec *qm, t_MMrec *mm);
-
-real 
-call_orca(t_commrec *cr,t_forcerec *fr, t_QMrec *qm,
-              t_MMrec *mm,rvec f[], rvec fshift[]);
-
-#endif
-
-
+#include "qmmm_lr.h"
+#include "qm_backend.h"
+#include "string2.h"
+#include <unistd.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
 
 
 /* this struct and these comparison functions are needed for creating
@@ -147,6 +95,174 @@ static int int_comp(const void *a,const void *b){
   
 } /* int_comp */
 
+/* The MM embedding of the normal QM/MM scheme only changes when the
+ * QMMM neighbourlist is rebuilt. Every node keeps the sorted j-particles
+ * it contributed at the last search step, and the global list counts for
+ * each MM atom on how many nodes it was found. After a search step only
+ * the differences are exchanged and merged into the global list.
+ */
+typedef struct {
+  int      j;
+  int      shift;
+  int      n;      /* +1 atom entered the list, -1 it left */
+} t_mm_delta;
+
+typedef struct gmx_qmmm_embed {
+  int           nlocal;
+  int           nalloc_local;
+  t_j_particle  *local;     /* sorted j-particles of this node          */
+  int           *count;     /* nodes contributing indexMM[i]            */
+  int           *shiftsum;  /* sum of the shifts of these contributions */
+  int           ndelta;
+  int           nalloc_delta;
+  t_mm_delta    *delta;
+} t_qmmm_embed;
+
+static int delta_comp(const void *a, const void *b){
+
+  return (int)(((t_mm_delta *)a)->j)-(int)(((t_mm_delta *)b)->j);
+
+} /* delta_comp */
+
+static void add_delta(t_qmmm_embed *emb, int j, int shift, int n){
+
+  if(emb->ndelta >= emb->nalloc_delta){
+    emb->nalloc_delta = over_alloc_large(emb->ndelta+1);
+    srenew(emb->delta,emb->nalloc_delta);
+  }
+  emb->delta[emb->ndelta].j     = j;
+  emb->delta[emb->ndelta].shift = shift;
+  emb->delta[emb->ndelta].n     = n;
+  emb->ndelta++;
+} /* add_delta */
+
+static void diff_local_MM(t_qmmm_embed *emb, int nr, t_j_particle *mm_j){
+  /* compares the new (sorted) j-particles of this node with those of
+   * the previous search step and stores the differences in emb->delta
+   */
+  int
+    i=0,k=0;
+  t_j_particle
+    *old=emb->local;
+
+  emb->ndelta = 0;
+  while(i < emb->nlocal || k < nr){
+    if(k == nr || (i < emb->nlocal && old[i].j < mm_j[k].j)){
+      add_delta(emb,old[i].j,old[i].shift,-1);
+      i++;
+    }
+    else if(i == emb->nlocal || mm_j[k].j < old[i].j){
+      add_delta(emb,mm_j[k].j,mm_j[k].shift,1);
+      k++;
+    }
+    else{
+      if(old[i].shift != mm_j[k].shift){
+	add_delta(emb,old[i].j,old[i].shift,-1);
+	add_delta(emb,mm_j[k].j,mm_j[k].shift,1);
+      }
+      i++;
+      k++;
+    }
+  }
+  if(nr > emb->nalloc_local){
+    emb->nalloc_local = over_alloc_large(nr);
+    srenew(emb->local,emb->nalloc_local);
+  }
+  for(i=0;i<nr;i++){
+    emb->local[i] = mm_j[i];
+  }
+  emb->nlocal = nr;
+} /* diff_local_MM */
+
+static void gather_MM_deltas(t_commrec *cr, t_qmmm_embed *emb){
+  /* collects the differences of all nodes on all nodes. Only the
+   * entries that changed are communicated.
+   */
+  int
+    i,offset=0,ntot=0,*nnode,*buf;
+
+  snew(nnode,cr->nnodes);
+  nnode[cr->nodeid] = emb->ndelta;
+  gmx_sumi(cr->nnodes,nnode,cr);
+  for(i=0;i<cr->nnodes;i++){
+    if(i < cr->nodeid){
+      offset += nnode[i];
+    }
+    ntot += nnode[i];
+  }
+  if(ntot){
+    snew(buf,3*ntot);
+    for(i=0;i<emb->ndelta;i++){
+      buf[3*(offset+i)  ] = emb->delta[i].j;
+      buf[3*(offset+i)+1] = emb->delta[i].shift;
+      buf[3*(offset+i)+2] = emb->delta[i].n;
+    }
+    gmx_sumi(3*ntot,buf,cr);
+    emb->ndelta = 0;
+    for(i=0;i<ntot;i++){
+      add_delta(emb,buf[3*i],buf[3*i+1],buf[3*i+2]);
+    }
+    sfree(buf);
+    qsort(emb->delta,emb->ndelta,(size_t)sizeof(emb->delta[0]),delta_comp);
+  }
+  else{
+    emb->ndelta = 0;
+  }
+  sfree(nnode);
+} /* gather_MM_deltas */
+
+static void merge_MM_deltas(t_qmmm_embed *emb, t_MMrec *mm){
+  /* applies the (sorted) differences to the global MM list. Atoms
+   * that no node contributes anymore are removed.
+   */
+  int
+    i=0,k=0,nr=0,nmax,j,c,s,*index,*shift,*count,*shiftsum;
+
+  nmax = mm->nrMMatoms + emb->ndelta;
+  snew(index,nmax);
+  snew(shift,nmax);
+  snew(count,nmax);
+  snew(shiftsum,nmax);
+  while(i < mm->nrMMatoms || k < emb->ndelta){
+    if(k == emb->ndelta || (i < mm->nrMMatoms && mm->indexMM[i] < emb->delta[k].j)){
+      j = mm->indexMM[i];
+      c = emb->count[i];
+      s = emb->shiftsum[i];
+      i++;
+    }
+    else{
+      j = emb->delta[k].j;
+      c = 0;
+      s = 0;
+      if(i < mm->nrMMatoms && mm->indexMM[i] == j){
+	c = emb->count[i];
+	s = emb->shiftsum[i];
+	i++;
+      }
+      for(;k < emb->ndelta && emb->delta[k].j == j;k++){
+	c += emb->delta[k].n;
+	s += emb->delta[k].n*emb->delta[k].shift;
+      }
+    }
+    if(c > 0){
+      index[nr]    = j;
+      count[nr]    = c;
+      shiftsum[nr] = s;
+      shift[nr]    = s/c;
+      nr++;
+    }
+  }
+  sfree(mm->indexMM);
+  sfree(mm->shiftMM);
+  sfree(emb->count);
+  sfree(emb->shiftsum);
+  mm->indexMM   = index;
+  mm->shiftMM   = shift;
+  emb->count    = count;
+  emb->shiftsum = shiftsum;
+  mm->nrMMatoms = nr;
+} /* merge_MM_deltas */
+
 static int QMlayer_comp(const void *a, const void *b){
   
   return (int)(((t_QMrec *)a)->nrQMatoms)-(int)(((t_QMrec *)b)->nrQMatoms);
@@ -164,85 +280,17 @@ void sort_QMlayers(t_QMMMrec *qr){
 real call_QMroutine(t_commrec *cr, t_forcerec *fr, t_QMrec *qm, 
 		    t_MMrec *mm, rvec f[], rvec fshift[])
 {
-  /* makes a call to the requested QM routine (qm->QMmethod) 
-   * Note that f is actually the gradient, i.e. -f
+  /* makes a call to the QM program of this group (qm->backend, see
+   * qm_backend.h). Note that f is actually the gradient, i.e. -f
    */
-  real
-    QMener=0.0;
-
-    /* do a semi-empiprical calculation */
-    
-    if (qm->QMmethod<eQMmethodRHF && !(mm->nrMMatoms))
-    {
-#ifdef GMX_QMMM_MOPAC
-        if (qm->bSH)
-            QMener = call_mopac_SH(cr,fr,qm,mm,f,fshift);
-        else
-            QMener = call_mopac(cr,fr,qm,mm,f,fshift);
-#else
-        gmx_fatal(FARGS,"Semi-empirical QM only supported with Mopac.");
-#endif
-    }
-    else
-    {
-        /* do an ab-initio calculation */
-        if (qm->bSH)
-        {
-#ifdef GMX_QMMM_GAUSSIAN            
-            QMener = call_gaussian_SH(cr,fr,qm,mm,f,fshift);
-#else
-            gmx_fatal(FARGS,"Ab-initio Surface-hopping only supported with Gaussian.");
-#endif
-        }
-	else if (qm->bQED)
-	  {
-#ifdef GMX_QMMM_GAUSSIAN 
-            QMener = call_gaussian_QED(cr,fr,qm,mm,f,fshift);
-#else
-            gmx_fatal(FARGS,"cavity QED MD only supported with Gaussian.\n");
-#endif	    
-	  }
-        else
-        {
-#ifdef GMX_QMMM_GAMESS
-            QMener = call_gamess(cr,fr,qm,mm,f,fshift);
-#elif defined GMX_QMMM_GAUSSIAN
-            QMener = call_gaussian(cr,fr,qm,mm,f,fshift);
-#elif defined GMX_QMMM_ORCA
-            QMener = call_orca(cr,fr,qm,mm,f,fshift);
-#else
-            gmx_fatal(FARGS,"Ab-initio calculation only supported with Gamess, Gaussian or ORCA.");
-#endif
-        }
-    }
-    return (QMener);
-}
+  return (qm->backend->compute(cr,fr,qm,mm,f,fshift));
+} /* call_QMroutine */
 
 void init_QMroutine(t_commrec *cr, t_QMrec *qm, t_MMrec *mm)
 {
-    /* makes a call to the requested QM routine (qm->QMmethod) 
-     */
-    if (qm->QMmethod<eQMmethodRHF){
-#ifdef GMX_QMMM_MOPAC
-        /* do a semi-empiprical calculation */
-        init_mopac(cr,qm,mm);
-#else
-        gmx_fatal(FARGS,"Semi-empirical QM only supported with Mopac.");
-#endif
-    }
-    else 
-    {
-        /* do an ab-initio calculation */
-#ifdef GMX_QMMM_GAMESS
-        init_gamess(cr,qm,mm);
-#elif defined GMX_QMMM_GAUSSIAN
-        init_gaussian(cr,qm,mm);
-#elif defined GMX_QMMM_ORCA
-        init_orca(cr,qm,mm);
-#else
-        gmx_fatal(FARGS,"Ab-initio calculation only supported with Gamess, Gaussian or ORCA.");   
-#endif
-    }
+  /* initialises the QM program of this group
+   */
+  qm->backend->init(cr,qm,mm);
 } /* init_QMroutine */
 
 void update_QMMM_coord(rvec x[],rvec v[], t_forcerec *fr, t_QMrec *qm, t_MMrec *mm)
@@ -397,7 +445,7 @@ static void init_QMrec(int grpnr, t_QMrec *qm,int nr, int *atomarray,
 			   */
   /* print the current layer to allow users to check their input */
   fprintf(stderr,"Layer %d\nnr of QM atoms %d\n",grpnr,nr);
-  fprintf(stderr,"QMlevel: %s/%s\n\n",
+  fprintf(stderr,"QMlevel: %s/%s\n",
 	  eQMmethod_names[qm->QMmethod],eQMbasis_names[qm->QMbasis]);
   
   /* frontier atoms */
@@ -411,6 +459,10 @@ static void init_QMrec(int grpnr, t_QMrec *qm,int nr, int *atomarray,
   qm->bOPT     = ir->opts.bOPT[grpnr];
 
   qm->nsteps   = (int) ir->nsteps;
+  /* the QM program, MM point charges only in the normal scheme */
+  qm_backend_select(qm,ir->opts.QMprogram[grpnr],
+                    ir->QMMMscheme!=eQMMMschemeoniom);
+  fprintf(stderr,"QM program: %s\n\n",qm->backend->name);
   /* input and field needed for the decoherence correction
    */
   snew(qm->ffmass, qm->nrQMatoms);
@@ -446,6 +498,8 @@ t_QMrec *copy_QMrec(t_QMrec *qm)
   qmcopy->nelectrons   = qm->nelectrons;
   qmcopy->QMmethod     = qm->QMmethod; 
   qmcopy->QMbasis      = qm->QMbasis;  
+  qmcopy->QMprogram    = qm->QMprogram;
+  qmcopy->backend      = qm->backend;
   /* trajectory surface hopping setup (Gaussian only) */
   qmcopy->bSH          = qm->bSH;
   qmcopy->CASorbitals  = qm->CASorbitals;
@@ -486,6 +540,404 @@ t_QMrec *copy_QMrec(t_QMrec *qm)
 
 } /*copy_QMrec */
 
+/* Multi-layer ONIOM. Every layer but the last is computed at its own
+ * level of theory and, with the atoms of that layer, at the level of
+ * the next layer. These 2*nrQMlayers-1 QM calculations are independent
+ * and each one keeps its QM record and a scratch directory for the
+ * whole run, so the QM programs can not overwrite each others input,
+ * checkpoint and output files. With process creation available the
+ * jobs are run as concurrent child processes, $QMMM_ONIOM_NPAR sets
+ * how many may run at the same time (default all), 1 runs them one
+ * after another in mdrun itself. The scratch directories are made in
+ * $QMMM_ONIOM_DIR, or in the working directory if not set.
+ */
+typedef struct {
+  t_QMrec  *qm;      /* layer record, or the lower level copy    */
+  real     sign;     /* +1 higher level, -1 lower level          */
+  gmx_bool bReinit;  /* init_QMroutine before every call         */
+  char     *dir;     /* scratch directory                        */
+  rvec     *f;       /* gradient and shift gradient of the job   */
+  rvec     *fshift;
+  real     ener;
+#ifndef GMX_NO_SYSTEM
+  pid_t    pid;
+  int      fd;       /* read end of the pipe from the child      */
+#endif
+} t_oniom_job;
+
+typedef struct gmx_qmmm_oniom {
+  int          njob;
+  t_oniom_job  *job;
+  int          npar;
+  char         *cwd;
+} t_qmmm_oniom;
+
+static gmx_bool oniom_reinit(t_QMrec *qm){
+  /* the QM routines that are linked in keep their setup in COMMON
+   * blocks, these have to be set up again for each layer
+   */
+  return (qm->backend->caps & eQMcapREINIT);
+} /* oniom_reinit */
+
+static void oniom_chdir(const char *dir){
+
+  if(chdir(dir) != 0){
+    gmx_fatal(FARGS,"Can not change to ONIOM directory %s\n",dir);
+  }
+} /* oniom_chdir */
+
+static t_QMrec *mk_oniom_lower(t_QMrec *qm, t_QMrec *next){
+  /* the atoms of layer qm with the method of layer next */
+  t_QMrec
+    *low;
+  int
+    i;
+
+  low = copy_QMrec(next);
+  low->nrQMatoms = qm->nrQMatoms;
+  srenew(low->xQM,qm->nrQMatoms);
+  srenew(low->indexQM,qm->nrQMatoms);
+  srenew(low->atomicnumberQM,qm->nrQMatoms);
+  srenew(low->shiftQM,qm->nrQMatoms);
+  srenew(low->frontatoms,qm->nrQMatoms);
+  srenew(low->c6,qm->nrQMatoms);
+  srenew(low->c12,qm->nrQMatoms);
+  for(i=0;i<qm->nrQMatoms;i++){
+    low->indexQM[i]        = qm->indexQM[i];
+    low->atomicnumberQM[i] = qm->atomicnumberQM[i];
+    low->frontatoms[i]     = qm->frontatoms[i];
+    low->c6[i]             = qm->c6[i];
+    low->c12[i]            = qm->c12[i];
+  }
+  low->QMcharge = qm->QMcharge;
+  /* gaussian only reads its settings into records without nQMcpus */
+  low->nQMcpus  = 0;
+
+  return(low);
+} /* mk_oniom_lower */
+
+static t_qmmm_oniom *init_QMMM_oniom(t_commrec *cr, t_QMMMrec *qr){
+  t_qmmm_oniom
+    *on;
+  t_oniom_job
+    *job;
+  t_QMrec
+    *qm;
+  char
+    *base,*env;
+  int
+    i,k;
+  gmx_bool
+    bState=FALSE;
+
+  snew(on,1);
+  on->njob = 2*qr->nrQMlayers-1;
+  snew(on->job,on->njob);
+  snew(on->cwd,STRLEN);
+  if(getcwd(on->cwd,STRLEN) == NULL){
+    gmx_fatal(FARGS,"Can not determine the working directory\n");
+  }
+  base = getenv("QMMM_ONIOM_DIR");
+  if(base == NULL){
+    base = on->cwd;
+  }
+  for(k=0;k<on->njob;k++){
+    job = &on->job[k];
+    i   = k/2;
+    if(k == on->njob-1 || k%2 == 0){
+      job->qm   = qr->qm[i];
+      job->sign = 1;
+    }
+    else{
+      job->qm   = mk_oniom_lower(qr->qm[i],qr->qm[i+1]);
+      job->sign = -1;
+    }
+    qm = job->qm;
+    bState = bState || qm->bSH || qm->bQED;
+    snew(job->f,qm->nrQMatoms+qr->mm->nrMMatoms);
+    snew(job->fshift,qm->nrQMatoms+qr->mm->nrMMatoms);
+    snew(job->dir,STRLEN);
+    if(MULTISIM(cr)){
+      sprintf(job->dir,"%s/oniom%d_%d",base,k,cr->ms->sim);
+    }
+    else{
+      sprintf(job->dir,"%s/oniom%d",base,k);
+    }
+    if(mkdir(job->dir,0755) != 0 && errno != EEXIST){
+      gmx_fatal(FARGS,"Can not create ONIOM directory %s: %s\n",
+		job->dir,strerror(errno));
+    }
+    /* the setup is done once, except for the linked in QM routines */
+    job->bReinit = oniom_reinit(qm);
+    if(!job->bReinit){
+      oniom_chdir(job->dir);
+      init_QMroutine(cr,qm,qr->mm);
+      oniom_chdir(on->cwd);
+    }
+  }
+  on->npar = on->njob;
+  env = getenv("QMMM_ONIOM_NPAR");
+  if(env){
+    on->npar = max(1,strtol(env,NULL,10));
+  }
+#ifdef GMX_NO_SYSTEM
+  on->npar = 1;
+#endif
+  if(bState && on->npar > 1){
+    /* surface hopping and cavity QED keep their state in the QMrec */
+    fprintf(stderr,"ONIOM layers with state between steps, "
+	    "running the layer jobs one at a time\n");
+    on->npar = 1;
+  }
+  fprintf(stderr,"ONIOM: %d QM jobs per step in %s/oniom*, %d at a time\n",
+	  on->njob,base,on->npar);
+
+  return(on);
+} /* init_QMMM_oniom */
+
+static void run_oniom_job(t_commrec *cr, t_forcerec *fr, t_MMrec *mm,
+			  t_oniom_job *job){
+  if(job->bReinit){
+    init_QMroutine(cr,job->qm,mm);
+  }
+  job->ener = call_QMroutine(cr,fr,job->qm,mm,job->f,job->fshift);
+} /* run_oniom_job */
+
+#ifndef GMX_NO_SYSTEM
+static int oniom_io(int fd, void *buf, size_t n, gmx_bool bWrite){
+  char
+    *p = buf;
+  ssize_t
+    nr;
+
+  while(n > 0){
+    nr = bWrite ? write(fd,p,n) : read(fd,p,n);
+    if(nr < 0 && errno == EINTR){
+      continue;
+    }
+    if(nr <= 0){
+      return -1;
+    }
+    p += nr;
+    n -= nr;
+  }
+  return 0;
+} /* oniom_io */
+
+static void start_oniom_job(t_commrec *cr, t_forcerec *fr, t_MMrec *mm,
+			    t_oniom_job *job){
+  /* runs the job in a child process, which returns the energy, the
+   * gradients, the coordinates (changed by TS and OPT) and the QM step
+   * counter through a pipe
+   */
+  int
+    fd[2],n,status=0;
+
+  if(pipe(fd) != 0){
+    gmx_fatal(FARGS,"Can not create a pipe for an ONIOM job: %s\n",
+	      strerror(errno));
+  }
+  n = job->qm->nrQMatoms+mm->nrMMatoms;
+  fflush(stdout);
+  fflush(stderr);
+  job->pid = fork();
+  if(job->pid < 0){
+    gmx_fatal(FARGS,"Can not start an ONIOM job: %s\n",strerror(errno));
+  }
+  if(job->pid == 0){
+    close(fd[0]);
+    oniom_chdir(job->dir);
+    run_oniom_job(cr,fr,mm,job);
+    if(oniom_io(fd[1],&job->ener,sizeof(real),TRUE) != 0 ||
+       oniom_io(fd[1],&job->qm->QMstep,sizeof(int),TRUE) != 0 ||
+       oniom_io(fd[1],job->f,n*sizeof(rvec),TRUE) != 0 ||
+       oniom_io(fd[1],job->fshift,n*sizeof(rvec),TRUE) != 0 ||
+       oniom_io(fd[1],job->qm->xQM,job->qm->nrQMatoms*sizeof(rvec),TRUE) != 0){
+      status = 1;
+    }
+    fflush(stdout);
+    fflush(stderr);
+    _exit(status);
+  }
+  close(fd[1]);
+  job->fd = fd[0];
+} /* start_oniom_job */
+
+static void finish_oniom_job(t_MMrec *mm, t_oniom_job *job){
+  int
+    n,status;
+  gmx_bool
+    bOK;
+
+  n = job->qm->nrQMatoms+mm->nrMMatoms;
+  bOK = (oniom_io(job->fd,&job->ener,sizeof(real),FALSE) == 0 &&
+	 oniom_io(job->fd,&job->qm->QMstep,sizeof(int),FALSE) == 0 &&
+	 oniom_io(job->fd,job->f,n*sizeof(rvec),FALSE) == 0 &&
+	 oniom_io(job->fd,job->fshift,n*sizeof(rvec),FALSE) == 0 &&
+	 oniom_io(job->fd,job->qm->xQM,
+		  job->qm->nrQMatoms*sizeof(rvec),FALSE) == 0);
+  close(job->fd);
+  while(waitpid(job->pid,&status,0) < 0 && errno == EINTR)
+    ;
+  if(!bOK || !WIFEXITED(status) || WEXITSTATUS(status) != 0){
+    gmx_fatal(FARGS,"ONIOM job in %s failed\n",job->dir);
+  }
+} /* finish_oniom_job */
+#endif
+
+static real calculate_QMMM_oniom(t_commrec *cr, t_forcerec *fr,
+				 rvec f[], rvec fshift[]){
+  t_QMMMrec
+    *qr=fr->qr;
+  t_qmmm_oniom
+    *on=qr->oniom;
+  t_oniom_job
+    *job;
+  t_QMrec
+    *qm;
+  real
+    QMener=0.0;
+  int
+    i,j,k;
+
+  /* the lower level copies follow the coordinates of their layer */
+  for(k=1;k<on->njob;k+=2){
+    qm = qr->qm[k/2];
+    for(i=0;i<qm->nrQMatoms;i++){
+      copy_rvec(qm->xQM[i],on->job[k].qm->xQM[i]);
+      on->job[k].qm->shiftQM[i] = qm->shiftQM[i];
+    }
+  }
+  if(on->npar == 1){
+    for(k=0;k<on->njob;k++){
+      oniom_chdir(on->job[k].dir);
+      run_oniom_job(cr,fr,qr->mm,&on->job[k]);
+      oniom_chdir(on->cwd);
+    }
+  }
+#ifndef GMX_NO_SYSTEM
+  else{
+    for(k=0;k<on->njob;k++){
+      if(k >= on->npar){
+	finish_oniom_job(qr->mm,&on->job[k-on->npar]);
+      }
+      start_oniom_job(cr,fr,qr->mm,&on->job[k]);
+    }
+    for(k=max(0,on->njob-on->npar);k<on->njob;k++){
+      finish_oniom_job(qr->mm,&on->job[k]);
+    }
+  }
+#endif
+  /* E = E1high-E1low+E2high-E2low+...+Elast. The next layer includes
+   * the current layer at the lower level of theory, this is similar
+   * for the gradients.
+   */
+  for(k=0;k<on->njob;k++){
+    job = &on->job[k];
+    qm  = job->qm;
+    QMener += job->sign*job->ener;
+    for(i=0;i<qm->nrQMatoms;i++){
+      for(j=0;j<DIM;j++){
+	f[qm->indexQM[i]][j]          -= job->sign*job->f[i][j];
+	fshift[qm->shiftQM[i]][j]     += job->sign*job->fshift[i][j];
+      }
+    }
+  }
+  return(QMener);
+} /* calculate_QMMM_oniom */
+
+/* Multiple time stepping of the QM force, switched on with
+ * $QMMM_MTS=N. The QM/MM force is computed every N steps only. With
+ * $QMMM_MTS_FORCE=impulse (default) it is applied N times as large on
+ * those steps and not in between, the RESPA impulse scheme for a
+ * leap-frog integrator. With extrapolate it is applied every step,
+ * linearly extrapolated from the last two QM steps. N has to divide
+ * nstlist, so the MM embedding only changes on QM steps. QM programs
+ * that propagate an electronic state (cavity QED, Ehrenfest only) are
+ * still called on the inner steps with qm->bMTSinner set; they then
+ * propagate with the QM results of the last QM step, their forces are
+ * not used. The
+ * far field term of $QMMM_PME_EMBED is not part of the QM force and is
+ * applied every step.
+ */
+typedef struct gmx_qmmm_mts {
+  int      nst;         /* QM force every nst steps                  */
+  gmx_bool bExtrap;     /* extrapolate instead of impulse            */
+  int      istep;       /* step in the current cycle                 */
+  int      nqm;         /* number of QM steps so far                 */
+  int      nalloc;
+  rvec     *f,*fprev;   /* QM/MM force of the last two QM steps      */
+  rvec     *finner;     /* forces of the inner steps, not used       */
+  rvec     fshift[SHIFTS],fshiftprev[SHIFTS];
+  real     ener,enerprev;
+  gmx_bool bPropagate;  /* call the QM program on the inner steps    */
+} t_qmmm_mts;
+
+static t_qmmm_mts *init_QMMM_mts(t_inputrec *ir, t_QMMMrec *qr){
+  t_qmmm_mts
+    *mts;
+  char
+    *env;
+  int
+    i,nst;
+  t_QMrec
+    *qm;
+
+  env = getenv("QMMM_MTS");
+  nst = env ? strtol(env,NULL,10) : 1;
+  if(nst <= 1){
+    return(NULL);
+  }
+  if(!EI_DYNAMICS(ir->eI)){
+    gmx_fatal(FARGS,"$QMMM_MTS is only supported with dynamical integrators\n");
+  }
+  if(ir->nstlist <= 0 || ir->nstlist % nst != 0){
+    gmx_fatal(FARGS,"$QMMM_MTS=%d should divide nstlist (%d)\n",
+	      nst,ir->nstlist);
+  }
+  snew(mts,1);
+  mts->nst = nst;
+  env = getenv("QMMM_MTS_FORCE");
+  if(env == NULL || gmx_strcasecmp(env,"impulse") == 0){
+    mts->bExtrap = FALSE;
+  }
+  else if(gmx_strcasecmp(env,"extrapolate") == 0){
+    mts->bExtrap = TRUE;
+  }
+  else{
+    gmx_fatal(FARGS,"$QMMM_MTS_FORCE = %s, should be impulse or extrapolate\n",
+	      env);
+  }
+  for(i=0;i<qr->nrQMlayers;i++){
+    qm = qr->qm[i];
+    if(qm->bSH || qm->bTS || qm->bOPT){
+      gmx_fatal(FARGS,"$QMMM_MTS does not support surface hopping or "
+		"QM optimisation\n");
+    }
+    if(qm->bQED){
+      if(!(qm->backend->caps & eQMcapMTS) || qr->nrQMlayers > 1){
+	gmx_fatal(FARGS,"QM program %s can not propagate on the inner "
+		  "$QMMM_MTS steps\n",qm->backend->name);
+      }
+      /* hops and velocity adjustments would act on the stale QM
+       * results of the inner steps
+       */
+      if(qr->SHmethod != eSHmethodEhrenfest){
+	gmx_fatal(FARGS,"$QMMM_MTS with cavity QED only supports "
+		  "SHmethod = %s, not %s\n",
+		  eSHmethod_names[eSHmethodEhrenfest],
+		  eSHmethod_names[qr->SHmethod]);
+      }
+      mts->bPropagate = TRUE;
+    }
+  }
+  fprintf(stderr,"QM/MM force every %d steps, %s in between%s\n",nst,
+	  mts->bExtrap ? "extrapolated" : "impulse",
+	  mts->bPropagate ? ", QED propagation every step" : "");
+
+  return(mts);
+} /* init_QMMM_mts */
+
 t_QMMMrec *mk_QMMMrec(void)
 {
 
@@ -497,6 +949,66 @@ t_QMMMrec *mk_QMMMrec(void)
 
 } /* mk_QMMMrec */
 
+void init_QMMM_MMtables(t_MMrec *mm, const gmx_mtop_t *mtop,
+                        int ntype, real *nbfp, gmx_bool bLJ)
+{
+  /* fills the per atom tables of the MM record in one pass over the
+   * topology, such that the MM arrays can later be gathered with the
+   * atom index alone
+   */
+  gmx_mtop_atomloop_all_t
+    aloop;
+  t_atom
+    *atom;
+  int
+    a;
+  real
+    c12au,c6au;
+
+  c6au  = (HARTREE2KJ*AVOGADRO*pow(BOHR2NM,6)); 
+  c12au = (HARTREE2KJ*AVOGADRO*pow(BOHR2NM,12)); 
+
+  snew(mm->atom_mass,mtop->natoms);
+  snew(mm->atom_charge,mtop->natoms);
+  if(bLJ){
+    snew(mm->atom_c6,mtop->natoms);
+    snew(mm->atom_c12,mtop->natoms);
+  }
+  aloop = gmx_mtop_atomloop_all_init(mtop);
+  while (gmx_mtop_atomloop_all_next(aloop,&a,&atom)){
+    mm->atom_mass[a]   = atom->m;
+    /* no free energy yet */
+    mm->atom_charge[a] = atom->q*mm->scalefactor;
+    if(bLJ){
+      mm->atom_c6[a]  = C6(nbfp,ntype,atom->type,atom->type)/c6au;
+      mm->atom_c12[a] = C12(nbfp,ntype,atom->type,atom->type)/c12au;
+    }
+  }
+} /* init_QMMM_MMtables */
+
+void gather_QMMM_MMtables(t_MMrec *mm, gmx_bool bLJ)
+{
+  int
+    i,a;
+
+  srenew(mm->ffmass,mm->nrMMatoms);
+  srenew(mm->MMcharges,mm->nrMMatoms);
+  for(i=0;i<mm->nrMMatoms;i++){
+    a = mm->indexMM[i];
+    mm->ffmass[i]    = mm->atom_mass[a];
+    mm->MMcharges[i] = mm->atom_charge[a];
+  }
+  if(bLJ){
+    srenew(mm->c6,mm->nrMMatoms);
+    srenew(mm->c12,mm->nrMMatoms);
+    for(i=0;i<mm->nrMMatoms;i++){
+      a = mm->indexMM[i];
+      mm->c6[i]  = mm->atom_c6[a];
+      mm->c12[i] = mm->atom_c12[a];
+    }
+  }
+} /* gather_QMMM_MMtables */
+
 void init_QMMMrec(t_commrec *cr,
 		  matrix box,
 		  gmx_mtop_t *mtop,
@@ -730,6 +1242,11 @@ void init_QMMMrec(t_commrec *cr,
     mm->scalefactor  = ir->scalefactor;
     mm->nrMMatoms    = (mtop->natoms)-(qr->qm[0]->nrQMatoms); /* rest of the atoms */
     qr->mm           = mm;
+    init_QMMM_MMtables(mm,mtop,fr->ntype,fr->nbfp,
+                       qr->qm[0]->bTS||qr->qm[0]->bOPT);
+    if (getenv("QMMM_PME_EMBED")){
+      qr->lr = qmmm_lr_init(cr,ir,fr,mtop,qr->qm[0],mm);
+    }
   } else {/* ONIOM */
     /* MM rec creation */    
     mm               = mk_MMrec(); 
@@ -740,35 +1257,17 @@ void init_QMMMrec(t_commrec *cr,
   
   /* these variables get updated in the update QMMMrec */
 
-  if(qr->nrQMlayers==1){
+  if(qr->nrQMlayers>1){
+    /* multi-layer ONIOM, see init_QMMM_oniom */
+    qr->oniom = init_QMMM_oniom(cr,qr);
+  }
+  else{
     /* with only one layer there is only one initialisation
-     * needed. Multilayer is a bit more complicated as it requires
-     * re-initialisation at every step of the simulation. This is due
-     * to the use of COMMON blocks in the fortran QM subroutines.  
+     * needed.
      */
-    if (qr->qm[0]->QMmethod<eQMmethodRHF)
-    {
-#ifdef GMX_QMMM_MOPAC
-        /* semi-empiprical 1-layer ONIOM calculation requested (mopac93) */
-        init_mopac(cr,qr->qm[0],qr->mm);
-#else
-        gmx_fatal(FARGS,"Semi-empirical QM only supported with Mopac.");
-#endif
-    }
-    else 
-    { 
-        /* ab initio calculation requested (gamess/gaussian/ORCA) */
-#ifdef GMX_QMMM_GAMESS
-        init_gamess(cr,qr->qm[0],qr->mm);
-#elif defined GMX_QMMM_GAUSSIAN
-        init_gaussian(cr,qr->qm[0],qr->mm);
-#elif defined GMX_QMMM_ORCA
-        init_orca(cr,qr->qm[0],qr->mm);
-#else
-        gmx_fatal(FARGS,"Ab-initio calculation only supported with Gamess, Gaussian or ORCA.");
-#endif
-    }
+    init_QMroutine(cr,qr->qm[0],qr->mm);
   }
+  qr->mts = init_QMMM_mts(ir,qr);
 } /* init_QMMMrec */
 
 void update_QMMMrec(t_commrec *cr,
@@ -776,7 +1275,8 @@ void update_QMMMrec(t_commrec *cr,
 		    rvec x[], rvec v[],
 		    t_mdatoms *md,
 		    matrix box,
-		    gmx_localtop_t *top, gmx_mtop_t *mtop)
+		    gmx_localtop_t *top, gmx_mtop_t *mtop,
+		    gmx_bool bNS)
 {
   /* updates the coordinates of both QM atoms and MM atoms and stores
    * them in the QMMMrec.  
@@ -802,24 +1302,14 @@ void update_QMMMrec(t_commrec *cr,
     *mm;
   t_pbc
     pbc;
-  int  
-    *parallelMMarray=NULL;
-  real
-    c12au,c6au;
-  t_atom    *atom;
 
-  c6au  = (HARTREE2KJ*AVOGADRO*pow(BOHR2NM,6)); 
-  c12au = (HARTREE2KJ*AVOGADRO*pow(BOHR2NM,12)); 
-
-  /* every cpu has this array. On every processor we fill this array
-   * with 1's and 0's. 1's indicate the atoms is a QM atom on the
-   * current cpu in a later stage these arrays are all summed. indexes
-   * > 0 indicate the atom is a QM atom. Every node therefore knows
-   * whcih atoms are part of the QM subsystem.  
-   */
   /* copy some pointers */
   qr          = fr->qr;
   mm          = qr->mm;
+  if(qr->mts && bNS){
+    /* nstlist is a multiple of the MTS interval, start a new cycle */
+    qr->mts->istep = 0;
+  }
   QMMMlist    = fr->QMMMlist;
 
   
@@ -844,201 +1334,154 @@ void update_QMMMrec(t_commrec *cr,
      * the shifts are used for computing virial of the QM/MM particles.
      */
     qm = qr->qm[0]; /* in case of normal QMMM, there is only one group */
-    snew(qm_i_particles,QMMMlist.nri);
-    if(QMMMlist.nri){
-      qm_i_particles[0].shift = XYZ2IS(0,0,0);
-      for(i=0;i<QMMMlist.nri;i++){
-	qm_i_particles[i].j     = QMMMlist.iinr[i];
+    if(qr->embed==NULL){
+      snew(qr->embed,1);
+      mm->nrMMatoms = 0;
+      bNS = TRUE;
+    }
+    /* the QMMM neighbourlist, and with it the embedding, only changes
+     * on search steps
+     */
+    if(bNS){
+      snew(qm_i_particles,QMMMlist.nri);
+      if(QMMMlist.nri){
+	qm_i_particles[0].shift = XYZ2IS(0,0,0);
+	for(i=0;i<QMMMlist.nri;i++){
+	  qm_i_particles[i].j     = QMMMlist.iinr[i];
 	
-	if(i){
-	  qm_i_particles[i].shift = pbc_dx_aiuc(&pbc,x[QMMMlist.iinr[0]],
-						x[QMMMlist.iinr[i]],dx);
-	  
-	}
-	/* However, since nri >= nrQMatoms, we do a quicksort, and throw
-	 * out double, triple, etc. entries later, as we do for the MM
-	 * list too.  
-	 */
+	  if(i){
+	    qm_i_particles[i].shift = pbc_dx_aiuc(&pbc,x[QMMMlist.iinr[0]],
+						  x[QMMMlist.iinr[i]],dx);
 	
-	/* compute the shift for the MM j-particles with respect to
-	 * the QM i-particle and store them. 
-	 */
+	  }
+	  /* However, since nri >= nrQMatoms, we do a quicksort, and throw
+	   * out double, triple, etc. entries later, as we do for the MM
+	   * list too.  
+	   */
+	
+	  /* compute the shift for the MM j-particles with respect to
+	   * the QM i-particle and store them. 
+	   */
+	
+	  crd[0] = IS2X(QMMMlist.shift[i]) + IS2X(qm_i_particles[i].shift);
+	  crd[1] = IS2Y(QMMMlist.shift[i]) + IS2Y(qm_i_particles[i].shift);
+	  crd[2] = IS2Z(QMMMlist.shift[i]) + IS2Z(qm_i_particles[i].shift);
+	  is = XYZ2IS(crd[0],crd[1],crd[2]); 
+	  for(j=QMMMlist.jindex[i];
+	      j<QMMMlist.jindex[i+1];
+	      j++){
+	    if(mm_nr >= mm_max){
+	      mm_max += 1000;
+	      srenew(mm_j_particles,mm_max);
+	    }	  
 	
-	crd[0] = IS2X(QMMMlist.shift[i]) + IS2X(qm_i_particles[i].shift);
-	crd[1] = IS2Y(QMMMlist.shift[i]) + IS2Y(qm_i_particles[i].shift);
-	crd[2] = IS2Z(QMMMlist.shift[i]) + IS2Z(qm_i_particles[i].shift);
-	is = XYZ2IS(crd[0],crd[1],crd[2]); 
-	for(j=QMMMlist.jindex[i];
-	    j<QMMMlist.jindex[i+1];
-	    j++){
-	  if(mm_nr >= mm_max){
-	    mm_max += 1000;
-	    srenew(mm_j_particles,mm_max);
-	  }	  
-	  
-	  mm_j_particles[mm_nr].j = QMMMlist.jjnr[j];
-	  mm_j_particles[mm_nr].shift = is;
-	  mm_nr++;
+	    mm_j_particles[mm_nr].j = QMMMlist.jjnr[j];
+	    mm_j_particles[mm_nr].shift = is;
+	    mm_nr++;
+	  }
 	}
-      }
-      
-      /* quicksort QM and MM shift arrays and throw away multiple entries */
-      
 
+	/* quicksort QM and MM shift arrays and throw away multiple entries */
 
-      qsort(qm_i_particles,QMMMlist.nri,
-	    (size_t)sizeof(qm_i_particles[0]),
-	    struct_comp);
-      qsort(mm_j_particles,mm_nr,
-	    (size_t)sizeof(mm_j_particles[0]),
-	    struct_comp);
-      /* remove multiples in the QM shift array, since in init_QMMM() we
-       * went through the atom numbers from 0 to md.nr, the order sorted
-       * here matches the one of QMindex already.
-       */
-      j=0;
-      for(i=0;i<QMMMlist.nri;i++){
-	if (i==0 || qm_i_particles[i].j!=qm_i_particles[i-1].j){
-	  qm_i_particles[j++] = qm_i_particles[i];
-	}
-      }
-      mm_nr_new = 0;
-      if(qm->bTS||qm->bOPT){
-	/* only remove double entries for the MM array */
-	for(i=0;i<mm_nr;i++){
-	  if((i==0 || mm_j_particles[i].j!=mm_j_particles[i-1].j)
-	     && !md->bQM[mm_j_particles[i].j]){
-	    mm_j_particles[mm_nr_new++] = mm_j_particles[i];
+
+
+	qsort(qm_i_particles,QMMMlist.nri,
+	      (size_t)sizeof(qm_i_particles[0]),
+	      struct_comp);
+	qsort(mm_j_particles,mm_nr,
+	      (size_t)sizeof(mm_j_particles[0]),
+	      struct_comp);
+	/* remove multiples in the QM shift array, since in init_QMMM() we
+	 * went through the atom numbers from 0 to md.nr, the order sorted
+	 * here matches the one of QMindex already.
+	 */
+	j=0;
+	for(i=0;i<QMMMlist.nri;i++){
+	  if (i==0 || qm_i_particles[i].j!=qm_i_particles[i-1].j){
+	    qm_i_particles[j++] = qm_i_particles[i];
 	  }
 	}
-      }      
-      /* we also remove mm atoms that have no charges! 
-      * actually this is already done in the ns.c  
-      */
-      else{
-	for(i=0;i<mm_nr;i++){
-	  if((i==0 || mm_j_particles[i].j!=mm_j_particles[i-1].j)
-	     && !md->bQM[mm_j_particles[i].j] 
-	     && (md->chargeA[mm_j_particles[i].j]
-		 || (md->chargeB && md->chargeB[mm_j_particles[i].j]))) {
-	    mm_j_particles[mm_nr_new++] = mm_j_particles[i];
+	mm_nr_new = 0;
+	if(qm->bTS||qm->bOPT){
+	  /* only remove double entries for the MM array */
+	  for(i=0;i<mm_nr;i++){
+	    if((i==0 || mm_j_particles[i].j!=mm_j_particles[i-1].j)
+	       && !md->bQM[mm_j_particles[i].j]){
+	      mm_j_particles[mm_nr_new++] = mm_j_particles[i];
+	    }
+	  }
+	}      
+	/* we also remove mm atoms that have no charges! 
+	* actually this is already done in the ns.c  
+	*/
+	else{
+	  for(i=0;i<mm_nr;i++){
+	    if((i==0 || mm_j_particles[i].j!=mm_j_particles[i-1].j)
+	       && !md->bQM[mm_j_particles[i].j] 
+	       && (md->chargeA[mm_j_particles[i].j]
+		   || (md->chargeB && md->chargeB[mm_j_particles[i].j]))) {
+	      mm_j_particles[mm_nr_new++] = mm_j_particles[i];
+	    }
 	  }
 	}
-      }
-      mm_nr = mm_nr_new;
-      /* store the data retrieved above into the QMMMrec
-       */    
-      k=0;
-      /* Keep the compiler happy,
-       * shift will always be set in the loop for i=0
-       */
-      shift = 0;
-      for(i=0;i<qm->nrQMatoms;i++){
-	/* not all qm particles might have appeared as i
-	 * particles. They might have been part of the same charge
-	 * group for instance.
-	 */
-	if (qm->indexQM[i] == qm_i_particles[k].j) {
-	  shift = qm_i_particles[k++].shift;
-	}
-	/* use previous shift, assuming they belong the same charge
-	 * group anyway,
+	mm_nr = mm_nr_new;
+	/* store the data retrieved above into the QMMMrec
+	 */    
+	k=0;
+	/* Keep the compiler happy,
+	 * shift will always be set in the loop for i=0
 	 */
-	
-	qm->shiftQM[i] = shift;
-      }
-    }
-    /* parallel excecution */
-    if(PAR(cr)){
-      snew(parallelMMarray,2*(md->nr)); 
-      /* only MM particles have a 1 at their atomnumber. The second part
-       * of the array contains the shifts. Thus:
-       * p[i]=1/0 depending on wether atomnumber i is a MM particle in the QM
-       * step or not. p[i+md->nr] is the shift of atomnumber i.
-       */
-      for(i=0;i<2*(md->nr);i++){
-	parallelMMarray[i]=0;
-      }
-      
-      for(i=0;i<mm_nr;i++){
-	parallelMMarray[mm_j_particles[i].j]=1;
-	parallelMMarray[mm_j_particles[i].j+(md->nr)]=mm_j_particles[i].shift;
-      }
-      gmx_sumi(md->nr,parallelMMarray,cr);
-      mm_nr=0;
-      
-      mm_max = 0;
-      for(i=0;i<md->nr;i++){
-	if(parallelMMarray[i]){
-	  if(mm_nr >= mm_max){
-	    mm_max += 1000;
-	    srenew(mm->indexMM,mm_max);
-	    srenew(mm->shiftMM,mm_max);
+	shift = 0;
+	for(i=0;i<qm->nrQMatoms;i++){
+	  /* not all qm particles might have appeared as i
+	   * particles. They might have been part of the same charge
+	   * group for instance.
+	   */
+	  if (qm->indexQM[i] == qm_i_particles[k].j) {
+	    shift = qm_i_particles[k++].shift;
 	  }
-	  mm->indexMM[mm_nr]  = i;
-	  mm->shiftMM[mm_nr++]= parallelMMarray[i+md->nr]/parallelMMarray[i];
+	  /* use previous shift, assuming they belong the same charge
+	   * group anyway,
+	   */
+	
+	  qm->shiftQM[i] = shift;
 	}
       }
-      mm->nrMMatoms=mm_nr;
-      free(parallelMMarray);
-    }
-    /* serial execution */
-    else{
-      mm->nrMMatoms = mm_nr;
-      srenew(mm->shiftMM,mm_nr);
-      srenew(mm->indexMM,mm_nr);
-      for(i=0;i<mm_nr;i++){
-	mm->indexMM[i]=mm_j_particles[i].j;
-	mm->shiftMM[i]=mm_j_particles[i].shift;
+      diff_local_MM(qr->embed,mm_nr,mm_j_particles);
+      /* parallel excecution */
+      if(PAR(cr)){
+	gather_MM_deltas(cr,qr->embed);
       }
-    }
-    /* (re) allocate memory for the MM coordiate array. The QM
-     * coordinate array was already allocated in init_QMMM, and is
-     * only (re)filled in the update_QMMM_coordinates routine 
-     */
-    srenew(mm->xMM,mm->nrMMatoms);
-    srenew(mm->ffmass, mm->nrMMatoms);
-    for (i=0; i<mm->nrMMatoms; i++)
-    {
-      gmx_mtop_atomnr_to_atom(mtop, mm->indexMM[i], &atom);
-      mm->ffmass[i] = atom->m;
-    }
-    srenew(mm->vMM, mm->nrMMatoms);
-
-
-
-
-
-    /* now we (re) fill the array that contains the MM charges with
-     * the forcefield charges. If requested, these charges will be
-     * scaled by a factor 
-     */
-    srenew(mm->MMcharges,mm->nrMMatoms);
-    for(i=0;i<mm->nrMMatoms;i++){/* no free energy yet */
-      mm->MMcharges[i]=md->chargeA[mm->indexMM[i]]*mm->scalefactor; 
-    }  
-    if(qm->bTS||qm->bOPT){
-      /* store (copy) the c6 and c12 parameters into the MMrec struct 
-       */
-      srenew(mm->c6,mm->nrMMatoms);
-      srenew(mm->c12,mm->nrMMatoms);
-      for (i=0;i<mm->nrMMatoms;i++){
-	mm->c6[i]  = C6(fr->nbfp,top->idef.atnr,
-			md->typeA[mm->indexMM[i]],
-			md->typeA[mm->indexMM[i]])/c6au;
-	mm->c12[i] =C12(fr->nbfp,top->idef.atnr,
-			md->typeA[mm->indexMM[i]],
-			md->typeA[mm->indexMM[i]])/c12au;
+      if(qr->embed->ndelta){
+	merge_MM_deltas(qr->embed,mm);
+	/* (re) allocate memory for the MM coordiate array. The QM
+	 * coordinate array was already allocated in init_QMMM, and is
+	 * only (re)filled in the update_QMMM_coordinates routine 
+	 */
+	srenew(mm->xMM,mm->nrMMatoms);
+	srenew(mm->vMM,mm->nrMMatoms);
+	/* masses, (scaled) charges and the c6 and c12 parameters of the
+	 * MM atoms come from the tables filled in init_QMMMrec
+	 */
+	gather_QMMM_MMtables(mm,qm->bTS||qm->bOPT);
+	if(qm->bTS||qm->bOPT){
+	  punch_QMMM_excl(qr->qm[0],mm,&(top->excls));
+	}
       }
-      punch_QMMM_excl(qr->qm[0],mm,&(top->excls));
+      free(qm_i_particles);
+      free(mm_j_particles);
     }
     /* the next routine fills the coordinate fields in the QMMM rec of
      * both the qunatum atoms and the MM atoms, using the shifts
      * calculated above.  
      */
     update_QMMM_coord(x,v,fr,qr->qm[0],qr->mm);
-    free(qm_i_particles);
-    free(mm_j_particles);
+    if(qr->lr){
+      /* far field of the MM atoms not in the neighbourlist, every
+       * step, also between $QMMM_MTS steps
+       */
+      qmmm_lr_update(qr->lr,cr,qr->qm[0],qr->mm,x,box);
+    }
   } 
   else { /* ONIOM */ /* ????? */
     mm->nrMMatoms=0;
@@ -1059,10 +1502,8 @@ void update_QMMMrec(t_commrec *cr,
 } /* update_QMMM_rec */
 
 
-real calculate_QMMM(t_commrec *cr,
-		    rvec x[],rvec f[],
-		    t_forcerec *fr,
-		    t_mdatoms *md)
+static real QMMM_forces(t_commrec *cr,rvec x[],rvec f[],rvec fshift_tot[],
+			t_forcerec *fr)
 {
   real
     QMener=0.0;
@@ -1073,14 +1514,13 @@ real calculate_QMMM(t_commrec *cr,
   t_QMMMrec
     *qr;
   t_QMrec
-    *qm,*qm2;
+    *qm;
   t_MMrec
     *mm=NULL;
   rvec 
-    *forces=NULL,*fshift=NULL,    
-    *forces2=NULL, *fshift2=NULL; /* needed for multilayer ONIOM */
+    *forces=NULL,*fshift=NULL;
   int
-    i,j,k;
+    i,j;
   /* make a local copy the QMMMrec pointer 
    */
   qr = fr->qr;
@@ -1097,13 +1537,13 @@ real calculate_QMMM(t_commrec *cr,
     for(i=0;i<qm->nrQMatoms;i++){
       for(j=0;j<DIM;j++){
 	f[qm->indexQM[i]][j]          -= forces[i][j];
-	fr->fshift[qm->shiftQM[i]][j] += fshift[i][j];
+	fshift_tot[qm->shiftQM[i]][j] += fshift[i][j];
       }
     }
     for(i=0;i<mm->nrMMatoms;i++){
       for(j=0;j<DIM;j++){
 	f[mm->indexMM[i]][j]          -= forces[qm->nrQMatoms+i][j];
-	fr->fshift[mm->shiftMM[i]][j] += fshift[qm->nrQMatoms+i][j];
+	fshift_tot[mm->shiftMM[i]][j] += fshift[qm->nrQMatoms+i][j];
       }
       
     }
@@ -1111,61 +1551,8 @@ real calculate_QMMM(t_commrec *cr,
     free(fshift);
   }
   else{ /* Multi-layer ONIOM */
-    for(i=0;i<qr->nrQMlayers-1;i++){ /* last layer is special */
-      qm  = qr->qm[i];
-      qm2 = copy_QMrec(qr->qm[i+1]);
-
-      qm2->nrQMatoms = qm->nrQMatoms;
-    
-      for(j=0;j<qm2->nrQMatoms;j++){
-	for(k=0;k<DIM;k++)
-	  qm2->xQM[j][k]       = qm->xQM[j][k];
-	qm2->indexQM[j]        = qm->indexQM[j];
-	qm2->atomicnumberQM[j] = qm->atomicnumberQM[j];
-	qm2->shiftQM[j]        = qm->shiftQM[j];
-      }
-
-      qm2->QMcharge = qm->QMcharge;
-      /* this layer at the higher level of theory */
-      srenew(forces,qm->nrQMatoms);
-      srenew(fshift,qm->nrQMatoms);
-      /* we need to re-initialize the QMroutine every step... */
-      init_QMroutine(cr,qm,mm);
-      QMener += call_QMroutine(cr,fr,qm,mm,forces,fshift);
-
-      /* this layer at the lower level of theory */
-      srenew(forces2,qm->nrQMatoms);
-      srenew(fshift2,qm->nrQMatoms);
-      init_QMroutine(cr,qm2,mm);
-      QMener -= call_QMroutine(cr,fr,qm2,mm,forces2,fshift2);
-      /* E = E1high-E1low The next layer includes the current layer at
-       * the lower level of theory, which provides + E2low
-       * this is similar for gradients
-       */
-      for(i=0;i<qm->nrQMatoms;i++){
-	for(j=0;j<DIM;j++){
-	  f[qm->indexQM[i]][j]          -= (forces[i][j]-forces2[i][j]);
-	  fr->fshift[qm->shiftQM[i]][j] += (fshift[i][j]-fshift2[i][j]);
-	}
-      }
-      free(qm2);
-    }
-    /* now the last layer still needs to be done: */
-    qm      = qr->qm[qr->nrQMlayers-1]; /* C counts from 0 */
-    init_QMroutine(cr,qm,mm);
-    srenew(forces,qm->nrQMatoms);
-    srenew(fshift,qm->nrQMatoms);
-    QMener += call_QMroutine(cr,fr,qm,mm,forces,fshift);
-    for(i=0;i<qm->nrQMatoms;i++){
-      for(j=0;j<DIM;j++){
-	f[qm->indexQM[i]][j]          -= forces[i][j];
-	fr->fshift[qm->shiftQM[i]][j] += fshift[i][j];
-      }
-    }
-    free(forces);
-    free(fshift);
-    free(forces2);
-    free(fshift2);
+    QMener = calculate_QMMM_oniom(cr,fr,f,fshift_tot);
+    qm     = qr->qm[qr->nrQMlayers-1]; /* C counts from 0 */
   }
   if(qm->bTS||qm->bOPT){
     /* qm[0] still contains the largest ONIOM QM subsystem 
@@ -1178,6 +1565,154 @@ real calculate_QMMM(t_commrec *cr,
     }
   }
   return(QMener);
+} /* QMMM_forces */
+
+static real calculate_QMMM_mts(t_commrec *cr,rvec x[],rvec f[],
+			       t_forcerec *fr,int natoms)
+{
+  t_QMMMrec
+    *qr=fr->qr;
+  t_qmmm_mts
+    *mts=qr->mts;
+  rvec
+    *tmp,dum[SHIFTS];
+  real
+    QMener=0,w;
+  int
+    i,j,s;
+
+  if(natoms > mts->nalloc){
+    mts->nalloc = over_alloc_large(natoms);
+    srenew(mts->f,mts->nalloc);
+    srenew(mts->fprev,mts->nalloc);
+    if(mts->bPropagate){
+      srenew(mts->finner,mts->nalloc);
+    }
+  }
+  s = mts->istep % mts->nst;
+  if(s == 0){
+    tmp        = mts->fprev;
+    mts->fprev = mts->f;
+    mts->f     = tmp;
+    for(i=0;i<SHIFTS;i++){
+      copy_rvec(mts->fshift[i],mts->fshiftprev[i]);
+    }
+    clear_rvecs(natoms,mts->f);
+    clear_rvecs(SHIFTS,mts->fshift);
+    mts->enerprev = mts->ener;
+    mts->ener     = QMMM_forces(cr,x,mts->f,mts->fshift,fr);
+    mts->nqm++;
+  }
+  else if(mts->bPropagate){
+    /* the electronic state follows the inner steps */
+    qr->qm[0]->bMTSinner = TRUE;
+    clear_rvecs(natoms,mts->finner);
+    clear_rvecs(SHIFTS,dum);
+    QMener = QMMM_forces(cr,x,mts->finner,dum,fr);
+    qr->qm[0]->bMTSinner = FALSE;
+  }
+  
+  if(mts->bExtrap){
+    /* F(s) = F0 + s/nst (F0 - F-1), held until there are two */
+    w = (mts->nqm > 1) ? (real)s/mts->nst : 0;
+    for(i=0;i<natoms;i++){
+      for(j=0;j<DIM;j++){
+	f[i][j] += (1+w)*mts->f[i][j] - w*mts->fprev[i][j];
+      }
+    }
+    for(i=0;i<SHIFTS;i++){
+      for(j=0;j<DIM;j++){
+	fr->fshift[i][j] += (1+w)*mts->fshift[i][j] - w*mts->fshiftprev[i][j];
+      }
+    }
+    if(s > 0 && !mts->bPropagate){
+      QMener = (1+w)*mts->ener - w*mts->enerprev;
+    }
+  }
+  else{
+    if(s == 0){
+      for(i=0;i<natoms;i++){
+	for(j=0;j<DIM;j++){
+	  f[i][j] += mts->nst*mts->f[i][j];
+	}
+      }
+      for(i=0;i<SHIFTS;i++){
+	for(j=0;j<DIM;j++){
+	  fr->fshift[i][j] += mts->nst*mts->fshift[i][j];
+	}
+      }
+    }
+    if(s > 0 && !mts->bPropagate){
+      QMener = mts->ener;
+    }
+  }
+  if(s == 0){
+    QMener = mts->ener;
+  }
+  mts->istep++;
+
+  return(QMener);
+} /* calculate_QMMM_mts */
+
+real calculate_QMMM(t_commrec *cr,
+		    rvec x[],rvec f[],
+		    t_forcerec *fr,
+		    t_mdatoms *md)
+{
+  real
+    QMener;
+
+  if(fr->qr->mts){
+    QMener = calculate_QMMM_mts(cr,x,f,fr,md->nr);
+  }
+  else{
+    QMener = QMMM_forces(cr,x,f,fr->fshift,fr);
+  }
+  if(fr->qr->lr){
+    QMener += qmmm_lr_forces(fr->qr->lr,f);
+  }
+  return(QMener);
 } /* calculate_QMMM */
 
+void done_QMMMrec(t_QMMMrec *qr)
+{
+  /* lets the QM programs of all groups, including the lower level
+   * ONIOM copies, clean up
+   */
+  int
+    i;
+  t_QMrec
+    *qm;
+
+  if(qr->oniom){
+    for(i=1;i<qr->oniom->njob;i+=2){
+      qm = qr->oniom->job[i].qm;
+      if(qm->backend->done){
+	qm->backend->done(qm);
+      }
+    }
+  }
+  for(i=0;i<qr->nrQMlayers;i++){
+    qm = qr->qm[i];
+    if(qm->backend->done){
+      qm->backend->done(qm);
+    }
+  }
+} /* done_QMMMrec */
+
+void checkpoint_QMMMrec(t_QMMMrec *qr)
+{
+  int
+    i;
+  t_QMrec
+    *qm;
+
+  for(i=0;i<qr->nrQMlayers;i++){
+    qm = qr->qm[i];
+    if(qm->backend->checkpoint){
+      qm->backend->checkpoint(qm);
+    }
+  }
+} /* checkpoint_QMMMrec */
+
 /* end of QMMM core routines */
@@ -0,0 +1,256 @@
+/* -*- mode: c; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; c-file-style: "stroustrup"; -*-
+ * $Id: gmx_matrix.c,v 1.4 2008/12/02 18:27:57 spoel Exp $
+ * 
+ *                This source code is part of
+ * 
+ *                 G   R   O   M   A   C   S
+ * 
+ *          GROningen MAchine for Chemical Simulations
+ * 
+ *                        VERSION 4.5
+ * Written by David van der Spoel, Erik Lindahl, Berk Hess, and others.
+ * Copyright (c) 1991-2000, University of Groningen, The Netherlands.
+ * Copyright (c) 2001-2008, The GROMACS development team,
+ * check out http://www.gromacs.org for more information.
+ 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * If you want to redistribute modifications, please consider that
+ * scientific software is very special. Version control is crucial -
+ * bugs must be traceable. We will be happy to consider code for
+ * inclusion in the official distribution, but derived work must not
+ * be called official GROMACS. Details are found in the README & COPYING
+ * files - if they are missing, get the official version at www.gromacs.org.
+ * 
+ * To help us fund GROMACS development, we humbly ask that you cite
+ * the papers on the package - you can find them in the top README file.
+ * 
+ * For more info, check our website at http://www.gromacs.org
+ * 
+ * And Hey:
+ * Groningen Machine for Chemical Simulation
+ */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include "typedefs.h"
+#include "smalloc.h"
+#include "macros.h"
+#include "physics.h"
+#include "mtop_util.h"
+#include "qmmm.h"
+
+/* Micro-benchmark of the gather of the MM embedding attributes:
+ * gather_QMMM_MMtables() against the per atom topology lookups
+ * update_QMMMrec() did before, reproduced below. For each number of
+ * embedding atoms on the command line (default 1e5, 3e5 and 1e6) a
+ * system of twice that size is built from a few molecule blocks, every
+ * other atom is embedded, and the time per gather and the largest
+ * deviation of the masses, charges and c6/c12 are reported.
+ */
+
+#define NTYPE 4
+
+/* ------- reference: the loops formerly in update_QMMMrec() ------- */
+
+static void ref_gather(t_MMrec *mm, gmx_mtop_t *mtop,
+                       real *chargeA, int *typeA, real *nbfp)
+{
+  int    i;
+  real   c12au,c6au;
+  t_atom *atom;
+
+  c6au  = (HARTREE2KJ*AVOGADRO*pow(BOHR2NM,6)); 
+  c12au = (HARTREE2KJ*AVOGADRO*pow(BOHR2NM,12)); 
+
+  srenew(mm->ffmass,mm->nrMMatoms);
+  for (i=0; i<mm->nrMMatoms; i++){
+    gmx_mtop_atomnr_to_atom(mtop,mm->indexMM[i],&atom);
+    mm->ffmass[i] = atom->m;
+  }
+  srenew(mm->MMcharges,mm->nrMMatoms);
+  for (i=0; i<mm->nrMMatoms; i++){
+    mm->MMcharges[i] = chargeA[mm->indexMM[i]]*mm->scalefactor; 
+  }  
+  srenew(mm->c6,mm->nrMMatoms);
+  srenew(mm->c12,mm->nrMMatoms);
+  for (i=0; i<mm->nrMMatoms; i++){
+    mm->c6[i]  = C6(nbfp,NTYPE,typeA[mm->indexMM[i]],
+                    typeA[mm->indexMM[i]])/c6au;
+    mm->c12[i] = C12(nbfp,NTYPE,typeA[mm->indexMM[i]],
+                     typeA[mm->indexMM[i]])/c12au;
+  }
+}
+
+/* ---------------------------------------------------------------- */
+
+static double wallclock(void)
+{
+  struct timeval tv;
+
+  gettimeofday(&tv,NULL);
+
+  return tv.tv_sec+1e-6*tv.tv_usec;
+}
+
+static double maxdiff(int n, real *a, real *b)
+{
+  int    i;
+  double d=0;
+
+  for (i=0; i<n; i++){
+    d = max(d,fabs(a[i]-b[i])/max(1e-30,fabs(b[i])));
+  }
+
+  return d;
+}
+
+/* a protein, some ions and water, split over a few molecule blocks as
+ * grompp writes them for a solvated system with several chains
+ */
+static void build_system(int natoms, gmx_mtop_t *mtop)
+{
+  int natoms_mol[] = { 2500, 1, 1, 3 };
+  int nblock[]     = { 4, 2, 2, 0 };
+  int mt,mb,a,b,n;
+
+  memset(mtop,0,sizeof(*mtop));
+  mtop->nmoltype = asize(natoms_mol);
+  snew(mtop->moltype,mtop->nmoltype);
+  for (mt=0; mt<mtop->nmoltype; mt++){
+    mtop->moltype[mt].atoms.nr   = natoms_mol[mt];
+    mtop->moltype[mt].atoms.nres = 1;
+    snew(mtop->moltype[mt].atoms.atom,natoms_mol[mt]);
+    for (a=0; a<natoms_mol[mt]; a++){
+      mtop->moltype[mt].atoms.atom[a].m    = 1+15*drand48();
+      mtop->moltype[mt].atoms.atom[a].q    = drand48()-0.5;
+      mtop->moltype[mt].atoms.atom[a].type = (int)(NTYPE*drand48());
+    }
+  }
+  /* protein chains with ions in between, water fills up the rest */
+  mtop->nmolblock = 0;
+  for (b=0; b<nblock[0]; b++){
+    srenew(mtop->molblock,mtop->nmolblock+2);
+    mtop->molblock[mtop->nmolblock].type   = 0;
+    mtop->molblock[mtop->nmolblock++].nmol = 1;
+    mtop->molblock[mtop->nmolblock].type   = 1+b%2;
+    mtop->molblock[mtop->nmolblock++].nmol = 10;
+  }
+  n = 0;
+  for (mb=0; mb<mtop->nmolblock; mb++){
+    mtop->molblock[mb].natoms_mol = natoms_mol[mtop->molblock[mb].type];
+    n += mtop->molblock[mb].nmol*mtop->molblock[mb].natoms_mol;
+  }
+  srenew(mtop->molblock,mtop->nmolblock+1);
+  mtop->molblock[mb].type       = 3;
+  mtop->molblock[mb].natoms_mol = 3;
+  mtop->molblock[mb].nmol       = max(0,natoms-n)/3;
+  mtop->nmolblock++;
+  mtop->natoms = n + 3*mtop->molblock[mb].nmol;
+  gmx_mtop_finalize(mtop);
+}
+
+int main(int argc,char *argv[])
+{
+  int        def[] = { 100000, 300000, 1000000 };
+  int        i,s,n,nrep,nsize=0,*size,*typeA;
+  double     t0,tnew,tref,dm,dq,dlj;
+  real       nbfp[2*NTYPE*NTYPE],*chargeA;
+  gmx_mtop_t mtop;
+  gmx_mtop_atomloop_all_t aloop;
+  t_atom     *atom;
+  t_MMrec    mm,mmr;
+
+  snew(size,argc+asize(def));
+  for (i=1; i<argc; i++){
+    size[nsize++] = atoi(argv[i]);
+  }
+  if (nsize == 0){
+    for (i=0; i<asize(def); i++){
+      size[nsize++] = def[i];
+    }
+  }
+  srand48(1993);
+  for (i=0; i<2*NTYPE*NTYPE; i++){
+    nbfp[i] = 1e-3*drand48();
+  }
+
+  printf("%8s %8s %5s %12s %12s %8s %10s %10s %10s\n",
+         "nembed","natoms","nrep","new (s)","ref (s)","speedup",
+         "max|dm|","max|dq|","max|dLJ|");
+  for (s=0; s<nsize; s++){
+    n = size[s];
+    build_system(2*n,&mtop);
+    /* what mdatoms holds in a particle decomposition run */
+    snew(chargeA,mtop.natoms);
+    snew(typeA,mtop.natoms);
+    aloop = gmx_mtop_atomloop_all_init(&mtop);
+    while (gmx_mtop_atomloop_all_next(aloop,&i,&atom)){
+      chargeA[i] = atom->q;
+      typeA[i]   = atom->type;
+    }
+
+    memset(&mm,0,sizeof(mm));
+    mm.scalefactor = 0.8;
+    mm.nrMMatoms   = mtop.natoms/2;
+    snew(mm.indexMM,mm.nrMMatoms);
+    for (i=0; i<mm.nrMMatoms; i++){
+      mm.indexMM[i] = 2*i+1;
+    }
+    mmr = mm;
+    init_QMMM_MMtables(&mm,&mtop,NTYPE,nbfp,TRUE);
+
+    nrep = max(1,(int)(2e7/(double)n));
+    t0 = wallclock();
+    for (i=0; i<nrep; i++){
+      gather_QMMM_MMtables(&mm,TRUE);
+    }
+    tnew = (wallclock()-t0)/nrep;
+    t0 = wallclock();
+    for (i=0; i<nrep; i++){
+      ref_gather(&mmr,&mtop,chargeA,typeA,nbfp);
+    }
+    tref = (wallclock()-t0)/nrep;
+
+    dm  = maxdiff(mm.nrMMatoms,mm.ffmass,mmr.ffmass);
+    dq  = maxdiff(mm.nrMMatoms,mm.MMcharges,mmr.MMcharges);
+    dlj = max(maxdiff(mm.nrMMatoms,mm.c6,mmr.c6),
+              maxdiff(mm.nrMMatoms,mm.c12,mmr.c12));
+    printf("%8d %8d %5d %12.4e %12.4e %8.1f %10.2e %10.2e %10.2e\n",
+           mm.nrMMatoms,mtop.natoms,nrep,tnew,tref,tref/tnew,dm,dq,dlj);
+    fflush(stdout);
+
+    sfree(mm.atom_c12);
+    sfree(mm.atom_c6);
+    sfree(mm.atom_charge);
+    sfree(mm.atom_mass);
+    sfree(mm.c12);
+    sfree(mm.c6);
+    sfree(mm.MMcharges);
+    sfree(mm.ffmass);
+    sfree(mmr.c12);
+    sfree(mmr.c6);
+    sfree(mmr.MMcharges);
+    sfree(mmr.ffmass);
+    sfree(mm.indexMM);
+    sfree(typeA);
+    sfree(chargeA);
+    for (i=0; i<mtop.nmoltype; i++){
+      sfree(mtop.moltype[i].atoms.atom);
+    }
+    sfree(mtop.moltype);
+    sfree(mtop.molblock);
+  }
+  sfree(size);
+
+  return 0;
+}
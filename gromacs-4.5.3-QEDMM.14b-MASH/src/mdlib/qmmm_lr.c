@@ -0,0 +1,238 @@
+/*
+ *
+ *                This source code is part of
+ *
+ *                 G   R   O   M   A   C   S
+ *
+ *          GROningen MAchine for Chemical Simulations
+ *
+ *                        VERSION 3.2.0
+ * Written by David van der Spoel, Erik Lindahl, Berk Hess, and others.
+ * Copyright (c) 1991-2000, University of Groningen, The Netherlands.
+ * Copyright (c) 2001-2004, The GROMACS development team,
+ * check out http://www.gromacs.org for more information.
+
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * If you want to redistribute modifications, please consider that
+ * scientific software is very special. Version control is crucial -
+ * bugs must be traceable. We will be happy to consider code for
+ * inclusion in the official distribution, but derived work must not
+ * be called official GROMACS. Details are found in the README & COPYING
+ * files - if they are missing, get the official version at www.gromacs.org.
+ *
+ * To help us fund GROMACS development, we humbly ask that you cite
+ * the papers on the package - you can find them in the top README file.
+ *
+ * For more info, check our website at http://www.gromacs.org
+ *
+ * And Hey:
+ * GROwing Monsters And Cloning Shrimps
+ */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <math.h>
+#include <string.h>
+#include "typedefs.h"
+#include "smalloc.h"
+#include "macros.h"
+#include "vec.h"
+#include "physics.h"
+#include "nrnb.h"
+#include "pme.h"
+#include "mtop_util.h"
+#include "gmx_fatal.h"
+#include "qmmm_lr.h"
+
+struct gmx_qmmm_lr {
+  gmx_pme_t  pme;
+  t_nrnb     nrnb;
+  int        natoms;
+  real       *q;           /* MM charges, zero on the QM atoms      */
+  real       *qqm;         /* QM charges, zero on the MM atoms      */
+  real       ewaldcoeff;
+  real       epsfac;
+  int        nq;
+  real       *Q;           /* topology charges of the QM atoms      */
+  real       *V;           /* far field potential at the QM atoms   */
+  rvec       *E;           /* and the field                         */
+  real       *Vmm;         /* potential and field of the QM charges */
+  rvec       *Emm;         /* at all atoms                          */
+  real       energy;
+  rvec       *f;           /* the forces of energy                  */
+};
+
+gmx_qmmm_lr_t qmmm_lr_init(t_commrec *cr, t_inputrec *ir, t_forcerec *fr,
+                           const gmx_mtop_t *mtop,
+                           t_QMrec *qm, t_MMrec *mm)
+{
+  gmx_qmmm_lr_t
+    lr;
+  int
+    i;
+  t_atom
+    *atom;
+
+  if (!EEL_PME(ir->coulombtype)){
+    gmx_fatal(FARGS,"QMMM_PME_EMBED needs PME electrostatics");
+  }
+  if (PAR(cr)){
+    gmx_fatal(FARGS,"QMMM_PME_EMBED does not work in parallel yet, "
+              "use one node per simulation");
+  }
+  snew(lr,1);
+  if (gmx_pme_init(&lr->pme,cr,1,1,ir,mtop->natoms,FALSE,FALSE) != 0){
+    gmx_fatal(FARGS,"Error initializing PME for the QM/MM embedding");
+  }
+  init_nrnb(&lr->nrnb);
+  lr->natoms     = mtop->natoms;
+  lr->ewaldcoeff = fr->ewaldcoeff;
+  lr->epsfac     = fr->epsfac;
+  /* the QM atoms do not contribute to their own embedding */
+  snew(lr->q,lr->natoms);
+  snew(lr->qqm,lr->natoms);
+  for (i=0;i<lr->natoms;i++){
+    lr->q[i] = mm->atom_charge[i];
+  }
+  lr->nq = qm->nrQMatoms;
+  snew(lr->Q,lr->nq);
+  for (i=0;i<lr->nq;i++){
+    gmx_mtop_atomnr_to_atom(mtop,qm->indexQM[i],&atom);
+    lr->Q[i] = atom->q;
+    lr->q[qm->indexQM[i]]   = 0;
+    lr->qqm[qm->indexQM[i]] = lr->Q[i];
+  }
+  snew(lr->V,lr->nq);
+  snew(lr->E,lr->nq);
+  snew(lr->Vmm,lr->natoms);
+  snew(lr->Emm,lr->natoms);
+  snew(lr->f,lr->natoms);
+  fprintf(stderr,"QM/MM: far field embedding through PME\n");
+
+  return lr;
+} /* qmmm_lr_init */
+
+/* the real space Ewald part of the interaction of QM atom a with
+ * explicit MM atom j, which the QM program already has: potential
+ * erf(beta r)/r per unit charge, returned, and dV/dr / r in *dg
+ */
+static real erf_pair(gmx_qmmm_lr_t lr, rvec xa, rvec xj, rvec dx, real *dg)
+{
+  real
+    r,rinv,erfr;
+
+  rvec_sub(xa,xj,dx);
+  r    = norm(dx);
+  rinv = 1.0/r;
+  erfr = gmx_erf(lr->ewaldcoeff*r);
+  *dg  = (M_2_SQRTPI*lr->ewaldcoeff*exp(-sqr(lr->ewaldcoeff*r))*r - erfr)
+    *rinv*rinv*rinv;
+
+  return erfr*rinv;
+}
+
+static void far_field(gmx_qmmm_lr_t lr, t_commrec *cr,
+                      t_QMrec *qm, t_MMrec *mm, rvec x[], matrix box)
+{
+  /* reciprocal space potential and field of all MM charges at the QM
+   * atoms, minus the part of the explicit MM atoms, which the QM
+   * program gets as bare point charges
+   */
+  int
+    a,j;
+  real
+    energy,dvdl,qj,vp,dg;
+  rvec
+    dx;
+  matrix
+    vir;
+
+  clear_mat(vir);
+  gmx_pme_do(lr->pme,0,lr->natoms,x,NULL,lr->q,NULL,box,cr,0,0,
+             &lr->nrnb,NULL,vir,lr->ewaldcoeff,&energy,0,&dvdl,
+             GMX_PME_SPREAD_Q | GMX_PME_SOLVE | GMX_PME_CALC_POT);
+  gmx_pme_calc_potential(lr->pme,lr->nq,qm->xQM,lr->V,lr->E);
+
+  for (a=0;a<lr->nq;a++){
+    for (j=0;j<mm->nrMMatoms;j++){
+      qj  = lr->q[mm->indexMM[j]];
+      vp  = erf_pair(lr,qm->xQM[a],mm->xMM[j],dx,&dg);
+      lr->V[a] -= lr->epsfac*qj*vp;
+      svmul(lr->epsfac*qj*dg,dx,dx);
+      rvec_inc(lr->E[a],dx);
+    }
+  }
+} /* far_field */
+
+void qmmm_lr_update(gmx_qmmm_lr_t lr, t_commrec *cr,
+                    t_QMrec *qm, t_MMrec *mm, rvec x[], matrix box)
+{
+  int
+    a,i,j;
+  real
+    energy,dvdl,qj,dg;
+  rvec
+    dx,fa;
+  matrix
+    vir;
+
+  far_field(lr,cr,qm,mm,x,box);
+
+  /* E = sum_a Q_a V_a, the force on QM atom a is Q_a E_a */
+  clear_rvecs(lr->natoms,lr->f);
+  lr->energy = 0;
+  for (a=0;a<lr->nq;a++){
+    lr->energy += lr->Q[a]*lr->V[a];
+    svmul(lr->Q[a],lr->E[a],fa);
+    rvec_inc(lr->f[qm->indexQM[a]],fa);
+  }
+
+  /* the reaction on the MM atoms: their charge in the reciprocal
+   * space field of the QM charges, which is exactly the derivative of
+   * the interpolated energy above since spreading and gathering use
+   * the same splines
+   */
+  clear_mat(vir);
+  gmx_pme_do(lr->pme,0,lr->natoms,x,NULL,lr->qqm,NULL,box,cr,0,0,
+             &lr->nrnb,NULL,vir,lr->ewaldcoeff,&energy,0,&dvdl,
+             GMX_PME_SPREAD_Q | GMX_PME_SOLVE | GMX_PME_CALC_POT);
+  gmx_pme_calc_potential(lr->pme,lr->natoms,x,lr->Vmm,lr->Emm);
+  for (i=0;i<lr->natoms;i++){
+    if (lr->q[i] != 0){
+      svmul(lr->q[i],lr->Emm[i],fa);
+      rvec_inc(lr->f[i],fa);
+    }
+  }
+  /* minus the erf pairs of the explicit MM atoms */
+  for (j=0;j<mm->nrMMatoms;j++){
+    qj = lr->q[mm->indexMM[j]];
+    for (a=0;a<lr->nq;a++){
+      erf_pair(lr,qm->xQM[a],mm->xMM[j],dx,&dg);
+      svmul(-lr->epsfac*lr->Q[a]*qj*dg,dx,dx);
+      rvec_inc(lr->f[mm->indexMM[j]],dx);
+    }
+  }
+  if (debug){
+    fprintf(debug,"QM/MM PME embedding: %d explicit MM charges, far field "
+            "energy %g, potential %g field %g %g %g at QM atom 0\n",
+            mm->nrMMatoms,lr->energy,lr->V[0],
+            lr->E[0][XX],lr->E[0][YY],lr->E[0][ZZ]);
+  }
+} /* qmmm_lr_update */
+
+real qmmm_lr_forces(gmx_qmmm_lr_t lr, rvec f[])
+{
+  int
+    i;
+
+  for (i=0;i<lr->natoms;i++){
+    rvec_inc(f[i],lr->f[i]);
+  }
+
+  return lr->energy;
+} /* qmmm_lr_forces */
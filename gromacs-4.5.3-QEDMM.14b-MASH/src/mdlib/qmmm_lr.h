@@ -0,0 +1,90 @@
+/*
+ *
+ *                This source code is part of
+ *
+ *                 G   R   O   M   A   C   S
+ *
+ *          GROningen MAchine for Chemical Simulations
+ *
+ *                        VERSION 3.2.0
+ * Written by David van der Spoel, Erik Lindahl, Berk Hess, and others.
+ * Copyright (c) 1991-2000, University of Groningen, The Netherlands.
+ * Copyright (c) 2001-2004, The GROMACS development team,
+ * check out http://www.gromacs.org for more information.
+
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * If you want to redistribute modifications, please consider that
+ * scientific software is very special. Version control is crucial -
+ * bugs must be traceable. We will be happy to consider code for
+ * inclusion in the official distribution, but derived work must not
+ * be called official GROMACS. Details are found in the README & COPYING
+ * files - if they are missing, get the official version at www.gromacs.org.
+ *
+ * To help us fund GROMACS development, we humbly ask that you cite
+ * the papers on the package - you can find them in the top README file.
+ *
+ * For more info, check our website at http://www.gromacs.org
+ *
+ * And Hey:
+ * Gallium Rubidium Oxygen Manganese Argon Carbon Silicon
+ */
+
+
+#ifndef _qmmm_lr_h
+#define _qmmm_lr_h
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "typedefs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Long-range electrostatic embedding of the QM region. Only the MM
+ * atoms in the QMMM neighbourlist are passed to the QM program as
+ * point charges. With $QMMM_PME_EMBED set, the potential and field of
+ * all other MM charges at the QM atoms are computed with PME, and
+ * their interaction with the topology charges Q_a of the QM atoms is
+ * added as a separate energy term
+ *
+ *   E_lr = sum_a Q_a V_far(x_a)
+ *
+ * with its forces on the QM and all MM atoms. The MM charges the QM
+ * program sees stay the physical ones; the far field thus does not
+ * polarize the QM density, which the explicit charges within the
+ * cutoff do. The explicit MM atoms only contribute the reciprocal
+ * space part beyond the erf pair the QM program already has, so E_lr
+ * is continuous up to erfc(beta rc) as atoms enter or leave the list.
+ * E_lr is not included in the virial.
+ */
+
+typedef struct gmx_qmmm_lr *gmx_qmmm_lr_t;
+
+gmx_qmmm_lr_t qmmm_lr_init(t_commrec *cr, t_inputrec *ir, t_forcerec *fr,
+                           const gmx_mtop_t *mtop,
+                           t_QMrec *qm, t_MMrec *mm);
+/* Sets up a separate PME grid for the MM charges. Needs PME
+ * electrostatics and a single node per simulation.
+ */
+
+void qmmm_lr_update(gmx_qmmm_lr_t lr, t_commrec *cr,
+                    t_QMrec *qm, t_MMrec *mm, rvec x[], matrix box);
+/* Computes E_lr and its forces. Call every step, after the QM and MM
+ * coordinates have been updated.
+ */
+
+real qmmm_lr_forces(gmx_qmmm_lr_t lr, rvec f[]);
+/* Adds the forces of the last qmmm_lr_update to f, returns E_lr */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif	/* _qmmm_lr_h */
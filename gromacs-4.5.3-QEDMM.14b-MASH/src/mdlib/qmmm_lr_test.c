@@ -0,0 +1,250 @@
+/* -*- mode: c; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; c-file-style: "stroustrup"; -*-
+ * $Id: gmx_matrix.c,v 1.4 2008/12/02 18:27:57 spoel Exp $
+ * 
+ *                This source code is part of
+ * 
+ *                 G   R   O   M   A   C   S
+ * 
+ *          GROningen MAchine for Chemical Simulations
+ * 
+ *                        VERSION 4.5
+ * Written by David van der Spoel, Erik Lindahl, Berk Hess, and others.
+ * Copyright (c) 1991-2000, University of Groningen, The Netherlands.
+ * Copyright (c) 2001-2008, The GROMACS development team,
+ * check out http://www.gromacs.org for more information.
+ 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * If you want to redistribute modifications, please consider that
+ * scientific software is very special. Version control is crucial -
+ * bugs must be traceable. We will be happy to consider code for
+ * inclusion in the official distribution, but derived work must not
+ * be called official GROMACS. Details are found in the README & COPYING
+ * files - if they are missing, get the official version at www.gromacs.org.
+ * 
+ * To help us fund GROMACS development, we humbly ask that you cite
+ * the papers on the package - you can find them in the top README file.
+ * 
+ * For more info, check our website at http://www.gromacs.org
+ * 
+ * And Hey:
+ * Groningen Machine for Chemical Simulation
+ */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "typedefs.h"
+#include "smalloc.h"
+#include "macros.h"
+#include "vec.h"
+#include "physics.h"
+#include "main.h"
+#include "coulomb.h"
+#include "qmmm_lr.h"
+
+/* Finite difference check of the far field term of $QMMM_PME_EMBED.
+ * Random charges in a cubic box, a small QM region in the middle and
+ * the MM atoms within -rc of it as the explicit charges. The forces
+ * qmmm_lr_forces returns for the QM atoms and for some explicit and
+ * some far MM atoms are compared with central differences of E_lr,
+ * and the charges the QM program sees must stay the topology ones.
+ * Exits with 1 if the largest deviation is above -tol times the
+ * largest force.
+ */
+
+#define NATOMS 1000
+#define NQM    6
+#define NCHECK 6
+
+static gmx_mtop_t *build_mtop(int natoms, real *q)
+{
+  gmx_mtop_t *mtop;
+  int        i;
+
+  snew(mtop,1);
+  mtop->natoms    = natoms;
+  mtop->nmoltype  = 1;
+  mtop->nmolblock = 1;
+  snew(mtop->moltype,1);
+  snew(mtop->molblock,1);
+  mtop->moltype[0].atoms.nr = natoms;
+  snew(mtop->moltype[0].atoms.atom,natoms);
+  for (i=0; i<natoms; i++){
+    mtop->moltype[0].atoms.atom[i].q = q[i];
+  }
+  mtop->molblock[0].type       = 0;
+  mtop->molblock[0].nmol       = 1;
+  mtop->molblock[0].natoms_mol = natoms;
+
+  return mtop;
+}
+
+/* E_lr at x, with its forces added to f */
+static real lr_energy(gmx_qmmm_lr_t lr, t_commrec *cr, t_QMrec *qm,
+                      t_MMrec *mm, rvec x[], matrix box, rvec f[])
+{
+  int i;
+
+  for (i=0; i<qm->nrQMatoms; i++){
+    copy_rvec(x[qm->indexQM[i]],qm->xQM[i]);
+  }
+  for (i=0; i<mm->nrMMatoms; i++){
+    copy_rvec(x[mm->indexMM[i]],mm->xMM[i]);
+  }
+  qmmm_lr_update(lr,cr,qm,mm,x,box);
+
+  return qmmm_lr_forces(lr,f);
+}
+
+int main(int argc,char *argv[])
+{
+  int           i,j,d,c,ncheck=0,check[NQM+2*NCHECK],nfail=0;
+  real          L=3.0,rc=0.9,rtol=1e-5,*q,qsum,Ep,Em,E0,x0;
+  double        h=1e-4,fmax=0,dmax=0,dq=0;
+  rvec          *x,*f,*fdum,cq,dx;
+  matrix        box;
+  t_commrec     *cr;
+  t_inputrec    ir;
+  t_forcerec    fr;
+  gmx_mtop_t    *mtop;
+  t_QMrec       qm;
+  t_MMrec       mm;
+  real          *MMcharges;
+  gmx_qmmm_lr_t lr;
+#ifdef GMX_DOUBLE
+  double        tol=1e-6;
+#else
+  double        tol=1e-2;
+
+  h = 1e-3;
+#endif
+
+  for (i=1; i<argc; i++){
+    if (strcmp(argv[i],"-tol") == 0 && i+1 < argc){
+      tol = strtod(argv[++i],NULL);
+    }
+    else if (strcmp(argv[i],"-rc") == 0 && i+1 < argc){
+      rc = strtod(argv[++i],NULL);
+    }
+  }
+  srand48(1);
+  snew(x,NATOMS);
+  snew(f,NATOMS);
+  snew(fdum,NATOMS);
+  snew(q,NATOMS);
+  clear_mat(box);
+  for (d=0; d<DIM; d++){
+    box[d][d] = L;
+  }
+  /* QM atoms 0..NQM-1 in the middle, neutral MM */
+  qsum = 0;
+  for (i=0; i<NATOMS; i++){
+    for (d=0; d<DIM; d++){
+      x[i][d] = (i < NQM) ? 0.5*L+0.3*(drand48()-0.5) : L*drand48();
+    }
+    q[i] = (i < NQM) ? 0.6*(drand48()-0.5) : 0.8*(drand48()-0.5);
+    if (i >= NQM){
+      qsum += q[i];
+    }
+  }
+  for (i=NQM; i<NATOMS; i++){
+    q[i] -= qsum/(NATOMS-NQM);
+  }
+
+  cr = init_cr_nopar();
+  memset(&ir,0,sizeof(ir));
+  ir.coulombtype = eelPME;
+  ir.ePBC        = epbcXYZ;
+  ir.efep        = efepNO;
+  ir.nkx = ir.nky = ir.nkz = 32;
+  ir.pme_order   = 4;
+  ir.epsilon_r   = 1;
+  memset(&fr,0,sizeof(fr));
+  fr.ewaldcoeff  = calc_ewaldcoeff(rc,rtol);
+  fr.epsfac      = ONE_4PI_EPS0;
+  mtop = build_mtop(NATOMS,q);
+
+  memset(&qm,0,sizeof(qm));
+  memset(&mm,0,sizeof(mm));
+  qm.nrQMatoms = NQM;
+  snew(qm.indexQM,NQM);
+  snew(qm.xQM,NQM);
+  clear_rvec(cq);
+  for (i=0; i<NQM; i++){
+    qm.indexQM[i] = i;
+    rvec_inc(cq,x[i]);
+    check[ncheck++] = i;
+  }
+  svmul(1.0/NQM,cq,cq);
+  mm.scalefactor = 1;
+  snew(mm.atom_charge,NATOMS);
+  snew(mm.indexMM,NATOMS);
+  snew(mm.xMM,NATOMS);
+  snew(mm.MMcharges,NATOMS);
+  for (i=0; i<NATOMS; i++){
+    mm.atom_charge[i] = q[i];
+    rvec_sub(x[i],cq,dx);
+    if (i >= NQM && norm(dx) < rc){
+      mm.MMcharges[mm.nrMMatoms] = q[i];
+      mm.indexMM[mm.nrMMatoms++] = i;
+    }
+  }
+  /* some explicit and some far MM atoms */
+  for (j=0; j<NCHECK; j++){
+    check[ncheck++] = mm.indexMM[(j*mm.nrMMatoms)/NCHECK];
+  }
+  for (i=NQM,j=0; i<NATOMS && j<NCHECK; i+=NATOMS/NCHECK){
+    rvec_sub(x[i],cq,dx);
+    if (norm(dx) > rc){
+      check[ncheck++] = i;
+      j++;
+    }
+  }
+  snew(MMcharges,mm.nrMMatoms);
+  memcpy(MMcharges,mm.MMcharges,mm.nrMMatoms*sizeof(real));
+
+  lr = qmmm_lr_init(cr,&ir,&fr,mtop,&qm,&mm);
+  E0 = lr_energy(lr,cr,&qm,&mm,x,box,f);
+  printf("%d atoms, %d QM, %d explicit MM, E_lr %g kJ/mol\n",
+         NATOMS,NQM,mm.nrMMatoms,E0);
+
+  printf("%6s %4s %12s %12s %10s\n","atom","dim","force","-dE/dx","diff");
+  for (c=0; c<ncheck; c++){
+    i = check[c];
+    for (d=0; d<DIM; d++){
+      x0 = x[i][d];
+      x[i][d] = x0+h;
+      Ep = lr_energy(lr,cr,&qm,&mm,x,box,fdum);
+      x[i][d] = x0-h;
+      Em = lr_energy(lr,cr,&qm,&mm,x,box,fdum);
+      x[i][d] = x0;
+      fmax = max(fmax,fabs(f[i][d]));
+      dmax = max(dmax,fabs(f[i][d]+(Ep-Em)/(2*h)));
+      printf("%6d %4d %12.6f %12.6f %10.2e\n",i,d,f[i][d],-(Ep-Em)/(2*h),
+             f[i][d]+(Ep-Em)/(2*h));
+    }
+  }
+  for (j=0; j<mm.nrMMatoms; j++){
+    dq = max(dq,fabs(mm.MMcharges[j]-MMcharges[j]));
+  }
+  printf("largest force %g, deviation %g, MM charge change %g\n",
+         fmax,dmax,dq);
+  if (dmax > tol*fmax || dq != 0){
+    nfail++;
+  }
+  if (nfail > 0){
+    printf("FAILED\n");
+    return 1;
+  }
+  printf("passed\n");
+
+  return 0;
+}
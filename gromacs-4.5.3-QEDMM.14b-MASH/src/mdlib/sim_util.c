@@ -695,7 +695,7 @@ void do_force(FILE *fplog,t_commrec *cr,
     /* update QMMMrec, if necessary */
     if(fr->bQMMM)
     {
-        update_QMMMrec(cr,fr,x,vel,mdatoms,box,top,mtop);
+        update_QMMMrec(cr,fr,x,vel,mdatoms,box,top,mtop,bNS);
     }
 
     if ((flags & GMX_FORCE_BONDED) && top->idef.il[F_POSRES].nr > 0)
@@ -0,0 +1,209 @@
+/*
+ * 
+ *                This source code is part of
+ * 
+ *                 G   R   O   M   A   C   S
+ * 
+ *          GROningen MAchine for Chemical Simulations
+ * 
+ *                        VERSION 3.2.0
+ * Written by David van der Spoel, Erik Lindahl, Berk Hess, and others.
+ * Copyright (c) 1991-2000, University of Groningen, The Netherlands.
+ * Copyright (c) 2001-2004, The GROMACS development team,
+ * check out http://www.gromacs.org for more information.
+
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * If you want to redistribute modifications, please consider that
+ * scientific software is very special. Version control is crucial -
+ * bugs must be traceable. We will be happy to consider code for
+ * inclusion in the official distribution, but derived work must not
+ * be called official GROMACS. Details are found in the README & COPYING
+ * files - if they are missing, get the official version at www.gromacs.org.
+ * 
+ * To help us fund GROMACS development, we humbly ask that you cite
+ * the papers on the package - you can find them in the top README file.
+ * 
+ * For more info, check our website at http://www.gromacs.org
+ * 
+ * And Hey:
+ * Green Red Orange Magenta Azure Cyan Skyblue
+ */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+#include "statutil.h"
+#include "typedefs.h"
+#include "smalloc.h"
+#include "macros.h"
+#include "gmx_fatal.h"
+#include "copyrite.h"
+#include "futil.h"
+#include "qtrio.h"
+#include "gmx_ana.h"
+
+static void print_eigen(FILE *fp, t_qtrframe *fr)
+{
+  int i,k;
+
+  for(i=0; i<fr->nstate; i++)
+  {
+    fprintf(fp,"step %4d Eigenvector %4d gap %12.8lf (c: %12.8lf + %12.8lf I):",
+            fr->step,i,fr->gap[i],fr->c[2*i],fr->c[2*i+1]);
+    if (fr->flags & QTR_EIGVEC)
+    {
+      for(k=0; k<fr->ndim; k++)
+      {
+        fprintf(fp," %12.8lf + %12.8lf I",fr->eigvec[2*(i*fr->ndim+k)],
+                fr->eigvec[2*(i*fr->ndim+k)+1]);
+      }
+    }
+    fprintf(fp,"\n");
+  }
+}
+
+static void print_coeff(FILE *fp, t_qtrframe *fr, double *c)
+{
+  int k;
+
+  fprintf(fp,"step %4d energy: %12.8lf coeff: ",fr->step,fr->energy);
+  for(k=0; k<fr->ndim; k++)
+  {
+    fprintf(fp," %12.8lf + %12.8lf I",c[2*k],c[2*k+1]);
+  }
+  fprintf(fp,"\n");
+}
+
+static void print_bright(FILE *fp, t_qtrframe *fr)
+{
+  int i;
+
+  for(i=0; i<fr->nstate; i++)
+  {
+    if (i < fr->npol)
+    {
+      fprintf(fp,"step %4d polariton %4d gap %12.8lf photon %8.5lf pop %12.8lf\n",
+              fr->step,i,fr->gap[i],fr->photon[i],fr->pop[i]);
+    }
+    else
+    {
+      fprintf(fp,"step %4d dark %4d states %6d gap %12.8lf pop %12.8lf\n",
+              fr->step,i-fr->npol,fr->ndeg[i],fr->gap[i],fr->pop[i]);
+    }
+  }
+}
+
+int gmx_qedtraj(int argc,char *argv[])
+{
+  const char *desc[] = {
+    "[TT]g_qedtraj[tt] converts the polariton trajectory that a QED/MM",
+    "run writes with [TT]$QED_TRAJ[tt] back to the text files it writes",
+    "without: the eigenvectors or coefficients of every frame to",
+    "[TT]-o[tt] (eigenvectors.dat), the diabatic coefficients of the",
+    "hybrid runs to [TT]-oc[tt] (coefficients.dat) and the energies and",
+    "transition dipoles of the molecules to [TT]-oe[tt], one file per",
+    "molecule with its number before the extension (energies0.dat, ...).",
+    "Frames without eigenvectors, see evstride in [TT]$QED_TRAJ[tt],",
+    "give the eigenvector lines without the components.[PAR]",
+    "The values have the accuracy of the trajectory, the prec of",
+    "[TT]$QED_TRAJ[tt], in the same format as the run would have printed."
+  };
+  t_filenm fnm[] = {
+    { efQTR, "-f",  "polariton",    ffREAD  },
+    { efDAT, "-o",  "eigenvectors", ffWRITE },
+    { efDAT, "-oc", "coefficients", ffOPTWR },
+    { efDAT, "-oe", "energies",     ffOPTWR }
+  };
+#define NFILE asize(fnm)
+  FILE         *in,*out,*cout=NULL,**eout=NULL;
+  t_qtrframe   *fr;
+  const char   *fn;
+  char         base[STRLEN],buf[STRLEN],*p;
+  int          i,nframe=0,neigvec=0,nmol=0;
+  output_env_t oenv;
+
+  CopyRight(stderr,argv[0]);
+  parse_common_args(&argc,argv,PCA_BE_NICE,
+                    NFILE,fnm,0,NULL,asize(desc),desc,0,NULL,&oenv);
+
+  in  = ffopen(opt2fn("-f",NFILE,fnm),"r");
+  out = ffopen(opt2fn("-o",NFILE,fnm),"w");
+  if (opt2bSet("-oc",NFILE,fnm))
+    cout = ffopen(opt2fn("-oc",NFILE,fnm),"w");
+  fn = opt2bSet("-oe",NFILE,fnm) ? opt2fn("-oe",NFILE,fnm) : NULL;
+
+  snew(fr,1);
+  while (read_next_qtr_frame(in,fr))
+  {
+    switch (fr->layout)
+    {
+    case eqtrEIGEN:
+      print_eigen(out,fr);
+      break;
+    case eqtrHYBRID:
+      print_eigen(out,fr);
+      if (cout)
+        print_coeff(cout,fr,fr->d);
+      break;
+    case eqtrCOEFF:
+      print_coeff(out,fr,fr->c);
+      break;
+    case eqtrBRIGHT:
+      print_bright(out,fr);
+      break;
+    default:
+      gmx_fatal(FARGS,"Unknown layout %d of the frame of step %d",
+                fr->layout,fr->step);
+    }
+    if (fn && (fr->flags & QTR_MOL))
+    {
+      if (eout == NULL)
+      {
+        nmol = fr->nmol;
+        snew(eout,nmol);
+        strncpy(base,fn,STRLEN-1);
+        base[STRLEN-1] = '\0';
+        if ((p = strrchr(base,'.')) != NULL)
+          *p = '\0';
+        for(i=0; i<nmol; i++)
+        {
+          if (snprintf(buf,STRLEN,"%s%d.dat",base,i) >= STRLEN)
+            gmx_fatal(FARGS,"File name too long: %s%d.dat",base,i);
+          eout[i] = ffopen(buf,"w");
+        }
+      }
+      for(i=0; i<min(nmol,fr->nmol); i++)
+      {
+        fprintf(eout[i],"step %d E(S0): %12.8lf E(S1) %12.8lf TDM: %12.8lf %12.8lf %12.8lf\n",
+                fr->step,fr->E0[i],fr->E1[i],
+                fr->tdm[3*i],fr->tdm[3*i+1],fr->tdm[3*i+2]);
+      }
+    }
+    if (fr->flags & QTR_EIGVEC)
+      neigvec++;
+    nframe++;
+  }
+  fprintf(stderr,"Converted %d frames, %d with eigenvectors",nframe,neigvec);
+  if (nmol > 0)
+    fprintf(stderr,", %d molecules",nmol);
+  fprintf(stderr,"\n");
+
+  ffclose(in);
+  ffclose(out);
+  if (cout)
+    ffclose(cout);
+  for(i=0; i<nmol; i++)
+    ffclose(eout[i]);
+  sfree(eout);
+  done_qtrframe(fr);
+  sfree(fr);
+
+  thanx(stderr);
+
+  return 0;
+}